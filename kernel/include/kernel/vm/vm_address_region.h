@@ -233,6 +233,20 @@ public:
     // Protect() will fail.
     virtual status_t Protect(vaddr_t base, size_t size, uint new_arch_mmu_flags);
 
+    enum class RangeOpType {
+        Commit,
+        Decommit,
+        HintNormal,
+        HintSequential,
+        HintRandom,
+    };
+
+    // Apply |op| to the memory of the mappings covering a subset of the
+    // region.  As with Protect(), the range must be fully mapped and may not
+    // overlap a subregion.  Hints apply to every mapping the range touches,
+    // as a whole.
+    virtual status_t RangeOp(RangeOpType op, vaddr_t base, size_t size);
+
     bool is_mapping() const override { return false; }
 
     void Dump(uint depth, bool verbose) const override;
@@ -358,6 +372,10 @@ public:
         return ERR_BAD_STATE;
     }
 
+    status_t RangeOp(RangeOpType op, vaddr_t base, size_t size) override {
+        return ERR_BAD_STATE;
+    }
+
     void Dump(uint depth, bool verbose) const override {
         return;
     }
@@ -458,6 +476,24 @@ private:
     // Implementation for Protect().  This does not acquire the aspace lock.
     status_t ProtectLocked(vaddr_t base, size_t size, uint new_arch_mmu_flags);
 
+    // Implementation for MapRange().  This does not acquire the aspace lock.
+    status_t MapRangeLocked(size_t offset, size_t len, bool commit);
+
+    // Implementation for VmAddressRegion::RangeOp(), on the part of this
+    // mapping in [base, base + size).  This does not acquire the aspace lock.
+    status_t RangeOpLocked(VmAddressRegion::RangeOpType op, vaddr_t base, size_t size);
+
+    // Whether the pages of the object are this address space's alone: no
+    // handle to the object is left, and it is mapped nowhere else.  Only
+    // then can they be discarded without losing anyone else's data.  Takes
+    // the object lock.
+    bool IsPrivateLocked() const;
+
+    // Maps in the pages the object already has after |va|, up to
+    // fault_around_ of them, so that a sequential walk does not fault on
+    // each one.  The aspace lock must be held too.
+    void FaultAroundLocked(vaddr_t va) TA_REQ(object_->lock());
+
     // Version of AllocatedPages() that does not acquire the aspace lock
     size_t AllocatedPagesLocked() const override;
 
@@ -477,4 +513,8 @@ private:
 
     // used to detect recursions through the vmo fault path
     bool currently_faulting_ = false;
+
+    // pages past a fault to map in along with it; set by access hints
+    static const uint kSequentialFaultAround = 16;
+    uint fault_around_ = 0;
 };
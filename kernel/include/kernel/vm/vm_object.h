@@ -14,6 +14,7 @@
 #include <list.h>
 #include <magenta/thread_annotations.h>
 #include <mxtl/array.h>
+#include <mxtl/atomic.h>
 #include <mxtl/intrusive_double_list.h>
 #include <mxtl/macros.h>
 #include <mxtl/ref_counted.h>
@@ -107,6 +108,15 @@ public:
         return ERR_NOT_SUPPORTED;
     }
 
+    // Track the dispatchers that can still hand the object out through a
+    // handle.  Once there are none, it is only reachable through the
+    // mappings of it (as anonymous memory is).
+    void AddHandleOwner() { handle_owners_.fetch_add(1, mxtl::memory_order_relaxed); }
+    void RemoveHandleOwner() { handle_owners_.fetch_sub(1, mxtl::memory_order_release); }
+    bool has_handle_owners() const {
+        return handle_owners_.load(mxtl::memory_order_acquire) != 0;
+    }
+
 protected:
     // private constructor (use Create())
     VmObject();
@@ -138,6 +148,8 @@ protected:
     // members
     mutable Mutex lock_;
     mxtl::DoublyLinkedList<VmMapping*> mapping_list_ TA_GUARDED(lock_);
+
+    mxtl::atomic<uint32_t> handle_owners_;
 };
 
 // the main VM object type, holding a list of pages
@@ -216,6 +228,11 @@ private:
 
     // a tree of pages
     VmPageList page_list_ TA_GUARDED(lock_);
+
+    // set once pages have been committed contiguously; drivers hand the
+    // physical addresses of such objects to devices, so their pages are
+    // never decommitted or resized away while the object lives
+    bool contiguous_ TA_GUARDED(lock_) = false;
 };
 
 // VMO representing a physical range of memory
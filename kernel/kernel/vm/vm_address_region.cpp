@@ -691,6 +691,74 @@ status_t VmAddressRegion::Protect(vaddr_t base, size_t size, uint new_arch_mmu_f
     return NO_ERROR;
 }
 
+status_t VmAddressRegion::RangeOp(RangeOpType op, vaddr_t base, size_t size) {
+    DEBUG_ASSERT(magic_ == kMagic);
+
+    if (size == 0 || !IS_PAGE_ALIGNED(base)) {
+        return ERR_INVALID_ARGS;
+    }
+
+    size = ROUNDUP(size, PAGE_SIZE);
+
+    AutoLock guard(aspace_->lock());
+    if (state_ != LifeCycleState::ALIVE) {
+        return ERR_BAD_STATE;
+    }
+
+    if (!is_in_range(base, size)) {
+        return ERR_INVALID_ARGS;
+    }
+
+    if (subregions_.is_empty()) {
+        return ERR_NOT_FOUND;
+    }
+
+    const vaddr_t end_addr = base + size;
+    const auto end = subregions_.lower_bound(end_addr);
+
+    auto begin = --subregions_.upper_bound(base);
+    if (!begin.IsValid() || begin->base() + begin->size() <= base) {
+        return ERR_NOT_FOUND;
+    }
+
+    // Validate the whole range before touching any of it, as Protect() does.
+    vaddr_t last_mapped = begin->base();
+    for (auto itr = begin; itr != end; ++itr) {
+        if (!itr->is_mapping()) {
+            return ERR_INVALID_ARGS;
+        }
+        if (itr->base() != last_mapped) {
+            return ERR_NOT_FOUND;
+        }
+        if (op == RangeOpType::Decommit &&
+            !(itr->as_vm_mapping()->arch_mmu_flags() & ARCH_MMU_FLAG_PERM_WRITE)) {
+            return ERR_ACCESS_DENIED;
+        }
+        // Dropping pages others can see would lose their data.
+        if (op == RangeOpType::Decommit && !itr->as_vm_mapping()->IsPrivateLocked()) {
+            return ERR_BAD_STATE;
+        }
+
+        last_mapped = itr->base() + itr->size();
+    }
+    if (last_mapped < base + size) {
+        return ERR_NOT_FOUND;
+    }
+
+    // None of the ops split mappings, so the tree is stable across the walk.
+    for (auto itr = begin; itr != end; ++itr) {
+        const vaddr_t op_base = mxtl::max(itr->base(), base);
+        const vaddr_t op_end = mxtl::min(itr->base() + itr->size(), end_addr);
+
+        status_t status = itr->as_vm_mapping()->RangeOpLocked(op, op_base, op_end - op_base);
+        if (status != NO_ERROR) {
+            return status;
+        }
+    }
+
+    return NO_ERROR;
+}
+
 vaddr_t VmAddressRegion::LinearRegionAllocatorLocked(size_t size, uint8_t align_pow2,
                                                      uint arch_mmu_flags) {
     DEBUG_ASSERT(is_mutex_held(aspace_->lock()));
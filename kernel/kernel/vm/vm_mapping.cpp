@@ -134,6 +134,7 @@ status_t VmMapping::ProtectLocked(vaddr_t base, size_t size, uint new_arch_mmu_f
         if (!ac.check()) {
             return ERR_NO_MEMORY;
         }
+        mapping->fault_around_ = fault_around_;
 
         status_t status = arch_mmu_protect(&aspace_->arch_aspace(), base, size / PAGE_SIZE,
                                            new_arch_mmu_flags);
@@ -157,6 +158,7 @@ status_t VmMapping::ProtectLocked(vaddr_t base, size_t size, uint new_arch_mmu_f
         if (!ac.check()) {
             return ERR_NO_MEMORY;
         }
+        mapping->fault_around_ = fault_around_;
 
         status_t status = arch_mmu_protect(&aspace_->arch_aspace(), base, size / PAGE_SIZE,
                                            new_arch_mmu_flags);
@@ -186,6 +188,8 @@ status_t VmMapping::ProtectLocked(vaddr_t base, size_t size, uint new_arch_mmu_f
     if (!ac.check()) {
         return ERR_NO_MEMORY;
     }
+    center_mapping->fault_around_ = fault_around_;
+    right_mapping->fault_around_ = fault_around_;
 
     status_t status = arch_mmu_protect(&aspace_->arch_aspace(), base, size / PAGE_SIZE,
                                        new_arch_mmu_flags);
@@ -286,6 +290,7 @@ status_t VmMapping::UnmapLocked(vaddr_t base, size_t size) {
     if (!ac.check()) {
         return ERR_NO_MEMORY;
     }
+    mapping->fault_around_ = fault_around_;
 
     // Unmap the middle segment
     LTRACEF("unmapping base %#lx size %#zx\n", base, size);
@@ -375,6 +380,13 @@ status_t VmMapping::MapRange(size_t offset, size_t len, bool commit) {
         return ERR_BAD_STATE;
     }
 
+    return MapRangeLocked(offset, len, commit);
+}
+
+status_t VmMapping::MapRangeLocked(size_t offset, size_t len, bool commit) {
+    DEBUG_ASSERT(magic_ == kMagic);
+    DEBUG_ASSERT(is_mutex_held(aspace_->lock()));
+
     LTRACEF("region %p '%s', offset %#zx, size %#zx, commit %d\n", this, name_, offset, len, commit);
 
     DEBUG_ASSERT(object_);
@@ -596,6 +608,10 @@ status_t VmMapping::PageFault(vaddr_t va, const uint pf_flags) {
             return ERR_NO_MEMORY;
         }
         DEBUG_ASSERT(mapped == 1);
+
+        if (fault_around_) {
+            FaultAroundLocked(va);
+        }
     }
 
 // TODO: figure out what to do with this
@@ -606,6 +622,101 @@ status_t VmMapping::PageFault(vaddr_t va, const uint pf_flags) {
     return NO_ERROR;
 }
 
+void VmMapping::FaultAroundLocked(vaddr_t va) {
+    DEBUG_ASSERT(is_mutex_held(aspace_->lock()));
+    DEBUG_ASSERT(object_->lock()->IsHeld());
+
+    const vaddr_t end = base_ + size_;
+    for (uint i = 0; i < fault_around_; i++) {
+        va += PAGE_SIZE;
+        if (va >= end) {
+            break;
+        }
+
+        // Only take pages the object already has: the point is to save
+        // faults on data that is there, not to commit memory on a guess.
+        paddr_t pa;
+        status_t status = object_->GetPageLocked(va - base_ + object_offset_, 0, nullptr, &pa);
+        if (status == ERR_OUT_OF_RANGE) {
+            // past the end of the object; nothing further along is there
+            break;
+        }
+        if (status < 0) {
+            continue;
+        }
+
+        uint page_flags;
+        paddr_t mapped_pa;
+        if (arch_mmu_query(&aspace_->arch_aspace(), va, &mapped_pa, &page_flags) >= 0) {
+            continue;
+        }
+
+        size_t mapped;
+        if (arch_mmu_map(&aspace_->arch_aspace(), va, pa, 1, arch_mmu_flags_, &mapped) < 0) {
+            break;
+        }
+        DEBUG_ASSERT(mapped == 1);
+#if ARCH_ARM64
+        if (arch_mmu_flags_ & ARCH_MMU_FLAG_PERM_EXECUTE)
+            arch_sync_cache_range(va, PAGE_SIZE);
+#endif
+    }
+}
+
+status_t VmMapping::RangeOpLocked(VmAddressRegion::RangeOpType op, vaddr_t base, size_t size) {
+    DEBUG_ASSERT(magic_ == kMagic);
+    DEBUG_ASSERT(is_mutex_held(aspace_->lock()));
+    DEBUG_ASSERT(size != 0 && IS_PAGE_ALIGNED(base) && IS_PAGE_ALIGNED(size));
+    DEBUG_ASSERT(base >= base_ && base - base_ < size_);
+    DEBUG_ASSERT(size_ - (base - base_) >= size);
+
+    LTRACEF("%p '%s' op %d base %#" PRIxPTR " size %#zx\n", this, name_,
+            static_cast<int>(op), base, size);
+
+    if (state_ != LifeCycleState::ALIVE) {
+        return ERR_BAD_STATE;
+    }
+
+    const size_t offset = base - base_;
+    switch (op) {
+    case VmAddressRegion::RangeOpType::Commit:
+        return MapRangeLocked(offset, size, true);
+    case VmAddressRegion::RangeOpType::Decommit:
+        if (!(arch_mmu_flags_ & ARCH_MMU_FLAG_PERM_WRITE)) {
+            return ERR_ACCESS_DENIED;
+        }
+        if (!IsPrivateLocked()) {
+            return ERR_BAD_STATE;
+        }
+        // the object unmaps the freed pages from all of its mappings
+        return object_->DecommitRange(object_offset_ + offset, size, nullptr);
+    case VmAddressRegion::RangeOpType::HintNormal:
+    case VmAddressRegion::RangeOpType::HintRandom:
+        fault_around_ = 0;
+        return NO_ERROR;
+    case VmAddressRegion::RangeOpType::HintSequential:
+        fault_around_ = kSequentialFaultAround;
+        return NO_ERROR;
+    }
+    return ERR_INVALID_ARGS;
+}
+
+bool VmMapping::IsPrivateLocked() const {
+    DEBUG_ASSERT(is_mutex_held(aspace_->lock()));
+
+    if (object_->has_handle_owners()) {
+        return false;
+    }
+
+    AutoLock guard(object_->lock());
+    for (const auto& m : object_->mapping_list_) {
+        if (m.aspace_.get() != aspace_.get()) {
+            return false;
+        }
+    }
+    return true;
+}
+
 // We disable thread safety analysis here because one of the common uses of this
 // function is for splitting one mapping object into several that will be backed
 // by the same VmObject.  In that case, object_->lock() gets aliased across all
@@ -22,7 +22,7 @@
 
 #define LOCAL_TRACE MAX(VM_GLOBAL_TRACE, 0)
 
-VmObject::VmObject() {
+VmObject::VmObject() : handle_owners_(0) {
     LTRACEF("%p\n", this);
 }
 
@@ -392,6 +392,8 @@ status_t VmObjectPaged::CommitRangeContiguous(uint64_t offset, uint64_t len, uin
     // for now we only support committing as much as we were asked for
     DEBUG_ASSERT(!committed || *committed == count * PAGE_SIZE);
 
+    contiguous_ = true;
+
     return NO_ERROR;
 }
 
@@ -404,6 +406,9 @@ status_t VmObjectPaged::DecommitRange(uint64_t offset, uint64_t len, uint64_t* d
 
     AutoLock a(&lock_);
 
+    if (contiguous_)
+        return ERR_NOT_SUPPORTED;
+
     // trim the size
     uint64_t new_len;
     if (!TrimRange(offset, len, size_, &new_len))
@@ -453,6 +458,9 @@ status_t VmObjectPaged::Resize(uint64_t s) {
 
     // see if we're shrinking the vmo
     if (s < size_) {
+        if (contiguous_)
+            return ERR_NOT_SUPPORTED;
+
         // figure the starting and ending page offset that is affected
         uint64_t start = ROUNDUP_PAGE_SIZE(s);
         uint64_t end = ROUNDUP_PAGE_SIZE(size_);
@@ -44,6 +44,15 @@ public:
     mx_status_t Read(void* dest, size_t len, bool from_user,
                      size_t* nread);
 
+    // The size of the buffer holding data written to the peer and not yet
+    // read from this end.  It can only be changed while empty.
+    size_t GetBufferSize();
+    mx_status_t SetBufferSize(size_t size);
+    // The same for the peer's buffer, which is the one writes to this end
+    // fill up.
+    mx_status_t GetPeerBufferSize(size_t* size);
+    mx_status_t SetPeerBufferSize(size_t size);
+
     void OnPeerZeroHandles();
 
 private:
@@ -54,6 +63,7 @@ private:
         size_t Write(const void* src, size_t len, bool from_user);
         size_t Read(void* dest, size_t len, bool from_user);
         size_t CouldRead() const;
+        size_t size() const;
         size_t free() const;
         bool empty() const;
 
@@ -39,6 +39,8 @@ public:
 
     mx_status_t Unmap(vaddr_t base, size_t len);
 
+    mx_status_t RangeOp(uint32_t op, vaddr_t base, size_t len);
+
     mxtl::RefPtr<VmAddressRegion> vmar() const { return vmar_; }
 
     // Check if the given flags define an allowed combination of RWX
@@ -26,6 +26,7 @@ public:
     mx_obj_type_t get_type() const final { return MX_OBJ_TYPE_VMEM; }
     StateTracker* get_state_tracker() final { return &state_tracker_; }
     CookieJar* get_cookie_jar() final { return &cookie_jar_; }
+    void on_zero_handles() final;
 
     mx_status_t Read(user_ptr<void> user_data, size_t length,
                      uint64_t offset, size_t* actual);
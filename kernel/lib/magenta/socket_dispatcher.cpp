@@ -28,7 +28,14 @@
 constexpr mx_rights_t kDefaultSocketRights =
     MX_RIGHT_TRANSFER | MX_RIGHT_DUPLICATE | MX_RIGHT_READ | MX_RIGHT_WRITE;
 
+// Only sockets created MX_SOCKET_CREATE_RESIZABLE, like mxio's pipes, may
+// have their buffers looked at and resized.
+constexpr mx_rights_t kResizableSocketRights =
+    kDefaultSocketRights | MX_RIGHT_GET_PROPERTY | MX_RIGHT_SET_PROPERTY;
+
 constexpr size_t kDeFaultSocketBufferSize = 256 * 1024u;
+constexpr size_t kMinSocketBufferSize = PAGE_SIZE;
+constexpr size_t kMaxSocketBufferSize = 16 * 1024 * 1024u;
 
 constexpr mx_signals_t kValidSignalMask =
     MX_SOCKET_READABLE | MX_SOCKET_PEER_CLOSED | MX_USER_SIGNAL_ALL;
@@ -44,27 +51,38 @@ SocketDispatcher::CBuf::~CBuf() {
     VmAspace::kernel_aspace()->FreeRegion(reinterpret_cast<vaddr_t>(buf_));
 }
 
+// Also used to swap an empty buffer for one of another size; the old one
+// is kept if the new one cannot be had.
 bool SocketDispatcher::CBuf::Init(uint32_t len) {
-    vmo_ = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, len);
-    if (!vmo_)
+    auto vmo = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, len);
+    if (!vmo)
         return false;
 
     void* start = nullptr;
     auto st = VmAspace::kernel_aspace()->MapObject(
-        vmo_, "socket", 0u, len, &start, PAGE_SIZE_SHIFT, 0,
+        vmo, "socket", 0u, len, &start, PAGE_SIZE_SHIFT, 0,
         0, ARCH_MMU_FLAG_PERM_READ | ARCH_MMU_FLAG_PERM_WRITE);
 
     if (st < 0)
         return false;
 
-    buf_ = reinterpret_cast<char*>(start);
-
-    if (!buf_)
+    if (!start)
         return false;
+
+    if (buf_)
+        VmAspace::kernel_aspace()->FreeRegion(reinterpret_cast<vaddr_t>(buf_));
+    buf_ = reinterpret_cast<char*>(start);
+    vmo_ = mxtl::move(vmo);
     len_pow2_ = log2_uint_floor(len);
+    head_ = 0u;
+    tail_ = 0u;
     return true;
 }
 
+size_t SocketDispatcher::CBuf::size() const {
+    return valpow2(len_pow2_);
+}
+
 size_t SocketDispatcher::CBuf::free() const {
     uint consumed = modpow2((uint)(head_ - tail_), len_pow2_);
     return valpow2(len_pow2_) - consumed - 1;
@@ -177,7 +195,8 @@ status_t SocketDispatcher::Create(uint32_t flags,
     if ((status = socket1->Init(socket0)) != NO_ERROR)
         return status;
 
-    *rights = kDefaultSocketRights;
+    *rights = (flags & MX_SOCKET_CREATE_RESIZABLE) ? kResizableSocketRights
+                                                   : kDefaultSocketRights;
     *dispatcher0 = mxtl::RefPtr<Dispatcher>(socket0.get());
     *dispatcher1 = mxtl::RefPtr<Dispatcher>(socket1.get());
     return NO_ERROR;
@@ -381,3 +400,56 @@ mx_status_t SocketDispatcher::Read(void* dest, size_t len,
     *nread = static_cast<size_t>(st);
     return NO_ERROR;
 }
+
+size_t SocketDispatcher::GetBufferSize() {
+    canary_.Assert();
+
+    AutoLock lock(&lock_);
+    return cbuf_.size();
+}
+
+mx_status_t SocketDispatcher::SetBufferSize(size_t size) {
+    canary_.Assert();
+
+    if (size < kMinSocketBufferSize || size > kMaxSocketBufferSize)
+        return ERR_OUT_OF_RANGE;
+    uint32_t len = round_up_pow2_u32(static_cast<uint32_t>(size));
+
+    AutoLock lock(&lock_);
+    if (len == cbuf_.size())
+        return NO_ERROR;
+    // Data in the buffer would have to be moved, and a smaller buffer
+    // might not hold it.
+    if (!cbuf_.empty())
+        return ERR_BAD_STATE;
+    return cbuf_.Init(len) ? NO_ERROR : ERR_NO_MEMORY;
+}
+
+mx_status_t SocketDispatcher::GetPeerBufferSize(size_t* size) {
+    canary_.Assert();
+
+    mxtl::RefPtr<SocketDispatcher> other;
+    {
+        AutoLock lock(&lock_);
+        if (!other_)
+            return ERR_PEER_CLOSED;
+        other = other_;
+    }
+
+    *size = other->GetBufferSize();
+    return NO_ERROR;
+}
+
+mx_status_t SocketDispatcher::SetPeerBufferSize(size_t size) {
+    canary_.Assert();
+
+    mxtl::RefPtr<SocketDispatcher> other;
+    {
+        AutoLock lock(&lock_);
+        if (!other_)
+            return ERR_PEER_CLOSED;
+        other = other_;
+    }
+
+    return other->SetBufferSize(size);
+}
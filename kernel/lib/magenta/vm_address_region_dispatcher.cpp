@@ -221,6 +221,37 @@ mx_status_t VmAddressRegionDispatcher::Unmap(vaddr_t base, size_t len) {
     return vmar_->Unmap(base, len);
 }
 
+mx_status_t VmAddressRegionDispatcher::RangeOp(uint32_t op, vaddr_t base, size_t len) {
+    canary_.Assert();
+
+    if (!IS_PAGE_ALIGNED(base)) {
+        return ERR_INVALID_ARGS;
+    }
+
+    VmAddressRegion::RangeOpType type;
+    switch (op) {
+    case MX_VMAR_OP_COMMIT:
+        type = VmAddressRegion::RangeOpType::Commit;
+        break;
+    case MX_VMAR_OP_DECOMMIT:
+        type = VmAddressRegion::RangeOpType::Decommit;
+        break;
+    case MX_VMAR_OP_HINT_NORMAL:
+        type = VmAddressRegion::RangeOpType::HintNormal;
+        break;
+    case MX_VMAR_OP_HINT_SEQUENTIAL:
+        type = VmAddressRegion::RangeOpType::HintSequential;
+        break;
+    case MX_VMAR_OP_HINT_RANDOM:
+        type = VmAddressRegion::RangeOpType::HintRandom;
+        break;
+    default:
+        return ERR_INVALID_ARGS;
+    }
+
+    return vmar_->RangeOp(type, base, len);
+}
+
 bool VmAddressRegionDispatcher::is_valid_mapping_protection(uint32_t flags) {
     switch (flags & (MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE)) {
         case 0: // no way to express no permissions
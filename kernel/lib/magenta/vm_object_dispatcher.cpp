@@ -34,10 +34,18 @@ status_t VmObjectDispatcher::Create(mxtl::RefPtr<VmObject> vmo,
 }
 
 VmObjectDispatcher::VmObjectDispatcher(mxtl::RefPtr<VmObject> vmo)
-    : vmo_(vmo), state_tracker_(0u) {}
+    : vmo_(vmo), state_tracker_(0u) {
+    vmo_->AddHandleOwner();
+}
 
 VmObjectDispatcher::~VmObjectDispatcher() {}
 
+void VmObjectDispatcher::on_zero_handles() {
+    canary_.Assert();
+
+    vmo_->RemoveHandleOwner();
+}
+
 mx_status_t VmObjectDispatcher::Read(user_ptr<void> user_data,
                                      size_t length,
                                      uint64_t offset,
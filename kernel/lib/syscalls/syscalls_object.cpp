@@ -13,6 +13,7 @@
 #include <magenta/magenta.h>
 #include <magenta/process_dispatcher.h>
 #include <magenta/resource_dispatcher.h>
+#include <magenta/socket_dispatcher.h>
 #include <magenta/thread_dispatcher.h>
 #include <magenta/vm_address_region_dispatcher.h>
 
@@ -443,6 +444,25 @@ mx_status_t sys_object_get_property(mx_handle_t handle_value, uint32_t property,
                 return ERR_INVALID_ARGS;
             return NO_ERROR;
         }
+        case MX_PROP_SOCKET_BUFFER_SIZE:
+        case MX_PROP_SOCKET_PEER_BUFFER_SIZE: {
+            if (size < sizeof(size_t))
+                return ERR_BUFFER_TOO_SMALL;
+            auto socket = DownCastDispatcher<SocketDispatcher>(&dispatcher);
+            if (!socket)
+                return ERR_WRONG_TYPE;
+            size_t value;
+            if (property == MX_PROP_SOCKET_BUFFER_SIZE) {
+                value = socket->GetBufferSize();
+            } else {
+                mx_status_t status = socket->GetPeerBufferSize(&value);
+                if (status != NO_ERROR)
+                    return status;
+            }
+            if (_value.reinterpret<size_t>().copy_to_user(value) != NO_ERROR)
+                return ERR_INVALID_ARGS;
+            return NO_ERROR;
+        }
         default:
             return ERR_INVALID_ARGS;
     }
@@ -518,6 +538,20 @@ mx_status_t sys_object_set_property(mx_handle_t handle_value, uint32_t property,
                 return ERR_INVALID_ARGS;
             return process->set_debug_addr(value);
         }
+        case MX_PROP_SOCKET_BUFFER_SIZE:
+        case MX_PROP_SOCKET_PEER_BUFFER_SIZE: {
+            if (size < sizeof(size_t))
+                return ERR_BUFFER_TOO_SMALL;
+            auto socket = DownCastDispatcher<SocketDispatcher>(&dispatcher);
+            if (!socket)
+                return up->BadHandle(handle_value, ERR_WRONG_TYPE);
+            size_t value = 0;
+            if (_value.reinterpret<const size_t>().copy_from_user(&value) != NO_ERROR)
+                return ERR_INVALID_ARGS;
+            if (property == MX_PROP_SOCKET_BUFFER_SIZE)
+                return socket->SetBufferSize(value);
+            return socket->SetPeerBufferSize(value);
+        }
     }
 
     return ERR_INVALID_ARGS;
@@ -198,3 +198,18 @@ mx_status_t sys_vmar_protect(mx_handle_t vmar_handle, uintptr_t addr, size_t len
 
     return vmar->Protect(addr, len, prot);
 }
+
+mx_status_t sys_vmar_op_range(mx_handle_t vmar_handle, uint32_t op, uintptr_t addr, size_t len) {
+    auto up = ProcessDispatcher::GetCurrent();
+
+    // throwing away the contents of memory is a write
+    mx_rights_t vmar_rights = (op == MX_VMAR_OP_DECOMMIT) ? MX_RIGHT_WRITE : 0u;
+
+    // lookup the dispatcher from handle
+    mxtl::RefPtr<VmAddressRegionDispatcher> vmar;
+    mx_status_t status = up->GetDispatcherWithRights(vmar_handle, vmar_rights, &vmar);
+    if (status != NO_ERROR)
+        return status;
+
+    return vmar->RangeOp(op, addr, len);
+}
@@ -109,7 +109,7 @@ static mx_status_t dispatch(mx_handle_t h, void* _ctx, void* cookie) {
     uint32_t num_bytes = 0;
     uint32_t num_handles = 0;
     mx_status_t status = mx_channel_read(h, 0, NULL, 0, &num_bytes, NULL, 0, &num_handles);
-    if (status == ERR_BAD_STATE) {
+    if (status == ERR_SHOULD_WAIT) {
         return ERR_DISPATCHER_NO_WORK;
     } else if (status != ERR_BUFFER_TOO_SMALL ||
                num_handles > 1 ||
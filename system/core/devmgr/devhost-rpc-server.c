@@ -107,15 +107,9 @@ static void sync_io_complete(iotxn_t* txn, void* cookie) {
     completion_signal((completion_t*)cookie);
 }
 
-static ssize_t do_sync_io(mx_device_t* dev, uint32_t opcode, void* buf, size_t count, mx_off_t off) {
-    iotxn_t* txn;
-    mx_status_t status = iotxn_alloc(&txn, IOTXN_ALLOC_CONTIGUOUS | IOTXN_ALLOC_POOL, MXIO_CHUNK_SIZE);
-    if (status != NO_ERROR) {
-        return status;
-    }
-
-    assert(count <= MXIO_CHUNK_SIZE);
-
+// queues 'txn' and waits for it, returning the bytes transferred or an error
+static ssize_t do_sync_txn(mx_device_t* dev, iotxn_t* txn, uint32_t opcode,
+                           size_t count, mx_off_t off) {
     completion_t completion = COMPLETION_INIT;
 
     txn->opcode = opcode;
@@ -124,30 +118,104 @@ static ssize_t do_sync_io(mx_device_t* dev, uint32_t opcode, void* buf, size_t c
     txn->complete_cb = sync_io_complete;
     txn->cookie = &completion;
 
-    // if write, write the data to the iotxn
-    if (opcode == IOTXN_OP_WRITE) {
-        iotxn_copyto(txn, buf, txn->length, 0);
-    }
-
     dev->ops->iotxn_queue(dev, txn);
     completion_wait(&completion, MX_TIME_INFINITE);
 
     if (txn->status != NO_ERROR) {
-        size_t txn_status = txn->status;
-        iotxn_release(txn);
-        return txn_status;
+        return txn->status;
+    }
+    return txn->actual;
+}
+
+static ssize_t do_sync_io(mx_device_t* dev, uint32_t opcode, void* buf, size_t count, mx_off_t off) {
+    iotxn_t* txn;
+    mx_status_t status = iotxn_alloc(&txn, IOTXN_ALLOC_CONTIGUOUS | IOTXN_ALLOC_POOL, MXIO_CHUNK_SIZE);
+    if (status != NO_ERROR) {
+        return status;
+    }
+
+    assert(count <= MXIO_CHUNK_SIZE);
+
+    // if write, write the data to the iotxn
+    if (opcode == IOTXN_OP_WRITE) {
+        iotxn_copyto(txn, buf, count, 0);
     }
 
+    ssize_t actual = do_sync_txn(dev, txn, opcode, count, off);
+
     // if read, get the data
-    if (opcode == IOTXN_OP_READ) {
-        iotxn_copyfrom(txn, buf, txn->actual, 0);
+    if ((opcode == IOTXN_OP_READ) && (actual > 0)) {
+        iotxn_copyfrom(txn, buf, actual, 0);
     }
 
-    ssize_t actual = txn->actual;
     iotxn_release(txn);
     return actual;
 }
 
+// largest iotxn the pool keeps; vmo io is done through one at a time
+#define VMO_IO_CHUNK_SIZE (1024 * 1024)
+
+// reads or writes through the caller's vmo, copying in large chunks to and
+// from a pooled iotxn which the devhost owns.  The caller's pages are not
+// handed to the driver: nothing pins them, so the caller could decommit
+// or resize the vmo while the device is still transferring into it.
+static ssize_t do_vmo_io(mx_device_t* dev, uint32_t opcode, mx_handle_t vmo, size_t count, mx_off_t off) {
+    uint64_t size;
+    mx_status_t status;
+    if ((status = mx_vmo_get_size(vmo, &size)) != NO_ERROR) {
+        return status;
+    }
+    if (size < count) {
+        return ERR_INVALID_ARGS;
+    }
+    if (count == 0) {
+        return 0;
+    }
+
+    iotxn_t* txn;
+    size_t chunk = (count < VMO_IO_CHUNK_SIZE) ? count : VMO_IO_CHUNK_SIZE;
+    if ((status = iotxn_alloc(&txn, IOTXN_ALLOC_POOL, chunk)) != NO_ERROR) {
+        return status;
+    }
+    void* buf;
+    if ((status = iotxn_mmap(txn, &buf)) != NO_ERROR) {
+        iotxn_release(txn);
+        return status;
+    }
+
+    size_t done = 0;
+    ssize_t r = 0;
+    while (done < count) {
+        size_t xfer = ((count - done) < chunk) ? (count - done) : chunk;
+        size_t copied;
+        if (opcode == IOTXN_OP_WRITE) {
+            status = mx_vmo_read(vmo, buf, done, xfer, &copied);
+            if ((status != NO_ERROR) || (copied != xfer)) {
+                // the caller shrank or decommitted its vmo under us
+                r = (status != NO_ERROR) ? status : ERR_IO;
+                break;
+            }
+        }
+        if ((r = do_sync_txn(dev, txn, opcode, xfer, off + done)) <= 0) {
+            break;
+        }
+        if (opcode == IOTXN_OP_READ) {
+            status = mx_vmo_write(vmo, buf, done, r, &copied);
+            if ((status != NO_ERROR) || (copied != (size_t)r)) {
+                r = (status != NO_ERROR) ? status : ERR_IO;
+                break;
+            }
+        }
+        done += r;
+        if ((size_t)r < xfer) {
+            break;
+        }
+    }
+    iotxn_release(txn);
+    // a partial transfer is reported as such, an error only if nothing moved
+    return ((r < 0) && (done == 0)) ? r : (ssize_t)done;
+}
+
 static ssize_t do_ioctl(mx_device_t* dev, uint32_t op, const void* in_buf, size_t in_len, void* out_buf, size_t out_len) {
     mx_status_t r;
     switch (op) {
@@ -204,6 +272,20 @@ static ssize_t do_ioctl(mx_device_t* dev, uint32_t op, const void* in_buf, size_
         r = dev->ops->resume(dev);
         break;
     }
+    case IOCTL_DEVICE_GET_IOTXN_STATS: {
+        // drivers keep their own pools; if this one does not report its
+        // pool, report the one read() and write() allocate from
+        r = dev->ops->ioctl(dev, op, in_buf, in_len, out_buf, out_len);
+        if (r == ERR_NOT_SUPPORTED) {
+            if (out_len < sizeof(iotxn_pool_stats_t)) {
+                r = ERR_BUFFER_TOO_SMALL;
+            } else {
+                iotxn_pool_stats(out_buf);
+                r = sizeof(iotxn_pool_stats_t);
+            }
+        }
+        break;
+    }
     default:
         r = dev->ops->ioctl(dev, op, in_buf, in_len, out_buf, out_len);
     }
@@ -312,6 +394,27 @@ static mx_status_t _devhost_rio_handler(mxrio_msg_t* msg, mx_handle_t rh,
         mx_status_t r = do_sync_io(dev, IOTXN_OP_WRITE, msg->data, len, msg->arg2.off);
         return r;
     }
+    case MXRIO_READ_VMO:
+    case MXRIO_WRITE_VMO: {
+        bool read = (MXRIO_OP(msg->op) == MXRIO_READ_VMO);
+        mx_handle_t vmo = msg->handle[0];
+        mx_status_t r;
+        if (read ? !CAN_READ(ios) : !CAN_WRITE(ios)) {
+            r = ERR_ACCESS_DENIED;
+        } else if ((arg < 0) || ((msg->arg2.off < 0) && (msg->arg2.off != MXRIO_OFF_SEEK))) {
+            r = ERR_INVALID_ARGS;
+        } else {
+            bool seek = (msg->arg2.off == MXRIO_OFF_SEEK);
+            mx_off_t off = seek ? ios->io_off : (mx_off_t)msg->arg2.off;
+            r = do_vmo_io(dev, read ? IOTXN_OP_READ : IOTXN_OP_WRITE, vmo, arg, off);
+            if ((r >= 0) && seek) {
+                ios->io_off += r;
+            }
+            msg->arg2.off = seek ? ios->io_off : 0;
+        }
+        mx_handle_close(vmo);
+        return r;
+    }
     case MXRIO_SEEK: {
         size_t end, n;
         end = dev->ops->get_size(dev);
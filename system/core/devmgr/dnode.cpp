@@ -46,12 +46,14 @@ void Dnode::RemoveFromParent() {
     // Detach from parent
     if (parent_) {
         parent_->children_.erase(*this);
+        fs::Vfs::InvalidateLookup(parent_->vnode_, name_.get(), NameLen());
         if (IsDirectory()) {
             // '..' no longer references parent.
-            parent_->vnode_->link_count_--;
+            parent_->vnode_->link_count_.fetch_sub(1);
         }
         parent_ = nullptr;
-        vnode_->link_count_--;
+        vnode_->link_count_.fetch_sub(1);
+        vfs_notify_change();
     }
 }
 
@@ -76,12 +78,17 @@ void Dnode::AddChild(mxtl::RefPtr<Dnode> parent, mxtl::RefPtr<Dnode> child) {
     MX_DEBUG_ASSERT(parent->IsDirectory());
 
     child->parent_ = parent;
-    child->vnode_->link_count_++;
+    child->vnode_->link_count_.fetch_add(1);
     if (child->IsDirectory()) {
         // Child has '..' pointing back at parent.
-        parent->vnode_->link_count_++;
+        parent->vnode_->link_count_.fetch_add(1);
     }
+    Dnode* dn = child.get();
     parent->children_.push_back(mxtl::move(child));
+    // devices and bootfs files are added here directly, not through
+    // the generic Vfs calls
+    fs::Vfs::InvalidateLookup(parent->vnode_, dn->name_.get(), dn->NameLen());
+    vfs_notify_change();
 }
 
 mx_status_t Dnode::Lookup(const char* name, size_t len, mxtl::RefPtr<Dnode>* out) const {
@@ -25,6 +25,8 @@ static_assert(NAME_MAX == 255, "NAME_MAX must be 255");
 static_assert(((kDnodeNameMax + 1) & kDnodeNameMax) == 0,
               "Expected kDnodeNameMax to be one less than a power of two");
 
+// Dnodes make up the memfs namespace; everything but their refcount is
+// guarded by memfs_lock.
 class Dnode : public mxtl::RefCounted<Dnode> {
 public:
     DISALLOW_COPY_ASSIGN_AND_MOVE(Dnode);
@@ -14,9 +14,21 @@
 #include <mxio/remoteio.h>
 #include <mxio/vfs.h>
 
+__BEGIN_CDECLS
+
+// Guards the memfs namespace: the dnode tree, link counts, mount points
+// and directory watchers. File contents and times are guarded by the
+// lock of the vnode they belong to, which may be taken while holding
+// memfs_lock, but not the other way around.
+extern mtx_t memfs_lock;
+
+__END_CDECLS
+
 #ifdef __cplusplus
 
+#include <mxtl/atomic.h>
 #include <mxtl/intrusive_double_list.h>
+#include <mxtl/mutex.h>
 #include <mxtl/ref_ptr.h>
 #include <mxtl/unique_ptr.h>
 
@@ -49,22 +61,28 @@ public:
 
     // To be more specific: Is this vnode connected into the directory hierarchy?
     // VnodeDirs can be unlinked, and this method will subsequently return false.
+    // Callers hold memfs_lock.
     bool IsDirectory() const { return dnode_ != nullptr; }
 
     virtual ~VnodeMemfs();
 
     // TODO(smklein): The following members should become private
+    // These are part of the namespace, and are guarded by memfs_lock.
     uint32_t seqcount_;
 
     Dnode::DeviceList devices_; // All devices pointing to this vnode
     mxtl::RefPtr<Dnode> dnode_;
-    uint32_t link_count_;
+    // Changed under memfs_lock, but read by Getattr without it.
+    mxtl::atomic<uint32_t> link_count_;
 
 protected:
     VnodeMemfs();
 
+    mx_status_t AttachRemoteLocked(mx_handle_t h) TA_REQ(memfs_lock);
+
+    mxtl::Mutex lock_;
     uint64_t create_time_;
-    uint64_t modify_time_;
+    uint64_t modify_time_ TA_GUARDED(lock_);
 };
 
 class VnodeFile final : public VnodeMemfs {
@@ -73,14 +91,15 @@ public:
     ~VnodeFile();
 
 private:
-    void Release() final;
+    void Release() TA_NO_THREAD_SAFETY_ANALYSIS final;
     ssize_t Read(void* data, size_t len, size_t off) final;
     ssize_t Write(const void* data, size_t len, size_t off) final;
     mx_status_t Truncate(size_t len) final;
     mx_status_t Getattr(vnattr_t* a) final;
+    mx_status_t Mmap(uint32_t flags, size_t len, size_t* off, mx_handle_t* out) final;
 
-    mx_handle_t vmo_;
-    mx_off_t length_;
+    mx_handle_t vmo_ TA_GUARDED(lock_);
+    mx_off_t length_ TA_GUARDED(lock_);
 };
 
 class VnodeDir : public VnodeMemfs {
@@ -97,8 +116,9 @@ public:
     mx_status_t CreateFromVmo(const char* name, size_t namelen, mx_handle_t vmo, mx_off_t off,
                               mx_off_t len);
 
-    mx_status_t CreateDeviceAtLocked(memfs::VnodeDir** out, const char* name, mx_handle_t h);
-    void NotifyAdd(const char* name, size_t len) TA_REQ(vfs_lock) final;
+    mx_status_t CreateDeviceAtLocked(memfs::VnodeDir** out, const char* name, mx_handle_t h)
+        TA_REQ(memfs_lock);
+    void NotifyAdd(const char* name, size_t len) TA_REQ(memfs_lock) final;
 private:
     mx_status_t IoctlWatchDir(const void* in_buf, size_t in_len, void* out_buf,
                               size_t out_len) final;
@@ -106,11 +126,12 @@ private:
 
     // Resolves the question, "Can this directory create a child node with the name?"
     // Returns "NO_ERROR" on success; otherwise explains failure with error message.
-    mx_status_t CanCreate(const char* name, size_t namelen) const;
+    mx_status_t CanCreate(const char* name, size_t namelen) const TA_REQ(memfs_lock);
 
     // Creates a dnode for the Vnode, attaches vnode to dnode, (if directory) attaches
     // dnode to vnode, and adds dnode to parent directory.
-    mx_status_t AttachVnode(memfs::VnodeMemfs* vn, const char* name, size_t namelen, bool isdir);
+    mx_status_t AttachVnode(memfs::VnodeMemfs* vn, const char* name, size_t namelen, bool isdir)
+        TA_REQ(memfs_lock);
 
     mx_status_t Unlink(const char* name, size_t len, bool must_be_dir) final;
     mx_status_t Rename(fs::Vnode* newdir,
@@ -120,9 +141,7 @@ private:
     mx_status_t Link(const char* name, size_t len, fs::Vnode* target) final;
     mx_status_t Getattr(vnattr_t* a) override;
 
-    // TODO(smklein): Guard the watch list with a lock more fine-grained
-    // than the VFS lock (or make the watch list thread-safe while lock-free).
-    mxtl::DoublyLinkedList<mxtl::unique_ptr<VnodeWatcher>> watch_list_ TA_GUARDED(vfs_lock);
+    mxtl::DoublyLinkedList<mxtl::unique_ptr<VnodeWatcher>> watch_list_ TA_GUARDED(memfs_lock);
 };
 
 class VnodeDevice final : public VnodeDir {
@@ -177,7 +196,7 @@ mx_handle_t vfs_create_root_handle(VnodeMemfs* vn);
 // device fs
 VnodeDir* devfs_get_root(void);
 mx_status_t memfs_create_device_at(VnodeDir* parent, VnodeDir** out, const char* name,
-                                   mx_handle_t hdevice) TA_EXCL(vfs_lock);
+                                   mx_handle_t hdevice) TA_EXCL(memfs_lock);
 mx_status_t devfs_remove(VnodeDir* vn);
 
 // boot fs
@@ -191,7 +210,7 @@ mx_status_t systemfs_add_file(const char* path, mx_handle_t vmo, mx_off_t off, s
 // memory fs
 VnodeDir* memfs_get_root(void);
 mx_status_t memfs_add_link(VnodeDir* parent, const char* name,
-                           VnodeMemfs* target) TA_EXCL(vfs_lock);
+                           VnodeMemfs* target) TA_EXCL(memfs_lock);
 
 // Create the global root to memfs
 VnodeDir* vfs_create_global_root(void) TA_NO_THREAD_SAFETY_ANALYSIS;
@@ -201,6 +220,6 @@ VnodeDir* vfs_create_root(void);
 
 // shared among all memory filesystems
 mx_status_t memfs_create_directory(const char* path, uint32_t flags);
-void memfs_mount(VnodeDir* parent, VnodeDir* subtree) TA_EXCL(vfs_lock);
+void memfs_mount(VnodeDir* parent, VnodeDir* subtree) TA_EXCL(memfs_lock);
 
 __END_CDECLS
@@ -25,6 +25,8 @@
 
 #define MXDEBUG 0
 
+mtx_t memfs_lock = MTX_INIT;
+
 namespace memfs {
 
 constexpr size_t kMinfsMaxFileSize = (8192 * 8192);
@@ -46,7 +48,7 @@ VnodeFile::VnodeFile() : vmo_(MX_HANDLE_INVALID), length_(0) {}
 VnodeFile::~VnodeFile() {}
 
 VnodeDir::VnodeDir() {
-    link_count_ = 1; // Implied '.'
+    link_count_.store(1); // Implied '.'
 }
 VnodeDir::~VnodeDir() {}
 
@@ -56,7 +58,7 @@ VnodeVmo::~VnodeVmo() {}
 
 VnodeDevice::VnodeDevice() {
     flags_ |= V_FLAG_DEVICE;
-    link_count_ = 1; // Implied '.'
+    link_count_.store(1); // Implied '.'
 }
 VnodeDevice::~VnodeDevice() {}
 
@@ -84,8 +86,11 @@ void VnodeDevice::Release() {
 }
 
 mx_status_t VnodeMemfs::Open(uint32_t flags) {
-    if ((flags & O_DIRECTORY) && !IsDirectory()) {
-        return ERR_NOT_DIR;
+    if (flags & O_DIRECTORY) {
+        mxtl::AutoLock lock(&memfs_lock);
+        if (!IsDirectory()) {
+            return ERR_NOT_DIR;
+        }
     }
     RefAcquire();
     return NO_ERROR;
@@ -97,6 +102,7 @@ mx_status_t VnodeMemfs::Close() {
 }
 
 ssize_t VnodeFile::Read(void* data, size_t len, size_t off) {
+    mxtl::AutoLock lock(&lock_);
     if ((off >= length_) || (vmo_ == MX_HANDLE_INVALID)) {
         return 0;
     }
@@ -123,6 +129,7 @@ ssize_t VnodeVmo::Read(void* data, size_t len, size_t off) {
 }
 
 ssize_t VnodeFile::Write(const void* data, size_t len, size_t off) {
+    mxtl::AutoLock lock(&lock_);
     mx_status_t status;
     size_t newlen = off + len;
     newlen = newlen > kMinfsMaxFileSize ? kMinfsMaxFileSize : newlen;
@@ -167,11 +174,35 @@ ssize_t VnodeVmo::Write(const void* data, size_t len, size_t off) {
     if (r < 0) {
         return r;
     }
+    mxtl::AutoLock lock(&lock_);
     modify_time_ = mx_time_get(MX_CLOCK_UTC);
     return rlen;
 }
 
+mx_status_t VnodeFile::Mmap(uint32_t flags, size_t len, size_t* off, mx_handle_t* out) {
+    mxtl::AutoLock lock(&lock_);
+    mx_status_t status;
+    if (vmo_ == MX_HANDLE_INVALID) {
+        // First access to the file? Allocate it.
+        if ((status = mx_vmo_create(0, 0, &vmo_)) != NO_ERROR) {
+            return status;
+        }
+    }
+
+    // The file's contents live in the vmo, so shared mappings see (and
+    // make) the same changes as reads and writes.  Without copy-on-write
+    // clones, a private mapping is only handed a readable vmo, and the
+    // client maps a copy of it.
+    mx_rights_t rights = MX_RIGHT_TRANSFER | MX_RIGHT_DUPLICATE | MX_RIGHT_READ | MX_RIGHT_MAP;
+    if ((flags & MXIO_MMAP_FLAG_WRITE) && !(flags & MXIO_MMAP_FLAG_PRIVATE)) {
+        rights |= MX_RIGHT_WRITE;
+    }
+    rights |= (flags & MXIO_MMAP_FLAG_EXEC) ? MX_RIGHT_EXECUTE : 0;
+    return mx_handle_duplicate(vmo_, rights, out);
+}
+
 mx_status_t VnodeDir::Lookup(fs::Vnode** out, const char* name, size_t len) {
+    mxtl::AutoLock lock(&memfs_lock);
     if (!IsDirectory()) {
         return ERR_NOT_FOUND;
     }
@@ -193,9 +224,10 @@ mx_status_t VnodeDir::Lookup(fs::Vnode** out, const char* name, size_t len) {
 
 mx_status_t VnodeFile::Getattr(vnattr_t* attr) {
     memset(attr, 0, sizeof(vnattr_t));
+    mxtl::AutoLock lock(&lock_);
     attr->mode = V_TYPE_FILE | V_IRUSR;
     attr->size = length_;
-    attr->nlink = link_count_;
+    attr->nlink = link_count_.load();
     attr->create_time = create_time_;
     attr->modify_time = modify_time_;
     return NO_ERROR;
@@ -203,9 +235,10 @@ mx_status_t VnodeFile::Getattr(vnattr_t* attr) {
 
 mx_status_t VnodeDir::Getattr(vnattr_t* attr) {
     memset(attr, 0, sizeof(vnattr_t));
+    mxtl::AutoLock lock(&lock_);
     attr->mode = V_TYPE_DIR | V_IRUSR;
     attr->size = 0;
-    attr->nlink = link_count_;
+    attr->nlink = link_count_.load();
     attr->create_time = create_time_;
     attr->modify_time = modify_time_;
     return NO_ERROR;
@@ -213,13 +246,11 @@ mx_status_t VnodeDir::Getattr(vnattr_t* attr) {
 
 mx_status_t VnodeVmo::Getattr(vnattr_t* attr) {
     memset(attr, 0, sizeof(vnattr_t));
-    if (!IsDirectory()) {
-        attr->mode = V_TYPE_FILE | V_IRUSR;
-    } else {
-        attr->mode = V_TYPE_DIR | V_IRUSR;
-    }
+    // Vmo vnodes are only ever created as files.
+    attr->mode = V_TYPE_FILE | V_IRUSR;
     attr->size = length_;
-    attr->nlink = link_count_;
+    mxtl::AutoLock lock(&lock_);
+    attr->nlink = link_count_.load();
     attr->create_time = create_time_;
     attr->modify_time = modify_time_;
     return NO_ERROR;
@@ -227,13 +258,14 @@ mx_status_t VnodeVmo::Getattr(vnattr_t* attr) {
 
 mx_status_t VnodeDevice::Getattr(vnattr_t* attr) {
     memset(attr, 0, sizeof(vnattr_t));
+    mxtl::AutoLock lock(&memfs_lock);
     if (IsRemote() && !IsDirectory()) {
         attr->mode = V_TYPE_CDEV | V_IRUSR | V_IWUSR;
     } else {
         attr->mode = V_TYPE_DIR | V_IRUSR;
     }
     attr->size = 0;
-    attr->nlink = link_count_;
+    attr->nlink = link_count_.load();
     return NO_ERROR;
 }
 
@@ -243,12 +275,14 @@ mx_status_t VnodeMemfs::Setattr(vnattr_t* attr) {
         return ERR_INVALID_ARGS;
     }
     if (attr->valid & ATTR_MTIME) {
+        mxtl::AutoLock lock(&lock_);
         modify_time_ = attr->modify_time;
     }
     return NO_ERROR;
 }
 
 mx_status_t VnodeDir::Readdir(void* cookie, void* data, size_t len) {
+    mxtl::AutoLock lock(&memfs_lock);
     if (!IsDirectory()) {
         // This WAS a directory, but it has been deleted.
         return Dnode::ReaddirStart(cookie, data, len);
@@ -258,6 +292,7 @@ mx_status_t VnodeDir::Readdir(void* cookie, void* data, size_t len) {
 
 // postcondition: reference taken on vn returned through "out"
 mx_status_t VnodeDir::Create(fs::Vnode** out, const char* name, size_t len, uint32_t mode) {
+    mxtl::AutoLock lock(&memfs_lock);
     mx_status_t status;
     if ((status = CanCreate(name, len)) != NO_ERROR) {
         return status;
@@ -286,6 +321,7 @@ mx_status_t VnodeDir::Create(fs::Vnode** out, const char* name, size_t len, uint
 
 mx_status_t VnodeDir::Unlink(const char* name, size_t len, bool must_be_dir) {
     xprintf("memfs_unlink(%p,'%.*s')\n", this, (int)len, name);
+    mxtl::AutoLock lock(&memfs_lock);
     if (!IsDirectory()) {
         // Calling unlink from unlinked, empty directory
         return ERR_BAD_STATE;
@@ -309,6 +345,7 @@ mx_status_t VnodeDir::Unlink(const char* name, size_t len, bool must_be_dir) {
 }
 
 mx_status_t VnodeFile::Truncate(size_t len) {
+    mxtl::AutoLock lock(&lock_);
     mx_status_t status;
     len = len > kMinfsMaxFileSize ? kMinfsMaxFileSize : len;
 
@@ -350,6 +387,7 @@ mx_status_t VnodeDir::Rename(fs::Vnode* _newdir, const char* oldname, size_t old
                              bool dst_must_be_dir) {
     VnodeMemfs* newdir = static_cast<VnodeMemfs*>(_newdir);
 
+    mxtl::AutoLock lock(&memfs_lock);
     if (!IsDirectory() || !newdir->IsDirectory())
         return ERR_BAD_STATE;
     if ((oldlen == 1) && (oldname[0] == '.'))
@@ -431,6 +469,7 @@ mx_status_t VnodeDir::Rename(fs::Vnode* _newdir, const char* oldname, size_t old
 mx_status_t VnodeDir::Link(const char* name, size_t len, fs::Vnode* target) {
     VnodeMemfs* vn = static_cast<VnodeMemfs*>(target);
 
+    mxtl::AutoLock lock(&memfs_lock);
     if ((len == 1) && (name[0] == '.')) {
         return ERR_BAD_STATE;
     } else if ((len == 2) && (name[0] == '.') && (name[1] == '.')) {
@@ -493,13 +532,15 @@ ssize_t VnodeMemfs::Ioctl(uint32_t op, const void* in_buf, size_t in_len,
 }
 
 mx_status_t VnodeMemfs::AttachRemote(mx_handle_t h) {
+    mxtl::AutoLock lock(&memfs_lock);
+    return AttachRemoteLocked(h);
+}
+
+mx_status_t VnodeMemfs::AttachRemoteLocked(mx_handle_t h) {
     if (!IsDirectory()) {
         return ERR_NOT_DIR;
-    } else if (IsRemote()) {
-        return ERR_ALREADY_BOUND;
     }
-    remote_ = h;
-    return NO_ERROR;
+    return SetRemote(h);
 }
 
 static mx_status_t memfs_create_fs(const char* name, bool device, VnodeDir** out) {
@@ -525,18 +566,17 @@ static mx_status_t memfs_create_fs(const char* name, bool device, VnodeDir** out
     return NO_ERROR;
 }
 
-static void memfs_mount_locked(VnodeDir* parent, VnodeDir* subtree) TA_REQ(vfs_lock) {
+static void memfs_mount_locked(VnodeDir* parent, VnodeDir* subtree) TA_REQ(memfs_lock) {
     Dnode::AddChild(parent->dnode_, subtree->dnode_);
 }
 
-// TODO(smklein): Update the usage of the vfs_lock here to a Vnode-specific lock,
-// allowing vnode creation, but preventing TOCTTOU bugs between checking if the
-// device exists and when we actually create it.
+// memfs_lock is held across the check for an existing device and its
+// creation, so two devices cannot race to the same name.
 //
 // precondition: no ref taken on parent
 // postcondition: ref returned on out parameter
 mx_status_t VnodeDir::CreateDeviceAtLocked(VnodeDir** out, const char* name,
-                                           mx_handle_t h) TA_REQ(vfs_lock) {
+                                           mx_handle_t h) {
     if (name == nullptr) {
         return ERR_INVALID_ARGS;
     }
@@ -573,7 +613,7 @@ mx_status_t VnodeDir::CreateDeviceAtLocked(VnodeDir** out, const char* name,
 
     if (h) {
         // attach device
-        vn->AttachRemote(h);
+        vn->AttachRemoteLocked(h);
     }
 
     NotifyAdd(name, len);
@@ -583,7 +623,7 @@ mx_status_t VnodeDir::CreateDeviceAtLocked(VnodeDir** out, const char* name,
 }
 
 static mx_status_t memfs_add_link_locked(VnodeDir* parent, const char* name,
-                                         VnodeMemfs* vn) TA_REQ(vfs_lock) {
+                                         VnodeMemfs* vn) TA_REQ(memfs_lock) {
     if ((parent == nullptr) || (vn == nullptr)) {
         return ERR_INVALID_ARGS;
     }
@@ -624,6 +664,7 @@ got_name:
 
 mx_status_t VnodeDir::CreateFromVmo(const char* name, size_t namelen,
                                     mx_handle_t vmo, mx_off_t off, mx_off_t len) {
+    mxtl::AutoLock lock(&memfs_lock);
     mx_status_t status;
     if ((status = CanCreate(name, namelen)) != NO_ERROR) {
         return status;
@@ -685,6 +726,11 @@ mx_status_t memfs_create_directory(const char* path, uint32_t flags) {
     if ((r = fs::Vfs::Walk(memfs::vfs_root, &parent_vn, path, &pathout)) < 0) {
         return r;
     }
+    if (r > 0) {
+        // the walk stopped at a mount point; the directory is made
+        // under it, but the remote handle is not needed
+        mx_handle_close(r);
+    }
     memfs::VnodeDir* parent = static_cast<memfs::VnodeDir*>(parent_vn);
 
     if (strcmp(pathout, "") == 0) {
@@ -750,10 +796,13 @@ memfs::VnodeDir* bootfs_get_root() {
 
 mx_status_t memfs_create_device_at(memfs::VnodeDir* parent, memfs::VnodeDir** out,
                                    const char* name, mx_handle_t h) {
-    if ((parent == nullptr) || !parent->IsDirectory()) {
+    if (parent == nullptr) {
+        return ERR_INVALID_ARGS;
+    }
+    mxtl::AutoLock lock(&memfs_lock);
+    if (!parent->IsDirectory()) {
         return ERR_INVALID_ARGS;
     }
-    mxtl::AutoLock lock(&vfs_lock);
     return parent->CreateDeviceAtLocked(out, name, h);
 }
 
@@ -779,12 +828,12 @@ memfs::VnodeDir* vfs_create_global_root() {
 }
 
 void memfs_mount(memfs::VnodeDir* parent, memfs::VnodeDir* subtree) {
-    mxtl::AutoLock lock(&vfs_lock);
+    mxtl::AutoLock lock(&memfs_lock);
     memfs_mount_locked(parent, subtree);
 }
 
 mx_status_t memfs_add_link(memfs::VnodeDir* parent, const char* name,
                            memfs::VnodeMemfs* target) {
-    mxtl::AutoLock lock(&vfs_lock);
+    mxtl::AutoLock lock(&memfs_lock);
     return memfs_add_link_locked(parent, name, target);
 }
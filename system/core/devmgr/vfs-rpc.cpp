@@ -28,6 +28,8 @@
 
 #define MXDEBUG 0
 
+#define VFS_DISPATCHER_MAX_THREADS 4
+
 mtx_t vfs_lock = MTX_INIT;
 
 mxio_dispatcher_t* vfs_dispatcher;
@@ -38,13 +40,19 @@ static VnodeMemfs* global_vfs_root;
 
 mx_status_t VnodeDevice::GetHandles(uint32_t flags, mx_handle_t* hnds,
                                     uint32_t* type, void* extra, uint32_t* esize) {
-    if (IsDevice() && !(flags & O_DIRECTORY)) {
-        *type = 0;
-        hnds[0] = remote_;
-        return 1;
-    } else {
-        return VnodeMemfs::GetHandles(flags, hnds, type, extra, esize);
+    if (!(flags & O_DIRECTORY)) {
+        mxtl::AutoLock lock(&memfs_lock);
+        if (IsDevice()) {
+            mx_handle_t h = CloneRemote();
+            if (h < 0) {
+                return h;
+            }
+            *type = 0;
+            hnds[0] = h;
+            return 1;
+        }
     }
+    return VnodeMemfs::GetHandles(flags, hnds, type, extra, esize);
 }
 
 mx_status_t VnodeMemfs::GetHandles(uint32_t flags, mx_handle_t* hnds, uint32_t* type, void* extra,
@@ -61,7 +69,7 @@ VnodeWatcher::~VnodeWatcher() {
     }
 }
 
-void VnodeDir::NotifyAdd(const char* name, size_t len) TA_REQ(vfs_lock) {
+void VnodeDir::NotifyAdd(const char* name, size_t len) {
     xprintf("devfs: notify vn=%p name='%.*s'\n", this, (int)len, name);
     for (auto it = watch_list_.begin(); it != watch_list_.end();) {
         mx_status_t status;
@@ -79,10 +87,6 @@ mx_status_t VnodeDir::IoctlWatchDir(const void* in_buf, size_t in_len, void* out
     if ((out_len != sizeof(mx_handle_t)) || (in_len != 0)) {
         return ERR_INVALID_ARGS;
     }
-    if (!IsDirectory()) {
-        // not a directory
-        return ERR_WRONG_TYPE;
-    }
     AllocChecker ac;
     mxtl::unique_ptr<VnodeWatcher> watcher(new (&ac) VnodeWatcher);
     if (!ac.check()) {
@@ -92,8 +96,13 @@ mx_status_t VnodeDir::IoctlWatchDir(const void* in_buf, size_t in_len, void* out
     if (mx_channel_create(0, &h, &watcher->h) < 0) {
         return ERR_NO_RESOURCES;
     }
+    mxtl::AutoLock lock(&memfs_lock);
+    if (!IsDirectory()) {
+        // not a directory
+        mx_handle_close(h);
+        return ERR_WRONG_TYPE;
+    }
     memcpy(out_buf, &h, sizeof(mx_handle_t));
-    mxtl::AutoLock lock(&vfs_lock);
     watch_list_.push_back(mxtl::move(watcher));
     return sizeof(mx_handle_t);
 }
@@ -103,15 +112,11 @@ mx_status_t VnodeDir::IoctlWatchDir(const void* in_buf, size_t in_len, void* out
 // The following functions exist outside the memfs namespace so they
 // can be exposed to C:
 
-static volatile int vfs_txn = -1;
-static int vfs_txn_no = 0;
-
+// The vfs dispatcher runs on several threads; memfs guards its namespace
+// with memfs_lock and each file with a lock of its own, so requests on
+// different connections run in parallel.
 mx_status_t vfs_handler(mxrio_msg_t* msg, mx_handle_t rh, void* cookie) {
-    vfs_txn_no = (vfs_txn_no + 1) & 0x0FFFFFFF;
-    vfs_txn = vfs_txn_no;
-    mx_status_t r = vfs_handler_generic(msg, rh, cookie);
-    vfs_txn = -1;
-    return r;
+    return vfs_handler_generic(msg, rh, cookie);
 }
 
 // Acquire the root vnode and return a handle to it through the VFS dispatcher
@@ -132,7 +137,11 @@ mx_handle_t vfs_create_root_handle(VnodeMemfs* vn) {
 void vfs_global_init(VnodeDir* root) {
     memfs::global_vfs_root = root;
     if (mxio_dispatcher_create(&vfs_dispatcher, mxrio_handler) == NO_ERROR) {
-        mxio_dispatcher_start(vfs_dispatcher, "vfs-rio-dispatcher");
+        uint32_t threads = mx_system_get_num_cpus();
+        if (threads > VFS_DISPATCHER_MAX_THREADS) {
+            threads = VFS_DISPATCHER_MAX_THREADS;
+        }
+        mxio_dispatcher_start_etc(vfs_dispatcher, "vfs-rio-dispatcher", threads);
     }
 }
 
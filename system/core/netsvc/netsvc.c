@@ -158,8 +158,8 @@ void udp6_recv(void* data, size_t len,
     }
 }
 
-void netifc_recv(void* data, size_t len) {
-    eth_recv(data, len);
+void netifc_recv(void* data, size_t len, uint32_t flags) {
+    eth_recv(data, len, flags);
 }
 
 int main(int argc, char** argv) {
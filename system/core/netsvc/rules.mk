@@ -15,7 +15,7 @@ MODULE_SRCS += \
     $(LOCAL_DIR)/netfile.c \
     $(LOCAL_DIR)/device_id.c
 
-MODULE_STATIC_LIBS := system/ulib/inet6
+MODULE_STATIC_LIBS := system/ulib/inet6 system/ulib/inet-checksum
 
 MODULE_LIBS := system/ulib/mxio system/ulib/launchpad system/ulib/magenta system/ulib/c
 
@@ -28,7 +28,9 @@
 // Rebind the block device (if supported)
 #define IOCTL_BLOCK_RR_PART \
     IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_BLOCK, 6)
-// Set up a FIFO-based server on the block device; acquire the handle to it
+// Set up a FIFO-based server on the block device; acquire the handle to it.
+// Each open connection to the device may have its own server, and the servers
+// of separate connections run in parallel.
 #define IOCTL_BLOCK_GET_FIFOS \
     IOCTL(IOCTL_KIND_GET_HANDLE, IOCTL_FAMILY_BLOCK, 7)
 // Attach a VMO to the currently running FIFO server
@@ -101,6 +103,10 @@ IOCTL_WRAPPER(ioctl_block_fifo_close, IOCTL_BLOCK_FIFO_CLOSE);
 // Once a txn has been allocated, it can be re-used many times. It is recommended that
 // transactions are allocated on a "per-thread" basis, and only freed on thread teardown.
 //
+// Adjacent reads or writes on the same txn and vmoid (contiguous both within the VMO and
+// on the device) may be merged by the server into a single device operation; this is
+// invisible to the client, which still receives a response covering every request.
+//
 // The protocol to communicate with a single txn is as follows:
 // 1) SEND [N - 1] messages with an allocated txnid for any value of 1 <= N < MAX_TXN_MESSAGES.
 //    The BLOCKIO_TXN_END flag is not set for this step.
@@ -109,7 +115,7 @@ IOCTL_WRAPPER(ioctl_block_fifo_close, IOCTL_BLOCK_FIFO_CLOSE);
 //    This response is sent once all operations either complete or a single operation fails.
 //    At this point, step (1) may begin again without reallocating the txn.
 //
-// For BLOCKIO_READ and BLOCKIO_WRITE, N may be greater than 1.
+// For BLOCKIO_READ, BLOCKIO_WRITE and BLOCKIO_SYNC, N may be greater than 1.
 // Otherwise, N == 1 (skipping step (1) in the protocol above).
 //
 // Notes:
@@ -131,15 +137,39 @@ IOCTL_WRAPPER(ioctl_block_fifo_close, IOCTL_BLOCK_FIFO_CLOSE);
 //   -> (txnid = 3, vmoid = 1, OP = Write)
 //   -> (txnid = 3, vmoid = 1, OP = Read | Want Reply)
 //   <- Repsonse sent to txnid = 3
+//
+// Ordering:
+// Requests may be started in any order, and may complete in any order, regardless of the
+// order in which they were sent and the transactions they belong to. Where order matters
+// (for example, a filesystem journal must be on disk before the blocks it describes are
+// written in place), clients order requests with the following:
+// - BLOCKIO_BARRIER_BEFORE: The request is not started until every request sent ahead of
+//   it (on any txnid) has completed.
+// - BLOCKIO_BARRIER_AFTER: No request sent after this one is started until it has completed.
+// - BLOCKIO_FUA: A write which has completed is on stable storage, rather than in a volatile
+//   cache within the device.
+// - BLOCKIO_SYNC: Completes once every write which completed before it was started is on
+//   stable storage. It implies BLOCKIO_BARRIER_BEFORE; vmoid, length and offsets are ignored.
+//
+// For example, a journal commit which must be on disk before the blocks it describes are
+// overwritten may be sent without waiting for a response in between:
+//   -> (txnid = 1, vmoid = 1, OP = Write)                  Journal record
+//   -> (txnid = 1, vmoid = 1, OP = Sync | Barrier After)   Record is durable
+//   -> (txnid = 1, vmoid = 2, OP = Write)                  Blocks written in place
+//   -> (txnid = 1, vmoid = 2, OP = Write | Want Reply)
+//   <- Response sent to txnid = 1
 
 #define BLOCKIO_READ      0x0001 // Reads from the Block device into the VMO
 #define BLOCKIO_WRITE     0x0002 // Writes to the Block device from the VMO
-#define BLOCKIO_SYNC      0x0003 // Unimplemented
+#define BLOCKIO_SYNC      0x0003 // Flushes previously completed writes to stable storage
 #define BLOCKIO_CLOSE_VMO 0x0004 // Detaches the VMO from the block device; closes the handle to it.
 #define BLOCKIO_OP_MASK   0x00FF
 
-#define BLOCKIO_TXN_END   0x0100 // Expects response after request (and all previous) have completed
-#define BLOCKIO_FLAG_MASK 0xFF00
+#define BLOCKIO_TXN_END        0x0100 // Expects response after request (and all previous) have completed
+#define BLOCKIO_BARRIER_BEFORE 0x0200 // Starts only after all previous requests have completed
+#define BLOCKIO_BARRIER_AFTER  0x0400 // Completes before any subsequent request is started
+#define BLOCKIO_FUA            0x0800 // Write is on stable storage when it completes
+#define BLOCKIO_FLAG_MASK      0xFF00
 
 typedef struct {
     txnid_t txnid;
@@ -61,6 +61,24 @@
 #define IOCTL_DEVICE_SYNC \
     IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_DEVICE, 7)
 
+// Return statistics for the iotxn pool of the driver serving the device
+// (or, if the driver does not answer, of the devhost it runs in)
+//   in: none
+//   out: iotxn_pool_stats_t
+#define IOCTL_DEVICE_GET_IOTXN_STATS \
+    IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_DEVICE, 8)
+
+typedef struct {
+    uint64_t allocs;        // iotxn_alloc() and iotxn_clone() calls
+    uint64_t cache_hits;    // allocations taken from the calling thread's cache
+    uint64_t pool_hits;     // allocations taken from the shared pool
+    uint64_t vmo_creates;   // allocations which had to create a vmo
+    uint64_t releases;      // iotxns returned to the pool
+    uint64_t frees;         // iotxns freed outright on release
+    uint64_t pooled;        // iotxns waiting in the pool now
+    uint64_t pooled_bytes;  // the size of their vmos
+} iotxn_pool_stats_t;
+
 // Indicates if there's data available to read,
 // or room to write, or an error condition.
 #define DEVICE_SIGNAL_READABLE MX_USER_SIGNAL_0
@@ -92,3 +110,6 @@ IOCTL_WRAPPER(ioctl_device_debug_resume, IOCTL_DEVICE_DEBUG_RESUME);
 
 // ssize_t ioctl_device_sync(int fd);
 IOCTL_WRAPPER(ioctl_device_sync, IOCTL_DEVICE_SYNC);
+
+// ssize_t ioctl_device_get_iotxn_stats(int fd, iotxn_pool_stats_t* out);
+IOCTL_WRAPPER_OUT(ioctl_device_get_iotxn_stats, IOCTL_DEVICE_GET_IOTXN_STATS, iotxn_pool_stats_t);
@@ -24,6 +24,10 @@
     IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_DEVMGR, 4)
 #define IOCTL_DEVMGR_GET_TOKEN \
     IOCTL(IOCTL_KIND_GET_HANDLE, IOCTL_FAMILY_DEVMGR, 5)
+// Get a read-only vmo which begins with a uint64_t count of the changes
+// made to names and attributes in the filesystem which 'fd' belongs to.
+#define IOCTL_DEVMGR_GET_GENERATION \
+    IOCTL(IOCTL_KIND_GET_HANDLE, IOCTL_FAMILY_DEVMGR, 7)
 
 // ssize_t ioctl_devmgr_mount_fs(int fd, mx_handle_t* in);
 IOCTL_WRAPPER_IN(ioctl_devmgr_mount_fs, IOCTL_DEVMGR_MOUNT_FS, mx_handle_t);
@@ -43,6 +47,9 @@ IOCTL_WRAPPER_VAROUT(ioctl_devmgr_query_fs, IOCTL_DEVMGR_QUERY_FS, char);
 // ssize_t ioctl_devmgr_get_token(int fd, mx_handle_t* out);
 IOCTL_WRAPPER_OUT(ioctl_devmgr_get_token, IOCTL_DEVMGR_GET_TOKEN, mx_handle_t);
 
+// ssize_t ioctl_devmgr_get_generation(int fd, mx_handle_t* out);
+IOCTL_WRAPPER_OUT(ioctl_devmgr_get_generation, IOCTL_DEVMGR_GET_GENERATION, mx_handle_t);
+
 // TODO(smklein): Move these ioctls to a new location
 #define IOCTL_BLOBSTORE_BLOB_INIT \
     IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_DEVMGR, 6)
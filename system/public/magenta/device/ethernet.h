@@ -26,6 +26,10 @@ typedef struct eth_info_t {
 } eth_info_t;
 
 #define ETH_FEATURE_WLAN 1
+// the device completes transport checksums (see ETH_FIFO_TX_CSUM)
+#define ETH_FEATURE_TX_CSUM 2
+// the device verifies transport checksums (see ETH_FIFO_RX_CSUM_OK)
+#define ETH_FEATURE_RX_CSUM 4
 
 // Get the fifos to submit tx and rx operations
 //   in: none
@@ -48,6 +52,15 @@ typedef struct eth_fifos_t {
 #define IOCTL_ETHERNET_SET_IOBUF \
     IOCTL(IOCTL_KIND_SET_HANDLE, IOCTL_FAMILY_ETH, 2)
 
+// Allocate an io buffer which the device may receive into directly, to
+// be registered with SET_IOBUF like any other.  Other io buffers are
+// received into through a copy.  Fails with ERR_NOT_SUPPORTED if the
+// device has no use for one.
+//   in: uint64_t (size in bytes)
+//  out: mx_handle_t (vmo)
+#define IOCTL_ETHERNET_ALLOC_IOBUF \
+    IOCTL(IOCTL_KIND_GET_HANDLE, IOCTL_FAMILY_ETH, 7)
+
 // Start/Stop transferring packets
 // Start will not succeed (ERR_BAD_STATE) until the fifos have been
 // obtained and an io buffer vmo has been registered.
@@ -85,13 +98,16 @@ typedef struct eth_fifos_t {
 // are returned along with the fifo handles in the eth_fifos_t.
 
 // flags values for request messages
-// - none -
+#define ETH_FIFO_TX_CSUM (8u)   // complete the transport (TCP, UDP or ICMPv6)
+                                // checksum, whose field holds the pseudo-header
+                                // sum (only with ETH_FEATURE_TX_CSUM)
 
 // flags values for response messages
 #define ETH_FIFO_RX_OK   (1u)   // packet received okay
 #define ETH_FIFO_TX_OK   (1u)   // packet transmitted okay
 #define ETH_FIFO_INVALID (2u)   // offset+length not within io_vmo bounds
 #define ETH_FIFO_RX_TX   (4u)   // received our own tx packet (when TX_LISTEN)
+#define ETH_FIFO_RX_CSUM_OK (8u) // the transport checksum has been verified
 
 typedef struct eth_fifo_entry {
     // offset from start of io_vmo to packet data
@@ -113,6 +129,9 @@ IOCTL_WRAPPER_OUT(ioctl_ethernet_get_fifos, IOCTL_ETHERNET_GET_FIFOS, eth_fifos_
 // ssize_t ioctl_ethernet_set_iobuf(int fd, mx_handle_t_t* entries);
 IOCTL_WRAPPER_IN(ioctl_ethernet_set_iobuf, IOCTL_ETHERNET_SET_IOBUF, mx_handle_t);
 
+// ssize_t ioctl_ethernet_alloc_iobuf(int fd, const uint64_t* size, mx_handle_t* out);
+IOCTL_WRAPPER_INOUT(ioctl_ethernet_alloc_iobuf, IOCTL_ETHERNET_ALLOC_IOBUF, uint64_t, mx_handle_t);
+
 // ssize_t ioctl_ethernet_start(int fd);
 IOCTL_WRAPPER(ioctl_ethernet_start, IOCTL_ETHERNET_START);
 
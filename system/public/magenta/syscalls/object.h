@@ -190,6 +190,17 @@ typedef struct mx_info_maps {
 // Argument is the value of ld.so's _dl_debug_addr, a uintptr_t.
 #define MX_PROP_PROCESS_DEBUG_ADDR          5u
 
+// Argument is a size_t: the size of the buffer holding data which has
+// been written to a socket's peer and not yet read from the socket.
+// Rounded up to a power of two; can only be set while the buffer is empty.
+#define MX_PROP_SOCKET_BUFFER_SIZE          6u
+
+// Argument is a size_t: the size of the buffer holding data which has
+// been written to the socket and not yet read from its peer, which is the
+// peer's MX_PROP_SOCKET_BUFFER_SIZE.  Fails with ERR_PEER_CLOSED once the
+// peer is gone.
+#define MX_PROP_SOCKET_PEER_BUFFER_SIZE     7u
+
 // Policies for MX_PROP_BAD_HANDLE_POLICY:
 #define MX_POLICY_BAD_HANDLE_IGNORE         0u
 #define MX_POLICY_BAD_HANDLE_LOG            1u
@@ -209,6 +209,13 @@ typedef uint32_t mx_rights_t;
 #define MX_VMO_OP_CACHE_CLEAN            8u
 #define MX_VMO_OP_CACHE_CLEAN_INVALIDATE 9u
 
+// VM Address Region opcodes
+#define MX_VMAR_OP_COMMIT                1u
+#define MX_VMAR_OP_DECOMMIT              2u
+#define MX_VMAR_OP_HINT_NORMAL           3u
+#define MX_VMAR_OP_HINT_SEQUENTIAL       4u
+#define MX_VMAR_OP_HINT_RANDOM           5u
+
 // Mapping flags to vmar routines
 #define MX_VM_FLAG_PERM_READ          (1u << 0)
 #define MX_VM_FLAG_PERM_WRITE         (1u << 1)
@@ -252,6 +259,9 @@ typedef int64_t mx_rel_off_t;
 // Socket options and limits.
 #define MX_SOCKET_HALF_CLOSE                1u
 
+// Socket creation options.
+#define MX_SOCKET_CREATE_RESIZABLE          1u
+
 // Flags which can be used to to control cache policy for APIs which map memory.
 typedef enum {
     MX_CACHE_POLICY_CACHED          = 0,
@@ -54,6 +54,13 @@ ssize_t VnodeBlob::Read(void* data, size_t len, size_t off) {
     return actual;
 }
 
+mx_status_t VnodeBlob::Mmap(uint32_t flags, size_t len, size_t* off, mx_handle_t* out) {
+    if (IsDirectory()) {
+        return ERR_NOT_FILE;
+    }
+    return blob->Mmap(flags, len, off, out);
+}
+
 ssize_t VnodeBlob::Write(const void* data, size_t len, size_t off) {
     if (IsDirectory()) {
         return ERR_NOT_FILE;
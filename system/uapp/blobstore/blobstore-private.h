@@ -98,6 +98,11 @@ public:
     // Requires: kBlobStateReadable
     mx_status_t Read(void* data, size_t len, size_t off, size_t* actual);
 
+    // Returns a read-only handle to the blob's contents, having verified
+    // all of them, since nothing is verified as the mapping is read.
+    // Requires: kBlobStateReadable
+    mx_status_t Mmap(uint32_t flags, size_t len, size_t* off, mx_handle_t* out);
+
     // Creates an emtpy Blob with the given name.
     // Initializes to kBlobStateEmpty
     static mxtl::RefPtr<Blob> Create(const merkle::Digest& digest);
@@ -268,6 +273,7 @@ private:
     mx_status_t Close() final;
     ssize_t Read(void* data, size_t len, size_t off) final;
     ssize_t Write(const void* data, size_t len, size_t off) final;
+    mx_status_t Mmap(uint32_t flags, size_t len, size_t* off, mx_handle_t* out) final;
     mx_status_t Lookup(fs::Vnode** out, const char* name, size_t len) final;
     mx_status_t Getattr(vnattr_t* a) final;
     mx_status_t Create(fs::Vnode** out, const char* name, size_t len, uint32_t mode) final;
@@ -17,6 +17,7 @@
 #include <merkle/tree.h>
 #include <mxtl/ref_ptr.h>
 #include <mxio/debug.h>
+#include <mxio/vfs.h>
 
 #define MXDEBUG 0
 
@@ -519,6 +520,37 @@ mx_status_t Blob::Read(void* data, size_t len, size_t off, size_t* actual) {
     return mx_vmo_read(vmo_blob_, data, off, len, actual);
 }
 
+mx_status_t Blob::Mmap(uint32_t flags, size_t len, size_t* off, mx_handle_t* out) {
+    if (GetState() != kBlobStateReadable) {
+        return ERR_BAD_STATE;
+    }
+    if (flags & MXIO_MMAP_FLAG_WRITE) {
+        // Blobs are immutable; private copies are made by the client.
+        return ERR_ACCESS_DENIED;
+    }
+
+    mx_status_t status = InitVmos();
+    if (status != NO_ERROR) {
+        return status;
+    }
+
+    merkle::Tree mt;
+    merkle::Digest d;
+    d = ((const uint8_t*) &digest_[0]);
+    auto inode = &vn->blobstore->node_map_[map_index_];
+    uint64_t size_merkle = merkle::Tree::GetTreeLength(inode->blob_size);
+    status = mt.Verify((const void*)vmo_blob_addr_, inode->blob_size,
+                       (const void*)vmo_merkle_tree_addr_, size_merkle,
+                       0, inode->blob_size, d);
+    if (status != NO_ERROR) {
+        return status;
+    }
+
+    mx_rights_t rights = MX_RIGHT_TRANSFER | MX_RIGHT_DUPLICATE | MX_RIGHT_READ | MX_RIGHT_MAP;
+    rights |= (flags & MXIO_MMAP_FLAG_EXEC) ? MX_RIGHT_EXECUTE : 0;
+    return mx_handle_duplicate(vmo_blob_, rights, out);
+}
+
 void Blob::QueueUnlink() {
     flags_ |= kBlobFlagDeletable;
 }
@@ -0,0 +1,262 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Measures packets per second through the ethernet core driver. Frames are
+// sent as fast as the tx fifo takes them, with tx listening enabled, so
+// that every frame sent also comes back up the rx path of the same client.
+
+#include <magenta/compiler.h>
+#include <magenta/device/ethernet.h>
+#include <magenta/process.h>
+#include <magenta/syscalls.h>
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define BUFSIZE 2048
+
+// IEEE 802 local experimental ethertype
+#define ETHBENCH_ETHERTYPE 0x88b5
+
+typedef struct {
+    mx_handle_t tx_fifo;
+    mx_handle_t rx_fifo;
+    uint32_t tx_depth;
+    uint32_t rx_depth;
+    uint8_t* iobuf;
+
+    // tx buffers not currently queued to the driver
+    eth_fifo_entry_t* tx_free;
+    uint32_t tx_free_count;
+
+    uint64_t tx_queued;
+    uint64_t tx_done;
+    uint64_t rx_echoed;
+    uint64_t rx_other;
+} ethbench_t;
+
+// queues up to 'limit' frames from the free tx buffers
+static mx_status_t send_frames(ethbench_t* eb, uint64_t limit) {
+    uint32_t n = eb->tx_free_count;
+    if (n > limit) {
+        n = limit;
+    }
+    if (n == 0) {
+        return NO_ERROR;
+    }
+    uint32_t actual;
+    eth_fifo_entry_t* e = eb->tx_free + eb->tx_free_count - n;
+    mx_status_t status = mx_fifo_write(eb->tx_fifo, e, sizeof(*e) * n, &actual);
+    if (status < 0) {
+        return (status == ERR_SHOULD_WAIT) ? NO_ERROR : status;
+    }
+    // entries are taken from the end of the free list, so those that
+    // were not written are still at its end
+    memmove(e, e + actual, sizeof(*e) * (n - actual));
+    eb->tx_free_count -= actual;
+    eb->tx_queued += actual;
+    return NO_ERROR;
+}
+
+static mx_status_t reap_tx(ethbench_t* eb) {
+    eth_fifo_entry_t entries[eb->tx_depth];
+    uint32_t n;
+    mx_status_t status;
+    if ((status = mx_fifo_read(eb->tx_fifo, entries, sizeof(entries), &n)) < 0) {
+        return (status == ERR_SHOULD_WAIT) ? NO_ERROR : status;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        if (!(entries[i].flags & ETH_FIFO_TX_OK)) {
+            fprintf(stderr, "ethbench: tx failed (flags %x)\n", entries[i].flags);
+            return ERR_IO;
+        }
+        eb->tx_free[eb->tx_free_count++] = entries[i];
+    }
+    eb->tx_done += n;
+    return NO_ERROR;
+}
+
+static mx_status_t reap_rx(ethbench_t* eb) {
+    eth_fifo_entry_t entries[eb->rx_depth];
+    uint32_t n;
+    mx_status_t status;
+    if ((status = mx_fifo_read(eb->rx_fifo, entries, sizeof(entries), &n)) < 0) {
+        return (status == ERR_SHOULD_WAIT) ? NO_ERROR : status;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        if ((entries[i].flags & (ETH_FIFO_RX_OK | ETH_FIFO_RX_TX)) ==
+            (ETH_FIFO_RX_OK | ETH_FIFO_RX_TX)) {
+            eb->rx_echoed++;
+        } else if (entries[i].flags & ETH_FIFO_RX_OK) {
+            eb->rx_other++;
+        }
+        entries[i].length = BUFSIZE;
+        entries[i].flags = 0;
+    }
+    uint32_t actual;
+    if ((status = mx_fifo_write(eb->rx_fifo, entries, sizeof(entries[0]) * n, &actual)) < 0) {
+        return status;
+    }
+    return (actual == n) ? NO_ERROR : ERR_IO;
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: ethbench <network-device> [packets] [frame-size]\n");
+}
+
+int main(int argc, char** argv) {
+    if ((argc < 2) || (argc > 4)) {
+        usage();
+        return -1;
+    }
+    uint64_t packets = (argc > 2) ? strtoull(argv[2], NULL, 0) : 1000000;
+    size_t frame_size = (argc > 3) ? strtoul(argv[3], NULL, 0) : 64;
+    if ((frame_size < 60) || (frame_size > 1514)) {
+        fprintf(stderr, "ethbench: frame size must be from 60 to 1514 bytes\n");
+        return -1;
+    }
+
+    int fd;
+    if ((fd = open(argv[1], O_RDWR)) < 0) {
+        fprintf(stderr, "ethbench: cannot open '%s'\n", argv[1]);
+        return -1;
+    }
+
+    eth_info_t info;
+    eth_fifos_t fifos;
+    ssize_t r;
+    if ((r = ioctl_ethernet_get_info(fd, &info)) < 0) {
+        fprintf(stderr, "ethbench: failed to get info: %zd\n", r);
+        return -1;
+    }
+    if ((r = ioctl_ethernet_get_fifos(fd, &fifos)) < 0) {
+        fprintf(stderr, "ethbench: failed to get fifos: %zd\n", r);
+        return -1;
+    }
+
+    ethbench_t eb = {
+        .tx_fifo = fifos.tx_fifo,
+        .rx_fifo = fifos.rx_fifo,
+        .tx_depth = fifos.tx_depth,
+        .rx_depth = fifos.rx_depth,
+    };
+    size_t count = eb.tx_depth + eb.rx_depth;
+    uint64_t iosize = count * BUFSIZE;
+    mx_handle_t iovmo;
+    mx_status_t status;
+    // frames are received straight into an io buffer from the device,
+    // and copied into one of our own
+    if (ioctl_ethernet_alloc_iobuf(fd, &iosize, &iovmo) >= 0) {
+        printf("ethbench: receiving into the device's io buffer\n");
+    } else if ((status = mx_vmo_create(iosize, 0, &iovmo)) < 0) {
+        return -1;
+    } else {
+        printf("ethbench: receiving through a copy\n");
+    }
+    if ((status = mx_vmar_map(mx_vmar_root_self(), 0, iovmo, 0, iosize,
+                              MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE,
+                              (uintptr_t*)&eb.iobuf)) < 0) {
+        return -1;
+    }
+    if ((r = ioctl_ethernet_set_iobuf(fd, &iovmo)) < 0) {
+        fprintf(stderr, "ethbench: failed to set iobuf: %zd\n", r);
+        return -1;
+    }
+    if ((eb.tx_free = calloc(eb.tx_depth, sizeof(eth_fifo_entry_t))) == NULL) {
+        return -1;
+    }
+
+    // tx frames are addressed to ourselves, so that a switch does not
+    // flood them, and carry an experimental ethertype
+    for (uint32_t n = 0; n < eb.tx_depth; n++) {
+        uint8_t* frame = eb.iobuf + n * BUFSIZE;
+        memset(frame, 0, frame_size);
+        memcpy(frame, info.mac, sizeof(info.mac));
+        memcpy(frame + sizeof(info.mac), info.mac, sizeof(info.mac));
+        frame[12] = ETHBENCH_ETHERTYPE >> 8;
+        frame[13] = ETHBENCH_ETHERTYPE & 0xff;
+        eth_fifo_entry_t entry = {
+            .offset = n * BUFSIZE,
+            .length = frame_size,
+            .flags = 0,
+            .cookie = NULL,
+        };
+        eb.tx_free[eb.tx_free_count++] = entry;
+    }
+    for (uint32_t n = 0; n < eb.rx_depth; n++) {
+        eth_fifo_entry_t entry = {
+            .offset = (eb.tx_depth + n) * BUFSIZE,
+            .length = BUFSIZE,
+            .flags = 0,
+            .cookie = NULL,
+        };
+        uint32_t actual;
+        if ((status = mx_fifo_write(eb.rx_fifo, &entry, sizeof(entry), &actual)) < 0) {
+            fprintf(stderr, "ethbench: failed to queue rx buffer: %d\n", status);
+            return -1;
+        }
+    }
+
+    if (ioctl_ethernet_start(fd) < 0) {
+        fprintf(stderr, "ethbench: failed to start network interface\n");
+        return -1;
+    }
+    if (ioctl_ethernet_tx_listen_start(fd) < 0) {
+        fprintf(stderr, "ethbench: failed to start listening\n");
+        return -1;
+    }
+
+    mx_time_t start = mx_time_get(MX_CLOCK_MONOTONIC);
+    mx_wait_item_t items[2] = {
+        { .handle = eb.tx_fifo, .waitfor = MX_FIFO_READABLE | MX_FIFO_PEER_CLOSED },
+        { .handle = eb.rx_fifo, .waitfor = MX_FIFO_READABLE | MX_FIFO_PEER_CLOSED },
+    };
+    while ((eb.tx_done < packets) || (eb.rx_echoed < eb.tx_done)) {
+        if ((status = send_frames(&eb, packets - eb.tx_queued)) < 0) {
+            break;
+        }
+        uint64_t progress = eb.tx_done + eb.rx_echoed + eb.rx_other;
+        if (((status = reap_tx(&eb)) < 0) || ((status = reap_rx(&eb)) < 0)) {
+            break;
+        }
+        if (progress != eb.tx_done + eb.rx_echoed + eb.rx_other) {
+            continue;
+        }
+        // echoes which were dropped for lack of rx buffers never arrive,
+        // so stop waiting for them once the link goes quiet
+        status = mx_object_wait_many(items, countof(items),
+                                     (eb.tx_done < packets) ? MX_TIME_INFINITE : MX_MSEC(100));
+        if (status == ERR_TIMED_OUT) {
+            status = NO_ERROR;
+            break;
+        } else if (status < 0) {
+            break;
+        }
+        if ((items[0].pending | items[1].pending) & MX_FIFO_PEER_CLOSED) {
+            status = ERR_PEER_CLOSED;
+            break;
+        }
+    }
+    mx_time_t elapsed = mx_time_get(MX_CLOCK_MONOTONIC) - start;
+    if (status < 0) {
+        fprintf(stderr, "ethbench: failed: %d\n", status);
+    }
+
+    uint64_t usec = elapsed / 1000;
+    if (usec == 0) {
+        usec = 1;
+    }
+    printf("ethbench: %zu byte frames: sent %" PRIu64 " [%" PRIu64 " pps], "
+           "echoed %" PRIu64 " [%" PRIu64 " pps], lost %" PRIu64 "\n",
+           frame_size, eb.tx_done, eb.tx_done * 1000000 / usec,
+           eb.rx_echoed, eb.rx_echoed * 1000000 / usec, eb.tx_done - eb.rx_echoed);
+
+    ioctl_ethernet_stop(fd);
+    close(fd);
+    return (status < 0) ? -1 : 0;
+}
@@ -0,0 +1,507 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Measures throughput between two hosts, in the manner of iperf, over the
+// ethernet fifo interface. The client sends frames at a peer for a fixed
+// time; the server counts what arrives, and both report the rate each
+// interval. Frames are either raw (with an experimental ethertype), or
+// IPv6 UDP datagrams, whose checksums the device computes and verifies
+// when it can, so that offloads can be compared.
+
+#include <inet-checksum/checksum.h>
+#include <magenta/compiler.h>
+#include <magenta/device/ethernet.h>
+#include <magenta/process.h>
+#include <magenta/syscalls.h>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define BUFSIZE 2048
+
+// IEEE 802 local experimental ethertype (ethbench uses the other one)
+#define ETHPERF_ETHERTYPE 0x88b6
+#define ETHPERF_UDP_PORT 5001
+
+#define ETH_HDR_LEN 14
+#define IP6_HDR_LEN 40
+#define UDP_HDR_LEN 8
+
+typedef struct {
+    mx_handle_t tx_fifo;
+    mx_handle_t rx_fifo;
+    uint32_t tx_depth;
+    uint32_t rx_depth;
+    uint8_t* iobuf;
+    eth_info_t info;
+
+    // tx buffers not currently queued to the driver
+    eth_fifo_entry_t* tx_free;
+    uint32_t tx_free_count;
+
+    // options
+    bool udp;
+    size_t frame_size;
+    uint8_t peer[6];
+
+    uint64_t seq;
+    uint64_t bytes;
+    uint64_t frames;
+    uint64_t lost;
+    uint64_t csum_errors;
+} ethperf_t;
+
+// the pseudo-header sum of a UDP datagram in an IPv6 frame
+static uint16_t udp6_pseudo_sum(const uint8_t* frame) {
+    const uint8_t* ip = frame + ETH_HDR_LEN;
+    uint16_t proto = htons(17);
+    uint16_t sum = inet_checksum(ip + 8, 32, 0);
+    sum = inet_checksum(ip + 4, 2, sum);
+    return inet_checksum(&proto, 2, sum);
+}
+
+static void ll6addr_from_mac(uint8_t* ip, const uint8_t* mac) {
+    memset(ip, 0, 16);
+    ip[0] = 0xfe;
+    ip[1] = 0x80;
+    ip[8] = mac[0] ^ 2;
+    ip[9] = mac[1];
+    ip[10] = mac[2];
+    ip[11] = 0xff;
+    ip[12] = 0xfe;
+    ip[13] = mac[3];
+    ip[14] = mac[4];
+    ip[15] = mac[5];
+}
+
+// where the sequence number lives in a frame
+static size_t seq_offset(ethperf_t* ep) {
+    return ep->udp ? (ETH_HDR_LEN + IP6_HDR_LEN + UDP_HDR_LEN) : ETH_HDR_LEN;
+}
+
+static void build_frame(ethperf_t* ep, uint8_t* frame) {
+    memset(frame, 0, ep->frame_size);
+    memcpy(frame, ep->peer, 6);
+    memcpy(frame + 6, ep->info.mac, 6);
+    if (!ep->udp) {
+        frame[12] = ETHPERF_ETHERTYPE >> 8;
+        frame[13] = ETHPERF_ETHERTYPE & 0xff;
+        return;
+    }
+    frame[12] = 0x86;
+    frame[13] = 0xdd;
+
+    uint8_t* ip = frame + ETH_HDR_LEN;
+    size_t len = ep->frame_size - ETH_HDR_LEN - IP6_HDR_LEN;
+    ip[0] = 0x60;
+    ip[4] = (uint8_t)(len >> 8);
+    ip[5] = (uint8_t)len;
+    ip[6] = 17;
+    ip[7] = 255;
+    ll6addr_from_mac(ip + 8, ep->info.mac);
+    ll6addr_from_mac(ip + 24, ep->peer);
+
+    uint8_t* udp = ip + IP6_HDR_LEN;
+    udp[0] = udp[2] = ETHPERF_UDP_PORT >> 8;
+    udp[1] = udp[3] = ETHPERF_UDP_PORT & 0xff;
+    udp[4] = (uint8_t)(len >> 8);
+    udp[5] = (uint8_t)len;
+}
+
+// stamps a frame with the next sequence number, and fills in the UDP
+// checksum (or as much of it as the device leaves to us)
+static uint16_t stamp_frame(ethperf_t* ep, uint8_t* frame) {
+    uint64_t seq = ep->seq++;
+    memcpy(frame + seq_offset(ep), &seq, sizeof(seq));
+    if (!ep->udp) {
+        return 0;
+    }
+    // checksums are in network order, as they lie in the frame
+    uint8_t* udp = frame + ETH_HDR_LEN + IP6_HDR_LEN;
+    uint16_t sum = udp6_pseudo_sum(frame);
+    if (ep->info.features & ETH_FEATURE_TX_CSUM) {
+        memcpy(udp + 6, &sum, sizeof(sum));
+        return ETH_FIFO_TX_CSUM;
+    }
+    memset(udp + 6, 0, sizeof(sum));
+    sum = ~inet_checksum(udp, ep->frame_size - ETH_HDR_LEN - IP6_HDR_LEN, sum);
+    if (sum == 0) {
+        sum = 0xffff;
+    }
+    memcpy(udp + 6, &sum, sizeof(sum));
+    return 0;
+}
+
+// accounts for a received frame, if it is one of ours
+static void count_frame(ethperf_t* ep, const uint8_t* frame, size_t len, uint32_t flags) {
+    if (len < ETH_HDR_LEN + sizeof(uint64_t)) {
+        return;
+    }
+    uint16_t type = (uint16_t)((frame[12] << 8) | frame[13]);
+    size_t off = ETH_HDR_LEN;
+    if (type == 0x86dd) {
+        const uint8_t* ip = frame + ETH_HDR_LEN;
+        const uint8_t* udp = ip + IP6_HDR_LEN;
+        off = ETH_HDR_LEN + IP6_HDR_LEN + UDP_HDR_LEN;
+        if ((len < off + sizeof(uint64_t)) || (ip[6] != 17) ||
+            (((udp[2] << 8) | udp[3]) != ETHPERF_UDP_PORT)) {
+            return;
+        }
+        size_t ulen = (size_t)((ip[4] << 8) | ip[5]);
+        if (ulen > len - ETH_HDR_LEN - IP6_HDR_LEN) {
+            return;
+        }
+        if (!(flags & ETH_FIFO_RX_CSUM_OK) &&
+            (inet_checksum(udp, ulen, udp6_pseudo_sum(frame)) != 0xffff)) {
+            ep->csum_errors++;
+            return;
+        }
+    } else if (type != ETHPERF_ETHERTYPE) {
+        return;
+    }
+
+    uint64_t seq;
+    memcpy(&seq, frame + off, sizeof(seq));
+    if (seq > ep->seq) {
+        ep->lost += seq - ep->seq;
+    }
+    if (seq >= ep->seq) {
+        ep->seq = seq + 1;
+    }
+    ep->bytes += len;
+    ep->frames++;
+}
+
+static mx_status_t send_frames(ethperf_t* ep) {
+    uint32_t n = ep->tx_free_count;
+    if (n == 0) {
+        return NO_ERROR;
+    }
+    eth_fifo_entry_t* e = ep->tx_free;
+    for (uint32_t i = 0; i < n; i++) {
+        e[i].flags = stamp_frame(ep, ep->iobuf + e[i].offset);
+    }
+    uint32_t actual;
+    mx_status_t status = mx_fifo_write(ep->tx_fifo, e, sizeof(*e) * n, &actual);
+    if (status < 0) {
+        actual = 0;
+        if (status != ERR_SHOULD_WAIT) {
+            return status;
+        }
+    }
+    // the frames which did not fit are sent again, with the same numbers
+    ep->seq -= n - actual;
+    memmove(e, e + actual, sizeof(*e) * (n - actual));
+    ep->tx_free_count -= actual;
+    return NO_ERROR;
+}
+
+static mx_status_t reap_tx(ethperf_t* ep) {
+    eth_fifo_entry_t entries[ep->tx_depth];
+    uint32_t n;
+    mx_status_t status;
+    if ((status = mx_fifo_read(ep->tx_fifo, entries, sizeof(entries), &n)) < 0) {
+        return (status == ERR_SHOULD_WAIT) ? NO_ERROR : status;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        if (!(entries[i].flags & ETH_FIFO_TX_OK)) {
+            fprintf(stderr, "ethperf: tx failed (flags %x)\n", entries[i].flags);
+            return ERR_IO;
+        }
+        ep->bytes += entries[i].length;
+        ep->frames++;
+        ep->tx_free[ep->tx_free_count++] = entries[i];
+    }
+    return NO_ERROR;
+}
+
+static mx_status_t reap_rx(ethperf_t* ep) {
+    eth_fifo_entry_t entries[ep->rx_depth];
+    uint32_t n;
+    mx_status_t status;
+    if ((status = mx_fifo_read(ep->rx_fifo, entries, sizeof(entries), &n)) < 0) {
+        return (status == ERR_SHOULD_WAIT) ? NO_ERROR : status;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        if (entries[i].flags & ETH_FIFO_RX_OK) {
+            count_frame(ep, ep->iobuf + entries[i].offset, entries[i].length, entries[i].flags);
+        }
+        entries[i].length = BUFSIZE;
+        entries[i].flags = 0;
+    }
+    uint32_t actual;
+    if ((status = mx_fifo_write(ep->rx_fifo, entries, sizeof(entries[0]) * n, &actual)) < 0) {
+        return status;
+    }
+    return (actual == n) ? NO_ERROR : ERR_IO;
+}
+
+static mx_status_t ethperf_open(ethperf_t* ep, const char* dev, int* out) {
+    int fd;
+    if ((fd = open(dev, O_RDWR)) < 0) {
+        fprintf(stderr, "ethperf: cannot open '%s'\n", dev);
+        return ERR_IO;
+    }
+
+    eth_fifos_t fifos;
+    ssize_t r;
+    if ((r = ioctl_ethernet_get_info(fd, &ep->info)) < 0) {
+        fprintf(stderr, "ethperf: failed to get info: %zd\n", r);
+        return (mx_status_t)r;
+    }
+    if ((r = ioctl_ethernet_get_fifos(fd, &fifos)) < 0) {
+        fprintf(stderr, "ethperf: failed to get fifos: %zd\n", r);
+        return (mx_status_t)r;
+    }
+    ep->tx_fifo = fifos.tx_fifo;
+    ep->rx_fifo = fifos.rx_fifo;
+    ep->tx_depth = fifos.tx_depth;
+    ep->rx_depth = fifos.rx_depth;
+
+    size_t count = ep->tx_depth + ep->rx_depth;
+    mx_handle_t iovmo;
+    mx_status_t status;
+    if ((status = mx_vmo_create(count * BUFSIZE, 0, &iovmo)) < 0) {
+        return status;
+    }
+    if ((status = mx_vmar_map(mx_vmar_root_self(), 0, iovmo, 0, count * BUFSIZE,
+                              MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE,
+                              (uintptr_t*)&ep->iobuf)) < 0) {
+        return status;
+    }
+    if ((r = ioctl_ethernet_set_iobuf(fd, &iovmo)) < 0) {
+        fprintf(stderr, "ethperf: failed to set iobuf: %zd\n", r);
+        return (mx_status_t)r;
+    }
+    if ((ep->tx_free = calloc(ep->tx_depth, sizeof(eth_fifo_entry_t))) == NULL) {
+        return ERR_NO_MEMORY;
+    }
+    for (uint32_t n = 0; n < ep->tx_depth; n++) {
+        eth_fifo_entry_t entry = {
+            .offset = n * BUFSIZE,
+            .length = ep->frame_size,
+            .flags = 0,
+            .cookie = NULL,
+        };
+        ep->tx_free[ep->tx_free_count++] = entry;
+    }
+    for (uint32_t n = 0; n < ep->rx_depth; n++) {
+        eth_fifo_entry_t entry = {
+            .offset = (ep->tx_depth + n) * BUFSIZE,
+            .length = BUFSIZE,
+            .flags = 0,
+            .cookie = NULL,
+        };
+        uint32_t actual;
+        if ((status = mx_fifo_write(ep->rx_fifo, &entry, sizeof(entry), &actual)) < 0) {
+            fprintf(stderr, "ethperf: failed to queue rx buffer: %d\n", status);
+            return status;
+        }
+    }
+
+    if (ioctl_ethernet_start(fd) < 0) {
+        fprintf(stderr, "ethperf: failed to start network interface\n");
+        return ERR_IO;
+    }
+    *out = fd;
+    return NO_ERROR;
+}
+
+static void report(const char* what, uint64_t bytes, uint64_t frames, mx_time_t from, mx_time_t to) {
+    double secs = (double)(to - from) / 1e9;
+    if (secs <= 0) {
+        return;
+    }
+    printf("[%6.1f-%6.1f sec] %s %10" PRIu64 " bytes %8" PRIu64 " frames %9.2f Mbits/sec\n",
+           (double)from / 1e9, (double)to / 1e9, what, bytes, frames, (double)bytes * 8 / secs / 1e6);
+}
+
+static mx_status_t run_client(ethperf_t* ep, mx_time_t duration, mx_time_t interval) {
+    for (uint32_t n = 0; n < ep->tx_depth; n++) {
+        build_frame(ep, ep->iobuf + n * BUFSIZE);
+    }
+    printf("ethperf: sending %zu byte %s frames for %" PRIu64 " sec%s\n", ep->frame_size,
+           ep->udp ? "udp" : "raw", duration / MX_SEC(1),
+           (ep->udp && (ep->info.features & ETH_FEATURE_TX_CSUM)) ? " (checksum offload)" : "");
+
+    mx_time_t start = mx_time_get(MX_CLOCK_MONOTONIC);
+    mx_time_t end = start + duration;
+    mx_time_t last = start;
+    uint64_t last_bytes = 0;
+    uint64_t last_frames = 0;
+    mx_status_t status = NO_ERROR;
+    for (;;) {
+        mx_time_t now = mx_time_get(MX_CLOCK_MONOTONIC);
+        if ((now >= last + interval) || (now >= end)) {
+            report("sent", ep->bytes - last_bytes, ep->frames - last_frames,
+                   last - start, now - start);
+            last = now;
+            last_bytes = ep->bytes;
+            last_frames = ep->frames;
+        }
+        if (now >= end) {
+            break;
+        }
+        if (((status = send_frames(ep)) < 0) || ((status = reap_tx(ep)) < 0) ||
+            ((status = reap_rx(ep)) < 0)) {
+            break;
+        }
+        if (ep->tx_free_count == 0) {
+            status = mx_object_wait_one(ep->tx_fifo, MX_FIFO_READABLE | MX_FIFO_PEER_CLOSED,
+                                        MX_MSEC(10), NULL);
+            if ((status < 0) && (status != ERR_TIMED_OUT)) {
+                break;
+            }
+            status = NO_ERROR;
+        }
+    }
+    report("total", ep->bytes, ep->frames, 0, mx_time_get(MX_CLOCK_MONOTONIC) - start);
+    return status;
+}
+
+static mx_status_t run_server(ethperf_t* ep, mx_time_t duration, mx_time_t interval) {
+    printf("ethperf: listening for frames from any peer%s\n",
+           (ep->info.features & ETH_FEATURE_RX_CSUM) ? " (checksum offload)" : "");
+
+    mx_time_t origin = mx_time_get(MX_CLOCK_MONOTONIC);
+    mx_time_t start = 0;
+    mx_time_t last = 0;
+    mx_time_t active = 0;
+    uint64_t last_bytes = 0;
+    uint64_t last_frames = 0;
+    mx_status_t status = NO_ERROR;
+    for (;;) {
+        mx_time_t now = mx_time_get(MX_CLOCK_MONOTONIC);
+        if ((duration != 0) && (now >= origin + duration)) {
+            break;
+        }
+        status = mx_object_wait_one(ep->rx_fifo, MX_FIFO_READABLE | MX_FIFO_PEER_CLOSED,
+                                    MX_MSEC(100), NULL);
+        if ((status < 0) && (status != ERR_TIMED_OUT)) {
+            break;
+        }
+        uint64_t frames = ep->frames;
+        if ((status = reap_rx(ep)) < 0) {
+            break;
+        }
+        now = mx_time_get(MX_CLOCK_MONOTONIC);
+        if (ep->frames != frames) {
+            if (start == 0) {
+                // a new run: count from its first frame
+                start = last = now;
+            }
+            active = now;
+        }
+        if (start == 0) {
+            continue;
+        }
+        if (now >= last + interval) {
+            report("received", ep->bytes - last_bytes, ep->frames - last_frames,
+                   last - start, now - start);
+            last = now;
+            last_bytes = ep->bytes;
+            last_frames = ep->frames;
+        }
+        // a run ends once the sender has been quiet for a second
+        if (now >= active + MX_SEC(1)) {
+            report("total", ep->bytes, ep->frames, 0, active - start);
+            printf("ethperf: lost %" PRIu64 " frames, %" PRIu64 " checksum errors\n",
+                   ep->lost, ep->csum_errors);
+            ep->bytes = ep->frames = ep->lost = ep->csum_errors = 0;
+            ep->seq = 0;
+            start = 0;
+            last_bytes = last_frames = 0;
+        }
+    }
+    return status;
+}
+
+static void usage(void) {
+    fprintf(stderr,
+            "usage: ethperf -s [options] <network-device>\n"
+            "       ethperf -c <peer-mac> [options] <network-device>\n"
+            "options:\n"
+            "  -t <sec>    time to send for (client) or listen for (server, default forever)\n"
+            "  -i <sec>    seconds between reports (default 1)\n"
+            "  -l <bytes>  frame size, from 64 to 1514 (client, default 1514)\n"
+            "  -u          send IPv6 UDP frames, rather than raw ones (client)\n");
+}
+
+int main(int argc, char** argv) {
+    ethperf_t ep = {
+        .frame_size = 1514,
+    };
+    bool server = false;
+    bool client = false;
+    mx_time_t duration = 0;
+    mx_time_t interval = MX_SEC(1);
+    const char* dev = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        const char* val = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (!strcmp(arg, "-s")) {
+            server = true;
+        } else if (!strcmp(arg, "-u")) {
+            ep.udp = true;
+        } else if (!strcmp(arg, "-c") && val) {
+            if (sscanf(val, "%hhx:%hhx:%hhx:%hhx:%hhx:%hhx", &ep.peer[0], &ep.peer[1],
+                       &ep.peer[2], &ep.peer[3], &ep.peer[4], &ep.peer[5]) != 6) {
+                fprintf(stderr, "ethperf: bad mac address '%s'\n", val);
+                return -1;
+            }
+            client = true;
+            i++;
+        } else if (!strcmp(arg, "-t") && val) {
+            duration = MX_SEC(strtoull(val, NULL, 0));
+            i++;
+        } else if (!strcmp(arg, "-i") && val) {
+            interval = MX_SEC(strtoull(val, NULL, 0));
+            i++;
+        } else if (!strcmp(arg, "-l") && val) {
+            ep.frame_size = strtoul(val, NULL, 0);
+            i++;
+        } else if ((arg[0] != '-') && (dev == NULL)) {
+            dev = arg;
+        } else {
+            usage();
+            return -1;
+        }
+    }
+    if ((server == client) || (dev == NULL) || (interval == 0)) {
+        usage();
+        return -1;
+    }
+    if ((ep.frame_size < 64) || (ep.frame_size > 1514)) {
+        fprintf(stderr, "ethperf: frame size must be from 64 to 1514 bytes\n");
+        return -1;
+    }
+    if (client && (duration == 0)) {
+        duration = MX_SEC(10);
+    }
+
+    int fd;
+    mx_status_t status;
+    if ((status = ethperf_open(&ep, dev, &fd)) < 0) {
+        return -1;
+    }
+    if (client) {
+        status = run_client(&ep, duration, interval);
+    } else {
+        status = run_server(&ep, duration, interval);
+    }
+    if (status < 0) {
+        fprintf(stderr, "ethperf: failed: %d\n", status);
+    }
+
+    ioctl_ethernet_stop(fd);
+    close(fd);
+    return (status < 0) ? -1 : 0;
+}
@@ -13,14 +13,132 @@
 #include <mxtl/ref_ptr.h>
 #include <mxtl/unique_ptr.h>
 
+#ifdef __Fuchsia__
+#include <magenta/syscalls.h>
+#endif
+
 #include "minfs.h"
 #include "minfs-private.h"
 
 namespace minfs {
 
+#ifdef __Fuchsia__
+mx_status_t Bcache::Readblk(uint32_t bno, void* data) {
+    trace(IO, "readblk() bno=%u\n", bno);
+    if (JournalRead(bno, data)) {
+        return NO_ERROR;
+    }
+    block_fifo_request_t request;
+    request.txnid = txnid_;
+    request.vmoid = blk_vmoid_;
+    request.opcode = BLOCKIO_READ;
+    request.length = kMinfsBlockSize;
+    request.vmo_offset = 0;
+    request.dev_offset = static_cast<uint64_t>(bno) * kMinfsBlockSize;
+    if (block_fifo_txn(fifo_client_, &request, 1) != NO_ERROR) {
+        error("minfs: cannot read block %u\n", bno);
+        return ERR_IO;
+    }
+    memcpy(data, blk_vmo_->GetData(), kMinfsBlockSize);
+    return NO_ERROR;
+}
+
+mx_status_t Bcache::Writeblk(uint32_t bno, const void* data) {
+    trace(IO, "writeblk() bno=%u\n", bno);
+    memcpy(blk_vmo_->GetData(), data, kMinfsBlockSize);
+    block_fifo_request_t request;
+    request.txnid = txnid_;
+    request.vmoid = blk_vmoid_;
+    request.opcode = BLOCKIO_WRITE;
+    request.length = kMinfsBlockSize;
+    request.vmo_offset = 0;
+    request.dev_offset = static_cast<uint64_t>(bno) * kMinfsBlockSize;
+    if (block_fifo_txn(fifo_client_, &request, 1) != NO_ERROR) {
+        error("minfs: cannot write block %u\n", bno);
+        return ERR_IO;
+    }
+    return NO_ERROR;
+}
+
+mx_status_t Bcache::AttachVmo(mx_handle_t vmo, vmoid_t* out) {
+    mx_handle_t xfer_vmo;
+    mx_status_t status = mx_handle_duplicate(vmo, MX_RIGHT_SAME_RIGHTS, &xfer_vmo);
+    if (status != NO_ERROR) {
+        return status;
+    }
+    ssize_t r = ioctl_block_attach_vmo(fd_, &xfer_vmo, out);
+    if (r < 0) {
+        mx_handle_close(xfer_vmo);
+        return static_cast<mx_status_t>(r);
+    }
+    return NO_ERROR;
+}
+
+mx_status_t Bcache::DetachVmo(vmoid_t vmoid) {
+    block_fifo_request_t request;
+    request.txnid = txnid_;
+    request.vmoid = vmoid;
+    request.opcode = BLOCKIO_CLOSE_VMO;
+    return block_fifo_txn(fifo_client_, &request, 1);
+}
+
+mx_status_t Bcache::Flush() {
+    trace(IO, "flush()\n");
+    block_fifo_request_t request;
+    request.txnid = txnid_;
+    request.vmoid = blk_vmoid_;
+    request.opcode = BLOCKIO_SYNC;
+    request.length = 0;
+    request.vmo_offset = 0;
+    request.dev_offset = 0;
+    if (block_fifo_txn(fifo_client_, &request, 1) != NO_ERROR) {
+        error("minfs: cannot flush device\n");
+        return ERR_IO;
+    }
+    return NO_ERROR;
+}
+
+mx_status_t Bcache::Txn(block_fifo_request_t* requests, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        requests[i].txnid = txnid_;
+        trace(IO, "txn() op=%u len=%#llx vmo_off=%#llx dev_off=%#llx\n",
+              requests[i].opcode, (unsigned long long)requests[i].length,
+              (unsigned long long)requests[i].vmo_offset,
+              (unsigned long long)requests[i].dev_offset);
+    }
+    return block_fifo_txn(fifo_client_, requests, count);
+}
+
+mx_status_t Bcache::InitFifo() {
+    mx_handle_t fifo;
+    ssize_t r;
+    if ((r = ioctl_block_get_fifos(fd_, &fifo)) < 0) {
+        error("minfs: cannot acquire block fifo\n");
+        return static_cast<mx_status_t>(r);
+    }
+    if ((r = ioctl_block_alloc_txn(fd_, &txnid_)) < 0) {
+        mx_handle_close(fifo);
+        ioctl_block_fifo_close(fd_);
+        return static_cast<mx_status_t>(r);
+    }
+    mx_status_t status;
+    if ((status = block_fifo_create_client(fifo, &fifo_client_)) != NO_ERROR) {
+        mx_handle_close(fifo);
+        ioctl_block_fifo_close(fd_);
+        return status;
+    }
+    if ((status = MappedVmo::Create(kMinfsBlockSize, &blk_vmo_)) != NO_ERROR) {
+        return status;
+    }
+    return AttachVmo(blk_vmo_->GetVmo(), &blk_vmoid_);
+}
+#else
 mx_status_t Bcache::Readblk(uint32_t bno, void* data) {
     off_t off = bno * kMinfsBlockSize;
     trace(IO, "readblk() bno=%u off=%#llx\n", bno, (unsigned long long)off);
+    if (JournalRead(bno, data)) {
+        return NO_ERROR;
+    }
     if (lseek(fd_, off, SEEK_SET) < 0) {
         error("minfs: cannot seek to block %u\n", bno);
         return ERR_IO;
@@ -45,6 +163,7 @@ mx_status_t Bcache::Writeblk(uint32_t bno, const void* data) {
     }
     return NO_ERROR;
 }
+#endif
 
 constexpr uint32_t kModeFind = 0;
 constexpr uint32_t kModeLoad = 1;
@@ -132,7 +251,7 @@ void Bcache::Put(mxtl::RefPtr<BlockNode> blk, uint32_t flags) {
     // remove from busy list
     lists_.Erase(blk, kBlockBusy);
     if ((flags | blk->flags_) & kBlockDirty) {
-        if (Writeblk(blk->bno_, blk->data()) < 0) {
+        if (Log(blk->bno_, blk->data()) < 0) {
             error("block write error!\n");
         }
         blk->flags_ &= ~kBlockDirty;
@@ -172,7 +291,58 @@ mx_status_t Bcache::Write(uint32_t bno, const void* data, uint32_t off, uint32_t
     }
 }
 
+mx_status_t Bcache::JournalInit(uint32_t start, uint32_t blocks) {
+    if (journal_ != nullptr) {
+        return NO_ERROR;
+    }
+    return Journal::Create(this, start, blocks, &journal_);
+}
+
+mx_status_t Bcache::Log(uint32_t bno, const void* data) {
+    if (journal_ == nullptr) {
+        return Writeblk(bno, data);
+    }
+    mx_status_t status = journal_->Log(bno, data);
+    if ((status == NO_ERROR) && (op_depth_ == 0)) {
+        // Not part of any operation; commit it on its own.
+        status = journal_->Commit();
+    }
+    return status;
+}
+
+mx_status_t Bcache::Forget(uint32_t bno) {
+    // Drop any cached copy, so that a later Get reads the block's new
+    // contents rather than what it held before it was freed.
+    mxtl::RefPtr<BlockNode> blk = hash_.find(bno).CopyPointer();
+    if ((blk != nullptr) && !(blk->flags_ & kBlockBusy)) {
+        lists_.Erase(blk, kBlockLRU);
+        hash_.erase(*blk);
+        lists_.PushBack(mxtl::move(blk), kBlockFree);
+    }
+    if (journal_ == nullptr) {
+        return NO_ERROR;
+    }
+    mx_status_t status = journal_->Forget(bno);
+    if ((status == NO_ERROR) && (op_depth_ == 0)) {
+        // Not part of any operation; commit the revocation on its own.
+        status = journal_->Commit();
+    }
+    return status;
+}
+
+void Bcache::EndOp() {
+    assert(op_depth_ > 0);
+    if ((--op_depth_ == 0) && (journal_ != nullptr)) {
+        if (journal_->Commit() != NO_ERROR) {
+            error("minfs: failed to commit transaction\n");
+        }
+    }
+}
+
 int Bcache::Sync() {
+    if ((journal_ != nullptr) && (journal_->Commit() != NO_ERROR)) {
+        return ERR_IO;
+    }
     return fsync(fd_);
 }
 
@@ -190,17 +360,51 @@ mx_status_t Bcache::Create(Bcache** out, int fd, uint32_t blockmax, uint32_t blo
         }
         num--;
     }
+#ifdef __Fuchsia__
+    mx_status_t status;
+    if ((status = bc->InitFifo()) != NO_ERROR) {
+        return status;
+    }
+#endif
     *out = bc.release();
     return NO_ERROR;
 }
 
 int Bcache::Close() {
+    if ((journal_ != nullptr) && journal_->Dirty()) {
+        if ((journal_->Commit() != NO_ERROR) || (journal_->Checkpoint() != NO_ERROR)) {
+            error("minfs: failed to write back journal\n");
+        }
+    }
+    journal_.reset();
+#ifdef __Fuchsia__
+    if (fifo_client_ != nullptr) {
+        block_fifo_release_client(fifo_client_);
+        ioctl_block_fifo_close(fd_);
+        fifo_client_ = nullptr;
+    }
+#endif
     return close(fd_);
 }
 
+#ifdef __Fuchsia__
 Bcache::Bcache(int fd, uint32_t blockmax, uint32_t blocksize) :
-    fd_(fd), blockmax_(blockmax), blocksize_(blocksize) {}
-Bcache::~Bcache() {}
+    fd_(fd), blockmax_(blockmax), blocksize_(blocksize), op_depth_(0), fifo_client_(nullptr) {}
+#else
+Bcache::Bcache(int fd, uint32_t blockmax, uint32_t blocksize) :
+    fd_(fd), blockmax_(blockmax), blocksize_(blocksize), op_depth_(0) {}
+#endif
+
+Bcache::~Bcache() {
+#ifdef __Fuchsia__
+    // Only still held if InitFifo failed part way, or Close was never called;
+    // left attached, the fifo would make the next mount of the device fail.
+    if (fifo_client_ != nullptr) {
+        block_fifo_release_client(fifo_client_);
+        ioctl_block_fifo_close(fd_);
+    }
+#endif
+}
 
 size_t BcacheLists::SizeAllSlow() const {
     return list_busy_.size_slow() + list_lru_.size_slow() + list_free_.size_slow();
@@ -0,0 +1,128 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <magenta/new.h>
+
+#include "minfs-private.h"
+
+namespace minfs {
+namespace {
+
+constexpr uint32_t kDirIndexBucketsMin = 64;
+constexpr uint32_t kDirIndexBucketsMax = 1 << 16;
+
+} // namespace anonymous
+
+DirIndex::DirIndex() : ino_(0), append_off_(), bucket_count_(0), used_count_(0) {}
+
+DirIndex::~DirIndex() {
+    // Unlink every record from its bucket before the tree frees it.
+    for (uint32_t i = 0; i < bucket_count_; i++) {
+        buckets_[i].clear();
+    }
+}
+
+mx_status_t DirIndex::Create(mxtl::unique_ptr<DirIndex>* out) {
+    AllocChecker ac;
+    mxtl::unique_ptr<DirIndex> index(new (&ac) DirIndex());
+    if (!ac.check()) {
+        return ERR_NO_MEMORY;
+    }
+    mx_status_t status;
+    if ((status = index->Grow()) != NO_ERROR) {
+        return status;
+    }
+    *out = mxtl::move(index);
+    return NO_ERROR;
+}
+
+mx_status_t DirIndex::Grow() {
+    uint32_t count = bucket_count_ ? bucket_count_ * 2 : kDirIndexBucketsMin;
+    AllocChecker ac;
+    mxtl::unique_ptr<mxtl::DoublyLinkedList<DirRecord*>[]>
+            buckets(new (&ac) mxtl::DoublyLinkedList<DirRecord*>[count]);
+    if (!ac.check()) {
+        return ERR_NO_MEMORY;
+    }
+    for (uint32_t i = 0; i < bucket_count_; i++) {
+        while (!buckets_[i].is_empty()) {
+            DirRecord* rec = buckets_[i].pop_front();
+            buckets[rec->hash & (count - 1)].push_front(rec);
+        }
+    }
+    buckets_ = mxtl::move(buckets);
+    bucket_count_ = count;
+    return NO_ERROR;
+}
+
+mx_status_t DirIndex::Insert(uint32_t off, const char* name, size_t len) {
+    DirRecord* rec;
+    auto iter = records_.find(off);
+    if (iter.IsValid()) {
+        rec = &(*iter);
+        if (rec->used) {
+            Bucket(rec->hash).erase(*rec);
+            used_count_--;
+        }
+    } else {
+        AllocChecker ac;
+        mxtl::unique_ptr<DirRecord> r(new (&ac) DirRecord());
+        if (!ac.check()) {
+            return ERR_NO_MEMORY;
+        }
+        r->off = off;
+        rec = r.get();
+        records_.insert(mxtl::move(r));
+    }
+
+    rec->used = (len != 0);
+    if (rec->used) {
+        if ((used_count_ >= bucket_count_ * 4) && (bucket_count_ < kDirIndexBucketsMax)) {
+            mx_status_t status;
+            if ((status = Grow()) != NO_ERROR) {
+                rec->used = false;
+                return status;
+            }
+        }
+        rec->hash = Hash(name, len);
+        Bucket(rec->hash).push_front(rec);
+        used_count_++;
+    }
+    return NO_ERROR;
+}
+
+void DirIndex::Release(uint32_t off) {
+    auto iter = records_.find(off);
+    if (iter.IsValid() && iter->used) {
+        Bucket(iter->hash).erase(*iter);
+        iter->used = false;
+        used_count_--;
+    }
+}
+
+void DirIndex::Remove(uint32_t off) {
+    Release(off);
+    records_.erase(off);
+}
+
+uint32_t DirIndex::Prev(uint32_t off) const {
+    auto iter = records_.find(off);
+    if (!iter.IsValid() || (iter == records_.begin())) {
+        return off;
+    }
+    return (--iter)->off;
+}
+
+DirRecord* DirIndex::Find(uint32_t hash, DirRecord* rec) {
+    mxtl::DoublyLinkedList<DirRecord*>& bucket = Bucket(hash);
+    auto iter = (rec == nullptr) ? bucket.begin() : ++bucket.make_iterator(*rec);
+    for (; iter != bucket.end(); ++iter) {
+        if (iter->hash == hash) {
+            return &(*iter);
+        }
+    }
+    return nullptr;
+}
+
+} // namespace minfs
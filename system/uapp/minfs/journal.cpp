@@ -0,0 +1,350 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fs/trace.h>
+#include <magenta/new.h>
+#include <mxtl/algorithm.h>
+
+#include "minfs.h"
+#include "minfs-private.h"
+
+namespace minfs {
+namespace {
+
+// FNV-1a, a word at a time (folding the high half of the state back into
+// the low half, since the multiply only carries upwards). 'len' must be a
+// multiple of the word size.
+uint64_t checksum_update(uint64_t n, const void* ptr, size_t len) {
+    const uint64_t* data = static_cast<const uint64_t*>(ptr);
+    for (size_t i = 0; i < len / sizeof(uint64_t); i++) {
+        n = (n ^ data[i]) * FNV64_PRIME;
+        n ^= n >> 32;
+    }
+    return n;
+}
+
+} // namespace anonymous
+
+Journal::Journal(Bcache* bc, uint32_t start, uint32_t blocks) :
+    bc_(bc), start_(start), blocks_(blocks), head_(1), seq_(0),
+    max_txn_(mxtl::min(kMinfsJournalEntries, blocks - 2)), dirty_(false),
+    revoked_count_(0), buffer_(nullptr) {}
+
+Journal::~Journal() {
+#ifdef __Fuchsia__
+    if (vmo_ != nullptr) {
+        bc_->DetachVmo(vmoid_);
+    }
+#endif
+}
+
+mx_status_t Journal::Create(Bcache* bc, uint32_t start, uint32_t blocks,
+                            mxtl::unique_ptr<Journal>* out) {
+    AllocChecker ac;
+    mxtl::unique_ptr<Journal> journal(new (&ac) Journal(bc, start, blocks));
+    if (!ac.check()) {
+        return ERR_NO_MEMORY;
+    }
+
+    mx_status_t status;
+#ifdef __Fuchsia__
+    if ((status = MappedVmo::Create(blocks * kMinfsBlockSize, &journal->vmo_)) != NO_ERROR) {
+        return status;
+    } else if ((status = bc->AttachVmo(journal->vmo_->GetVmo(), &journal->vmoid_)) != NO_ERROR) {
+        journal->vmo_.reset();
+        return status;
+    }
+    journal->buffer_ = journal->vmo_->GetData();
+#else
+    journal->data_.reset(static_cast<char*>(malloc(blocks * kMinfsBlockSize)));
+    if (journal->data_ == nullptr) {
+        return ERR_NO_MEMORY;
+    }
+    journal->buffer_ = journal->data_.get();
+#endif
+
+    if ((status = journal->Replay()) != NO_ERROR) {
+        return status;
+    }
+    *out = mxtl::move(journal);
+    return NO_ERROR;
+}
+
+mx_status_t Journal::Replay() {
+    mx_status_t status;
+#ifdef __Fuchsia__
+    ReadTxn txn(bc_);
+    txn.Enqueue(vmoid_, 0, start_, blocks_);
+    if ((status = txn.Flush()) != NO_ERROR) {
+        error("minfs: cannot read journal\n");
+        return status;
+    }
+#else
+    for (uint32_t n = 0; n < blocks_; n++) {
+        if ((status = bc_->Readblk(start_ + n, Slot(n))) != NO_ERROR) {
+            return status;
+        }
+    }
+#endif
+
+    const minfs_journal_info_t* info = static_cast<const minfs_journal_info_t*>(Slot(0));
+    if (info->magic != kMinfsJournalMagic) {
+        error("minfs: bad journal magic\n");
+        return ERR_INVALID_ARGS;
+    }
+    seq_ = info->seq;
+
+    // Records are replayed for as long as each follows on from the last. The
+    // first which does not was either left over from before the last
+    // checkpoint, or torn by a crash.
+    uint32_t replayed = 0;
+    while (head_ < blocks_) {
+        minfs_journal_record_t* rec = static_cast<minfs_journal_record_t*>(Slot(head_));
+        if ((rec->magic != kMinfsJournalRecordMagic) || (rec->seq != seq_) ||
+            (rec->count + rec->revoked == 0) || (rec->count > max_txn_) ||
+            (rec->revoked > kMinfsJournalEntries - rec->count) ||
+            (rec->count > blocks_ - head_ - 1)) {
+            break;
+        }
+        uint64_t checksum = rec->checksum;
+        rec->checksum = 0;
+        if (Checksum(head_) != checksum) {
+            warn("minfs: journal record %llu is torn\n", (unsigned long long)seq_);
+            break;
+        }
+        bool valid = true;
+        for (uint32_t i = 0; i < rec->count + rec->revoked; i++) {
+            valid &= (rec->bno[i] < bc_->Maxblk());
+        }
+        if (!valid) {
+            error("minfs: journal record %llu is invalid\n", (unsigned long long)seq_);
+            break;
+        }
+
+        for (uint32_t i = 0; i < rec->revoked; i++) {
+            committed_.erase(rec->bno[rec->count + i]);
+        }
+        for (uint32_t i = 0; i < rec->count; i++) {
+            auto iter = committed_.find(rec->bno[i]);
+            if (iter.IsValid()) {
+                memcpy(iter->data, Slot(head_ + 1 + i), kMinfsBlockSize);
+                continue;
+            }
+            AllocChecker ac;
+            mxtl::unique_ptr<JournalBlock> blk(new (&ac) JournalBlock());
+            if (!ac.check()) {
+                return ERR_NO_MEMORY;
+            }
+            blk->bno = rec->bno[i];
+            memcpy(blk->data, Slot(head_ + 1 + i), kMinfsBlockSize);
+            committed_.insert(mxtl::move(blk));
+        }
+        head_ += 1 + rec->count;
+        seq_++;
+        replayed++;
+    }
+    if (replayed > 0) {
+        trace(MINFS, "journal: replayed %u records (%zu blocks)\n", replayed, committed_.size());
+    }
+    return NO_ERROR;
+}
+
+uint64_t Journal::Checksum(uint32_t n) const {
+    const minfs_journal_record_t* rec = static_cast<const minfs_journal_record_t*>(Slot(n));
+    // The checksum covers the header (excluding the checksum itself) and
+    // every block in the record.
+    uint64_t checksum = checksum_update(FNV64_OFFSET_BASIS, rec,
+                                        offsetof(minfs_journal_record_t, checksum));
+    return checksum_update(checksum, &rec->count,
+                           kMinfsBlockSize * (1 + rec->count) -
+                           offsetof(minfs_journal_record_t, count));
+}
+
+mx_status_t Journal::WriteSlots(uint32_t n, uint32_t count) {
+#ifdef __Fuchsia__
+    WriteTxn txn(bc_);
+    txn.Enqueue(vmoid_, n, start_ + n, count);
+    return txn.Flush();
+#else
+    for (uint32_t i = n; i < n + count; i++) {
+        mx_status_t status;
+        if ((status = bc_->Writeblk(start_ + i, Slot(i))) != NO_ERROR) {
+            return status;
+        }
+    }
+    return NO_ERROR;
+#endif
+}
+
+mx_status_t Journal::Log(uint32_t bno, const void* data) {
+    auto iter = txn_.find(bno);
+    if (iter.IsValid()) {
+        memcpy(iter->data, data, kMinfsBlockSize);
+        return NO_ERROR;
+    }
+
+    mx_status_t status;
+    if (txn_.size() == max_txn_) {
+        // An operation which touches more blocks than fit in a record is
+        // split across several transactions.
+        if ((status = Commit()) != NO_ERROR) {
+            return status;
+        }
+    }
+    AllocChecker ac;
+    mxtl::unique_ptr<JournalBlock> blk(new (&ac) JournalBlock());
+    if (!ac.check()) {
+        return ERR_NO_MEMORY;
+    }
+    blk->bno = bno;
+    memcpy(blk->data, data, kMinfsBlockSize);
+    txn_.insert(mxtl::move(blk));
+    return NO_ERROR;
+}
+
+bool Journal::Read(uint32_t bno, void* data) const {
+    auto iter = txn_.find(bno);
+    if (!iter.IsValid()) {
+        iter = committed_.find(bno);
+        if (!iter.IsValid()) {
+            return false;
+        }
+    }
+    memcpy(data, iter->data, kMinfsBlockSize);
+    return true;
+}
+
+mx_status_t Journal::Forget(uint32_t bno) {
+    txn_.erase(bno);
+    if (committed_.erase(bno) == nullptr) {
+        return NO_ERROR;
+    }
+    // The stale copy will not be written home by a checkpoint, but a replay
+    // would still find it in its record until a later one revokes it.
+    mx_status_t status;
+    if (revoked_count_ == countof(revoked_)) {
+        if ((status = Commit()) != NO_ERROR) {
+            return status;
+        }
+    }
+    revoked_[revoked_count_++] = bno;
+    return NO_ERROR;
+}
+
+mx_status_t Journal::Commit() {
+    mx_status_t status;
+    // Revocations which do not fit alongside the transaction's blocks go
+    // out in records of their own.
+    while (!txn_.is_empty() || (revoked_count_ > 0)) {
+        uint32_t count = static_cast<uint32_t>(txn_.size());
+        if (head_ + 1 + count > blocks_) {
+            // Checkpointing discards every record, and with them any copy
+            // which was to be revoked.
+            if ((status = Checkpoint()) != NO_ERROR) {
+                return status;
+            }
+            if (count == 0) {
+                break;
+            }
+        }
+        uint32_t revoked = mxtl::min(revoked_count_, kMinfsJournalEntries - count);
+
+        minfs_journal_record_t* rec = static_cast<minfs_journal_record_t*>(Slot(head_));
+        memset(rec, 0, sizeof(*rec));
+        rec->magic = kMinfsJournalRecordMagic;
+        rec->seq = seq_;
+        rec->count = count;
+        rec->revoked = revoked;
+        uint32_t i = 0;
+        for (const auto& blk : txn_) {
+            rec->bno[i] = blk.bno;
+            memcpy(Slot(head_ + 1 + i), blk.data, kMinfsBlockSize);
+            i++;
+        }
+        memcpy(&rec->bno[count], revoked_, revoked * sizeof(uint32_t));
+        rec->checksum = Checksum(head_);
+        if ((status = WriteSlots(head_, 1 + count)) != NO_ERROR) {
+            error("minfs: cannot write journal record\n");
+            return status;
+        }
+        trace(MINFS, "journal: commit seq=%llu blocks=%u revoked=%u at %u\n",
+              (unsigned long long)seq_, count, revoked, head_);
+        head_ += 1 + count;
+        seq_++;
+        dirty_ = true;
+
+        revoked_count_ -= revoked;
+        memmove(revoked_, revoked_ + revoked, revoked_count_ * sizeof(uint32_t));
+        while (!txn_.is_empty()) {
+            mxtl::unique_ptr<JournalBlock> blk = txn_.pop_front();
+            committed_.erase(blk->bno);
+            committed_.insert(mxtl::move(blk));
+        }
+    }
+    return NO_ERROR;
+}
+
+mx_status_t Journal::Checkpoint() {
+    if (head_ == 1) {
+        // No records since the last checkpoint, so nothing to revoke either.
+        revoked_count_ = 0;
+        return NO_ERROR;
+    }
+
+    // Committed blocks are staged in the body of the journal (there are
+    // fewer of them than blocks in the journal) and written home in block
+    // order, so runs of adjacent blocks are written together.
+    mx_status_t status;
+    uint32_t n = 1;
+#ifdef __Fuchsia__
+    // The records must be durable before any block they describe is
+    // overwritten in place.
+    if ((status = bc_->Flush()) != NO_ERROR) {
+        return status;
+    }
+    WriteTxn txn(bc_);
+    for (const auto& blk : committed_) {
+        memcpy(Slot(n), blk.data, kMinfsBlockSize);
+        if ((status = txn.Enqueue(vmoid_, n, blk.bno, 1)) != NO_ERROR) {
+            return status;
+        }
+        n++;
+    }
+    if ((status = txn.Flush()) != NO_ERROR) {
+        error("minfs: cannot checkpoint journal\n");
+        return status;
+    } else if ((status = bc_->Flush()) != NO_ERROR) {
+        return status;
+    }
+#else
+    for (const auto& blk : committed_) {
+        if ((status = bc_->Writeblk(blk.bno, blk.data)) != NO_ERROR) {
+            error("minfs: cannot checkpoint journal\n");
+            return status;
+        }
+        n++;
+    }
+#endif
+    trace(MINFS, "journal: checkpoint seq=%llu blocks=%u\n", (unsigned long long)seq_, n - 1);
+
+    // Only once every block is home may the records be discarded.
+    minfs_journal_info_t* info = static_cast<minfs_journal_info_t*>(Slot(0));
+    memset(info, 0, kMinfsBlockSize);
+    info->magic = kMinfsJournalMagic;
+    info->seq = seq_;
+    if ((status = WriteSlots(0, 1)) != NO_ERROR) {
+        error("minfs: cannot write journal info\n");
+        return status;
+    }
+    committed_.clear();
+    revoked_count_ = 0;
+    head_ = 1;
+    return NO_ERROR;
+}
+
+} // namespace minfs
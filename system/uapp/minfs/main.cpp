@@ -23,6 +23,8 @@
 #ifndef __Fuchsia__
 
 static minfs::Bcache* the_block_cache;
+static const char* the_device;
+static uint32_t the_device_blocks;
 extern minfs::VnodeMinfs* fake_root;
 
 int run_fs_tests(int argc, char** argv);
@@ -58,6 +60,29 @@ int io_setup(minfs::Bcache* bc) {
     return 0;
 }
 
+} // namespace anonymous
+
+// Simulates a crash: abandons the mounted filesystem, along with everything
+// it has yet to write back, checks the device and mounts it again.
+int crash_remount() {
+    int fd;
+    if ((fd = open(the_device, O_RDWR)) < 0) {
+        return -1;
+    }
+    minfs::Bcache* bc;
+    if (minfs::Bcache::Create(&bc, fd, the_device_blocks, minfs::kMinfsBlockSize,
+                              minfs::kMinfsBlockCacheSize) < 0) {
+        close(fd);
+        return -1;
+    }
+    if (minfs_check(bc) < 0) {
+        return -1;
+    }
+    return io_setup(bc);
+}
+
+namespace {
+
 int do_minfs_test(minfs::Bcache* bc, int argc, char** argv) {
     if (io_setup(bc)) {
         return -1;
@@ -374,6 +399,10 @@ found:
         fprintf(stderr, "error: cannot create block cache\n");
         return -1;
     }
+#ifndef __Fuchsia__
+    the_device = fn;
+    the_device_blocks = (uint32_t) size;
+#endif
 
     for (unsigned i = 0; i < countof(CMDS); i++) {
         if (!strcmp(cmd, CMDS[i].name)) {
@@ -312,6 +312,8 @@ mx_status_t check_file(CheckMaps* chk, const Minfs* fs,
     // count and sanity-check data blocks
 
     unsigned max = 0;
+    uint32_t extents = 0;
+    uint32_t prev = 0;
     for (unsigned n = 0;;n++) {
         mx_status_t status;
         uint32_t bno;
@@ -329,7 +331,16 @@ mx_status_t check_file(CheckMaps* chk, const Minfs* fs,
                 warn("check: ino#%u: block %u(@%u): %s\n", ino, n, bno, msg);
             }
             max = n + 1;
+            if ((prev == 0) || (bno != prev + 1)) {
+                extents++;
+            }
         }
+        prev = bno;
+    }
+    chk->files++;
+    chk->extents += extents;
+    if (extents > 1) {
+        chk->fragmented_files++;
     }
     if (max) {
         unsigned sizeblocks = inode->size / kMinfsBlockSize;
@@ -403,6 +414,9 @@ mx_status_t minfs_check(Bcache* bc) {
     }
 
     CheckMaps chk;
+    chk.files = 0;
+    chk.extents = 0;
+    chk.fragmented_files = 0;
     if ((status = chk.checked_inodes.Reset(info.inode_count)) < 0) {
         return status;
     }
@@ -445,6 +459,12 @@ mx_status_t minfs_check(Bcache* bc) {
               missing, missing > 1 ? "s" : "");
     }
 
+    if (chk.files) {
+        fprintf(stderr, "check: %u files, %u extents, %u fragmented (%u.%02u extents/file)\n",
+                chk.files, chk.extents, chk.fragmented_files,
+                chk.extents / chk.files, (chk.extents * 100 / chk.files) % 100);
+    }
+
     //TODO: check allocated inodes that were abandoned
     //TODO: check allocated blocks that were not accounted for
     //TODO: check unallocated inodes where magic != 0
@@ -79,8 +79,7 @@ mxtl::RefPtr<BlockNode> Minfs::BitmapBlockGet(const mxtl::RefPtr<BlockNode>& blk
             return blk;
         }
         // write previous block to disk
-        const void* src = GetBlock(block_map_, bitblock_old);
-        memcpy(blk->data(), src, kMinfsBlockSize);
+        BitmapBlockCopy(blk->data(), bitblock_old);
         bc_->Put(blk, kBlockDirty);
     }
     return mxtl::RefPtr<BlockNode>(bc_->Get(info_.abm_block + bitblock));
@@ -89,8 +88,7 @@ mxtl::RefPtr<BlockNode> Minfs::BitmapBlockGet(const mxtl::RefPtr<BlockNode>& blk
 void Minfs::BitmapBlockPut(const mxtl::RefPtr<BlockNode>& blk) {
     if (blk) {
         uint32_t bitblock = blk->GetKey() - info_.abm_block;
-        const void* src = GetBlock(block_map_, bitblock);
-        memcpy(blk->data(), src, kMinfsBlockSize);
+        BitmapBlockCopy(blk->data(), bitblock);
         bc_->Put(blk, kBlockDirty);
     }
 }
@@ -104,6 +102,9 @@ mx_status_t VnodeMinfs::InodeDestroy() {
     memcpy(&inode, &inode_, sizeof(inode));
     memset(&inode_, 0, sizeof(inode));
     InodeSync(kMxFsSyncDefault);
+    // Discard any index the filesystem holds for the (directory) inode
+    fs_->DirIndexGet(ino_);
+    dir_index_.reset();
     return fs_->InoFree(inode, ino_);
 }
 
@@ -139,6 +140,7 @@ mx_status_t VnodeMinfs::BlocksShrink(uint32_t start) {
             return ERR_IO;
         }
 
+        fs_->bc_->Forget(inode_.dnum[bno]);
         fs_->block_map_.Clear(inode_.dnum[bno], inode_.dnum[bno] + 1);
         inode_.dnum[bno] = 0;
         inode_.block_count--;
@@ -182,6 +184,7 @@ mx_status_t VnodeMinfs::BlocksShrink(uint32_t start) {
                 fs_->bc_->Put(blk, iflags);
                 return ERR_IO;
             }
+            fs_->bc_->Forget(entry[direct]);
             fs_->block_map_.Clear(entry[direct], entry[direct] + 1);
             entry[direct] = 0;
             iflags = kBlockDirty;
@@ -199,6 +202,7 @@ mx_status_t VnodeMinfs::BlocksShrink(uint32_t start) {
             if (bitmap_blk == nullptr) {
                 return ERR_IO;
             }
+            fs_->bc_->Forget(inode_.inum[indirect]);
             fs_->block_map_.Clear(inode_.inum[indirect], inode_.inum[indirect] + 1);
             inode_.inum[indirect] = 0;
             inode_.block_count--;
@@ -214,86 +218,106 @@ mx_status_t VnodeMinfs::BlocksShrink(uint32_t start) {
 }
 
 #ifdef __Fuchsia__
-// Read data from disk at block 'bno', into the 'nth' logical block of the file.
-mx_status_t VnodeMinfs::FillBlock(uint32_t n, uint32_t bno) {
-    // TODO(smklein): read directly from block device into vmo; no need to copy
-    // into an intermediate buffer.
-    char bdata[kMinfsBlockSize];
-    if (fs_->bc_->Readblk(bno, bdata)) {
-        return ERR_IO;
-    }
-    mx_status_t status = vmo_write_exact(vmo_, bdata, n * kMinfsBlockSize, kMinfsBlockSize);
-    if (status != NO_ERROR) {
-        return status;
-    }
-    return NO_ERROR;
-}
-
 // Since we cannot yet register the filesystem as a paging service (and cleanly
-// fault on pages when they are actually needed), we currently read an entire
-// file to a VMO when a file's data block are accessed.
-//
-// TODO(smklein): Even this hack can be optimized; a bitmap could be used to
-// track all 'empty/read/dirty' blocks for each vnode, rather than reading
-// the entire file.
+// fault on pages when they are actually needed), file contents are read into
+// a VMO, block by block, as they are accessed (see VmoLoad).
 mx_status_t VnodeMinfs::InitVmo() {
     if (vmo_ != MX_HANDLE_INVALID) {
         return NO_ERROR;
     }
 
     mx_status_t status;
+    uint32_t blocks = mxtl::roundup(inode_.size, kMinfsBlockSize) / kMinfsBlockSize;
+    if ((status = vmo_loaded_.Reset(blocks)) != NO_ERROR) {
+        return status;
+    }
     if ((status = mx_vmo_create(mxtl::roundup(inode_.size, kMinfsBlockSize), 0, &vmo_)) != NO_ERROR) {
         error("Failed to initialize vmo; error: %d\n", status);
         return status;
+    } else if ((status = fs_->bc_->AttachVmo(vmo_, &vmoid_)) != NO_ERROR) {
+        error("Failed to attach vmo to block device; error: %d\n", status);
+        mx_handle_close(vmo_);
+        vmo_ = MX_HANDLE_INVALID;
+        return status;
     }
+    return NO_ERROR;
+}
 
-    // Initialize all direct blocks
-    uint32_t bno;
-    for (uint32_t d = 0; d < kMinfsDirect; d++) {
-        if ((bno = inode_.dnum[d]) != 0) {
-            if ((status = FillBlock(d, bno)) != NO_ERROR) {
-                error("Failed to fill bno %u; error: %d\n", bno, status);
-                return status;
-            }
-        }
+mx_status_t VnodeMinfs::VmoLoad(uint32_t start, uint32_t end) {
+    end = mxtl::min(end, static_cast<uint32_t>(vmo_loaded_.size()));
+    if (start >= end) {
+        return NO_ERROR;
     }
 
-    // Initialize all indirect blocks
-    for (uint32_t i = 0; i < kMinfsIndirect; i++) {
-        uint32_t ibno;
-        mxtl::RefPtr<BlockNode> iblk;
-        if ((ibno = inode_.inum[i]) != 0) {
-            // TODO(smklein): Should there be a separate vmo for indirect blocks?
-            if ((iblk = fs_->bc_->Get(ibno)) == nullptr) {
-                return ERR_IO;
+    // Blocks are read from the device directly into the vmo. Runs of blocks
+    // which are contiguous on disk are coalesced into a single request.
+    ReadTxn txn(fs_->bc_);
+    mx_status_t status;
+    uint8_t data[kMinfsBlockSize];
+    for (uint32_t n = start; n < end; n++) {
+        n = static_cast<uint32_t>(vmo_loaded_.Scan(n, end, true));
+        if (n == end) {
+            break;
+        }
+        uint32_t bno;
+        if ((status = GetBno(n, &bno, false)) != NO_ERROR) {
+            txn.Flush();
+            vmo_loaded_.Clear(start, end);
+            return status;
+        }
+        if ((bno != 0) && IsDirectory() && fs_->bc_->JournalRead(bno, data)) {
+            // Directory blocks may not have been written home yet.
+            if ((status = vmo_write_exact(vmo_, data, n * kMinfsBlockSize,
+                                          kMinfsBlockSize)) != NO_ERROR) {
+                txn.Flush();
+                vmo_loaded_.Clear(start, end);
+                return status;
             }
-            uint32_t* ientry = static_cast<uint32_t*>(iblk->data());
-
-            const uint32_t direct_per_indirect = kMinfsBlockSize / sizeof(uint32_t);
-            for (uint32_t j = 0; j < direct_per_indirect; j++) {
-                if ((bno = ientry[j]) != 0) {
-                    uint32_t n = kMinfsDirect + i * direct_per_indirect + j;
-                    if ((status = FillBlock(n, bno)) != NO_ERROR) {
-                        fs_->bc_->Put(iblk, 0);
-                        return status;
-                    }
-                }
+        } else if (bno != 0) {
+            if ((status = txn.Enqueue(vmoid_, n, bno, 1)) != NO_ERROR) {
+                error("Failed to fill bno %u; error: %d\n", bno, status);
+                txn.Flush();
+                vmo_loaded_.Clear(start, end);
+                return status;
             }
-            fs_->bc_->Put(iblk, 0);
         }
+        vmo_loaded_.Set(n, n + 1);
+    }
+    // On any failure, blocks marked loaded above may not have been read;
+    // they are all tried again on the next access.
+    if ((status = txn.Flush()) != NO_ERROR) {
+        vmo_loaded_.Clear(start, end);
+        return status;
     }
-
     return NO_ERROR;
 }
 #endif
 
+mx_status_t VnodeMinfs::BlockNewData(uint32_t n, uint32_t hint, uint32_t* bno) {
+    if (n != reserve_next_) {
+        // Not growing sequentially; the reservation is no longer useful
+        fs_->BlocksUnreserve(&reservation_);
+        reserve_window_ = kMinfsReserveMin;
+    }
+    if (reservation_.count == 0) {
+        fs_->BlocksReserve(hint, reserve_window_, &reservation_);
+        reserve_window_ = mxtl::min(reserve_window_ * 2, kMinfsReserveMax);
+    }
+    reserve_next_ = n + 1;
+    if (reservation_.count == 0) {
+        return fs_->BlockNew(hint, bno, nullptr);
+    }
+    return fs_->BlockNew(&reservation_, bno);
+}
+
 // Get the bno corresponding to the nth logical block within the file.
 mx_status_t VnodeMinfs::GetBno(uint32_t n, uint32_t* bno, bool alloc) {
-    uint32_t hint = 0;
     // direct blocks are simple... is there an entry in dnum[]?
     if (n < kMinfsDirect) {
         if (((*bno = inode_.dnum[n]) == 0) && alloc) {
-            mx_status_t status = fs_->BlockNew(hint, bno, nullptr);
+            // prefer to place the block right after its predecessor
+            uint32_t hint = ((n > 0) && inode_.dnum[n - 1]) ? inode_.dnum[n - 1] + 1 : 0;
+            mx_status_t status = BlockNewData(n, hint, bno);
             if (status != NO_ERROR) {
                 return status;
             }
@@ -305,12 +329,12 @@ mx_status_t VnodeMinfs::GetBno(uint32_t n, uint32_t* bno, bool alloc) {
     }
 
     // for indirect blocks, adjust past the direct blocks
-    n -= kMinfsDirect;
+    uint32_t m = n - kMinfsDirect;
 
     // determine indices into the indirect block list and into
     // the block list in the indirect block
-    uint32_t i = static_cast<uint32_t>(n / (kMinfsBlockSize / sizeof(uint32_t)));
-    uint32_t j = n % (kMinfsBlockSize / sizeof(uint32_t));
+    uint32_t i = static_cast<uint32_t>(m / (kMinfsBlockSize / sizeof(uint32_t)));
+    uint32_t j = m % (kMinfsBlockSize / sizeof(uint32_t));
 
     if (i >= kMinfsIndirect) {
         return ERR_OUT_OF_RANGE;
@@ -344,7 +368,8 @@ mx_status_t VnodeMinfs::GetBno(uint32_t n, uint32_t* bno, bool alloc) {
 
     if (((*bno = ientry[j]) == 0) && alloc) {
         // allocate a new block
-        mx_status_t status = fs_->BlockNew(hint, bno, nullptr);
+        uint32_t hint = ((j > 0) && ientry[j - 1]) ? ientry[j - 1] + 1 : 0;
+        mx_status_t status = BlockNewData(n, hint, bno);
         if (status != NO_ERROR) {
             fs_->bc_->Put(iblk, iflags);
             return status;
@@ -450,6 +475,7 @@ mx_status_t VnodeMinfs::UnlinkChild(VnodeMinfs* childvn, minfs_dirent_t* de, Dir
     size_t off = offs->off;
     size_t off_next = off + MinfsReclen(de, off);
     minfs_dirent_t de_prev, de_next;
+    bool merge_next = false;
     mx_status_t status;
 
     // Read the direntries we're considering merging with.
@@ -467,6 +493,7 @@ mx_status_t VnodeMinfs::UnlinkChild(VnodeMinfs* childvn, minfs_dirent_t* de, Dir
             goto fail;
         }
         if (de_next.ino == 0) {
+            merge_next = true;
             coalesced_size += MinfsReclen(&de_next, off_next);
             // If the next entry *was* last, then 'de' is now last.
             de->reclen |= (de_next.reclen & kMinfsReclenLast);
@@ -500,6 +527,18 @@ mx_status_t VnodeMinfs::UnlinkChild(VnodeMinfs* childvn, minfs_dirent_t* de, Dir
         goto fail;
     }
 
+    if (dir_index_ != nullptr) {
+        if (merge_next) {
+            dir_index_->Remove(static_cast<uint32_t>(off_next));
+        }
+        if (off != offs->off) {
+            dir_index_->Remove(static_cast<uint32_t>(offs->off));
+        } else {
+            dir_index_->Release(static_cast<uint32_t>(off));
+        }
+        dir_index_->AppendFree(static_cast<uint32_t>(off), MinfsReclen(de, off));
+    }
+
     if (de->reclen & kMinfsReclenLast) {
         // Truncating the directory merely removed unused space; if it fails,
         // the directory contents are still valid.
@@ -642,6 +681,10 @@ static mx_status_t add_dirent(VnodeMinfs* vndir, minfs_dirent_t* de, DirArgs* ar
     if (status != NO_ERROR) {
         return status;
     }
+    if ((vndir->dir_index_ != nullptr) &&
+        (vndir->dir_index_->Insert(static_cast<uint32_t>(off), args->name, args->len) != NO_ERROR)) {
+        vndir->dir_index_.reset();
+    }
     vndir->inode_.dirent_count++;
     if (args->type == kMinfsTypeDir) {
         // Child directory has '..' which will point to parent directory
@@ -656,6 +699,10 @@ static mx_status_t cb_dir_append(VnodeMinfs* vndir, minfs_dirent_t* de,
     if (de->ino == 0) {
         // empty entry, do we fit?
         if (args->reclen > reclen) {
+            if (vndir->dir_index_ != nullptr) {
+                vndir->dir_index_->AppendSkip(args->reclen, static_cast<uint32_t>(offs->off),
+                                              static_cast<uint32_t>(offs->off + reclen));
+            }
             return do_next_dirent(de, offs);
         }
         return add_dirent(vndir, de, args, offs->off);
@@ -668,6 +715,10 @@ static mx_status_t cb_dir_append(VnodeMinfs* vndir, minfs_dirent_t* de,
         }
         uint32_t extra = reclen - size;
         if (extra < args->reclen) {
+            if (vndir->dir_index_ != nullptr) {
+                vndir->dir_index_->AppendSkip(args->reclen, static_cast<uint32_t>(offs->off),
+                                              static_cast<uint32_t>(offs->off + reclen));
+            }
             return do_next_dirent(de, offs);
         }
         // shrink existing entry
@@ -699,14 +750,18 @@ static mx_status_t cb_dir_append(VnodeMinfs* vndir, minfs_dirent_t* de,
 //  'offs': Offset info about where in the directory this direntry is located.
 //          Since 'func' may create / remove surrounding dirents, it is responsible for
 //          updating the offset information to access the next dirent.
+//
+// Iteration begins with the record at 'start', which must be the offset of
+// a record. The first record's 'off_prev' is its own offset.
 mx_status_t VnodeMinfs::ForEachDirent(DirArgs* args,
                                       mx_status_t (*func)(VnodeMinfs*, minfs_dirent_t*, DirArgs*,
-                                                          DirectoryOffset*)) {
+                                                          DirectoryOffset*),
+                                      size_t start) {
     char data[kMinfsMaxDirentSize];
     minfs_dirent_t* de = (minfs_dirent_t*) data;
     DirectoryOffset offs = {
-        .off = 0,
-        .off_prev = 0,
+        .off = start,
+        .off_prev = start,
     };
     while (offs.off + MINFS_DIRENT_SIZE < kMinfsMaxDirectorySize) {
         trace(MINFS, "Reading dirent at offset %zd\n", offs.off);
@@ -733,16 +788,100 @@ mx_status_t VnodeMinfs::ForEachDirent(DirArgs* args,
     return ERR_NOT_FOUND;
 }
 
+static mx_status_t cb_dir_index(VnodeMinfs* vndir, minfs_dirent_t* de,
+                                DirArgs* args, DirectoryOffset* offs) {
+    mx_status_t status = vndir->dir_index_->Insert(static_cast<uint32_t>(offs->off), de->name,
+                                                   de->ino ? de->namelen : 0);
+    if (status != NO_ERROR) {
+        return status;
+    } else if (de->reclen & kMinfsReclenLast) {
+        return DIR_CB_DONE;
+    }
+    return do_next_dirent(de, offs);
+}
+
+void VnodeMinfs::DirIndexInit() {
+    if ((dir_index_ != nullptr) || ((dir_index_ = fs_->DirIndexGet(ino_)) != nullptr)) {
+        return;
+    } else if (inode_.size < kMinfsDirIndexMinSize) {
+        return;
+    }
+    // Failing to build the index only costs us linear scans
+    if (DirIndex::Create(&dir_index_) != NO_ERROR) {
+        return;
+    }
+    DirArgs args = DirArgs();
+    if (ForEachDirent(&args, cb_dir_index) != NO_ERROR) {
+        dir_index_.reset();
+    }
+}
+
+mx_status_t VnodeMinfs::LookupDirent(DirArgs* args,
+                                     mx_status_t (*func)(VnodeMinfs*, minfs_dirent_t*, DirArgs*,
+                                                         DirectoryOffset*)) {
+    DirIndexInit();
+    if (dir_index_ == nullptr) {
+        return ForEachDirent(args, func);
+    }
+
+    char data[kMinfsMaxDirentSize];
+    minfs_dirent_t* de = (minfs_dirent_t*) data;
+    uint32_t hash = DirIndex::Hash(args->name, args->len);
+    for (DirRecord* rec = dir_index_->Find(hash, nullptr); rec != nullptr;
+         rec = dir_index_->Find(hash, rec)) {
+        DirectoryOffset offs = {
+            .off = rec->off,
+            .off_prev = dir_index_->Prev(rec->off),
+        };
+        size_t r;
+        mx_status_t status = ReadInternal(data, kMinfsMaxDirentSize, offs.off, &r);
+        if (status != NO_ERROR) {
+            return status;
+        } else if ((status = validate_dirent(de, r, offs.off)) != NO_ERROR) {
+            return status;
+        }
+
+        // 'func' only modifies the directory (and the index) when it matches
+        // the dirent, in which case it stops the iteration.
+        switch ((status = func(this, de, args, &offs))) {
+        case DIR_CB_NEXT:
+            break;
+        case DIR_CB_SAVE_SYNC:
+            inode_.seq_num++;
+            InodeSync(kMxFsSyncMtime);
+            return NO_ERROR;
+        case DIR_CB_DONE:
+        default:
+            return status;
+        }
+    }
+    return ERR_NOT_FOUND;
+}
+
+mx_status_t VnodeMinfs::AppendDirent(DirArgs* args) {
+    DirIndexInit();
+    size_t start = (dir_index_ != nullptr) ? dir_index_->AppendOffset(args->reclen) : 0;
+    return ForEachDirent(args, cb_dir_append, start);
+}
+
 void VnodeMinfs::Release() {
+    Transaction transaction(fs_->bc_);
     trace(MINFS, "minfs_release() vn=%p(#%u)%s\n", this, ino_,
           inode_.link_count ? "" : " link-count is zero");
     if (inode_.link_count == 0) {
         InodeDestroy();
     }
 
+    fs_->BlocksUnreserve(&reservation_);
+    if (dir_index_ != nullptr) {
+        fs_->DirIndexPut(ino_, mxtl::move(dir_index_));
+    }
     fs_->VnodeRelease(this);
 #ifdef __Fuchsia__
-    mx_handle_close(vmo_);
+    if (vmo_ != MX_HANDLE_INVALID) {
+        fs_->bc_->DetachVmo(vmoid_);
+        mx_handle_close(vmo_);
+    }
 #endif
     delete this;
 }
@@ -753,11 +892,25 @@ mx_status_t VnodeMinfs::Open(uint32_t flags) {
         return ERR_NOT_DIR;
     }
     RefAcquire();
+#ifdef __Fuchsia__
+    open_count_++;
+#endif
     return NO_ERROR;
 }
 
 mx_status_t VnodeMinfs::Close() {
     trace(MINFS, "minfs_close() vn=%p(#%u)\n", this, ino_);
+#ifdef __Fuchsia__
+    // mxio holds the connection a shared mapping was made through open
+    // until it is unmapped, so once the last one closes there are no
+    // more stores to write back.
+    if ((--open_count_ == 0) && mapped_writable_) {
+        if (SyncMapped() != NO_ERROR) {
+            error("minfs: failed to write back mapped file\n");
+        }
+        mapped_writable_ = false;
+    }
+#endif
     RefRelease();
     return NO_ERROR;
 }
@@ -790,7 +943,26 @@ mx_status_t VnodeMinfs::ReadInternal(void* data, size_t len, size_t off, size_t*
 #ifdef __Fuchsia__
     if ((status = InitVmo()) != NO_ERROR) {
         return status;
-    } else if ((status = mx_vmo_read(vmo_, data, off, len, actual)) != NO_ERROR) {
+    }
+
+    uint32_t n_start = static_cast<uint32_t>(off / kMinfsBlockSize);
+    uint32_t n_end = static_cast<uint32_t>((off + len + kMinfsBlockSize - 1) / kMinfsBlockSize);
+    if (!vmo_loaded_.Get(n_start, n_end)) {
+        // Sequential readers which keep missing get an increasingly large
+        // readahead window; anyone else reads only what they asked for.
+        if (n_start == readahead_next_) {
+            readahead_window_ = mxtl::max(readahead_window_ * 2, kMinfsReadaheadMin);
+            readahead_window_ = mxtl::min(readahead_window_, kMinfsReadaheadMax);
+        } else {
+            readahead_window_ = 0;
+        }
+        if ((status = VmoLoad(n_start, n_end + readahead_window_)) != NO_ERROR) {
+            return status;
+        }
+    }
+    readahead_next_ = n_end;
+
+    if ((status = mx_vmo_read(vmo_, data, off, len, actual)) != NO_ERROR) {
         return status;
     }
 #else
@@ -832,6 +1004,7 @@ mx_status_t VnodeMinfs::ReadInternal(void* data, size_t len, size_t off, size_t*
 }
 
 ssize_t VnodeMinfs::Write(const void* data, size_t len, size_t off) {
+    Transaction transaction(fs_->bc_);
     trace(MINFS, "minfs_write() vn=%p(#%u) len=%zd off=%zd\n", this, ino_, len, off);
     if (IsDirectory()) {
         return ERR_NOT_FILE;
@@ -859,6 +1032,9 @@ mx_status_t VnodeMinfs::WriteInternal(const void* data, size_t len, size_t off,
     if ((status = InitVmo()) != NO_ERROR) {
         return status;
     }
+    // Modified blocks are written from the vmo to disk once the whole
+    // write has been staged, coalescing contiguous blocks.
+    WriteTxn txn(fs_->bc_);
 #endif
     const void* const start = data;
     uint32_t n = static_cast<uint32_t>(off / kMinfsBlockSize);
@@ -888,27 +1064,39 @@ mx_status_t VnodeMinfs::WriteInternal(const void* data, size_t len, size_t off,
         // the file. As a consequence, an error is returned (ERR_IO) rather than
         // doing a partial read.
 
+        // Partially overwritten blocks need their old contents first
+        if (xfer != kMinfsBlockSize) {
+            if ((status = VmoLoad(n, n + 1)) != NO_ERROR) {
+                txn.Flush();
+                return ERR_IO;
+            }
+        } else if (n < vmo_loaded_.size()) {
+            vmo_loaded_.Set(n, n + 1);
+        }
+
         // Update this block of the in-memory VMO
         if ((status = vmo_write_exact(vmo_, data, xfer_off, xfer)) != NO_ERROR) {
+            txn.Flush();
             return ERR_IO;
         }
 
-        // Update this block on-disk
-        char bdata[kMinfsBlockSize];
-        // TODO(smklein): Can we write directly from the VMO to the block device,
-        // preventing the need for a 'bdata' variable?
-        if (xfer != kMinfsBlockSize) {
-            if (vmo_read_exact(vmo_, bdata, n * kMinfsBlockSize, kMinfsBlockSize) != NO_ERROR) {
-                return ERR_IO;
-            }
-        }
-        const void* wdata = (xfer != kMinfsBlockSize) ? bdata : data;
+        // Update this block on-disk, directly from the VMO
         uint32_t bno;
         if ((status = GetBno(n, &bno, true)) != NO_ERROR) {
+            txn.Flush();
             return status;
         }
         assert(bno != 0);
-        if (fs_->bc_->Writeblk(bno, wdata)) {
+        if (IsDirectory() && fs_->bc_->Journaled()) {
+            // Directory blocks are metadata, and go through the journal.
+            char wdata[kMinfsBlockSize];
+            if ((vmo_read_exact(vmo_, wdata, n * kMinfsBlockSize, kMinfsBlockSize) != NO_ERROR) ||
+                (fs_->bc_->Log(bno, wdata) != NO_ERROR)) {
+                txn.Flush();
+                return ERR_IO;
+            }
+        } else if (txn.Enqueue(vmoid_, n, bno, 1) != NO_ERROR) {
+            txn.Flush();
             return ERR_IO;
         }
 #else
@@ -922,7 +1110,7 @@ mx_status_t VnodeMinfs::WriteInternal(const void* data, size_t len, size_t off,
             return ERR_IO;
         }
         memcpy(wdata + adjust, data, xfer);
-        if (fs_->bc_->Writeblk(bno, wdata)) {
+        if (IsDirectory() ? fs_->bc_->Log(bno, wdata) : fs_->bc_->Writeblk(bno, wdata)) {
             return ERR_IO;
         }
 #endif
@@ -934,6 +1122,11 @@ mx_status_t VnodeMinfs::WriteInternal(const void* data, size_t len, size_t off,
     }
 
 done:
+#ifdef __Fuchsia__
+    if (txn.Flush() != NO_ERROR) {
+        return ERR_IO;
+    }
+#endif
     len = (uintptr_t)data - (uintptr_t)start;
     if (len == 0) {
         // If more than zero bytes were requested, but zero bytes were written,
@@ -965,7 +1158,7 @@ mx_status_t VnodeMinfs::Lookup(fs::Vnode** out, const char* name, size_t len) {
     args.name = name;
     args.len = len;
     mx_status_t status;
-    if ((status = ForEachDirent(&args, cb_dir_find)) < 0) {
+    if ((status = LookupDirent(&args, cb_dir_find)) < 0) {
         return status;
     }
     VnodeMinfs* vn;
@@ -988,6 +1181,7 @@ mx_status_t VnodeMinfs::Getattr(vnattr_t* a) {
 }
 
 mx_status_t VnodeMinfs::Setattr(vnattr_t* a) {
+    Transaction transaction(fs_->bc_);
     int dirty = 0;
     trace(MINFS, "minfs_setattr() vn=%p(#%u)\n", this, ino_);
     if ((a->valid & ~(ATTR_CTIME|ATTR_MTIME)) != 0) {
@@ -1086,9 +1280,11 @@ fail:
 }
 
 #ifdef __Fuchsia__
-VnodeMinfs::VnodeMinfs(Minfs* fs) : fs_(fs), vmo_(MX_HANDLE_INVALID) {}
+VnodeMinfs::VnodeMinfs(Minfs* fs) : fs_(fs), vmo_(MX_HANDLE_INVALID), readahead_next_(0),
+    readahead_window_(0), mapped_writable_(false), open_count_(0), reservation_(), reserve_window_(kMinfsReserveMin), reserve_next_(0) {}
 #else
-VnodeMinfs::VnodeMinfs(Minfs* fs) : fs_(fs) {}
+VnodeMinfs::VnodeMinfs(Minfs* fs) : fs_(fs), reservation_(),
+    reserve_window_(kMinfsReserveMin), reserve_next_(0) {}
 #endif
 
 mx_status_t VnodeMinfs::Allocate(Minfs* fs, uint32_t type, VnodeMinfs** out) {
@@ -1113,6 +1309,7 @@ mx_status_t VnodeMinfs::AllocateHollow(Minfs* fs, VnodeMinfs** out) {
 }
 
 mx_status_t VnodeMinfs::Create(fs::Vnode** out, const char* name, size_t len, uint32_t mode) {
+    Transaction transaction(fs_->bc_);
     trace(MINFS, "minfs_create() vn=%p(#%u) name='%.*s' mode=%#x\n",
           this, ino_, (int)len, name, mode);
     assert(len <= kMinfsMaxNameSize);
@@ -1129,7 +1326,7 @@ mx_status_t VnodeMinfs::Create(fs::Vnode** out, const char* name, size_t len, ui
     args.len = len;
     // ensure file does not exist
     mx_status_t status;
-    if ((status = ForEachDirent(&args, cb_dir_find)) != ERR_NOT_FOUND) {
+    if ((status = LookupDirent(&args, cb_dir_find)) != ERR_NOT_FOUND) {
         return ERR_ALREADY_EXISTS;
     }
 
@@ -1159,7 +1356,7 @@ mx_status_t VnodeMinfs::Create(fs::Vnode** out, const char* name, size_t len, ui
     args.ino = vn->ino_;
     args.type = type;
     args.reclen = static_cast<uint32_t>(DirentSize(static_cast<uint8_t>(len)));
-    if ((status = ForEachDirent(&args, cb_dir_append)) < 0) {
+    if ((status = AppendDirent(&args)) < 0) {
         vn->Release(); // vn refcount +0
         return status;
     }
@@ -1194,6 +1391,7 @@ ssize_t VnodeMinfs::Ioctl(uint32_t op, const void* in_buf, size_t in_len, void*
 }
 
 mx_status_t VnodeMinfs::Unlink(const char* name, size_t len, bool must_be_dir) {
+    Transaction transaction(fs_->bc_);
     trace(MINFS, "minfs_unlink() vn=%p(#%u) name='%.*s'\n", this, ino_, (int)len, name);
     assert(len <= kMinfsMaxNameSize);
     assert(memchr(name, '/', len) == NULL);
@@ -1210,10 +1408,11 @@ mx_status_t VnodeMinfs::Unlink(const char* name, size_t len, bool must_be_dir) {
     args.name = name;
     args.len = len;
     args.type = must_be_dir ? kMinfsTypeDir : 0;
-    return ForEachDirent(&args, cb_dir_unlink);
+    return LookupDirent(&args, cb_dir_unlink);
 }
 
 mx_status_t VnodeMinfs::Truncate(size_t len) {
+    Transaction transaction(fs_->bc_);
     if (IsDirectory()) {
         return ERR_NOT_FILE;
     }
@@ -1235,6 +1434,9 @@ mx_status_t VnodeMinfs::TruncateInternal(size_t len) {
 #endif
 
     if (len < inode_.size) {
+        // Blocks past the new end of file are about to be released
+        fs_->BlocksUnreserve(&reservation_);
+
         // Truncate should make the file shorter
         size_t bno = inode_.size / kMinfsBlockSize;
         size_t trunc_bno = len / kMinfsBlockSize;
@@ -1262,6 +1464,10 @@ mx_status_t VnodeMinfs::TruncateInternal(size_t len) {
             if (bno != 0) {
                 size_t adjust = len % kMinfsBlockSize;
 #ifdef __Fuchsia__
+                uint32_t n = static_cast<uint32_t>(len / kMinfsBlockSize);
+                if ((r = VmoLoad(n, n + 1)) != NO_ERROR) {
+                    return ERR_IO;
+                }
                 if ((r = vmo_read_exact(vmo_, bdata, len - adjust, adjust)) != NO_ERROR) {
                     return ERR_IO;
                 }
@@ -1333,6 +1539,7 @@ static mx_status_t check_not_subdirectory(VnodeMinfs* src, VnodeMinfs* newdir) {
 mx_status_t VnodeMinfs::Rename(fs::Vnode* _newdir, const char* oldname, size_t oldlen,
                                const char* newname, size_t newlen, bool src_must_be_dir,
                                bool dst_must_be_dir) {
+    Transaction transaction(fs_->bc_);
     VnodeMinfs* newdir = static_cast<VnodeMinfs*>(_newdir);
     trace(MINFS, "minfs_rename() olddir=%p(#%u) newdir=%p(#%u) oldname='%.*s' newname='%.*s'\n",
           this, ino_, newdir, newdir->ino_, (int)oldlen, oldname, (int)newlen, newname);
@@ -1360,7 +1567,7 @@ mx_status_t VnodeMinfs::Rename(fs::Vnode* _newdir, const char* oldname, size_t o
     DirArgs args = DirArgs();
     args.name = oldname;
     args.len = oldlen;
-    if ((status = ForEachDirent(&args, cb_dir_find)) < 0) {
+    if ((status = LookupDirent(&args, cb_dir_find)) < 0) {
         return status;
     } else if ((status = fs_->VnodeGet(&oldvn, args.ino)) < 0) {
         return status;
@@ -1380,11 +1587,11 @@ mx_status_t VnodeMinfs::Rename(fs::Vnode* _newdir, const char* oldname, size_t o
     args.len = newlen;
     args.ino = oldvn->ino_;
     args.type = oldvn->IsDirectory() ? kMinfsTypeDir : kMinfsTypeFile;
-    status = newdir->ForEachDirent(&args, cb_dir_attempt_rename);
+    status = newdir->LookupDirent(&args, cb_dir_attempt_rename);
     if (status == ERR_NOT_FOUND) {
         // if 'newname' does not exist, create it
         args.reclen = static_cast<uint32_t>(DirentSize(static_cast<uint8_t>(newlen)));
-        if ((status = newdir->ForEachDirent(&args, cb_dir_append)) < 0) {
+        if ((status = newdir->AppendDirent(&args)) < 0) {
             goto done;
         }
         status = NO_ERROR;
@@ -1403,7 +1610,7 @@ mx_status_t VnodeMinfs::Rename(fs::Vnode* _newdir, const char* oldname, size_t o
         args.name = "..";
         args.len = 2;
         args.ino = newdir->ino_;
-        if ((status = vn->ForEachDirent(&args, cb_dir_update_inode)) < 0) {
+        if ((status = vn->LookupDirent(&args, cb_dir_update_inode)) < 0) {
             vn->RefRelease();
             goto done;
         }
@@ -1417,13 +1624,14 @@ mx_status_t VnodeMinfs::Rename(fs::Vnode* _newdir, const char* oldname, size_t o
     // finally, remove oldname from its original position
     args.name = oldname;
     args.len = oldlen;
-    status = ForEachDirent(&args, cb_dir_force_unlink);
+    status = LookupDirent(&args, cb_dir_force_unlink);
 done:
     oldvn->RefRelease();
     return status;
 }
 
 mx_status_t VnodeMinfs::Link(const char* name, size_t len, fs::Vnode* _target) {
+    Transaction transaction(fs_->bc_);
     trace(MINFS, "minfs_link() vndir=%p(#%u) name='%.*s'\n", this, ino_, (int)len, name);
     assert(len <= kMinfsMaxNameSize);
     assert(memchr(name, '/', len) == NULL);
@@ -1450,14 +1658,14 @@ mx_status_t VnodeMinfs::Link(const char* name, size_t len, fs::Vnode* _target) {
     args.name = name;
     args.len = len;
     mx_status_t status;
-    if ((status = ForEachDirent(&args, cb_dir_find)) != ERR_NOT_FOUND) {
+    if ((status = LookupDirent(&args, cb_dir_find)) != ERR_NOT_FOUND) {
         return (status == NO_ERROR) ? ERR_ALREADY_EXISTS : status;
     }
 
     args.ino = target->ino_;
     args.type = kMinfsTypeFile; // We can't hard link directories
     args.reclen = static_cast<uint32_t>(DirentSize(static_cast<uint8_t>(len)));
-    if ((status = ForEachDirent(&args, cb_dir_append)) < 0) {
+    if ((status = AppendDirent(&args)) < 0) {
         return status;
     }
 
@@ -1469,17 +1677,88 @@ mx_status_t VnodeMinfs::Link(const char* name, size_t len, fs::Vnode* _target) {
 }
 
 mx_status_t VnodeMinfs::Sync() {
+#ifdef __Fuchsia__
+    if (mapped_writable_) {
+        mx_status_t status;
+        if ((status = SyncMapped()) != NO_ERROR) {
+            return status;
+        }
+    }
+#endif
     return fs_->bc_->Sync();
 }
 
+#ifdef __Fuchsia__
+mx_status_t VnodeMinfs::Mmap(uint32_t flags, size_t len, size_t* off, mx_handle_t* out) {
+    trace(MINFS, "minfs_mmap() vn=%p(#%u) len=%zd off=%zd\n", this, ino_, len, *off);
+    if (IsDirectory()) {
+        return ERR_NOT_FILE;
+    }
+    mx_status_t status;
+    if ((status = InitVmo()) != NO_ERROR) {
+        return status;
+    }
+
+    // Pages of the mapping are faulted in from the vmo, never through
+    // ReadInternal, so everything mapped must be loaded first.
+    if (*off < vmo_loaded_.size() * kMinfsBlockSize) {
+        size_t end = mxtl::min(*off + len, vmo_loaded_.size() * kMinfsBlockSize);
+        uint32_t n_start = static_cast<uint32_t>(*off / kMinfsBlockSize);
+        uint32_t n_end = static_cast<uint32_t>(mxtl::roundup(end, kMinfsBlockSize) / kMinfsBlockSize);
+        if ((status = VmoLoad(n_start, n_end)) != NO_ERROR) {
+            return status;
+        }
+    }
+
+    // Without copy-on-write clones, a private mapping is only handed a
+    // readable vmo, and the client maps a copy of it.
+    mx_rights_t rights = MX_RIGHT_TRANSFER | MX_RIGHT_DUPLICATE | MX_RIGHT_READ | MX_RIGHT_MAP;
+    if ((flags & MXIO_MMAP_FLAG_WRITE) && !(flags & MXIO_MMAP_FLAG_PRIVATE)) {
+        rights |= MX_RIGHT_WRITE;
+        mapped_writable_ = true;
+    }
+    if (flags & MXIO_MMAP_FLAG_EXEC) {
+        rights |= MX_RIGHT_EXECUTE;
+    }
+    return mx_handle_duplicate(vmo_, rights, out);
+}
+
+mx_status_t VnodeMinfs::SyncMapped() {
+    Transaction transaction(fs_->bc_);
+    WriteTxn txn(fs_->bc_);
+    mx_status_t status;
+    uint32_t blocks = static_cast<uint32_t>(mxtl::roundup(inode_.size, kMinfsBlockSize) /
+                                            kMinfsBlockSize);
+    for (uint32_t n = 0; n < blocks; n++) {
+        // Blocks never loaded were never mapped, so cannot have changed.
+        if ((n < vmo_loaded_.size()) && !vmo_loaded_.Get(n, n + 1)) {
+            continue;
+        }
+        uint32_t bno;
+        if ((status = GetBno(n, &bno, true)) != NO_ERROR) {
+            txn.Flush();
+            return status;
+        }
+        if ((status = txn.Enqueue(vmoid_, n, bno, 1)) != NO_ERROR) {
+            txn.Flush();
+            return status;
+        }
+    }
+    if ((status = txn.Flush()) != NO_ERROR) {
+        return status;
+    }
+    InodeSync(kMxFsSyncMtime);
+    // stores through the mapping changed the file without a write
+    vfs_notify_change();
+    return NO_ERROR;
+}
+#endif
+
 mx_status_t VnodeMinfs::AttachRemote(mx_handle_t h) {
     if (!IsDirectory() || IsDeletedDirectory()) {
         return ERR_NOT_DIR;
-    } else if (IsRemote()) {
-        return ERR_ALREADY_BOUND;
     }
-    remote_ = h;
-    return NO_ERROR;
+    return SetRemote(h);
 }
 
 } // namespace minfs
@@ -5,8 +5,10 @@
 #pragma once
 
 #include <mxtl/algorithm.h>
+#include <mxtl/intrusive_double_list.h>
 #include <mxtl/intrusive_hash_table.h>
 #include <mxtl/intrusive_single_list.h>
+#include <mxtl/intrusive_wavl_tree.h>
 #include <mxtl/macros.h>
 #include <mxtl/ref_counted.h>
 #include <mxtl/ref_ptr.h>
@@ -29,14 +31,125 @@ constexpr uint32_t kMxFsSyncCtime   = (1<<1);
 
 constexpr uint32_t kMinfsBlockCacheSize = 64;
 
+// Bounds on the number of blocks reserved at once for a file which is
+// growing sequentially. The reservation doubles each time it is used up.
+constexpr uint32_t kMinfsReserveMin = 8;
+constexpr uint32_t kMinfsReserveMax = 256;
+
+// Bounds on the number of blocks read ahead of a sequential reader.
+constexpr uint32_t kMinfsReadaheadMin = 4;
+constexpr uint32_t kMinfsReadaheadMax = 64;
+
+// Directories of at least this size are indexed in memory on first lookup.
+constexpr uint32_t kMinfsDirIndexMinSize = kMinfsBlockSize;
+// Number of directory indices kept after their vnodes have been released.
+constexpr uint32_t kMinfsDirIndexCacheSize = 8;
+
 // Used by fsck
 struct CheckMaps {
     RawBitmap checked_inodes;
     RawBitmap checked_blocks;
+    // Fragmentation statistics: contiguous runs of data blocks, summed
+    // over all files, and the number of files with more than one run.
+    uint32_t files;
+    uint32_t extents;
+    uint32_t fragmented_files;
 };
 
 class VnodeMinfs;
 
+// A run of free blocks set aside for the future allocations of a single vnode,
+// so that a file which grows a little at a time still ends up contiguous on
+// disk.
+//
+// Reserved blocks are marked in the in-memory block bitmap, so nobody else
+// allocates them, but they are masked out whenever a bitmap block is written
+// to disk. Reservations never outlive the mounted filesystem.
+struct BlockReservation : public mxtl::DoublyLinkedListable<BlockReservation*> {
+    uint32_t start; // First block in the reservation
+    uint32_t count; // Number of blocks remaining
+};
+
+// A single record (in use or free) of an indexed directory.
+struct DirRecord : public mxtl::WAVLTreeContainable<mxtl::unique_ptr<DirRecord>>,
+                   public mxtl::DoublyLinkedListable<DirRecord*> {
+    uint32_t GetKey() const { return off; }
+
+    uint32_t off;  // Offset of the record within the directory
+    uint32_t hash; // Hash of the name, if the record is in use
+    bool used;
+};
+
+// In-memory index of a large directory, so that named lookups do not need to
+// scan every dirent. Records are kept in offset order, so the predecessor of
+// a record is available for coalescing on unlink, and records which are in
+// use are also hashed by name.
+//
+// The index is built from disk on first lookup, and must be updated by every
+// operation which adds, removes or coalesces a record. Records in use never
+// move. If the index cannot be updated (i.e., out of memory), it is discarded
+// and rebuilt on a later lookup.
+//
+// Vnodes do not outlive their references, so when the vnode of a directory is
+// released its index is handed back to the filesystem, which keeps a few of
+// them for the next vnode of the same inode.
+class DirIndex : public mxtl::DoublyLinkedListable<mxtl::unique_ptr<DirIndex>> {
+public:
+    DISALLOW_COPY_ASSIGN_AND_MOVE(DirIndex);
+    static mx_status_t Create(mxtl::unique_ptr<DirIndex>* out);
+    ~DirIndex();
+
+    static uint32_t Hash(const char* name, size_t len) { return fnv1a32(name, len); }
+
+    // Record that a dirent starts at 'off'. If 'len' is non-zero, it holds
+    // 'name', otherwise it is free. An existing record at 'off' is updated.
+    mx_status_t Insert(uint32_t off, const char* name, size_t len);
+    // Mark the record at 'off' as free.
+    void Release(uint32_t off);
+    // Forget the record at 'off', which has been merged into its predecessor.
+    void Remove(uint32_t off);
+
+    // Returns the offset of the record before 'off', or 'off' itself if
+    // there is no such record.
+    uint32_t Prev(uint32_t off) const;
+    // Returns the next record in use after 'rec' (or the first, if 'rec' is
+    // null) which might be named with 'hash'.
+    DirRecord* Find(uint32_t hash, DirRecord* rec);
+
+    // Appends of a dirent of size 'reclen' may start at this offset: no
+    // earlier record has space for it.
+    uint32_t AppendOffset(uint32_t reclen) const { return append_off_[reclen / 4]; }
+    // The record at 'off', followed by one at 'next', lacks space for 'reclen'.
+    void AppendSkip(uint32_t reclen, uint32_t off, uint32_t next) {
+        if (append_off_[reclen / 4] == off) {
+            append_off_[reclen / 4] = next;
+        }
+    }
+    // The record at 'off' is now free, with room for 'size' bytes of dirents.
+    void AppendFree(uint32_t off, uint32_t size) {
+        size = mxtl::min(size, kMinfsMaxDirentSize);
+        for (uint32_t i = 0; i <= size / 4; i++) {
+            append_off_[i] = mxtl::min(append_off_[i], off);
+        }
+    }
+
+    // Inode of the directory, while the index is cached by the filesystem.
+    uint32_t ino_;
+
+private:
+    DirIndex();
+    mx_status_t Grow();
+    mxtl::DoublyLinkedList<DirRecord*>& Bucket(uint32_t hash) {
+        return buckets_[hash & (bucket_count_ - 1)];
+    }
+
+    uint32_t append_off_[kMinfsMaxDirentSize / 4 + 1];
+    mxtl::WAVLTree<uint32_t, mxtl::unique_ptr<DirRecord>> records_;
+    mxtl::unique_ptr<mxtl::DoublyLinkedList<DirRecord*>[]> buckets_;
+    uint32_t bucket_count_;
+    uint32_t used_count_;
+};
+
 class Minfs {
 public:
     DISALLOW_COPY_ASSIGN_AND_MOVE(Minfs);
@@ -55,10 +168,26 @@ public:
     // remove a vnode from the hash map
     void VnodeRelease(VnodeMinfs* vn);
 
+    // Claim the cached index of directory 'ino', if there is one.
+    mxtl::unique_ptr<DirIndex> DirIndexGet(uint32_t ino);
+    // Cache the index of directory 'ino', whose vnode is being released.
+    void DirIndexPut(uint32_t ino, mxtl::unique_ptr<DirIndex> index);
+
     // Allocate a new data block and bcache_get_zero() it.
     // Acquires the block if out_block is not null.
     mx_status_t BlockNew(uint32_t hint, uint32_t* out_bno, mxtl::RefPtr<BlockNode>* out_block);
 
+    // Allocate the first block of a non-empty reservation.
+    mx_status_t BlockNew(BlockReservation* res, uint32_t* out_bno);
+
+    // Reserve a run of up to 'count' free blocks, preferably at or after 'hint'.
+    // If no run of that length exists, progressively shorter runs are tried;
+    // 'res' is left empty if the volume is full.
+    void BlocksReserve(uint32_t hint, uint32_t count, BlockReservation* res);
+
+    // Return the unallocated remainder of a reservation to the free pool.
+    void BlocksUnreserve(BlockReservation* res);
+
     // free ino in inode bitmap, release all blocks held by inode
     mx_status_t InoFree(const minfs_inode_t& inode, uint32_t ino);
 
@@ -89,15 +218,34 @@ private:
     // Find a free inode, allocate it in the inode bitmap, and write it back to disk
     mx_status_t InoNew(const minfs_inode_t* inode, uint32_t* ino_out);
     mx_status_t LoadBitmaps();
+#ifdef __Fuchsia__
+    // Blocks [start, start + count) have been read from disk into 'data';
+    // replace any which the journal holds newer copies of.
+    void JournalOverlay(void* data, uint32_t start, uint32_t count);
+#endif
+
+    // Write back the bitmap block covering 'bno', which has just been set in
+    // block_map_, acquiring the (zeroed) block itself if out_block is not null.
+    mx_status_t BlockCommit(uint32_t bno, mxtl::RefPtr<BlockNode>* out_block);
+
+    // Copy block 'bitblock' (relative to the start of the block bitmap) of
+    // block_map_ into 'data', clearing any bits which are merely reserved.
+    void BitmapBlockCopy(void* data, uint32_t bitblock);
 
     uint32_t abmblks_;
     uint32_t ibmblks_;
     RawBitmap inode_map_;
 #ifdef __Fuchsia__
+    vmoid_t block_map_vmoid_;
+    vmoid_t inode_map_vmoid_;
     mxtl::unique_ptr<MappedVmo> inode_table_;
+    vmoid_t inode_table_vmoid_;
 #endif
     using HashTable = mxtl::HashTable<uint32_t, VnodeMinfs*>;
     HashTable vnode_hash_;
+    mxtl::DoublyLinkedList<BlockReservation*> reservations_;
+    // Most recently released first
+    mxtl::DoublyLinkedList<mxtl::unique_ptr<DirIndex>> dir_indices_;
 };
 
 struct DirArgs {
@@ -149,6 +297,8 @@ public:
     Minfs* fs_;
     uint32_t ino_;
     minfs_inode_t inode_;
+    // Directories only: index of the dirents, if one has been built
+    mxtl::unique_ptr<DirIndex> dir_index_;
 
 private:
     VnodeMinfs(Minfs* fs);
@@ -175,14 +325,22 @@ private:
     mx_status_t AttachRemote(mx_handle_t) final;
 
     mx_status_t InitVmo();
-
-    // Read data from disk at block 'bno', into the 'nth' logical block of the file.
-    mx_status_t FillBlock(uint32_t n, uint32_t bno);
+#ifdef __Fuchsia__
+    // Ensure that logical blocks [start, end) of the file have been read
+    // from disk into the vmo. Missing blocks are read with a single
+    // transaction.
+    mx_status_t VmoLoad(uint32_t start, uint32_t end);
+#endif
 
     // Get the disk block 'bno' corresponding to the 'nth' logical block of the file.
     // Allocate the block if reqeusted.
     mx_status_t GetBno(uint32_t n, uint32_t* bno, bool alloc);
 
+    // Allocate a disk block for the 'nth' logical block of the file, drawing
+    // from (and refilling) the vnode's reservation while the file is growing
+    // sequentially. 'hint' is the preferred location of a new reservation.
+    mx_status_t BlockNewData(uint32_t n, uint32_t hint, uint32_t* bno);
+
     // Deletes all blocks (relateive to a file) from "start" (inclusive) to the end
     // of the file. Does not update mtime/atime.
     mx_status_t BlocksShrink(uint32_t start);
@@ -195,20 +353,54 @@ private:
     // Directories only
     mx_status_t ForEachDirent(DirArgs* args,
                               mx_status_t (*func)(VnodeMinfs*, minfs_dirent_t*, DirArgs*,
-                                                  DirectoryOffset*));
+                                                  DirectoryOffset*),
+                              size_t start = 0);
+    // Like ForEachDirent, but only calls 'func' on dirents which may be named
+    // 'args->name', using (and building, for a large directory) the index.
+    mx_status_t LookupDirent(DirArgs* args,
+                             mx_status_t (*func)(VnodeMinfs*, minfs_dirent_t*, DirArgs*,
+                                                 DirectoryOffset*));
+    // Adds a dirent for 'args', using free space in an existing record.
+    mx_status_t AppendDirent(DirArgs* args);
+    // Claims this directory's cached index, or builds one if the directory is large.
+    void DirIndexInit();
 
 #ifdef __Fuchsia__
     // The following functionality interacts with handles directly, and are not applicable outside
     // Fuchsia (since there is no "handle-equivalent" in host-side tools).
     mx_status_t GetHandles(uint32_t flags, mx_handle_t* hnds,
                            uint32_t* type, void* extra, uint32_t* esize) final;
+    mx_status_t Mmap(uint32_t flags, size_t len, size_t* off, mx_handle_t* out) final;
+    // Writes every block of vmo_ back to disk, since stores through shared
+    // mappings of it cannot be seen (or tracked) as they happen.
+    mx_status_t SyncMapped();
 
     // TODO(smklein): When we have can register MinFS as a pager service, and
     // it can properly handle pages faults on a vnode's contents, then we can
     // avoid reading the entire file up-front. Until then, read the contents of
     // a VMO into memory when it is read/written.
     mx_handle_t vmo_;
+    // Identifies vmo_ to the block device, once it has been attached.
+    vmoid_t vmoid_;
+    // Tracks which of the blocks present on disk when vmo_ was created
+    // have since been loaded into it. Later blocks are always present.
+    bitmap::RawBitmapGeneric<bitmap::DefaultStorage> vmo_loaded_;
+    // Logical block expected next from a sequential reader, and the
+    // number of blocks to read ahead of it.
+    uint32_t readahead_next_;
+    uint32_t readahead_window_;
+    // Set once vmo_ has been handed out for a shared writable mapping, and
+    // cleared when the last connection to the file closes.
+    bool mapped_writable_;
+    // Number of connections open to the vnode.
+    uint32_t open_count_;
 #endif
+
+    BlockReservation reservation_;
+    // Size of the next reservation
+    uint32_t reserve_window_;
+    // Logical block expected to be allocated next while growing sequentially
+    uint32_t reserve_next_;
 };
 
 // write the inode data of this vnode to disk (default does not update time values)
@@ -7,6 +7,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <bitmap/raw-bitmap.h>
@@ -37,6 +38,7 @@ void minfs_dump_info(minfs_info_t* info) {
     printf("minfs: inode bitmap @ %10u\n", info->ibm_block);
     printf("minfs: alloc bitmap @ %10u\n", info->abm_block);
     printf("minfs: inode table  @ %10u\n", info->ino_block);
+    printf("minfs: journal      @ %10u (%u blocks)\n", info->jnl_block, info->jnl_blocks);
     printf("minfs: data blocks  @ %10u\n", info->dat_block);
 }
 
@@ -46,7 +48,10 @@ mx_status_t minfs_check_info(minfs_info_t* info, uint32_t max) {
         error("minfs: bad magic\n");
         return ERR_INVALID_ARGS;
     }
-    if (info->version != kMinfsVersion) {
+    if (info->version == kMinfsVersionNoJournal) {
+        info->jnl_block = 0;
+        info->jnl_blocks = 0;
+    } else if (info->version != kMinfsVersion) {
         error("minfs: FS Version: %08x. Driver version: %08x\n", info->version,
               kMinfsVersion);
         return ERR_INVALID_ARGS;
@@ -60,6 +65,12 @@ mx_status_t minfs_check_info(minfs_info_t* info, uint32_t max) {
         error("minfs: too large for device\n");
         return ERR_INVALID_ARGS;
     }
+    if ((info->jnl_blocks != 0) &&
+        ((info->jnl_blocks < 3) || (info->jnl_block <= info->ino_block) ||
+         (info->jnl_block + info->jnl_blocks > info->dat_block))) {
+        error("minfs: bad journal location %u (%u blocks)\n", info->jnl_block, info->jnl_blocks);
+        return ERR_INVALID_ARGS;
+    }
     //TODO: validate layout
     return 0;
 }
@@ -67,19 +78,28 @@ mx_status_t minfs_check_info(minfs_info_t* info, uint32_t max) {
 mx_status_t Minfs::InodeSync(uint32_t ino, const minfs_inode_t* inode) {
     // Obtain the offset of the inode within its containing block
     uint32_t off_of_ino = (ino % kMinfsInodesPerBlock) * kMinfsInodeSize;
+    uint32_t bno_of_ino = info_.ino_block + (ino / kMinfsInodesPerBlock);
 #ifdef __Fuchsia__
     void* inodata = (void*)((uintptr_t)(inode_table_->GetData()) +
                             (uintptr_t)((ino / kMinfsInodesPerBlock) * kMinfsBlockSize));
+    memcpy((void*)((uintptr_t)inodata + off_of_ino), inode, kMinfsInodeSize);
+
+    if (bc_->Journaled()) {
+        return bc_->Log(bno_of_ino, inodata);
+    }
+
+    // commit the block straight from the inode table
+    WriteTxn txn(bc_);
+    txn.Enqueue(inode_table_vmoid_, ino / kMinfsInodesPerBlock, bno_of_ino, 1);
+    return txn.Flush();
 #else
     uint8_t inodata[kMinfsBlockSize];
-    bc_->Readblk(info_.ino_block + (ino / kMinfsInodesPerBlock), inodata);
-#endif
+    bc_->Readblk(bno_of_ino, inodata);
     memcpy((void*)((uintptr_t)inodata + off_of_ino), inode, kMinfsInodeSize);
 
     // commit blocks to disk
-    uint32_t bno_of_ino = info_.ino_block + (ino / kMinfsInodesPerBlock);
-    bc_->Writeblk(bno_of_ino, inodata);
-    return NO_ERROR;
+    return bc_->Log(bno_of_ino, inodata);
+#endif
 }
 
 Minfs::Minfs(Bcache* bc, minfs_info_t* info) : bc_(bc) {
@@ -106,6 +126,7 @@ mx_status_t Minfs::InoFree(const minfs_inode_t& inode, uint32_t ino) {
     bc_->Put(block_ibm, kBlockDirty);
 
     mxtl::RefPtr<BlockNode> bitmap_blk;
+    mx_status_t status;
 
     // release all direct blocks
     for (unsigned n = 0; n < kMinfsDirect; n++) {
@@ -115,6 +136,10 @@ mx_status_t Minfs::InoFree(const minfs_inode_t& inode, uint32_t ino) {
         if ((bitmap_blk = BitmapBlockGet(bitmap_blk, inode.dnum[n])) == nullptr) {
             return ERR_IO;
         }
+        if ((status = bc_->Forget(inode.dnum[n])) != NO_ERROR) {
+            BitmapBlockPut(bitmap_blk);
+            return status;
+        }
         block_map_.Clear(inode.dnum[n], inode.dnum[n] + 1);
     }
 
@@ -138,6 +163,11 @@ mx_status_t Minfs::InoFree(const minfs_inode_t& inode, uint32_t ino) {
                 bc_->Put(blk, 0);
                 return ERR_IO;
             }
+            if ((status = bc_->Forget(entry[m])) != NO_ERROR) {
+                BitmapBlockPut(bitmap_blk);
+                bc_->Put(blk, 0);
+                return status;
+            }
             block_map_.Clear(entry[m], entry[m] + 1);
         }
         bc_->Put(blk, 0);
@@ -145,6 +175,10 @@ mx_status_t Minfs::InoFree(const minfs_inode_t& inode, uint32_t ino) {
         if ((bitmap_blk = BitmapBlockGet(bitmap_blk, inode.inum[n])) == nullptr) {
             return ERR_IO;
         }
+        if ((status = bc_->Forget(inode.inum[n])) != NO_ERROR) {
+            BitmapBlockPut(bitmap_blk);
+            return status;
+        }
         block_map_.Clear(inode.inum[n], inode.inum[n] + 1);
     }
     BitmapBlockPut(bitmap_blk);
@@ -226,6 +260,20 @@ void Minfs::VnodeRelease(VnodeMinfs* vn) {
     vnode_hash_.erase(*vn);
 }
 
+mxtl::unique_ptr<DirIndex> Minfs::DirIndexGet(uint32_t ino) {
+    return dir_indices_.erase_if([ino](const DirIndex& index) {
+        return index.ino_ == ino;
+    });
+}
+
+void Minfs::DirIndexPut(uint32_t ino, mxtl::unique_ptr<DirIndex> index) {
+    index->ino_ = ino;
+    dir_indices_.push_front(mxtl::move(index));
+    if (dir_indices_.size_slow() > kMinfsDirIndexCacheSize) {
+        dir_indices_.pop_back();
+    }
+}
+
 mx_status_t Minfs::VnodeGet(VnodeMinfs** out, uint32_t ino) {
     if ((ino < 1) || (ino >= info_.inode_count)) {
         return ERR_OUT_OF_RANGE;
@@ -268,24 +316,54 @@ mx_status_t Minfs::VnodeGet(VnodeMinfs** out, uint32_t ino) {
 mx_status_t Minfs::BlockNew(uint32_t hint, uint32_t* out_bno, mxtl::RefPtr<BlockNode> *out_block) {
     size_t bitoff_start;
     mx_status_t status;
-    if ((status = block_map_.Find(false, hint, block_map_.size(), 1, &bitoff_start)) != NO_ERROR) {
-        if ((status = block_map_.Find(false, 0, hint, 1, &bitoff_start)) != NO_ERROR) {
+    while ((status = block_map_.Find(false, hint, block_map_.size(), 1, &bitoff_start)) != NO_ERROR) {
+        if ((status = block_map_.Find(false, 0, hint, 1, &bitoff_start)) == NO_ERROR) {
+            break;
+        }
+        if (reservations_.is_empty()) {
             return ERR_NO_SPACE;
         }
+        // The only free blocks left are reserved; give them all up and retry.
+        while (!reservations_.is_empty()) {
+            BlocksUnreserve(&reservations_.front());
+        }
     }
     status = block_map_.Set(bitoff_start, bitoff_start + 1);
     assert(status == NO_ERROR);
     uint32_t bno = static_cast<uint32_t>(bitoff_start);
     assert(bno != 0); // Cannot allocate root block
 
+    if ((status = BlockCommit(bno, out_block)) != NO_ERROR) {
+        return status;
+    }
+    *out_bno = bno;
+    return NO_ERROR;
+}
+
+mx_status_t Minfs::BlockNew(BlockReservation* res, uint32_t* out_bno) {
+    assert(res->count > 0);
+    // The block is already set in block_map_; it only needs to be committed.
+    uint32_t bno = res->start++;
+    if (--res->count == 0) {
+        reservations_.erase(*res);
+    }
+
+    mx_status_t status;
+    if ((status = BlockCommit(bno, nullptr)) != NO_ERROR) {
+        return status;
+    }
+    *out_bno = bno;
+    return NO_ERROR;
+}
+
+mx_status_t Minfs::BlockCommit(uint32_t bno, mxtl::RefPtr<BlockNode>* out_block) {
     // obtain the in-memory bitmap block
-    uint32_t bmbno;
-    void *bmdata = GetBitBlock(block_map_, &bmbno, bno); // bmbno relative to bitmap
-    bmbno += info_.abm_block;                            // bmbno relative to block device
+    uint32_t bmbno = bno / kMinfsBlockBits; // bmbno relative to bitmap
 
     // obtain the block of the alloc bitmap we need
     mxtl::RefPtr<BlockNode> block_abm;
-    if ((block_abm = bc_->Get(bmbno)) == nullptr) {
+    if ((block_abm = bc_->Get(info_.abm_block + bmbno)) == nullptr) {
+        bc_->Forget(bno);
         block_map_.Clear(bno, bno + 1);
         return ERR_IO;
     }
@@ -293,6 +371,7 @@ mx_status_t Minfs::BlockNew(uint32_t hint, uint32_t* out_bno, mxtl::RefPtr<Block
     // obtain the block we're allocating, if requested.
     if (out_block != nullptr) {
         if ((*out_block = bc_->GetZero(bno)) == nullptr) {
+            bc_->Forget(bno);
             block_map_.Clear(bno, bno + 1);
             bc_->Put(block_abm, 0);
             return ERR_IO;
@@ -300,12 +379,57 @@ mx_status_t Minfs::BlockNew(uint32_t hint, uint32_t* out_bno, mxtl::RefPtr<Block
     }
 
     // commit the bitmap
-    memcpy(block_abm->data(), bmdata, kMinfsBlockSize);
+    BitmapBlockCopy(block_abm->data(), bmbno);
     bc_->Put(block_abm, kBlockDirty);
-    *out_bno = bno;
     return NO_ERROR;
 }
 
+void Minfs::BlocksReserve(uint32_t hint, uint32_t count, BlockReservation* res) {
+    assert(res->count == 0);
+    size_t start;
+    for (; count > 0; count /= 2) {
+        if ((block_map_.Find(false, hint, block_map_.size(), count, &start) == NO_ERROR) ||
+            ((hint > 0) && (block_map_.Find(false, 0, hint, count, &start) == NO_ERROR))) {
+            break;
+        }
+    }
+    if (count == 0) {
+        return;
+    }
+    block_map_.Set(start, start + count);
+    res->start = static_cast<uint32_t>(start);
+    res->count = count;
+    reservations_.push_back(res);
+}
+
+void Minfs::BlocksUnreserve(BlockReservation* res) {
+    if (res->count == 0) {
+        return;
+    }
+    for (uint32_t n = 0; n < res->count; n++) {
+        bc_->Forget(res->start + n);
+    }
+    block_map_.Clear(res->start, res->start + res->count);
+    reservations_.erase(*res);
+    res->count = 0;
+}
+
+void Minfs::BitmapBlockCopy(void* data, uint32_t bitblock) {
+    memcpy(data, GetBlock(block_map_, bitblock), kMinfsBlockSize);
+
+    // Reserved blocks are not yet allocated as far as the disk is concerned.
+    uint32_t first = bitblock * kMinfsBlockBits;
+    uint32_t last = first + kMinfsBlockBits;
+    uint8_t* bits = static_cast<uint8_t*>(data);
+    for (const auto& res : reservations_) {
+        uint32_t start = mxtl::max(res.start, first);
+        uint32_t end = mxtl::min(res.start + res.count, last);
+        for (uint32_t n = start; n < end; n++) {
+            bits[(n - first) / 8] = static_cast<uint8_t>(bits[(n - first) / 8] & ~(1 << (n % 8)));
+        }
+    }
+}
+
 void minfs_dir_init(void* bdata, uint32_t ino_self, uint32_t ino_parent) {
 #define DE0_SIZE DirentSize(1)
 
@@ -362,6 +486,12 @@ mx_status_t Minfs::Create(Minfs** out, Bcache* bc, minfs_info_t* info) {
         return status;
     }
 
+    if ((info->jnl_blocks != 0) &&
+        ((status = bc->JournalInit(info->jnl_block, info->jnl_blocks)) != NO_ERROR)) {
+        error("minfs: cannot load journal\n");
+        return status;
+    }
+
     if ((status = fs->LoadBitmaps()) < 0) {
         return status;
     }
@@ -373,21 +503,54 @@ mx_status_t Minfs::Create(Minfs** out, Bcache* bc, minfs_info_t* info) {
     uint32_t inoblks = (inodes + kMinfsInodesPerBlock - 1) / kMinfsInodesPerBlock;
     if ((status = MappedVmo::Create(inoblks * kMinfsBlockSize, &fs->inode_table_)) != NO_ERROR) {
         return status;
+    } else if ((status = fs->bc_->AttachVmo(fs->inode_table_->GetVmo(),
+                                            &fs->inode_table_vmoid_)) != NO_ERROR) {
+        return status;
     }
 
-    for (uint32_t n = 0; n < inoblks; n++) {
-        void* bmdata = (void*)((uintptr_t)(fs->inode_table_->GetData()) +
-                               (uintptr_t)(kMinfsBlockSize * n));
-        if (fs->bc_->Readblk(fs->info_.ino_block + n, bmdata)) {
-            error("minfs: failed reading inode table\n");
-        }
+    ReadTxn txn(fs->bc_);
+    txn.Enqueue(fs->inode_table_vmoid_, 0, fs->info_.ino_block, inoblks);
+    if ((status = txn.Flush()) != NO_ERROR) {
+        error("minfs: failed reading inode table\n");
+        return status;
     }
+    fs->JournalOverlay(fs->inode_table_->GetData(), fs->info_.ino_block, inoblks);
 #endif
 
     *out = fs.release();
     return NO_ERROR;
 }
 
+#ifdef __Fuchsia__
+mx_status_t Minfs::LoadBitmaps() {
+    mx_status_t status;
+    if ((status = bc_->AttachVmo(block_map_.StorageUnsafe()->GetVmo(),
+                                 &block_map_vmoid_)) != NO_ERROR) {
+        return status;
+    } else if ((status = bc_->AttachVmo(inode_map_.StorageUnsafe()->GetVmo(),
+                                        &inode_map_vmoid_)) != NO_ERROR) {
+        return status;
+    }
+
+    // Both bitmaps are contiguous on disk; each is loaded with a single request.
+    ReadTxn txn(bc_);
+    txn.Enqueue(block_map_vmoid_, 0, info_.abm_block, abmblks_);
+    txn.Enqueue(inode_map_vmoid_, 0, info_.ibm_block, ibmblks_);
+    if ((status = txn.Flush()) != NO_ERROR) {
+        error("minfs: failed reading bitmaps\n");
+        return status;
+    }
+    JournalOverlay(block_map_.StorageUnsafe()->GetData(), info_.abm_block, abmblks_);
+    JournalOverlay(inode_map_.StorageUnsafe()->GetData(), info_.ibm_block, ibmblks_);
+    return NO_ERROR;
+}
+
+void Minfs::JournalOverlay(void* data, uint32_t start, uint32_t count) {
+    for (uint32_t n = 0; n < count; n++) {
+        bc_->JournalRead(start + n, (void*)((uintptr_t)data + (uintptr_t)n * kMinfsBlockSize));
+    }
+}
+#else
 mx_status_t Minfs::LoadBitmaps() {
     for (uint32_t n = 0; n < abmblks_; n++) {
         void* bmdata = GetBlock(block_map_, n);
@@ -403,6 +566,7 @@ mx_status_t Minfs::LoadBitmaps() {
     }
     return NO_ERROR;
 }
+#endif
 
 mx_status_t minfs_mount(VnodeMinfs** out, Bcache* bc) {
     minfs_info_t info;
@@ -413,6 +577,9 @@ mx_status_t minfs_mount(VnodeMinfs** out, Bcache* bc) {
         return status;
     }
 
+    // Volumes made before the journal are mounted as they are, without one
+    // (see minfs_check_info); block 0 is not rewritten, so older drivers
+    // can still mount them.
     Minfs* fs;
     if ((status = Minfs::Create(&fs, bc, &info)) != NO_ERROR) {
         error("minfs: mount failed\n");
@@ -462,7 +629,13 @@ int minfs_mkfs(Bcache* bc) {
     info.ibm_block = 8;
     info.abm_block = info.ibm_block + mxtl::roundup(ibmblks, 8u);
     info.ino_block = info.abm_block + mxtl::roundup(abmblks, 8u);
-    info.dat_block = info.ino_block + inoblks;
+    // The journal follows the inode table; small volumes get a smaller one.
+    info.jnl_block = info.ino_block + inoblks;
+    info.jnl_blocks = mxtl::min(kMinfsJournalBlocks, blocks / 64);
+    if (info.jnl_blocks < 16) {
+        info.jnl_blocks = 0;
+    }
+    info.dat_block = info.jnl_block + info.jnl_blocks;
     minfs_dump_info(&info);
 
     RawBitmap abm;
@@ -529,6 +702,18 @@ int minfs_mkfs(Bcache* bc) {
         bc->Put(blk, kBlockDirty);
     }
 
+    // write an empty journal, whose records are numbered from an arbitrary
+    // point so that none left behind by a previous filesystem are replayed
+    if (info.jnl_blocks != 0) {
+        blk = bc->GetZero(info.jnl_block);
+        minfs_journal_info_t* jinfo = static_cast<minfs_journal_info_t*>(blk->data());
+        jinfo->magic = kMinfsJournalMagic;
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        jinfo->seq = static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+        bc->Put(blk, kBlockDirty);
+    }
+
     // setup root inode
     blk = bc->Get(info.ino_block);
     minfs_inode_t* ino = (minfs_inode_t*) blk->data();
@@ -8,13 +8,21 @@
 #include <bitmap/storage.h>
 #include <mxtl/intrusive_double_list.h>
 #include <mxtl/intrusive_hash_table.h>
+#include <mxtl/intrusive_wavl_tree.h>
 #include <mxtl/macros.h>
 #include <mxtl/ref_counted.h>
 #include <mxtl/ref_ptr.h>
 #include <mxtl/unique_free_ptr.h>
+#include <mxtl/unique_ptr.h>
 
 #include <magenta/types.h>
 
+#ifdef __Fuchsia__
+#include <block-client/client.h>
+#include <fs/mapped-vmo.h>
+#include <magenta/device/block.h>
+#endif
+
 #include <assert.h>
 #include <limits.h>
 #include <stdint.h>
@@ -34,7 +42,10 @@ namespace minfs {
 
 constexpr uint64_t kMinfsMagic0 = (0x002153466e694d21ULL);
 constexpr uint64_t kMinfsMagic1 = (0x385000d3d3d3d304ULL);
-constexpr uint32_t kMinfsVersion = 0x00000002;
+constexpr uint32_t kMinfsVersion = 0x00000003;
+// Laid out like the current version, but with no journal; jnl_block and
+// jnl_blocks were zeroed padding.  Mounted as is, without a journal.
+constexpr uint32_t kMinfsVersionNoJournal = 0x00000002;
 
 constexpr uint32_t kMinfsRootIno        = 1;
 constexpr uint32_t kMinfsFlagClean      = 1;
@@ -72,6 +83,8 @@ typedef struct {
     uint32_t abm_block;     // first blockno of block allocation bitmap
     uint32_t ino_block;     // first blockno of inode table
     uint32_t dat_block;     // first blockno available for file data
+    uint32_t jnl_block;     // first blockno of metadata journal
+    uint32_t jnl_blocks;    // size of metadata journal (0 if none)
 } minfs_info_t;
 
 // Notes:
@@ -87,6 +100,8 @@ typedef struct {
 //     ino_block + ino / kMinfsInodesPerBlock
 //   at offset: ino % kMinfsInodesPerBlock
 // - inode 0 is never used, should be marked allocated but ignored
+// - the journal, if present, lies between the inode table and the
+//   data blocks (see minfs_journal_info_t)
 
 typedef struct {
     uint32_t magic;
@@ -106,6 +121,47 @@ typedef struct {
 static_assert(sizeof(minfs_inode_t) == kMinfsInodeSize,
               "minfs inode size is wrong");
 
+constexpr uint64_t kMinfsJournalMagic       = (0x6c6e726a73666e6dULL);
+constexpr uint64_t kMinfsJournalRecordMagic = (0x6472636573666e6dULL);
+constexpr uint32_t kMinfsJournalBlocks      = 256;
+constexpr uint32_t kMinfsJournalEntries     = (kMinfsBlockSize - 32) / sizeof(uint32_t);
+
+// The first block of the journal. Records follow it, starting at the
+// second block of the journal.
+typedef struct {
+    uint64_t magic;
+    uint64_t seq;                   // seq of the first valid record
+} minfs_journal_info_t;
+
+// Header of a journal record, which is immediately followed by the
+// 'count' metadata blocks it contains.
+typedef struct {
+    uint64_t magic;
+    uint64_t seq;                   // one more than the preceding record
+    uint64_t checksum;              // of the header (with checksum 0) and blocks
+    uint32_t count;                 // number of blocks in the record
+    uint32_t revoked;               // number of blocks revoked by the record
+    uint32_t bno[kMinfsJournalEntries]; // home location of each block, followed
+                                        // by the blocks revoked
+} minfs_journal_record_t;
+
+static_assert(sizeof(minfs_journal_record_t) == kMinfsBlockSize,
+              "minfs journal record header size is wrong");
+
+// Notes:
+// - metadata blocks (bitmaps, inodes, directories and indirect blocks) are
+//   written to the journal before they are written to their home location
+// - each record is written with a single request; a record whose checksum
+//   does not match was torn by a crash, and ends the journal
+// - on mount, records are replayed from the second block of the journal for
+//   as long as their seq follows on from the journal info
+// - a block freed while an earlier record holds a copy of it is revoked by
+//   the next record, so that replay drops the stale copy rather than
+//   writing it over whatever the block is reused for; a record's
+//   revocations apply before its blocks
+// - once every block in the journal has been written home, the seq in the
+//   journal info is advanced, discarding all records
+
 typedef struct {
     uint32_t ino;                   // inode number
     uint32_t reclen;                // Low 28 bits: Length of record
@@ -229,6 +285,83 @@ private:
     LinkedList list_free_;  // Never been used. Not in hash.
 };
 
+// A metadata block held by the journal until it has been written home.
+struct JournalBlock : public mxtl::WAVLTreeContainable<mxtl::unique_ptr<JournalBlock>> {
+    uint32_t GetKey() const { return bno; }
+
+    uint32_t bno;
+    uint8_t data[kMinfsBlockSize];
+};
+
+// Write-ahead journal of metadata blocks (journal.cpp).
+//
+// Blocks logged during a filesystem operation accumulate in memory and are
+// written to the journal as a single record when the operation commits, so
+// an operation costs one sequential write no matter how many bitmap, inode
+// and directory blocks it touches. Committed blocks are written home later,
+// in bulk ("checkpointing"): when the journal is full, or on unmount. Until
+// then, reads of those blocks are served from the journal.
+class Journal {
+public:
+    DISALLOW_COPY_ASSIGN_AND_MOVE(Journal);
+    // Loads the journal of 'blocks' blocks starting at 'start', holding on
+    // to the blocks of any records found there until the next checkpoint.
+    static mx_status_t Create(Bcache* bc, uint32_t start, uint32_t blocks,
+                              mxtl::unique_ptr<Journal>* out);
+    ~Journal();
+
+    // Adds block 'bno' to the current transaction.
+    mx_status_t Log(uint32_t bno, const void* data);
+    // Copies the latest logged contents of 'bno' into 'data', returning false
+    // if the journal does not hold the block.
+    bool Read(uint32_t bno, void* data) const;
+    // Block 'bno' has been freed, so an old copy must never be written home
+    // after it is reallocated; any committed copy is dropped, and revoked by
+    // the next record.
+    mx_status_t Forget(uint32_t bno);
+
+    // Writes the current transaction to the journal as one record.
+    mx_status_t Commit();
+    // Writes all committed blocks home and empties the journal.
+    mx_status_t Checkpoint();
+
+    // True once anything has been committed since the journal was loaded.
+    bool Dirty() const { return dirty_; }
+
+private:
+    Journal(Bcache* bc, uint32_t start, uint32_t blocks);
+    mx_status_t Replay();
+
+    // Staging buffer for block 'n' of the journal.
+    void* Slot(uint32_t n) const {
+        return (void*)((uintptr_t)buffer_ + (uintptr_t)n * kMinfsBlockSize);
+    }
+    // Writes staged blocks [n, n + count) to the same blocks of the journal.
+    mx_status_t WriteSlots(uint32_t n, uint32_t count);
+    uint64_t Checksum(uint32_t n) const;
+
+    using BlockTree = mxtl::WAVLTree<uint32_t, mxtl::unique_ptr<JournalBlock>>;
+
+    Bcache* bc_;
+    uint32_t start_;   // First block of the journal on disk
+    uint32_t blocks_;  // Size of the journal, including its info block
+    uint32_t head_;    // Journal block at which the next record is written
+    uint64_t seq_;     // Sequence number of the next record
+    uint32_t max_txn_; // Blocks per record
+    bool dirty_;
+    BlockTree txn_;       // Logged, but not yet committed
+    BlockTree committed_; // Committed, but not yet written home
+    uint32_t revoked_count_;
+    uint32_t revoked_[kMinfsJournalEntries]; // To be revoked by the next record
+#ifdef __Fuchsia__
+    mxtl::unique_ptr<MappedVmo> vmo_;
+    vmoid_t vmoid_;
+#else
+    mxtl::unique_free_ptr<char> data_;
+#endif
+    void* buffer_;     // Mirror of the journal, used to stage writes
+};
+
 class Bcache {
 public:
     DISALLOW_COPY_ASSIGN_AND_MOVE(Bcache);
@@ -238,7 +371,8 @@ public:
                               uint32_t num);
 
     // Raw block read functions.
-    // These do not track blocks (or attempt to access the block cache)
+    // These do not track blocks (or attempt to access the block cache).
+    // Reads return the journal's copy of a block, if it holds one.
     mx_status_t Readblk(uint32_t bno, void* data);
     mx_status_t Writeblk(uint32_t bno, const void* data);
 
@@ -253,8 +387,31 @@ public:
 
     // release a block back to the cache
     // flags *must* contain kBlockDirty if it was modified
+    // (dirty blocks are written through the journal, if there is one)
     void Put(mxtl::RefPtr<BlockNode> blk, uint32_t flags);
 
+    // Loads the metadata journal, after which metadata writes (and reads)
+    // go through it.
+    mx_status_t JournalInit(uint32_t start, uint32_t blocks);
+    bool Journaled() const { return journal_ != nullptr; }
+    // If the journal holds a newer copy of block 'bno' than the disk, copy
+    // it into 'data'.
+    bool JournalRead(uint32_t bno, void* data) const {
+        return (journal_ != nullptr) && journal_->Read(bno, data);
+    }
+    // Write a metadata block which is not held in the cache, through the
+    // journal if there is one.
+    mx_status_t Log(uint32_t bno, const void* data);
+    // Block 'bno' is about to be freed: drops it from the cache and the
+    // journal, so no stale copy is written over it once it is reused.
+    // Must be called before its bit is cleared in the block bitmap.
+    mx_status_t Forget(uint32_t bno);
+
+    // Metadata written between the outermost BeginOp and EndOp is committed
+    // to the journal as a single transaction (see Transaction).
+    void BeginOp() { op_depth_++; }
+    void EndOp();
+
     // Helper functions which combine 'Get' and 'Put'.
     mx_status_t Read(uint32_t bno, void* data, uint32_t off, uint32_t len);
     mx_status_t Write(uint32_t bno, const void* data, uint32_t off, uint32_t len);
@@ -262,13 +419,34 @@ public:
     // drop all non-busy, non-dirty blocks
     void Invalidate();
 
+    // Commit the current transaction, if any, and flush the device.
     int Sync();
+    // Write back everything held by the journal and close the device.
     int Close();
 
+#ifdef __Fuchsia__
+    // Hands a duplicate of 'vmo' to the block device's fifo server, returning
+    // the vmoid which identifies it in subsequent block fifo requests.
+    mx_status_t AttachVmo(mx_handle_t vmo, vmoid_t* out);
+    // Releases the block device's handle to a previously attached VMO.
+    mx_status_t DetachVmo(vmoid_t vmoid);
+
+    // Issues 'count' requests to the block device as a single fifo
+    // transaction, waiting for all of them to complete.
+    mx_status_t Txn(block_fifo_request_t* requests, size_t count);
+    // Waits until every write which has completed is on stable storage.
+    mx_status_t Flush();
+#endif
+
     ~Bcache();
 
 private:
     Bcache(int fd, uint32_t blockmax, uint32_t blocksize);
+#ifdef __Fuchsia__
+    // Connects to the block device's fifo server and attaches the scratch
+    // VMO used by Readblk / Writeblk.
+    mx_status_t InitFifo();
+#endif
 
     mxtl::RefPtr<BlockNode> Get(uint32_t bno, uint32_t mode);
 
@@ -279,8 +457,93 @@ private:
     int fd_;
     uint32_t blockmax_;
     uint32_t blocksize_;
+    mxtl::unique_ptr<Journal> journal_;
+    uint32_t op_depth_;
+#ifdef __Fuchsia__
+    fifo_client_t* fifo_client_;
+    txnid_t txnid_;
+    // Single-block VMO backing Readblk / Writeblk
+    mxtl::unique_ptr<MappedVmo> blk_vmo_;
+    vmoid_t blk_vmoid_;
+#endif
 };
 
+// Groups the metadata updates made by a filesystem operation into a single
+// journal transaction, which is committed when the outermost Transaction goes
+// out of scope.
+class Transaction {
+public:
+    DISALLOW_COPY_ASSIGN_AND_MOVE(Transaction);
+    explicit Transaction(Bcache* bc) : bc_(bc) { bc_->BeginOp(); }
+    ~Transaction() { bc_->EndOp(); }
+
+private:
+    Bcache* bc_;
+};
+
+#ifdef __Fuchsia__
+// Accumulates block requests of a single type (BLOCKIO_READ or BLOCKIO_WRITE)
+// against VMOs attached to the block device, and issues them together.
+//
+// Requests which are contiguous both within the VMO and on the device are
+// merged into a single request, so reading or writing a run of adjacent
+// blocks costs one fifo message. Offsets and lengths are in units of
+// kMinfsBlockSize.
+template <uint16_t Opcode>
+class BlockTxn {
+public:
+    DISALLOW_COPY_ASSIGN_AND_MOVE(BlockTxn);
+    explicit BlockTxn(Bcache* bc) : bc_(bc), count_(0) {}
+    ~BlockTxn() { assert(count_ == 0); }
+
+    mx_status_t Enqueue(vmoid_t vmoid, uint64_t vmo_blk, uint64_t dev_blk, uint64_t nblocks) {
+        uint64_t vmo_offset = vmo_blk * kMinfsBlockSize;
+        uint64_t dev_offset = dev_blk * kMinfsBlockSize;
+        uint64_t length = nblocks * kMinfsBlockSize;
+        if (count_ > 0) {
+            block_fifo_request_t* last = &requests_[count_ - 1];
+            if ((last->vmoid == vmoid) &&
+                (last->vmo_offset + last->length == vmo_offset) &&
+                (last->dev_offset + last->length == dev_offset)) {
+                last->length += length;
+                return NO_ERROR;
+            }
+        }
+        if (count_ == MAX_TXN_MESSAGES) {
+            mx_status_t status;
+            if ((status = Flush()) != NO_ERROR) {
+                return status;
+            }
+        }
+        block_fifo_request_t* req = &requests_[count_++];
+        req->vmoid = vmoid;
+        req->opcode = Opcode;
+        req->length = length;
+        req->vmo_offset = vmo_offset;
+        req->dev_offset = dev_offset;
+        return NO_ERROR;
+    }
+
+    // Sends all pending requests and waits for them to complete.
+    mx_status_t Flush() {
+        if (count_ == 0) {
+            return NO_ERROR;
+        }
+        mx_status_t status = bc_->Txn(requests_, count_);
+        count_ = 0;
+        return status;
+    }
+
+private:
+    Bcache* bc_;
+    size_t count_;
+    block_fifo_request_t requests_[MAX_TXN_MESSAGES];
+};
+
+using ReadTxn = BlockTxn<BLOCKIO_READ>;
+using WriteTxn = BlockTxn<BLOCKIO_WRITE>;
+#endif
+
 void* GetBlock(const RawBitmap& bitmap, uint32_t blkno);
 void* GetBitBlock(const RawBitmap& bitmap, uint32_t* blkno_out, uint32_t bitno);
 
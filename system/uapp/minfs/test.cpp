@@ -19,6 +19,7 @@
 #include "misc.h"
 
 void drop_cache();
+int crash_remount();
 
 #define TRY(func) ({\
     int ret = (func); \
@@ -308,6 +309,62 @@ int test_rename() {
     return 0;
 }
 
+// Metadata committed to the journal, but not yet written home, must survive
+// the loss of everything held in memory.
+int test_crash() {
+    char path[64];
+    char data[3 * 8192];
+    TRY(emu_mkdir("::crash", 0755));
+    for (int i = 0; i < 64; i++) {
+        snprintf(path, sizeof(path), "::crash/file%d", i);
+        int fd = TRY(emu_open(path, O_RDWR | O_CREAT | O_EXCL, 0644));
+        memset(data, i, sizeof(data));
+        TRY(emu_write(fd, data, (i % 3 + 1) * 8192));
+        emu_close(fd);
+        if (i % 16 == 0) {
+            snprintf(path, sizeof(path), "::crash/dir%d", i);
+            TRY(emu_mkdir(path, 0755));
+        }
+    }
+    for (int i = 1; i < 64; i += 2) {
+        snprintf(path, sizeof(path), "::crash/file%d", i);
+        TRY(emu_unlink(path));
+    }
+
+    TRY(crash_remount());
+
+    struct stat s;
+    for (int i = 0; i < 64; i++) {
+        snprintf(path, sizeof(path), "::crash/file%d", i);
+        int fd = emu_open(path, O_RDWR, 0644);
+        if (i % 2) {
+            EXPECT_FAIL(fd);
+            continue;
+        }
+        TRY(fd);
+        TRY(emu_fstat(fd, &s));
+        if (s.st_size != (i % 3 + 1) * 8192) {
+            fprintf(stderr, "error: %s has size %lld\n", path, (long long)s.st_size);
+            return -1;
+        }
+        TRY(emu_read(fd, data, sizeof(data)));
+        for (off_t n = 0; n < s.st_size; n++) {
+            if (data[n] != (char)i) {
+                fprintf(stderr, "error: %s has bad data at %lld\n", path, (long long)n);
+                return -1;
+            }
+        }
+        emu_close(fd);
+        TRY(emu_unlink(path));
+        if (i % 16 == 0) {
+            snprintf(path, sizeof(path), "::crash/dir%d", i);
+            TRY(emu_unlink(path));
+        }
+    }
+    TRY(emu_unlink("::crash"));
+    return 0;
+}
+
 int run_fs_tests(int argc, char** argv) {
     fprintf(stderr, "--- fs tests ---\n");
     if (argc > 0) {
@@ -323,6 +380,9 @@ int run_fs_tests(int argc, char** argv) {
         if (!strcmp(argv[0], "rename")) {
             return test_rename();
         }
+        if (!strcmp(argv[0], "crash")) {
+            return test_crash();
+        }
         fprintf(stderr, "unknown test: %s\n", argv[0]);
         return -1;
     }
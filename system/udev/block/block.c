@@ -22,8 +22,11 @@
 
 #define FLAG_BG_THREAD_JOINABLE       0x0001
 
+// Each open of the block device creates an instance, with its own fifo and
+// server thread, so that several clients may issue I/O in parallel.
 typedef struct blkdev {
     mx_device_t device;
+    mx_device_t* core; // The device implementing blockops
     block_ops_t* blockops;
 
     mtx_t lock;
@@ -37,7 +40,7 @@ typedef struct blkdev {
 static int blockserver_thread(void* arg) {
     blkdev_t* bdev = (blkdev_t*)arg;
     BlockServer* bs = bdev->bs;
-    blockserver_serve(bs, bdev->device.parent, bdev->blockops);
+    blockserver_serve(bs, bdev->core, bdev->blockops);
 
     mtx_lock(&bdev->lock);
     bdev->bs = NULL;
@@ -215,7 +218,38 @@ static mx_status_t blkdev_release(mx_device_t* dev) {
     return NO_ERROR;
 }
 
+static mx_protocol_device_t blkdev_instance_ops = {
+    .ioctl = blkdev_ioctl,
+    .iotxn_queue = blkdev_iotxn_queue,
+    .get_size = blkdev_get_size,
+    .unbind = blkdev_unbind,
+    .release = blkdev_release,
+};
+
+extern mx_driver_t _driver_block;
+
+static mx_status_t blkdev_open(mx_device_t* dev, mx_device_t** dev_out, uint32_t flags) {
+    blkdev_t* bdev = get_blkdev(dev);
+    blkdev_t* inst;
+    if ((inst = calloc(1, sizeof(blkdev_t))) == NULL) {
+        return ERR_NO_MEMORY;
+    }
+    inst->core = bdev->core;
+    inst->blockops = bdev->blockops;
+    device_init(&inst->device, &_driver_block, "block-instance", &blkdev_instance_ops);
+    mtx_init(&inst->lock, mtx_plain);
+
+    mx_status_t status;
+    if ((status = device_add_instance(&inst->device, dev)) != NO_ERROR) {
+        free(inst);
+        return status;
+    }
+    *dev_out = &inst->device;
+    return NO_ERROR;
+}
+
 static mx_protocol_device_t blkdev_ops = {
+    .open = blkdev_open,
     .ioctl = blkdev_ioctl,
     .iotxn_queue = blkdev_iotxn_queue,
     .get_size = blkdev_get_size,
@@ -235,6 +269,7 @@ static mx_status_t block_driver_bind(mx_driver_t* drv, mx_device_t* dev, void**
         goto fail;
     }
 
+    bdev->core = dev;
     device_init(&bdev->device, drv, "block", &blkdev_ops);
     mtx_init(&bdev->lock, mtx_plain);
 
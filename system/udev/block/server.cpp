@@ -11,24 +11,46 @@
 #include <magenta/device/block.h>
 #include <magenta/new.h>
 #include <magenta/syscalls.h>
+#include <mxtl/algorithm.h>
 #include <mxtl/auto_lock.h>
 #include <mxtl/limits.h>
 #include <mxtl/ref_ptr.h>
 
 #include "server.h"
 
-static mx_status_t do_read(mx_handle_t fifo, block_fifo_request_t* requests, uint32_t* count) {
+namespace {
+
+// The vmoid table starts small, and doubles as it fills.
+constexpr size_t kVmoidsMin = 16;
+constexpr size_t kVmoidsMax = mxtl::numeric_limits<vmoid_t>::max();
+
+// The longest run of requests which will be merged into one device I/O.
+constexpr uint64_t kMaxMergeLength = 1 << 20;
+
+// Set on the server's end of the fifo when a sync is waiting to be issued.
+constexpr mx_signals_t kSignalSyncPending = MX_USER_SIGNAL_0;
+
+} // namespace anonymous
+
+// Reads up to 'max' requests from the fifo, waiting for at least one, or
+// for a sync to be queued, in which case none are read.
+static mx_status_t do_read(mx_handle_t fifo, block_fifo_request_t* requests, size_t max,
+                           uint32_t* count) {
     mx_status_t status;
     while (true) {
-        status = mx_fifo_read(fifo, requests, sizeof(block_fifo_request_t), count);
+        status = mx_fifo_read(fifo, requests, sizeof(block_fifo_request_t) * max, count);
         if (status == ERR_SHOULD_WAIT) {
             mx_signals_t signals;
             if ((status = mx_object_wait_one(fifo,
-                                             MX_FIFO_READABLE | MX_FIFO_PEER_CLOSED,
+                                             MX_FIFO_READABLE | MX_FIFO_PEER_CLOSED |
+                                             kSignalSyncPending,
                                              MX_TIME_INFINITE, &signals)) != NO_ERROR) {
                 return status;
             } else if (signals & MX_FIFO_PEER_CLOSED) {
                 return ERR_PEER_CLOSED;
+            } else if (signals & kSignalSyncPending) {
+                *count = 0;
+                return NO_ERROR;
             }
             // Try reading again...
         } else {
@@ -82,9 +104,9 @@ fail:
     return ERR_IO;
 }
 
-void BlockTransaction::Complete(mx_status_t status) {
+void BlockTransaction::Complete(mx_status_t status, uint32_t count) {
     mxtl::AutoLock lock(&lock_);
-    response_.count++;
+    response_.count += count;
     MX_DEBUG_ASSERT(response_.count <= goal_);
 
     if ((status != NO_ERROR) && (response_.status == NO_ERROR)) {
@@ -132,21 +154,39 @@ mx_status_t IoBuffer::ValidateVmoHack(uint64_t length, uint64_t vmo_offset) {
 }
 
 mx_status_t BlockServer::FindVmoIDLocked(vmoid_t* out) {
-    for (vmoid_t i = last_id; i < mxtl::numeric_limits<vmoid_t>::max(); i++) {
-        if (!tree_.find(i).IsValid()) {
-            *out = i;
+    size_t size = vmos_.size();
+    for (size_t i = last_id; i < size; i++) {
+        if (vmos_[i] == nullptr) {
+            *out = static_cast<vmoid_t>(i);
             last_id = static_cast<vmoid_t>(i + 1);
             return NO_ERROR;
         }
     }
-    for (vmoid_t i = 0; i < last_id; i++) {
-        if (!tree_.find(i).IsValid()) {
-            *out = i;
+    for (size_t i = 0; i < mxtl::min(static_cast<size_t>(last_id), size); i++) {
+        if (vmos_[i] == nullptr) {
+            *out = static_cast<vmoid_t>(i);
             last_id = static_cast<vmoid_t>(i + 1);
             return NO_ERROR;
         }
     }
-    return ERR_NO_RESOURCES;
+
+    // Every vmoid is in use; grow the table.
+    if (size == kVmoidsMax) {
+        return ERR_NO_RESOURCES;
+    }
+    size_t new_size = mxtl::min(mxtl::max(size * 2, kVmoidsMin), kVmoidsMax);
+    AllocChecker ac;
+    mxtl::RefPtr<IoBuffer>* vmos = new (&ac) mxtl::RefPtr<IoBuffer>[new_size];
+    if (!ac.check()) {
+        return ERR_NO_MEMORY;
+    }
+    for (size_t i = 0; i < size; i++) {
+        vmos[i] = mxtl::move(vmos_[i]);
+    }
+    vmos_.reset(vmos, new_size);
+    *out = static_cast<vmoid_t>(size);
+    last_id = static_cast<vmoid_t>(size + 1);
+    return NO_ERROR;
 }
 
 mx_status_t BlockServer::AttachVmo(mx_handle_t vmo, vmoid_t* out) {
@@ -162,7 +202,7 @@ mx_status_t BlockServer::AttachVmo(mx_handle_t vmo, vmoid_t* out) {
     if (!ac.check()) {
         return ERR_NO_MEMORY;
     }
-    tree_.insert(mxtl::move(ibuf));
+    vmos_[id] = mxtl::move(ibuf);
     *out = id;
     return NO_ERROR;
 }
@@ -212,109 +252,291 @@ mx_status_t BlockServer::Create(mx_handle_t* fifo_out, BlockServer** out) {
 
 void blockserver_fifo_complete(void* cookie, mx_status_t status) {
     block_msg_t* msg = static_cast<block_msg_t*>(cookie);
-    // Since iobuf is a RefPtr, it lives at least as long as the txn,
-    // and is not discarded underneath the block device driver.
-    msg->iobuf = nullptr;
-    msg->txn->Complete(status);
-    msg->txn = nullptr;
+    msg->server->Complete(msg, status);
 }
 
 static block_callbacks_t cb = {
     blockserver_fifo_complete,
 };
 
-mx_status_t BlockServer::Serve(mx_device_t* dev, block_ops_t* ops) {
+void BlockServer::Complete(block_msg_t* msg, mx_status_t status) {
+    if (msg->sync && (status == NO_ERROR)) {
+        // A BLOCKIO_FUA write has reached the device; it completes once the
+        // device has flushed it to stable storage. This may be the driver's
+        // completion path, which must not be called back into, so the sync
+        // is left for the serving thread.
+        msg->sync = false;
+        {
+            mxtl::AutoLock lock(&idle_lock_);
+            msg->next_sync = pending_syncs_;
+            pending_syncs_ = msg;
+            cnd_broadcast(&idle_);
+        }
+        mx_object_signal(serving_fifo_, 0, kSignalSyncPending);
+        return;
+    }
 
-    ops->set_callbacks(dev, &cb);
+    // Since iobuf is a RefPtr, it lives at least as long as the txn,
+    // and is not discarded underneath the block device driver. Both are
+    // released before the txn responds, since the client may then reuse
+    // this message.
+    mxtl::RefPtr<BlockTransaction> txn = mxtl::move(msg->txn);
+    msg->iobuf = nullptr;
+    txn->Complete(status, msg->count);
 
-    mx_status_t status;
-    block_fifo_request_t requests[BLOCK_FIFO_MAX_DEPTH];
-    uint32_t count;
-    mx_handle_t fifo;
+    mxtl::AutoLock lock(&idle_lock_);
+    if (--in_flight_ == 0) {
+        cnd_broadcast(&idle_);
+    }
+}
+
+void BlockServer::IssueSync(block_msg_t* msg) {
+    if (ops_->sync == nullptr) {
+        // The device has no volatile write cache.
+        Complete(msg, NO_ERROR);
+        return;
+    }
+    ops_->sync(dev_, msg);
+}
+
+void BlockServer::IssuePendingSyncs() {
+    // Cleared before the queue is taken, so that a sync queued after this
+    // wakes the serving thread again.
+    mx_object_signal(serving_fifo_, kSignalSyncPending, 0);
+    block_msg_t* msg;
     {
-        mxtl::AutoLock server_lock(&server_lock_);
-        fifo = fifo_;
+        mxtl::AutoLock lock(&idle_lock_);
+        msg = pending_syncs_;
+        pending_syncs_ = nullptr;
     }
+    while (msg != nullptr) {
+        // The message may be reused as soon as it completes.
+        block_msg_t* next = msg->next_sync;
+        IssueSync(msg);
+        msg = next;
+    }
+}
+
+void BlockServer::WaitIdle() {
+    // FUA writes waiting on their sync are in flight too, and nothing but
+    // this thread will issue it.
     while (true) {
-        if ((status = do_read(fifo, &requests[0], &count)) != NO_ERROR) {
-            return status;
+        {
+            mxtl::AutoLock lock(&idle_lock_);
+            while ((in_flight_ != 0) && (pending_syncs_ == nullptr)) {
+                cnd_wait(&idle_, idle_lock_.GetInternal());
+            }
+            if (in_flight_ == 0) {
+                return;
+            }
         }
+        IssuePendingSyncs();
+    }
+}
 
-        for (size_t i = 0; i < count; i++) {
-            bool wants_reply = requests[i].opcode & BLOCKIO_TXN_END;
-            txnid_t txnid = requests[i].txnid;
-            vmoid_t vmoid = requests[i].vmoid;
+// Requests which must wait for the device to drain before they start.
+static bool WaitsBefore(const block_fifo_request_t* request) {
+    return (request->opcode & BLOCKIO_BARRIER_BEFORE) ||
+           ((request->opcode & BLOCKIO_OP_MASK) == BLOCKIO_SYNC);
+}
 
+// Returns the number of requests, starting at 'requests[0]', which may be
+// handed to the device as a single I/O: reads or writes on the same txn and
+// vmo, adjacent both within the vmo and on the device. Only the first may
+// carry BLOCKIO_BARRIER_BEFORE, only the last BLOCKIO_TXN_END, and none
+// BLOCKIO_BARRIER_AFTER.
+static size_t MergeCount(const block_fifo_request_t* requests, size_t count) {
+    uint16_t op = requests[0].opcode & BLOCKIO_OP_MASK;
+    if ((op != BLOCKIO_READ) && (op != BLOCKIO_WRITE)) {
+        return 1;
+    }
+    uint64_t length = requests[0].length;
+    size_t n = 1;
+    for (; n < count; n++) {
+        const block_fifo_request_t* prev = &requests[n - 1];
+        const block_fifo_request_t* next = &requests[n];
+        if ((prev->opcode & (BLOCKIO_TXN_END | BLOCKIO_BARRIER_AFTER)) ||
+            ((prev->opcode & ~BLOCKIO_BARRIER_BEFORE) != (next->opcode & ~BLOCKIO_TXN_END)) ||
+            (prev->txnid != next->txnid) || (prev->vmoid != next->vmoid) ||
+            (prev->vmo_offset + prev->length != next->vmo_offset) ||
+            (prev->dev_offset + prev->length != next->dev_offset) ||
+            (length + next->length > kMaxMergeLength)) {
+            break;
+        }
+        length += next->length;
+    }
+    return n;
+}
+
+void BlockServer::ProcessRequests(mx_handle_t fifo, const block_fifo_request_t* requests,
+                                  size_t count) {
+    // Requests are handed to the device in the order they arrive, so
+    // barriers are kept by holding back everything which follows them until
+    // the device has drained. The server lock is held across each run of
+    // requests between barriers, rather than taken for every request.
+    size_t i = 0;
+    while (i < count) {
+        if (WaitsBefore(&requests[i])) {
+            WaitIdle();
+        }
+        bool wait_after = false;
+        {
             mxtl::AutoLock server_lock(&server_lock_);
-            auto iobuf = tree_.find(vmoid);
-            if (!iobuf.IsValid()) {
-                // Operation which is not accessing a valid vmo
-                if (wants_reply) {
-                    OutOfBandErrorRespond(fifo, ERR_IO, txnid);
-                }
-                continue;
-            }
-            if (txnid >= MAX_TXN_COUNT || txns_[txnid] == nullptr) {
-                // Operation which is not accessing a valid txn
-                if (wants_reply) {
-                    OutOfBandErrorRespond(fifo, ERR_IO, txnid);
-                }
-                continue;
-            }
+            do {
+                size_t n = MergeCount(&requests[i], count - i);
+                ProcessRequestLocked(fifo, &requests[i], n);
+                i += n;
+                wait_after = requests[i - 1].opcode & BLOCKIO_BARRIER_AFTER;
+            } while (!wait_after && (i < count) && !WaitsBefore(&requests[i]));
+        }
+        if (wait_after) {
+            WaitIdle();
+        }
+    }
+}
 
-            switch (requests[i].opcode & BLOCKIO_OP_MASK) {
-            case BLOCKIO_READ:
-            case BLOCKIO_WRITE: {
-                block_msg_t* msg;
-                status = txns_[txnid]->Enqueue(wants_reply, &msg);
-                if (status != NO_ERROR) {
-                    break;
-                }
-                msg->txn = txns_[txnid];
-                msg->iobuf = iobuf.CopyPointer();
-
-                // Hack to ensure that the vmo is valid.
-                // In the future, this code will be responsible for pinning VMO pages,
-                // and the completion will be responsible for un-pinning those same pages.
-                status = iobuf->ValidateVmoHack(requests[i].length, requests[i].vmo_offset);
-                if (status != NO_ERROR) {
-                    cb.complete(msg, status);
-                    break;
-                }
-
-                if ((requests[i].opcode & BLOCKIO_OP_MASK) == BLOCKIO_READ) {
-                    ops->read(dev, iobuf->io_vmo_, requests[i].length,
-                              requests[i].vmo_offset, requests[i].dev_offset, msg);
-                } else {
-                    ops->write(dev, iobuf->io_vmo_, requests[i].length,
-                               requests[i].vmo_offset, requests[i].dev_offset, msg);
-                }
-                break;
-            }
-            case BLOCKIO_SYNC: {
-                // TODO(smklein): It might be more useful to have this on a per-vmo basis
-                fprintf(stderr, "Warning: BLOCKIO_SYNC is currently unimplemented\n");
-                break;
-            }
-            case BLOCKIO_CLOSE_VMO: {
-                tree_.erase(*iobuf);
-                if (wants_reply) {
-                    OutOfBandErrorRespond(fifo, NO_ERROR, txnid);
-                }
+void BlockServer::ProcessRequestLocked(mx_handle_t fifo, const block_fifo_request_t* requests,
+                                       size_t count) {
+    const block_fifo_request_t* request = &requests[0];
+    uint16_t op = request->opcode & BLOCKIO_OP_MASK;
+    uint16_t flags = request->opcode & BLOCKIO_FLAG_MASK;
+    bool wants_reply = requests[count - 1].opcode & BLOCKIO_TXN_END;
+    txnid_t txnid = request->txnid;
+    vmoid_t vmoid = request->vmoid;
+
+    IoBuffer* iobuf = (vmoid < vmos_.size()) ? vmos_[vmoid].get() : nullptr;
+    if ((iobuf == nullptr) && (op != BLOCKIO_SYNC)) {
+        // Operation which is not accessing a valid vmo
+        if (wants_reply) {
+            OutOfBandErrorRespond(fifo, ERR_IO, txnid);
+        }
+        return;
+    }
+    if (txnid >= MAX_TXN_COUNT || txns_[txnid] == nullptr) {
+        // Operation which is not accessing a valid txn
+        if (wants_reply) {
+            OutOfBandErrorRespond(fifo, ERR_IO, txnid);
+        }
+        return;
+    }
+
+    mx_status_t status;
+    switch (op) {
+    case BLOCKIO_READ:
+    case BLOCKIO_WRITE: {
+        // Each request in the run takes its own slot in the txn, so that the
+        // response counts them as the client sent them.
+        block_msg_t* msg = nullptr;
+        uint32_t merged = 0;
+        uint64_t length = 0;
+        for (size_t i = 0; i < count; i++) {
+            block_msg_t* m;
+            bool respond = requests[i].opcode & BLOCKIO_TXN_END;
+            if (txns_[txnid]->Enqueue(respond, &m) != NO_ERROR) {
                 break;
             }
-            default: {
-                fprintf(stderr, "Unrecognized Block Server operation: %x\n",
-                        requests[i].opcode);
-            }
+            if (msg == nullptr) {
+                msg = m;
             }
+            merged++;
+            length += requests[i].length;
+        }
+        if (merged == 0) {
+            break;
+        }
+        msg->txn = txns_[txnid];
+        msg->iobuf = vmos_[vmoid];
+        msg->server = this;
+        msg->count = merged;
+        msg->sync = (op == BLOCKIO_WRITE) && (flags & BLOCKIO_FUA);
+        {
+            mxtl::AutoLock lock(&idle_lock_);
+            in_flight_++;
+        }
+
+        // Hack to ensure that the vmo is valid.
+        // In the future, this code will be responsible for pinning VMO pages,
+        // and the completion will be responsible for un-pinning those same pages.
+        status = iobuf->ValidateVmoHack(length, request->vmo_offset);
+        if (status != NO_ERROR) {
+            Complete(msg, status);
+            break;
+        }
+
+        if (op == BLOCKIO_READ) {
+            ops_->read(dev_, iobuf->io_vmo_, length,
+                       request->vmo_offset, request->dev_offset, msg);
+        } else {
+            ops_->write(dev_, iobuf->io_vmo_, length,
+                        request->vmo_offset, request->dev_offset, msg);
+        }
+        break;
+    }
+    case BLOCKIO_SYNC: {
+        // Every earlier request has already completed (see ProcessRequests),
+        // so the flush covers all of them.
+        block_msg_t* msg;
+        status = txns_[txnid]->Enqueue(wants_reply, &msg);
+        if (status != NO_ERROR) {
+            break;
+        }
+        msg->txn = txns_[txnid];
+        msg->iobuf = nullptr;
+        msg->server = this;
+        msg->count = 1;
+        msg->sync = false;
+        {
+            mxtl::AutoLock lock(&idle_lock_);
+            in_flight_++;
+        }
+        IssueSync(msg);
+        break;
+    }
+    case BLOCKIO_CLOSE_VMO: {
+        vmos_[vmoid] = nullptr;
+        if (wants_reply) {
+            OutOfBandErrorRespond(fifo, NO_ERROR, txnid);
+        }
+        break;
+    }
+    default: {
+        fprintf(stderr, "Unrecognized Block Server operation: %x\n",
+                request->opcode);
+    }
+    }
+}
+
+mx_status_t BlockServer::Serve(mx_device_t* dev, block_ops_t* ops) {
+    dev_ = dev;
+    ops_ = ops;
+    ops->set_callbacks(dev, &cb);
+
+    mx_status_t status;
+    block_fifo_request_t requests[BLOCK_FIFO_MAX_DEPTH];
+    uint32_t count;
+    mx_handle_t fifo;
+    {
+        mxtl::AutoLock server_lock(&server_lock_);
+        fifo = fifo_;
+    }
+    serving_fifo_ = fifo;
+    while (true) {
+        IssuePendingSyncs();
+        if ((status = do_read(fifo, &requests[0], countof(requests), &count)) != NO_ERROR) {
+            return status;
         }
+        ProcessRequests(fifo, &requests[0], count);
     }
 }
 
-BlockServer::BlockServer() : fifo_(MX_HANDLE_INVALID), last_id(0) {}
+BlockServer::BlockServer() : dev_(nullptr), ops_(nullptr), in_flight_(0),
+    pending_syncs_(nullptr), serving_fifo_(MX_HANDLE_INVALID), fifo_(MX_HANDLE_INVALID),
+    last_id(0) {
+    cnd_init(&idle_);
+}
 BlockServer::~BlockServer() {
     ShutDown();
+    cnd_destroy(&idle_);
 }
 
 void BlockServer::ShutDown() {
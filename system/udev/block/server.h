@@ -11,18 +11,18 @@
 #include <ddk/protocol/block.h>
 #include <magenta/device/block.h>
 #include <magenta/types.h>
+#include <threads.h>
 
 #ifdef __cplusplus
 
-#include <mxtl/intrusive_wavl_tree.h>
+#include <mxtl/array.h>
 #include <mxtl/mutex.h>
 #include <mxtl/ref_counted.h>
 #include <mxtl/ref_ptr.h>
 #include <mxtl/unique_ptr.h>
 
 // Represents the mapping of "vmoid --> VMO"
-class IoBuffer : public mxtl::WAVLTreeContainable<mxtl::RefPtr<IoBuffer>>,
-                 public mxtl::RefCounted<IoBuffer> {
+class IoBuffer : public mxtl::RefCounted<IoBuffer> {
 public:
     vmoid_t GetKey() const { return vmoid_; }
 
@@ -36,7 +36,6 @@ public:
 
 private:
     friend class BlockServer;
-    friend struct TypeWAVLTraits;
     DISALLOW_COPY_ASSIGN_AND_MOVE(IoBuffer);
 
     const mx_handle_t io_vmo_;
@@ -45,11 +44,16 @@ private:
 
 constexpr uint32_t kTxnFlagRespond = 0x00000001; // Should a reponse be sent when we hit goal?
 
+class BlockServer;
 class BlockTransaction;
 
-typedef struct {
+typedef struct block_msg {
     mxtl::RefPtr<BlockTransaction> txn;
     mxtl::RefPtr<IoBuffer> iobuf;
+    BlockServer* server;
+    uint32_t count; // Number of fifo requests merged into this message
+    bool sync; // Should the device be synced before the message completes? (BLOCKIO_FUA)
+    struct block_msg* next_sync; // Next message waiting for its sync to be issued
 } block_msg_t;
 
 class BlockTransaction : public mxtl::RefCounted<BlockTransaction> {
@@ -63,8 +67,8 @@ public:
     // received before the transaction is identified as successful.
     mx_status_t Enqueue(bool do_respond, block_msg_t** msg_out);
 
-    // Called once the transaction has completed successfully.
-    void Complete(mx_status_t status);
+    // Called once 'count' of the transaction's messages have completed.
+    void Complete(mx_status_t status, uint32_t count);
 
     txnid_t GetTxnid() const;
 private:
@@ -86,7 +90,8 @@ public:
     // Creates a new BlockServer
     static mx_status_t Create(mx_handle_t* fifo_out, BlockServer** out);
 
-    // Starts the BlockServer using the current thread
+    // Starts the BlockServer using the current thread. Several BlockServers,
+    // each with their own fifo and thread, may serve the same device.
     mx_status_t Serve(mx_device_t* dev, block_ops_t* ops);
     mx_status_t AttachVmo(mx_handle_t vmo, vmoid_t* out);
     mx_status_t AllocateTxn(txnid_t* out);
@@ -94,6 +99,9 @@ public:
 
     void ShutDown();
 
+    // Called by the block device when a message it was handed has completed.
+    void Complete(block_msg_t* msg, mx_status_t status);
+
     ~BlockServer();
 private:
     DISALLOW_COPY_ASSIGN_AND_MOVE(BlockServer);
@@ -101,9 +109,36 @@ private:
 
     mx_status_t FindVmoIDLocked(vmoid_t* out);
 
+    // Hands a batch of requests read from the fifo to the device, keeping
+    // the barriers they ask for.
+    void ProcessRequests(mx_handle_t fifo, const block_fifo_request_t* requests, size_t count);
+    // Validates a run of 'count' requests which may be merged (see
+    // MergeCount) and hands them to the device as a single message.
+    void ProcessRequestLocked(mx_handle_t fifo, const block_fifo_request_t* requests,
+                              size_t count);
+    // Asks the device to flush its write cache, completing 'msg' once it has.
+    void IssueSync(block_msg_t* msg);
+    // Issues the syncs of FUA writes which have reached the device. They are
+    // queued by Complete() and issued from the serving thread, rather than
+    // from the driver's completion callback.
+    void IssuePendingSyncs();
+    // Blocks until every message handed to the device has completed.
+    void WaitIdle();
+
+    mx_device_t* dev_;
+    block_ops_t* ops_;
+
+    mxtl::Mutex idle_lock_;
+    uint32_t in_flight_; // Messages handed to the device, but not yet completed
+    cnd_t idle_;         // Signalled when in_flight_ drops to zero, or a sync is queued
+    block_msg_t* pending_syncs_; // Guarded by idle_lock_
+    // The fifo being served, signalled when a sync is queued.
+    mx_handle_t serving_fifo_;
+
     mxtl::Mutex server_lock_;
     mx_handle_t fifo_;
-    mxtl::WAVLTree<vmoid_t, mxtl::RefPtr<IoBuffer>> tree_;
+    // Attached VMOs, indexed by vmoid. Grows as VMOs are attached.
+    mxtl::Array<mxtl::RefPtr<IoBuffer>> vmos_;
     mxtl::RefPtr<BlockTransaction> txns_[MAX_TXN_COUNT];
     vmoid_t last_id;
 };
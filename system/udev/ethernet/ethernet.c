@@ -5,6 +5,7 @@
 #include <ddk/device.h>
 #include <ddk/driver.h>
 #include <ddk/binding.h>
+#include <ddk/io-buffer.h>
 #include <ddk/protocol/ethernet.h>
 
 #include <magenta/device/ethernet.h>
@@ -13,6 +14,8 @@
 #include <magenta/syscalls.h>
 #include <magenta/types.h>
 
+#include <limits.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -21,6 +24,10 @@
 #define FIFO_DEPTH 256
 #define FIFO_ESIZE sizeof(eth_fifo_entry_t)
 
+// rx buffers are taken from a client's rx fifo, and handed back
+// to it once filled, up to this many at a time
+#define RX_BATCH 32
+
 #define TRACE 0
 
 #if TRACE
@@ -34,6 +41,26 @@
 // ensure that we will not exceed fifo capacity
 static_assert((FIFO_DEPTH * FIFO_ESIZE) <= 4096, "");
 
+typedef struct ethdev ethdev_t;
+
+// A buffer queued to an ethermac with FEATURE_RX_QUEUE: either one of
+// edev's own rx buffers (e), which the frame is received into directly,
+// or a bounce buffer, which is copied to edev (or to every active
+// instance, if edev is NULL) when it completes.
+typedef struct eth_rxq_slot {
+    ethdev_t* edev;
+    eth_fifo_entry_t e;
+    int32_t bounce;
+} eth_rxq_slot_t;
+
+// The running instances, as seen by the receive path. A new set is
+// published whenever one starts, and a stopped one is cleared from its
+// slot, so delivering a packet takes no lock shared with the ioctl path.
+typedef struct eth_active {
+    uint32_t count;
+    ethdev_t* _Atomic edev[];
+} eth_active_t;
+
 // ethernet device
 typedef struct ethdev0 {
     // shared state
@@ -52,8 +79,39 @@ typedef struct ethdev0 {
     list_node_t list_active;
     list_node_t list_idle;
 
+    // list_active, for the receive path, and the number of
+    // threads currently walking it
+    eth_active_t* _Atomic active;
+    atomic_uint readers;
+
     ethmac_info_t info;
 
+    // FEATURE_RX_QUEUE state
+    //
+    // mac_lock serializes the ethermac's start(), stop() and queue_rx(),
+    // and guards the fields up to rxq_lock.  rxq_lock guards the queue
+    // itself (and the free bounce buffers), which is shared with
+    // complete_rx().  The rx thread keeps the queue full, and is woken
+    // through rxq_event.
+    mtx_t mac_lock;
+    bool rxq_running;
+    bool rxq_exit;
+    // the instance frames are received straight into, if only one is active
+    ethdev_t* rxq_direct;
+    uint32_t rxq_gen;
+
+    mtx_t rxq_lock;
+    eth_rxq_slot_t* rxq;
+    uint32_t rxq_head;
+    uint32_t rxq_count;
+    io_buffer_t bounce;
+    int32_t* bounce_free;
+    uint32_t bounce_free_count;
+
+    atomic_bool rxq_refill;
+    mx_handle_t rxq_event;
+    thrd_t rxq_thr;
+
     mx_device_t dev;
 } ethdev0_t;
 
@@ -62,6 +120,13 @@ static void eth0_downref(ethdev0_t* edev0) {
     edev0->refcount--;
     if (edev0->refcount == 0) {
         mtx_unlock(&edev0->lock);
+        free(atomic_load(&edev0->active));
+        if (edev0->info.features & ETHMAC_FEATURE_RX_QUEUE) {
+            io_buffer_release(&edev0->bounce);
+            mx_handle_close(edev0->rxq_event);
+            free(edev0->bounce_free);
+            free(edev0->rxq);
+        }
         free(edev0);
     } else {
         mtx_unlock(&edev0->lock);
@@ -84,7 +149,7 @@ static void eth0_downref(ethdev0_t* edev0) {
 #define ETHDEV_TX_LISTEN (16u)
 
 // ethernet instance device
-typedef struct ethdev {
+struct ethdev {
     list_node_t node;
 
     ethdev0_t* edev0;
@@ -99,10 +164,27 @@ typedef struct ethdev {
     mx_handle_t rx_fifo;
     uint32_t rx_depth;
 
-    // io buffer
+    // rx buffers taken from rx_fifo and not yet filled, and filled
+    // buffers not yet written back to it
+    mtx_t rx_lock;
+    eth_fifo_entry_t rx_free[RX_BATCH];
+    uint32_t rx_free_next;
+    uint32_t rx_free_count;
+    eth_fifo_entry_t rx_done[RX_BATCH];
+    uint32_t rx_done_count;
+
+    // io buffer, and its physical address if the ethermac is handed rx
+    // buffers to receive into (0 otherwise)
     mx_handle_t io_vmo;
     void* io_buf;
     size_t io_size;
+    mx_paddr_t io_phys;
+
+    // io buffer allocated by IOCTL_ETHERNET_ALLOC_IOBUF, and its koid.
+    // Only this buffer is received into directly: it is contiguous, so
+    // the client cannot decommit or shrink it under the ethermac.
+    io_buffer_t io_alloc;
+    mx_koid_t io_alloc_koid;
 
     // fifo thread
     thrd_t tx_thr;
@@ -112,91 +194,475 @@ typedef struct ethdev {
     uint32_t fail_rx_read;
     uint32_t fail_rx_write;
     uint32_t fail_tx_write;
-} ethdev_t;
+};
 
 #define FAIL_REPORT_RATE 50
 
 #define get_ethdev(d) containerof(d, ethdev_t, dev)
 #define get_ethdev0(d) containerof(d, ethdev0_t, dev)
 
-static void eth_handle_rx(ethdev_t* edev, const void* data, size_t len, uint32_t extra) {
-    eth_fifo_entry_t e;
+static eth_active_t* eth_active_enter(ethdev0_t* edev0) {
+    atomic_fetch_add(&edev0->readers, 1);
+    return atomic_load(&edev0->active);
+}
+
+static void eth_active_exit(ethdev0_t* edev0) {
+    atomic_fetch_sub(&edev0->readers, 1);
+}
+
+// Once this returns, no thread still walks a set unpublished before it
+// was called.
+static void eth_active_wait_locked(ethdev0_t* edev0) {
+    while (atomic_load(&edev0->readers) != 0) {
+        thrd_yield();
+    }
+}
+
+static mx_status_t eth_active_add_locked(ethdev0_t* edev0, ethdev_t* edev) {
+    uint32_t count = 1;
+    ethdev_t* e;
+    list_for_every_entry(&edev0->list_active, e, ethdev_t, node) {
+        count++;
+    }
+    eth_active_t* active;
+    if ((active = malloc(sizeof(eth_active_t) + count * sizeof(active->edev[0]))) == NULL) {
+        return ERR_NO_MEMORY;
+    }
+    count = 0;
+    list_for_every_entry(&edev0->list_active, e, ethdev_t, node) {
+        atomic_init(&active->edev[count++], e);
+    }
+    atomic_init(&active->edev[count++], edev);
+    active->count = count;
+
+    eth_active_t* old = atomic_exchange(&edev0->active, active);
+    eth_active_wait_locked(edev0);
+    free(old);
+    return NO_ERROR;
+}
+
+static void eth_active_remove_locked(ethdev0_t* edev0, ethdev_t* edev) {
+    eth_active_t* active = atomic_load(&edev0->active);
+    if (active == NULL) {
+        return;
+    }
+    for (uint32_t i = 0; i < active->count; i++) {
+        if (atomic_load(&active->edev[i]) == edev) {
+            atomic_store(&active->edev[i], NULL);
+        }
+    }
+    eth_active_wait_locked(edev0);
+}
+
+static void eth_rx_flush_locked(ethdev_t* edev) {
     mx_status_t status;
     uint32_t count;
+    uint32_t n = edev->rx_done_count;
 
-    // TODO: read multiple and cache locally to reduce syscalls
-    if ((status = mx_fifo_read(edev->rx_fifo, &e, sizeof(e), &count)) < 0) {
+    if (n == 0) {
+        return;
+    }
+    edev->rx_done_count = 0;
+    if ((status = mx_fifo_write(edev->rx_fifo, edev->rx_done, FIFO_ESIZE * n, &count)) < 0) {
         if (status == ERR_SHOULD_WAIT) {
-            if ((edev->fail_rx_read++ % FAIL_REPORT_RATE) == 0) {
-                printf("eth: no rx buffers available (%u times)\n",
-                       edev->fail_rx_read);
+            if ((edev->fail_rx_write++ % FAIL_REPORT_RATE) == 0) {
+                printf("eth: no rx_fifo space available (%u times)\n",
+                       edev->fail_rx_write);
             }
         } else {
             // Fatal, should force teardown
-            printf("eth: rx fifo read failed %d\n", status);
+            printf("eth: rx_fifo write failed %d\n", status);
         }
-        return;
+    } else if (count != n) {
+        printf("eth: rx_fifo: only wrote %u of %u!\n", count, n);
     }
+}
 
-    if ((e.offset >= edev->io_size) || ((e.length > (edev->io_size - e.offset)))) {
-        // invalid offset/length. report error. drop packet
-        e.length = 0;
-        e.flags = ETH_FIFO_INVALID;
-    } else if (len > e.length) {
-        e.length = 0;
-        e.flags = ETH_FIFO_INVALID;
-    } else {
+// takes the next rx buffer the client has made available
+static mx_status_t eth_rx_take_locked(ethdev_t* edev, eth_fifo_entry_t* e) {
+    mx_status_t status;
+    uint32_t count;
+
+    if (edev->rx_fifo == MX_HANDLE_INVALID) {
+        // torn down; io_buf may no longer be mapped
+        return ERR_BAD_STATE;
+    }
+    if (edev->rx_free_next == edev->rx_free_count) {
+        if ((status = mx_fifo_read(edev->rx_fifo, edev->rx_free,
+                                   sizeof(edev->rx_free), &count)) < 0) {
+            return status;
+        }
+        edev->rx_free_next = 0;
+        edev->rx_free_count = count;
+    }
+    *e = edev->rx_free[edev->rx_free_next++];
+    return NO_ERROR;
+}
+
+static void eth_rx_done_locked(ethdev_t* edev, const eth_fifo_entry_t* e) {
+    edev->rx_done[edev->rx_done_count++] = *e;
+    if (edev->rx_done_count == RX_BATCH) {
+        eth_rx_flush_locked(edev);
+    }
+}
+
+static bool eth_rx_valid(ethdev_t* edev, const eth_fifo_entry_t* e, size_t len) {
+    return (e->offset < edev->io_size) && (e->length <= (edev->io_size - e->offset)) &&
+           (len <= e->length);
+}
+
+static void eth_rx_copy_locked(ethdev_t* edev, eth_fifo_entry_t* e,
+                               const void* data, size_t len, uint32_t extra) {
+    if (eth_rx_valid(edev, e, len)) {
         // packet fits. deliver it
-        memcpy(edev->io_buf + e.offset, data, len);
-        e.length = len;
-        e.flags = ETH_FIFO_RX_OK | extra;
+        memcpy(edev->io_buf + e->offset, data, len);
+        e->length = len;
+        e->flags = ETH_FIFO_RX_OK | extra;
+    } else {
+        // invalid offset/length. report error. drop packet
+        e->length = 0;
+        e->flags = ETH_FIFO_INVALID;
     }
+    eth_rx_done_locked(edev, e);
+}
 
-    if ((status = mx_fifo_write(edev->rx_fifo, &e, sizeof(e), &count)) < 0) {
+static void eth_handle_rx(ethdev_t* edev, const void* data, size_t len, uint32_t extra) {
+    mx_status_t status;
+    eth_fifo_entry_t e;
+
+    mtx_lock(&edev->rx_lock);
+    if ((status = eth_rx_take_locked(edev, &e)) < 0) {
         if (status == ERR_SHOULD_WAIT) {
-            if ((edev->fail_rx_write++ % FAIL_REPORT_RATE) == 0) {
-                printf("eth: no rx_fifo space available (%u times)\n",
-                       edev->fail_rx_write);
+            if ((edev->fail_rx_read++ % FAIL_REPORT_RATE) == 0) {
+                printf("eth: no rx buffers available (%u times)\n",
+                       edev->fail_rx_read);
             }
-        } else {
+        } else if (status != ERR_BAD_STATE) {
             // Fatal, should force teardown
-            printf("eth: rx_fifo write failed %d\n", status);
+            printf("eth: rx fifo read failed %d\n", status);
         }
-        return;
+    } else {
+        eth_rx_copy_locked(edev, &e, data, len, extra);
     }
+    mtx_unlock(&edev->rx_lock);
+}
+
+// hands back rx buffers which were taken but not filled, with no
+// flags set, so that a stopped client gets all of its buffers back
+static void eth_rx_release(ethdev_t* edev) {
+    mtx_lock(&edev->rx_lock);
+    if (edev->rx_fifo != MX_HANDLE_INVALID) {
+        eth_rx_flush_locked(edev);
+        while (edev->rx_free_next < edev->rx_free_count) {
+            eth_fifo_entry_t* e = &edev->rx_done[edev->rx_done_count++];
+            *e = edev->rx_free[edev->rx_free_next++];
+            e->length = 0;
+            e->flags = 0;
+        }
+        eth_rx_flush_locked(edev);
+    }
+    edev->rx_free_next = 0;
+    edev->rx_free_count = 0;
+    edev->rx_done_count = 0;
+    mtx_unlock(&edev->rx_lock);
 }
 
 static void eth0_status(void* cookie, uint32_t status) {
     printf("eth: status() %08x\n", status);
 }
 
-// TODO: I think if this arrives at the wrong time during teardown we
-// can deadlock with the ethermac device
+static uint32_t eth_rx_flags(uint32_t flags) {
+    return (flags & ETHMAC_RX_CSUM_OK) ? ETH_FIFO_RX_CSUM_OK : 0;
+}
+
 static void eth0_recv(void* cookie, void* data, size_t len, uint32_t flags) {
     ethdev0_t* edev0 = cookie;
 
-    ethdev_t* edev;
-    mtx_lock(&edev0->lock);
-    list_for_every_entry(&edev0->list_active, edev, ethdev_t, node) {
-        eth_handle_rx(edev, data, len, 0);
+    uint32_t extra = eth_rx_flags(flags);
+    eth_active_t* active = eth_active_enter(edev0);
+    for (uint32_t i = 0; (active != NULL) && (i < active->count); i++) {
+        ethdev_t* edev = atomic_load(&active->edev[i]);
+        if (edev != NULL) {
+            eth_handle_rx(edev, data, len, extra);
+        }
+    }
+    eth_active_exit(edev0);
+}
+
+static void eth0_recv_flush(void* cookie) {
+    ethdev0_t* edev0 = cookie;
+
+    eth_active_t* active = eth_active_enter(edev0);
+    for (uint32_t i = 0; (active != NULL) && (i < active->count); i++) {
+        ethdev_t* edev = atomic_load(&active->edev[i]);
+        if (edev != NULL) {
+            mtx_lock(&edev->rx_lock);
+            if (edev->rx_fifo != MX_HANDLE_INVALID) {
+                eth_rx_flush_locked(edev);
+            }
+            mtx_unlock(&edev->rx_lock);
+        }
+    }
+    eth_active_exit(edev0);
+}
+
+// Returns where a client rx buffer may be received into, or 0 if the
+// client's io buffer is not one we allocated, or the rx buffer is too
+// small (in which case it is filled from a bounce buffer instead).
+static mx_paddr_t eth_rx_direct_addr(ethdev_t* edev, const eth_fifo_entry_t* e, size_t mtu) {
+    if ((edev->io_phys == 0) || !eth_rx_valid(edev, e, mtu)) {
+        return 0;
+    }
+    return edev->io_phys + e->offset;
+}
+
+static void* eth_bounce_data(ethdev0_t* edev0, int32_t n) {
+    return io_buffer_virt(&edev0->bounce) + (size_t)n * edev0->info.mtu;
+}
+
+static void eth0_complete_rx(void* cookie, uint32_t length, uint32_t flags) {
+    ethdev0_t* edev0 = cookie;
+    eth_rxq_slot_t slot;
+
+    mtx_lock(&edev0->rxq_lock);
+    if (edev0->rxq_count == 0) {
+        mtx_unlock(&edev0->rxq_lock);
+        return;
+    }
+    slot = edev0->rxq[edev0->rxq_head];
+    edev0->rxq_head = (edev0->rxq_head + 1) % edev0->info.rx_queue_depth;
+    edev0->rxq_count--;
+    mtx_unlock(&edev0->rxq_lock);
+    atomic_store(&edev0->rxq_refill, true);
+
+    if (length > edev0->info.mtu) {
+        length = 0;
+    }
+    if (slot.edev == NULL) {
+        if (length > 0) {
+            eth0_recv(edev0, eth_bounce_data(edev0, slot.bounce), length, flags);
+        }
+    } else {
+        ethdev_t* edev = slot.edev;
+        mtx_lock(&edev->rx_lock);
+        if (edev->rx_fifo != MX_HANDLE_INVALID) {
+            if (slot.bounce >= 0) {
+                eth_rx_copy_locked(edev, &slot.e, eth_bounce_data(edev0, slot.bounce),
+                                   length, eth_rx_flags(flags));
+            } else {
+                // already in place
+                slot.e.length = length;
+                slot.e.flags = ETH_FIFO_RX_OK | eth_rx_flags(flags);
+                eth_rx_done_locked(edev, &slot.e);
+            }
+        }
+        mtx_unlock(&edev->rx_lock);
+    }
+
+    if (slot.bounce >= 0) {
+        mtx_lock(&edev0->rxq_lock);
+        edev0->bounce_free[edev0->bounce_free_count++] = slot.bounce;
+        mtx_unlock(&edev0->rxq_lock);
+    }
+}
+
+static void eth0_rxq_flush(void* cookie) {
+    ethdev0_t* edev0 = cookie;
+    eth0_recv_flush(edev0);
+    if (atomic_exchange(&edev0->rxq_refill, false)) {
+        mx_object_signal(edev0->rxq_event, 0, MX_EVENT_SIGNALED);
     }
-    mtx_unlock(&edev0->lock);
 }
 
 static ethmac_ifc_t ethmac_ifc = {
     .status = eth0_status,
     .recv = eth0_recv,
+    .recv_flush = eth0_recv_flush,
 };
 
+static ethmac_ifc_t ethmac_rxq_ifc = {
+    .status = eth0_status,
+    .recv_flush = eth0_rxq_flush,
+    .complete_rx = eth0_complete_rx,
+};
+
+// Queues buffers to the ethermac until its queue is full.  Returns false
+// if the direct instance ran out of rx buffers first.
+static bool eth_rxq_fill_locked(ethdev0_t* edev0) {
+    uint32_t mtu = edev0->info.mtu;
+    for (;;) {
+        eth_rxq_slot_t slot = {
+            .edev = edev0->rxq_direct,
+            .bounce = -1,
+        };
+        mx_paddr_t pa = 0;
+
+        // only this thread adds to the queue, so there is still
+        // room when it is added to below
+        mtx_lock(&edev0->rxq_lock);
+        bool full = (edev0->rxq_count == edev0->info.rx_queue_depth);
+        mtx_unlock(&edev0->rxq_lock);
+        if (full) {
+            return true;
+        }
+
+        if (slot.edev != NULL) {
+            mtx_lock(&slot.edev->rx_lock);
+            if (eth_rx_take_locked(slot.edev, &slot.e) < 0) {
+                mtx_unlock(&slot.edev->rx_lock);
+                return false;
+            }
+            pa = eth_rx_direct_addr(slot.edev, &slot.e, mtu);
+            mtx_unlock(&slot.edev->rx_lock);
+        }
+
+        mtx_lock(&edev0->rxq_lock);
+        if (pa == 0) {
+            // there are as many bounce buffers as queue slots
+            slot.bounce = edev0->bounce_free[--edev0->bounce_free_count];
+            pa = io_buffer_phys(&edev0->bounce) + (size_t)slot.bounce * mtu;
+        }
+        uint32_t n = (edev0->rxq_head + edev0->rxq_count) % edev0->info.rx_queue_depth;
+        edev0->rxq[n] = slot;
+        edev0->rxq_count++;
+        mtx_unlock(&edev0->rxq_lock);
+
+        edev0->macops->queue_rx(edev0->mac, 0, pa, 0, mtu);
+    }
+}
+
+// Takes back every queued buffer, once the ethermac has been stopped.
+// Client buffers are returned to the client unfilled.
+static void eth_rxq_drain_locked(ethdev0_t* edev0) {
+    ethdev_t* direct = NULL;
+
+    mtx_lock(&edev0->rxq_lock);
+    while (edev0->rxq_count > 0) {
+        eth_rxq_slot_t* slot = &edev0->rxq[edev0->rxq_head];
+        edev0->rxq_head = (edev0->rxq_head + 1) % edev0->info.rx_queue_depth;
+        edev0->rxq_count--;
+        if (slot->bounce >= 0) {
+            edev0->bounce_free[edev0->bounce_free_count++] = slot->bounce;
+        }
+        if (slot->edev != NULL) {
+            direct = slot->edev;
+            mtx_lock(&direct->rx_lock);
+            if (direct->rx_fifo != MX_HANDLE_INVALID) {
+                slot->e.length = 0;
+                slot->e.flags = 0;
+                eth_rx_done_locked(direct, &slot->e);
+            }
+            mtx_unlock(&direct->rx_lock);
+        }
+    }
+    edev0->rxq_head = 0;
+    mtx_unlock(&edev0->rxq_lock);
+
+    if (direct != NULL) {
+        mtx_lock(&direct->rx_lock);
+        if (direct->rx_fifo != MX_HANDLE_INVALID) {
+            eth_rx_flush_locked(direct);
+        }
+        mtx_unlock(&direct->rx_lock);
+    }
+}
+
+// Brings the ethermac in line with the active instances.  It is stopped
+// (discarding whatever it has queued) and, if any instance is still
+// active, restarted with buffers from that instance, if there is only
+// one, or with bounce buffers, if there are several.
+static mx_status_t eth_rxq_update_locked(ethdev0_t* edev0) {
+    mx_status_t status = NO_ERROR;
+
+    mtx_lock(&edev0->mac_lock);
+    if (edev0->rxq_running) {
+        edev0->macops->stop(edev0->mac);
+        edev0->rxq_running = false;
+    }
+    eth_rxq_drain_locked(edev0);
+
+    edev0->rxq_direct = NULL;
+    if (!list_is_empty(&edev0->list_active)) {
+        ethdev_t* edev = list_peek_head_type(&edev0->list_active, ethdev_t, node);
+        if (list_next(&edev0->list_active, &edev->node) == NULL) {
+            edev0->rxq_direct = edev;
+        }
+        if (!edev0->rxq_exit) {
+            status = edev0->macops->start(edev0->mac, &ethmac_rxq_ifc, edev0);
+            edev0->rxq_running = (status == NO_ERROR);
+        }
+    }
+    edev0->rxq_gen++;
+    mtx_unlock(&edev0->mac_lock);
+
+    mx_object_signal(edev0->rxq_event, 0, MX_EVENT_SIGNALED);
+    return status;
+}
+
+static int eth_rxq_thread(void* arg) {
+    ethdev0_t* edev0 = arg;
+    mx_handle_t fifo = MX_HANDLE_INVALID;
+    uint32_t gen = 0;
+
+    for (;;) {
+        mx_wait_item_t items[2] = {
+            { .handle = edev0->rxq_event, .waitfor = MX_EVENT_SIGNALED },
+            { .handle = fifo, .waitfor = MX_FIFO_READABLE },
+        };
+        bool starved = false;
+
+        mtx_lock(&edev0->mac_lock);
+        if (edev0->rxq_exit) {
+            mtx_unlock(&edev0->mac_lock);
+            break;
+        }
+        if (gen != edev0->rxq_gen) {
+            // keep our own handle to the direct instance's rx fifo, to
+            // wait on when it has no buffers for us
+            gen = edev0->rxq_gen;
+            if (fifo != MX_HANDLE_INVALID) {
+                mx_handle_close(fifo);
+                fifo = MX_HANDLE_INVALID;
+            }
+            ethdev_t* edev = edev0->rxq_direct;
+            if (edev != NULL) {
+                mtx_lock(&edev->rx_lock);
+                if (edev->rx_fifo != MX_HANDLE_INVALID) {
+                    mx_handle_duplicate(edev->rx_fifo, MX_RIGHT_SAME_RIGHTS, &fifo);
+                }
+                mtx_unlock(&edev->rx_lock);
+            }
+            items[1].handle = fifo;
+        }
+        mx_object_signal(edev0->rxq_event, MX_EVENT_SIGNALED, 0);
+        if (edev0->rxq_running) {
+            starved = !eth_rxq_fill_locked(edev0);
+        }
+        mtx_unlock(&edev0->mac_lock);
+
+        mx_status_t status;
+        uint32_t count = (starved && (fifo != MX_HANDLE_INVALID)) ? 2 : 1;
+        if ((status = mx_object_wait_many(items, count, MX_TIME_INFINITE)) < 0) {
+            printf("eth: rxq: error waiting: %d\n", status);
+            break;
+        }
+    }
+
+    if (fifo != MX_HANDLE_INVALID) {
+        mx_handle_close(fifo);
+    }
+    return 0;
+}
+
 static void eth_tx_echo(ethdev0_t* edev0, const void* data, size_t len) {
-    ethdev_t* edev;
-    mtx_lock(&edev0->lock);
-    list_for_every_entry(&edev0->list_active, edev, ethdev_t, node) {
-        if (edev->state & ETHDEV_TX_LISTEN) {
+    eth_active_t* active = eth_active_enter(edev0);
+    for (uint32_t i = 0; (active != NULL) && (i < active->count); i++) {
+        ethdev_t* edev = atomic_load(&active->edev[i]);
+        if ((edev != NULL) && (edev->state & ETHDEV_TX_LISTEN)) {
             eth_handle_rx(edev, data, len, ETH_FIFO_RX_TX);
         }
     }
-    mtx_unlock(&edev0->lock);
+    eth_active_exit(edev0);
 }
 
 static mx_status_t eth_tx_listen_locked(ethdev_t* edev, bool yes) {
@@ -253,17 +719,29 @@ static int eth_tx_thread(void* arg) {
         }
 
         uint32_t n = count;
+        bool echoed = false;
         for (eth_fifo_entry_t* e = entries; count-- > 0; e++) {
             if ((e->offset > edev->io_size) || ((e->length > (edev->io_size - e->offset)))) {
                 e->flags = ETH_FIFO_INVALID;
             } else {
-                edev0->macops->send(edev0->mac, 0, edev->io_buf + e->offset, e->length);
+                uint32_t options = 0;
+                if ((e->flags & ETH_FIFO_TX_CSUM) &&
+                    (edev0->info.features & ETHMAC_FEATURE_TX_CSUM)) {
+                    options |= ETHMAC_TX_CSUM;
+                }
+                edev0->macops->send(edev0->mac, options, edev->io_buf + e->offset, e->length);
                 e->flags = ETH_FIFO_TX_OK;
+                // (frames sent with TX_CSUM are echoed as they were
+                // handed to us, with the checksum incomplete)
                 if (edev->state & ETHDEV_TX_LOOPBACK) {
                     eth_tx_echo(edev0, edev->io_buf + e->offset, e->length);
+                    echoed = true;
                 }
             }
         }
+        if (echoed) {
+            eth0_recv_flush(edev0);
+        }
 
         if ((status = mx_fifo_write(edev->tx_fifo, entries, sizeof(eth_fifo_entry_t) * n, &count)) < 0) {
             if (status == ERR_SHOULD_WAIT) {
@@ -341,6 +819,17 @@ static ssize_t eth_set_iobuf_locked(ethdev_t* edev, const void* in_buf, size_t i
         goto fail;
     }
 
+    // Nothing pins the pages of a vmo the client made, so the ethermac
+    // only receives straight into one from eth_alloc_iobuf_locked().
+    if (edev->io_alloc_koid != 0) {
+        mx_info_handle_basic_t info;
+        if ((mx_object_get_info(vmo, MX_INFO_HANDLE_BASIC, &info, sizeof(info),
+                                NULL, NULL) == NO_ERROR) &&
+            (info.koid == edev->io_alloc_koid) && (size <= edev->io_alloc.size)) {
+            edev->io_phys = io_buffer_phys(&edev->io_alloc);
+        }
+    }
+
     edev->io_vmo = vmo;
     edev->io_size = size;
 
@@ -351,6 +840,43 @@ fail:
     return status;
 }
 
+// largest io buffer eth_alloc_iobuf_locked() hands out, being contiguous
+#define ETH_IOBUF_ALLOC_MAX (4u * 1024 * 1024)
+
+static ssize_t eth_alloc_iobuf_locked(ethdev_t* edev, const void* in_buf, size_t in_len,
+                                      void* out_buf, size_t out_len) {
+    if ((in_len < sizeof(uint64_t)) || (out_len < sizeof(mx_handle_t))) {
+        return ERR_INVALID_ARGS;
+    }
+    if (!(edev->edev0->info.features & ETHMAC_FEATURE_RX_QUEUE)) {
+        // it would only be copied into, like any other
+        return ERR_NOT_SUPPORTED;
+    }
+    if (io_buffer_is_valid(&edev->io_alloc)) {
+        return ERR_ALREADY_BOUND;
+    }
+    uint64_t size = *((const uint64_t*) in_buf);
+    if ((size == 0) || (size > ETH_IOBUF_ALLOC_MAX)) {
+        return ERR_INVALID_ARGS;
+    }
+
+    mx_status_t status;
+    if ((status = io_buffer_init(&edev->io_alloc, size, IO_BUFFER_RW)) < 0) {
+        return status;
+    }
+    mx_info_handle_basic_t info;
+    mx_handle_t* vmo = out_buf;
+    if (((status = mx_object_get_info(edev->io_alloc.vmo_handle, MX_INFO_HANDLE_BASIC, &info,
+                                      sizeof(info), NULL, NULL)) < 0) ||
+        ((status = mx_handle_duplicate(edev->io_alloc.vmo_handle, MX_RIGHT_SAME_RIGHTS,
+                                       vmo)) < 0)) {
+        io_buffer_release(&edev->io_alloc);
+        return status;
+    }
+    edev->io_alloc_koid = info.koid;
+    return sizeof(mx_handle_t);
+}
+
 static mx_status_t eth_start_locked(ethdev_t* edev) {
     ethdev0_t* edev0 = edev->edev0;
 
@@ -376,7 +902,18 @@ static mx_status_t eth_start_locked(ethdev_t* edev) {
     }
 
     mx_status_t status;
-    if (list_is_empty(&edev0->list_active)) {
+    if ((status = eth_active_add_locked(edev0, edev)) < 0) {
+        return status;
+    }
+    if (edev0->info.features & ETHMAC_FEATURE_RX_QUEUE) {
+        list_delete(&edev->node);
+        list_add_tail(&edev0->list_active, &edev->node);
+        if ((status = eth_rxq_update_locked(edev0)) < 0) {
+            list_delete(&edev->node);
+            list_add_tail(&edev0->list_idle, &edev->node);
+            eth_rxq_update_locked(edev0);
+        }
+    } else if (list_is_empty(&edev0->list_active)) {
         status = edev0->macops->start(edev0->mac, &ethmac_ifc, edev0);
     } else {
         status = NO_ERROR;
@@ -387,6 +924,7 @@ static mx_status_t eth_start_locked(ethdev_t* edev) {
         list_delete(&edev->node);
         list_add_tail(&edev0->list_active, &edev->node);
     } else {
+        eth_active_remove_locked(edev0, edev);
         printf("eth: failed to start mac: %d\n", status);
     }
 
@@ -400,7 +938,14 @@ static mx_status_t eth_stop_locked(ethdev_t* edev) {
         edev->state &= (~ETHDEV_RUNNING);
         list_delete(&edev->node);
         list_add_tail(&edev0->list_idle, &edev->node);
-        if (list_is_empty(&edev0->list_active)) {
+        if (edev0->info.features & ETHMAC_FEATURE_RX_QUEUE) {
+            // takes back any of our buffers the ethermac holds
+            eth_rxq_update_locked(edev0);
+        }
+        eth_active_remove_locked(edev0, edev);
+        eth_rx_release(edev);
+        if (list_is_empty(&edev0->list_active) &&
+            !(edev0->info.features & ETHMAC_FEATURE_RX_QUEUE)) {
             if (!(edev->state & ETHDEV_DEAD)) {
                 edev0->macops->stop(edev0->mac);
             }
@@ -433,6 +978,12 @@ static ssize_t eth_ioctl(mx_device_t* dev, uint32_t op,
             if (edev->edev0->info.features & ETHMAC_FEATURE_WLAN) {
                 info->features |= ETH_FEATURE_WLAN;
             }
+            if (edev->edev0->info.features & ETHMAC_FEATURE_TX_CSUM) {
+                info->features |= ETH_FEATURE_TX_CSUM;
+            }
+            if (edev->edev0->info.features & ETHMAC_FEATURE_RX_CSUM) {
+                info->features |= ETH_FEATURE_RX_CSUM;
+            }
             info->mtu = edev->edev0->info.mtu;
             status = sizeof(*info);
         }
@@ -441,6 +992,9 @@ static ssize_t eth_ioctl(mx_device_t* dev, uint32_t op,
     case IOCTL_ETHERNET_GET_FIFOS:
         status = eth_get_fifos_locked(edev, out_buf, out_len);
         break;
+    case IOCTL_ETHERNET_ALLOC_IOBUF:
+        status = eth_alloc_iobuf_locked(edev, in_buf, in_len, out_buf, out_len);
+        break;
     case IOCTL_ETHERNET_SET_IOBUF:
         status = eth_set_iobuf_locked(edev, in_buf, in_len);
         break;
@@ -483,10 +1037,12 @@ static void eth_kill_locked(ethdev_t* edev) {
     edev->state |= ETHDEV_DEAD;
 
     // try to convince clients to close us
+    mtx_lock(&edev->rx_lock);
     if (edev->rx_fifo) {
         mx_handle_close(edev->rx_fifo);
         edev->rx_fifo = MX_HANDLE_INVALID;
     }
+    mtx_unlock(&edev->rx_lock);
     if (edev->tx_fifo) {
         mx_handle_close(edev->tx_fifo);
         edev->tx_fifo = MX_HANDLE_INVALID;
@@ -514,6 +1070,9 @@ static void eth_kill_locked(ethdev_t* edev) {
 static mx_status_t eth_release(mx_device_t* dev) {
     ethdev_t* edev = get_ethdev(dev);
     eth0_downref(edev->edev0);
+    if (io_buffer_is_valid(&edev->io_alloc)) {
+        io_buffer_release(&edev->io_alloc);
+    }
     free(edev);
     return ERR_NOT_SUPPORTED;
 }
@@ -549,6 +1108,7 @@ static mx_status_t eth0_open(mx_device_t* dev, mx_device_t** out, uint32_t flags
     }
 
     device_init(&edev->dev, &_driver_ethernet, "ethernet", &ethdev_ops);
+    mtx_init(&edev->rx_lock, mtx_plain);
     edev->dev.protocol_id = MX_PROTOCOL_ETHERNET;
     edev->dev.protocol_ops = &ethernet_ops;
     edev->edev0 = edev0;
@@ -573,6 +1133,22 @@ static void eth0_unbind(mx_device_t* dev) {
 
     mtx_lock(&edev0->lock);
 
+    if (edev0->info.features & ETHMAC_FEATURE_RX_QUEUE) {
+        // the ethermac must be done with client buffers before
+        // they are released below
+        mtx_lock(&edev0->mac_lock);
+        if (edev0->rxq_running) {
+            edev0->macops->stop(edev0->mac);
+            edev0->rxq_running = false;
+        }
+        eth_rxq_drain_locked(edev0);
+        edev0->rxq_direct = NULL;
+        edev0->rxq_exit = true;
+        mtx_unlock(&edev0->mac_lock);
+        mx_object_signal(edev0->rxq_event, 0, MX_EVENT_SIGNALED);
+        thrd_join(edev0->rxq_thr, NULL);
+    }
+
     // tear down shared memory, fifos, and threads
     // to encourage any open instances to close
     ethdev_t* edev;
@@ -601,7 +1177,50 @@ static mx_protocol_device_t ethdev0_ops = {
 };
 
 
-#define BAD_FEATURES (ETHMAC_FEATURE_RX_QUEUE | ETHMAC_FEATURE_TX_QUEUE)
+#define BAD_FEATURES (ETHMAC_FEATURE_TX_QUEUE)
+
+static mx_status_t eth_rxq_init(ethdev0_t* edev0) {
+    uint32_t depth = edev0->info.rx_queue_depth;
+    if ((depth == 0) || (edev0->info.mtu == 0)) {
+        printf("eth: bind: bad rx queue (depth %u, mtu %u)\n", depth, edev0->info.mtu);
+        return ERR_NOT_SUPPORTED;
+    }
+
+    mx_status_t status;
+    if (((edev0->rxq = calloc(depth, sizeof(eth_rxq_slot_t))) == NULL) ||
+        ((edev0->bounce_free = calloc(depth, sizeof(int32_t))) == NULL)) {
+        status = ERR_NO_MEMORY;
+        goto fail;
+    }
+    if ((status = io_buffer_init(&edev0->bounce, (size_t)depth * edev0->info.mtu,
+                                 IO_BUFFER_RW)) < 0) {
+        goto fail;
+    }
+    for (uint32_t n = 0; n < depth; n++) {
+        edev0->bounce_free[n] = depth - 1 - n;
+    }
+    edev0->bounce_free_count = depth;
+    if ((status = mx_event_create(0, &edev0->rxq_event)) < 0) {
+        goto fail_buffer;
+    }
+    mtx_init(&edev0->mac_lock, mtx_plain);
+    mtx_init(&edev0->rxq_lock, mtx_plain);
+    if (thrd_create_with_name(&edev0->rxq_thr, eth_rxq_thread, edev0,
+                              "eth-rxq-thread") != thrd_success) {
+        status = ERR_NO_RESOURCES;
+        goto fail_event;
+    }
+    return NO_ERROR;
+
+fail_event:
+    mx_handle_close(edev0->rxq_event);
+fail_buffer:
+    io_buffer_release(&edev0->bounce);
+fail:
+    free(edev0->bounce_free);
+    free(edev0->rxq);
+    return status;
+}
 
 static mx_status_t eth_bind(mx_driver_t* drv, mx_device_t* dev, void** cookie) {
     ethdev0_t* edev0;
@@ -639,7 +1258,23 @@ static mx_status_t eth_bind(mx_driver_t* drv, mx_device_t* dev, void** cookie) {
     edev0->mac = dev;
     edev0->dev.protocol_id = MX_PROTOCOL_ETHERNET;
 
+    if ((edev0->info.features & ETHMAC_FEATURE_RX_QUEUE) &&
+        ((status = eth_rxq_init(edev0)) < 0)) {
+        goto fail;
+    }
+
     if ((status = device_add(&edev0->dev, dev)) < 0) {
+        if (edev0->info.features & ETHMAC_FEATURE_RX_QUEUE) {
+            mtx_lock(&edev0->mac_lock);
+            edev0->rxq_exit = true;
+            mtx_unlock(&edev0->mac_lock);
+            mx_object_signal(edev0->rxq_event, 0, MX_EVENT_SIGNALED);
+            thrd_join(edev0->rxq_thr, NULL);
+            io_buffer_release(&edev0->bounce);
+            mx_handle_close(edev0->rxq_event);
+            free(edev0->bounce_free);
+            free(edev0->rxq);
+        }
         goto fail;
     }
 
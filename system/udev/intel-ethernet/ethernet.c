@@ -54,14 +54,16 @@ static int irq_thread(void* arg) {
 
         mtx_lock(&edev->lock);
         if (eth_handle_irq(&edev->eth) & ETH_IRQ_RX) {
-            void* data;
             size_t len;
 
-            while (eth_rx(&edev->eth, &data, &len) == NO_ERROR) {
+            while (eth_rx(&edev->eth, &len) == NO_ERROR) {
+                eth_rx_ack(&edev->eth);
                 if (edev->ifc) {
-                    edev->ifc->recv(edev->cookie, data, len, 0);
+                    edev->ifc->complete_rx(edev->cookie, len, 0);
                 }
-                eth_rx_ack(&edev->eth);
+            }
+            if (edev->ifc) {
+                edev->ifc->recv_flush(edev->cookie);
             }
         }
         mtx_unlock(&edev->lock);
@@ -80,7 +82,10 @@ static mx_status_t eth_query(mx_device_t* dev, uint32_t options, ethmac_info_t*
     }
 
     memset(info, 0, sizeof(*info));
+    info->features = ETHMAC_FEATURE_RX_QUEUE;
     info->mtu = ETH_RXBUF_SIZE; //TODO: not actually the mtu!
+    // one descriptor is always left empty, to tell a full ring from an empty one
+    info->rx_queue_depth = ETH_RXBUF_COUNT - 1;
     memcpy(info->mac, edev->eth.mac, sizeof(edev->eth.mac));
 
     return NO_ERROR;
@@ -89,6 +94,7 @@ static mx_status_t eth_query(mx_device_t* dev, uint32_t options, ethmac_info_t*
 static void eth_stop(mx_device_t* dev) {
     ethernet_device_t* edev = get_eth_device(dev);
     mtx_lock(&edev->lock);
+    eth_rx_stop(&edev->eth);
     edev->ifc = NULL;
     mtx_unlock(&edev->lock);
 }
@@ -103,6 +109,7 @@ static mx_status_t eth_start(mx_device_t* dev, ethmac_ifc_t* ifc, void* cookie)
     } else {
         edev->ifc = ifc;
         edev->cookie = cookie;
+        eth_rx_start(&edev->eth);
     }
     mtx_unlock(&edev->lock);
 
@@ -114,11 +121,26 @@ static void eth_send(mx_device_t* dev, uint32_t options, void* data, size_t leng
     eth_tx(&edev->eth, data, length);
 }
 
+static void eth_queue_rx(mx_device_t* dev, uint32_t options,
+                         uintptr_t pa0, uintptr_t pa1, size_t length) {
+    ethernet_device_t* edev = get_eth_device(dev);
+    if (length < ETH_RXBUF_SIZE) {
+        printf("eth: rx buffer too small (%zu bytes)\n", length);
+        return;
+    }
+    mtx_lock(&edev->lock);
+    if (eth_rx_queue(&edev->eth, pa0) < 0) {
+        printf("eth: rx ring overflow\n");
+    }
+    mtx_unlock(&edev->lock);
+}
+
 static ethmac_protocol_t ethmac_ops = {
     .query = eth_query,
     .stop = eth_stop,
     .start = eth_start,
     .send = eth_send,
+    .queue_rx = eth_queue_rx,
 };
 
 static mx_status_t eth_release(mx_device_t* dev) {
@@ -45,31 +45,53 @@ unsigned eth_handle_irq(ethdev_t* eth) {
     return readl(IE_ICR);
 }
 
-status_t eth_rx(ethdev_t* eth, void** data, size_t* len) {
+void eth_rx_start(ethdev_t* eth) {
+    eth_rx_stop(eth);
+    memset(eth->rxd, 0, ETH_RXBUF_COUNT * sizeof(ie_rxd_t));
+    eth->rx_rd_ptr = 0;
+    eth->rx_wr_ptr = 0;
+    writel(0, IE_RDH);
+    writel(0, IE_RDT);
+    writel(IE_RCTL_BSIZE2048 | IE_RCTL_DPF | IE_RCTL_SECRC | IE_RCTL_BAM | IE_RCTL_MPE | IE_RCTL_EN, IE_RCTL);
+}
+
+void eth_rx_stop(ethdev_t* eth) {
+    writel(readl(IE_RCTL) & ~IE_RCTL_EN, IE_RCTL);
+}
+
+status_t eth_rx_queue(ethdev_t* eth, uint64_t phys) {
+    uint32_t n = eth->rx_wr_ptr;
+    uint32_t next = (n + 1) & (ETH_RXBUF_COUNT - 1);
+
+    // the ring is full when the tail would catch up with the head
+    if (next == eth->rx_rd_ptr) {
+        return ERR_NO_RESOURCES;
+    }
+    eth->rxd[n].addr = phys;
+    eth->rxd[n].info = 0;
+    eth->rx_wr_ptr = next;
+    writel(next, IE_RDT);
+    return NO_ERROR;
+}
+
+status_t eth_rx(ethdev_t* eth, size_t* len) {
     uint32_t n = eth->rx_rd_ptr;
-    uint64_t info = eth->rxd[n].info;
+    if (n == eth->rx_wr_ptr) {
+        return ERR_SHOULD_WAIT;
+    }
 
+    uint64_t info = eth->rxd[n].info;
     if (!(info & IE_RXD_DONE)) {
         return ERR_SHOULD_WAIT;
     }
-
-    // copy out packet
-    mx_status_t r = IE_RXD_LEN(info);
-
-    *data = eth->rxb + ETH_RXBUF_SIZE * n;
-    *len = r;
-
+    *len = IE_RXD_LEN(info);
     return NO_ERROR;
 }
 
 void eth_rx_ack(ethdev_t* eth) {
     uint32_t n = eth->rx_rd_ptr;
-
-    // make buffer available to hw
     eth->rxd[n].info = 0;
-    writel(n, IE_RDT);
-    n = (n + 1) & (ETH_RXBUF_COUNT - 1);
-    eth->rx_rd_ptr = n;
+    eth->rx_rd_ptr = (n + 1) & (ETH_RXBUF_COUNT - 1);
 }
 
 status_t eth_tx(ethdev_t* eth, const void* data, size_t len) {
@@ -151,15 +173,18 @@ void eth_init_hw(ethdev_t* eth) {
     //TODO: TCTL COLD should be based on link state
     //TODO: use address filtering for multicast
 
-    // setup rx ring
+    // setup rx ring, which stays empty (and the receiver
+    // disabled) until eth_rx_start()
     eth->rx_rd_ptr = 0;
+    eth->rx_wr_ptr = 0;
     writel(0, IE_RXCSUM);
     writel((4 << 0) | (1 << 8) | (1 << 16) | (1 << 24), IE_RXDCTL);
     writel(eth->rxd_phys, IE_RDBAL);
     writel(eth->rxd_phys >> 32, IE_RDBAH);
     writel(ETH_RXBUF_COUNT * 16, IE_RDLEN);
-    writel(ETH_RXBUF_COUNT - 1, IE_RDT);
-    writel(IE_RCTL_BSIZE2048 | IE_RCTL_DPF | IE_RCTL_SECRC | IE_RCTL_BAM | IE_RCTL_MPE | IE_RCTL_EN, IE_RCTL);
+    writel(0, IE_RDH);
+    writel(0, IE_RDT);
+    writel(IE_RCTL_BSIZE2048 | IE_RCTL_DPF | IE_RCTL_SECRC | IE_RCTL_BAM | IE_RCTL_MPE, IE_RCTL);
 
     // setup tx ring
     eth->tx_wr_ptr = 0;
@@ -194,14 +219,6 @@ void eth_setup_buffers(ethdev_t* eth, void* iomem, mx_paddr_t iophys) {
     iophys += ETH_DRING_SIZE;
     memset(eth->txd, 0, ETH_DRING_SIZE);
 
-    eth->rxb = iomem;
-    eth->rxb_phys = iophys;
-    iomem += ETH_RXBUF_SIZE * ETH_RXBUF_COUNT;
-    iophys += ETH_RXBUF_SIZE * ETH_RXBUF_COUNT;
-
-    for (int n = 0; n < ETH_RXBUF_COUNT; n++) {
-        eth->rxd[n].addr = eth->rxb_phys + ETH_RXBUF_SIZE * n;
-    }
     for (int n = 0; n < ETH_TXBUF_COUNT - 1; n++) {
         framebuf_t *txb = iomem;
         txb->phys = iophys + ETH_TXBUF_HSIZE;
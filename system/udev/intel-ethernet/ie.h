@@ -28,25 +28,25 @@ struct ethdev {
     uint32_t tx_wr_ptr;
     uint32_t tx_rd_ptr;
     uint32_t rx_rd_ptr;
+    uint32_t rx_wr_ptr;
 
     list_node_t free_frames;
     list_node_t busy_frames;
 
-    // base physical addresses for
-    // tx/rx rings and rx buffers
+    // base physical addresses for tx/rx rings
     // store as 64bit integer to match hw register size
     uint64_t txd_phys;
     uint64_t rxd_phys;
-    uint64_t rxb_phys;
-    void* rxb;
 
     uint8_t mac[6];
 
     mtx_t send_lock;
 };
 
+// rx buffers are provided by the ethernet core (see eth_rx_queue()),
+// and must be at least this large
 #define ETH_RXBUF_SIZE  2048
-#define ETH_RXBUF_COUNT 32
+#define ETH_RXBUF_COUNT 128
 
 #define ETH_TXBUF_SIZE  2048
 #define ETH_TXBUF_COUNT 32
@@ -55,8 +55,7 @@ struct ethdev {
 
 #define ETH_DRING_SIZE 2048
 
-#define ETH_ALLOC ((ETH_RXBUF_SIZE * ETH_RXBUF_COUNT) + \
-                   (ETH_TXBUF_SIZE * ETH_TXBUF_COUNT) + \
+#define ETH_ALLOC ((ETH_TXBUF_SIZE * ETH_TXBUF_COUNT) + \
                    (ETH_DRING_SIZE * 2))
 
 status_t eth_reset_hw(ethdev_t* eth);
@@ -65,7 +64,16 @@ void eth_init_hw(ethdev_t* eth);
 
 void eth_dump_regs(ethdev_t* eth);
 
-status_t eth_rx(ethdev_t* eth, void** data, size_t* len);
+// empties the rx ring and enables the receiver
+void eth_rx_start(ethdev_t* eth);
+// disables the receiver; buffers in the rx ring are abandoned
+void eth_rx_stop(ethdev_t* eth);
+// adds a buffer of ETH_RXBUF_SIZE bytes to the rx ring
+status_t eth_rx_queue(ethdev_t* eth, uint64_t phys);
+
+// returns the length of the frame in the oldest rx buffer, if complete,
+// and then eth_rx_ack() retires that buffer
+status_t eth_rx(ethdev_t* eth, size_t* len);
 void eth_rx_ack(ethdev_t* eth);
 
 status_t eth_tx(ethdev_t* eth, const void* data, size_t len);
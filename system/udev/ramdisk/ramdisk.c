@@ -101,10 +101,18 @@ static void ramdisk_fifo_write(mx_device_t* dev, mx_handle_t vmo, uint64_t lengt
     rdev->cb->complete(cookie, status);
 }
 
+static void ramdisk_fifo_sync(mx_device_t* dev, void* cookie) {
+    ramdisk_device_t* rdev = get_ramdisk(dev);
+    // Writes complete synchronously, straight into the VMO; there is
+    // nothing held back to flush.
+    rdev->cb->complete(cookie, NO_ERROR);
+}
+
 static block_ops_t ramdisk_block_ops = {
     .set_callbacks = ramdisk_fifo_set_callbacks,
     .read = ramdisk_fifo_read,
     .write = ramdisk_fifo_write,
+    .sync = ramdisk_fifo_sync,
 };
 
 // implement device protocol:
@@ -186,8 +186,11 @@ static void ahci_port_reset(ahci_port_t* port) {
     ahci_write(&port->regs->serr, ahci_read(&port->regs->serr));
 }
 
-static bool ahci_port_cmd_busy(ahci_port_t* port, int slot) {
-    return ((ahci_read(&port->regs->sact) | ahci_read(&port->regs->ci)) & (1 << slot)) || (port->commands[slot] != NULL) || (port->running & (1 << slot));
+static void ahci_complete_list(list_node_t* list) {
+    iotxn_t* txn;
+    while ((txn = list_remove_head_type(list, iotxn_t, node)) != NULL) {
+        iotxn_complete(txn, txn->status, (txn->status == NO_ERROR) ? txn->length : 0);
+    }
 }
 
 static bool cmd_is_read(uint8_t cmd) {
@@ -215,64 +218,58 @@ static bool cmd_is_queued(uint8_t cmd) {
 }
 
 static void ahci_port_complete_txn(ahci_device_t* dev, ahci_port_t* port, mx_status_t status) {
-    iotxn_t* txn;
-    uint32_t sact = ahci_read(&port->regs->sact);
-    for (int i = 0; i < AHCI_MAX_COMMANDS; i++) {
-        txn = port->commands[i];
-        if (txn == NULL) {
-            continue;
-        }
-        if (!(sact & (1 << i))) {
-            mtx_lock(&port->lock);
-            // clear state before calling the complete() hook
-            port->running &= ~(1 << i);
-            port->commands[i] = NULL;
-
-            // resume the port if paused for sync and no outstanding transactions
-            if ((port->flags & AHCI_PORT_FLAG_SYNC_PAUSED) && !port->running) {
-                port->flags &= ~AHCI_PORT_FLAG_SYNC_PAUSED;
-            }
-            mtx_unlock(&port->lock);
-
-            iotxn_complete(txn, status, txn->length);
-        }
+    list_node_t completed = LIST_INITIAL_VALUE(completed);
+    mtx_lock(&port->lock);
+    // Queued commands are outstanding until their SACT bit clears, and
+    // others until their CI bit clears.
+    uint32_t active = ahci_read(&port->regs->sact) | ahci_read(&port->regs->ci);
+    uint32_t done = port->running & ~active;
+    // clear state before calling the complete() hooks
+    port->running &= ~done;
+    while (done) {
+        int slot = __builtin_ctz(done);
+        done &= done - 1;
+        iotxn_t* txn = port->commands[slot];
+        port->commands[slot] = NULL;
+        txn->status = status;
+        list_add_tail(&completed, &txn->node);
+    }
+
+    // resume the port if paused for sync and no outstanding transactions
+    if ((port->flags & AHCI_PORT_FLAG_SYNC_PAUSED) && !port->running) {
+        port->flags &= ~AHCI_PORT_FLAG_SYNC_PAUSED;
     }
+    mtx_unlock(&port->lock);
+
+    ahci_complete_list(&completed);
     // hit the worker thread to do the next txn
     completion_signal(&dev->worker_completion);
 }
 
+// Builds the command for 'txn' in 'slot', without issuing it. On error the
+// txn is left for the caller to complete.
 static mx_status_t ahci_do_txn(ahci_device_t* dev, ahci_port_t* port, int slot, iotxn_t* txn) {
     assert(slot < AHCI_MAX_COMMANDS);
-    assert(!ahci_port_cmd_busy(port, slot));
+    assert(!(port->running & (1u << slot)));
 
     sata_pdata_t* pdata = sata_iotxn_pdata(txn);
-    if ((cmd_is_read(pdata->cmd) || cmd_is_write(pdata->cmd)) && pdata->count == 0) {
-        // Empty reads and writes complete immediately, and are not actually
-        // transmitted to the underlying device.
-        // resume the port if paused for sync and no outstanding transactions
-        if ((port->flags & AHCI_PORT_FLAG_SYNC_PAUSED) && !port->running) {
-            port->flags &= ~AHCI_PORT_FLAG_SYNC_PAUSED;
+    // Commands without data (such as FLUSH CACHE EXT) have no PRD entries.
+    mx_paddr_t phys = 0;
+    if (txn->length > 0) {
+        mx_status_t status = iotxn_physmap(txn);
+        if (status != NO_ERROR) {
+            return status;
         }
-        iotxn_complete(txn, NO_ERROR, txn->length);
-        completion_signal(&dev->worker_completion);
-        return NO_ERROR;
-    }
-
-    mx_status_t status = iotxn_physmap(txn);
-    if (status != NO_ERROR) {
-        iotxn_complete(txn, status, 0);
-        completion_signal(&dev->worker_completion);
-        return status;
-    }
-    if (txn->phys_length != 1) {
-        printf("%s scatter/gather not implemented yet\n", __FUNCTION__);
-        iotxn_complete(txn, ERR_INVALID_ARGS, 0);
-        completion_signal(&dev->worker_completion);
-        return ERR_INVALID_ARGS;
+        if (txn->phys_length != 1) {
+            printf("%s scatter/gather not implemented yet\n", __FUNCTION__);
+            return ERR_INVALID_ARGS;
+        }
+        phys = iotxn_phys_contiguous(txn);
     }
-    mx_paddr_t phys = iotxn_phys_contiguous(txn);
 
-    if (dev->cap & AHCI_CAP_NCQ) {
+    // Reads and writes are queued (and may run alongside each other) if
+    // both the HBA and the drive support NCQ.
+    if ((dev->cap & AHCI_CAP_NCQ) && (pdata->max_cmd > 0)) {
         if (pdata->cmd == SATA_CMD_READ_DMA_EXT) {
             pdata->cmd = SATA_CMD_READ_FPDMA_QUEUED;
         } else if (pdata->cmd == SATA_CMD_WRITE_DMA_EXT) {
@@ -294,7 +291,7 @@ static mx_status_t ahci_do_txn(ahci_device_t* dev, ahci_port_t* port, int slot,
     cl->prdtl_flags_cfl = 0;
     cl->cfl = 5; // 20 bytes
     cl->w = cmd_is_write(pdata->cmd) ? 1 : 0;
-    cl->prdtl = 1;
+    cl->prdtl = (txn->length > 0) ? 1 : 0;
     cl->prdbc = 0;
     memset(port->ct[slot], 0, sizeof(ahci_ct_t));
 
@@ -343,19 +340,79 @@ static mx_status_t ahci_do_txn(ahci_device_t* dev, ahci_port_t* port, int slot,
     port->running |= (1 << slot);
     port->commands[slot] = txn;
 
-    // start command
-    if (cmd_is_queued(pdata->cmd)) {
-        ahci_write(&port->regs->sact, ahci_read(&port->regs->sact) | (1 << slot));
-    }
-    ahci_write(&port->regs->ci, ahci_read(&port->regs->ci) | (1 << slot));
-
     // set the watchdog
     // TODO: general timeout mechanism
-    pdata->timeout = mx_time_get(MX_CLOCK_MONOTONIC) + MX_SEC(1);
+    // (writing back a full cache can take a spinning disk several seconds)
+    mx_time_t timeout = (pdata->cmd == SATA_CMD_FLUSH_EXT) ? MX_SEC(30) : MX_SEC(1);
+    pdata->timeout = mx_time_get(MX_CLOCK_MONOTONIC) + timeout;
     completion_signal(&dev->watchdog_completion);
     return NO_ERROR;
 }
 
+// Starts as many of the port's queued txns as there are free command slots,
+// ringing the doorbell once for all of them. Txns which fail to start are
+// moved to 'failed', to be completed once the port lock is dropped.
+static void ahci_port_start_txns(ahci_device_t* dev, ahci_port_t* port, list_node_t* failed) {
+    uint32_t queued = 0;
+    uint32_t issued = 0;
+    iotxn_t* txn;
+    while (!(port->flags & AHCI_PORT_FLAG_SYNC_PAUSED) &&
+           (txn = list_peek_head_type(&port->txn_list, iotxn_t, node)) != NULL) {
+        // if IOTXN_SYNC_BEFORE, pause the port if there are transactions in flight
+        if ((txn->flags & IOTXN_SYNC_BEFORE) && (port->running || issued)) {
+            port->flags |= AHCI_PORT_FLAG_SYNC_PAUSED;
+            break;
+        }
+
+        // find a free command tag
+        sata_pdata_t* pdata = sata_iotxn_pdata(txn);
+        int max = MIN(pdata->max_cmd, (int)((dev->cap >> 8) & 0x1f));
+        uint32_t slots = (max == AHCI_MAX_COMMANDS - 1) ? 0xffffffff : ((2u << max) - 1);
+        uint32_t free = slots & ~port->running;
+        if (!free) {
+            break;
+        }
+        int slot = __builtin_ctz(free);
+
+        list_delete(&txn->node);
+        // if IOTXN_SYNC_AFTER, pause the port until this command is complete
+        if (txn->flags & IOTXN_SYNC_AFTER) {
+            port->flags |= AHCI_PORT_FLAG_SYNC_PAUSED;
+        }
+        if ((cmd_is_read(pdata->cmd) || cmd_is_write(pdata->cmd)) && pdata->count == 0) {
+            // Empty reads and writes complete immediately, and are not actually
+            // transmitted to the underlying device.
+            // resume the port if paused for sync and no outstanding transactions
+            if ((port->flags & AHCI_PORT_FLAG_SYNC_PAUSED) && !port->running && !issued) {
+                port->flags &= ~AHCI_PORT_FLAG_SYNC_PAUSED;
+            }
+            txn->status = NO_ERROR;
+            list_add_tail(failed, &txn->node);
+            continue;
+        }
+        // build the command
+        mx_status_t status = ahci_do_txn(dev, port, slot, txn);
+        if (status != NO_ERROR) {
+            txn->status = status;
+            list_add_tail(failed, &txn->node);
+            continue;
+        }
+        if (cmd_is_queued(pdata->cmd)) {
+            queued |= (1u << slot);
+        }
+        issued |= (1u << slot);
+    }
+
+    // start the commands; writing zeroes to SACT and CI has no effect, so
+    // only the new bits are written
+    if (queued) {
+        ahci_write(&port->regs->sact, queued);
+    }
+    if (issued) {
+        ahci_write(&port->regs->ci, issued);
+    }
+}
+
 static mx_status_t ahci_port_initialize(ahci_port_t* port) {
     uint32_t cmd = ahci_read(&port->regs->cmd);
     if (cmd & (AHCI_PORT_CMD_ST | AHCI_PORT_CMD_FRE | AHCI_PORT_CMD_CR | AHCI_PORT_CMD_FR)) {
@@ -475,54 +532,29 @@ void ahci_iotxn_queue(mx_device_t* dev, iotxn_t* txn) {
 static int ahci_worker_thread(void* arg) {
     ahci_device_t* dev = (ahci_device_t*)arg;
     ahci_port_t* port;
-    iotxn_t* txn;
     for (;;) {
+        // reset before looking at the ports, so that a txn queued (or a
+        // command slot freed) while they are being looked at is not missed
+        completion_reset(&dev->worker_completion);
+
         // iterate all the ports and run commands
         for (int i = 0; i < AHCI_MAX_PORTS; i++) {
             port = &dev->ports[i];
-            mtx_lock(&port->lock);
             if (!(port->flags & (AHCI_PORT_FLAG_IMPLEMENTED | AHCI_PORT_FLAG_PRESENT))) {
-                goto next;
-            }
-            if (port->flags & AHCI_PORT_FLAG_SYNC_PAUSED) {
-                goto next;
-            }
-
-            txn = list_peek_head_type(&port->txn_list, iotxn_t, node);
-            if (!txn) {
-                goto next;
-            }
-
-            // if IOTXN_SYNC_BEFORE, pause the port if there are transactions in flight
-            if ((txn->flags & IOTXN_SYNC_BEFORE) && port->running) {
-                port->flags |= AHCI_PORT_FLAG_SYNC_PAUSED;
-                goto next;
-            }
-
-            // find a free command tag
-            sata_pdata_t* pdata = sata_iotxn_pdata(txn);
-            int max = MIN(pdata->max_cmd, (int)((dev->cap >> 8) & 0x1f));
-            int i = 0;
-            for (i = 0; i <= max; i++) {
-                if (!ahci_port_cmd_busy(port, i)) break;
-            }
-            if (i > max) {
-                goto next;
-            }
-
-            list_delete(&txn->node);
-            // if IOTXN_SYNC_AFTER, pause the port until this command is complete
-            if (txn->flags & IOTXN_SYNC_AFTER) {
-                port->flags |= AHCI_PORT_FLAG_SYNC_PAUSED;
+                continue;
             }
-            // run the command
-            ahci_do_txn(dev, port, i, txn);
-next:
+            list_node_t failed = LIST_INITIAL_VALUE(failed);
+            mtx_lock(&port->lock);
+            ahci_port_start_txns(dev, port, &failed);
             mtx_unlock(&port->lock);
+            if (!list_is_empty(&failed)) {
+                ahci_complete_list(&failed);
+                // txns which finish straight away may have unpaused the port
+                completion_signal(&dev->worker_completion);
+            }
         }
         // wait here until more commands are queued, or a port becomes idle
         completion_wait(&dev->worker_completion, MX_TIME_INFINITE);
-        completion_reset(&dev->worker_completion);
     }
     return 0;
 }
@@ -576,15 +608,6 @@ static void ahci_port_irq(ahci_device_t* dev, int nr) {
     uint32_t is = ahci_read(&port->regs->is);
     ahci_write(&port->regs->is, is);
 
-    if (is & AHCI_PORT_INT_DHR) { // RFIS received
-        ahci_port_complete_txn(dev, port, NO_ERROR);
-    }
-    if (is & AHCI_PORT_INT_PS) { // PSFIS rcv
-        ahci_port_complete_txn(dev, port, NO_ERROR);
-    }
-    if (is & AHCI_PORT_INT_SDB) { // SDBFIS
-        ahci_port_complete_txn(dev, port, NO_ERROR);
-    }
     if (is & AHCI_PORT_INT_PRC) { // PhyRdy change
         uint32_t serr = ahci_read(&port->regs->serr);
         ahci_write(&port->regs->serr, serr & ~0x1);
@@ -592,6 +615,10 @@ static void ahci_port_irq(ahci_device_t* dev, int nr) {
     if (is & AHCI_PORT_INT_TFE) { // taskfile error
         xprintf("tfe error\n");
         ahci_port_complete_txn(dev, port, ERR_INTERNAL);
+    } else if (is & (AHCI_PORT_INT_DHR | AHCI_PORT_INT_PS | AHCI_PORT_INT_SDB)) {
+        // RFIS, PSFIS or SDBFIS received; every command whose SACT and CI
+        // bits have cleared is collected at once
+        ahci_port_complete_txn(dev, port, NO_ERROR);
     }
 }
 
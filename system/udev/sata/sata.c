@@ -130,7 +130,14 @@ static mx_status_t sata_device_identify(sata_device_t* dev, mx_device_t* control
     } else {
         xprintf(" PIO");
     }
-    dev->max_cmd = *(devinfo + SATA_DEVINFO_QUEUE_DEPTH);
+    // Only a drive which supports NCQ may have more than one command
+    // outstanding at a time.
+    if (*(devinfo + SATA_DEVINFO_SATA_CAP) & (1 << 8)) {
+        dev->max_cmd = *(devinfo + SATA_DEVINFO_QUEUE_DEPTH) & 0x1f;
+        xprintf(" NCQ");
+    } else {
+        dev->max_cmd = 0;
+    }
     xprintf(" %d commands\n", dev->max_cmd + 1);
     if (cap & (1 << 9)) {
         dev->sector_sz = 512; // default
@@ -187,6 +194,27 @@ static void sata_iotxn_queue(mx_device_t* dev, iotxn_t* txn) {
     ahci_iotxn_queue(dev->parent, txn);
 }
 
+// Queues a FLUSH CACHE EXT. It waits for every command ahead of it, and
+// holds back every command behind it, so it covers all writes which have
+// completed.
+static void sata_queue_flush(mx_device_t* dev, iotxn_t* txn) {
+    sata_device_t* device = get_sata_device(dev);
+    txn->opcode = IOTXN_OP_WRITE;
+    txn->flags = IOTXN_SYNC_BEFORE | IOTXN_SYNC_AFTER;
+    txn->offset = 0;
+    txn->length = 0;
+
+    sata_pdata_t* pdata = sata_iotxn_pdata(txn);
+    pdata->cmd = SATA_CMD_FLUSH_EXT;
+    pdata->device = 0x40;
+    pdata->lba = 0;
+    pdata->count = 0;
+    pdata->max_cmd = device->max_cmd;
+    pdata->port = device->port;
+
+    ahci_iotxn_queue(dev->parent, txn);
+}
+
 static void sata_sync_complete(iotxn_t* txn, void* cookie) {
     completion_signal((completion_t*)cookie);
 }
@@ -211,6 +239,11 @@ static ssize_t sata_ioctl(mx_device_t* dev, uint32_t op, const void* cmd, size_t
         // rebind to reread the partition table
         return device_rebind(dev);
     }
+    case IOCTL_DEVICE_GET_IOTXN_STATS: {
+        if (max < sizeof(iotxn_pool_stats_t)) return ERR_BUFFER_TOO_SMALL;
+        iotxn_pool_stats(reply);
+        return sizeof(iotxn_pool_stats_t);
+    }
     case IOCTL_DEVICE_SYNC: {
         iotxn_t* txn;
         mx_status_t status = iotxn_alloc(&txn, IOTXN_ALLOC_CONTIGUOUS, 0);
@@ -218,13 +251,9 @@ static ssize_t sata_ioctl(mx_device_t* dev, uint32_t op, const void* cmd, size_t
             return status;
         }
         completion_t completion = COMPLETION_INIT;
-        txn->opcode = IOTXN_OP_READ;
-        txn->flags = IOTXN_SYNC_BEFORE;
-        txn->offset = 0;
-        txn->length = 0;
         txn->complete_cb = sata_sync_complete;
         txn->cookie = &completion;
-        sata_iotxn_queue(dev, txn);
+        sata_queue_flush(dev, txn);
         completion_wait(&completion, MX_TIME_INFINITE);
         status = txn->status;
         iotxn_release(txn);
@@ -318,10 +347,28 @@ static void sata_fifo_write(mx_device_t* dev, mx_handle_t vmo, uint64_t length,
     sata_iotxn_queue(dev, txn);
 }
 
+static void sata_fifo_sync(mx_device_t* dev, void* cookie) {
+    sata_device_t* device = get_sata_device(dev);
+
+    mx_status_t status;
+    iotxn_t* txn;
+    if ((status = iotxn_alloc(&txn, IOTXN_ALLOC_CONTIGUOUS, 0)) != NO_ERROR) {
+        device->callbacks->complete(cookie, status);
+        return;
+    }
+
+    txn->complete_cb = sata_fifo_complete;
+    txn->cookie = cookie;
+    memcpy(txn->extra, &device, sizeof(sata_device_t*));
+
+    sata_queue_flush(dev, txn);
+}
+
 static block_ops_t sata_block_ops = {
     .set_callbacks = sata_fifo_set_callbacks,
     .read = sata_fifo_read,
     .write = sata_fifo_write,
+    .sync = sata_fifo_sync,
 };
 
 mx_status_t sata_bind(mx_device_t* dev, int port) {
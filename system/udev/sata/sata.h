@@ -13,6 +13,7 @@
 #define SATA_CMD_WRITE_DMA            0xca
 #define SATA_CMD_WRITE_DMA_EXT        0x35
 #define SATA_CMD_WRITE_FPDMA_QUEUED   0x61
+#define SATA_CMD_FLUSH_EXT            0xea
 
 #define SATA_DEVINFO_SERIAL              10
 #define SATA_DEVINFO_FW_REV              23
@@ -38,7 +39,7 @@ typedef struct sata_pdata {
     uint16_t count; // in blocks
     uint8_t cmd;
     uint8_t device;
-    int max_cmd;
+    int max_cmd; // highest command tag the device accepts; > 0 only with NCQ
     int port;
 } sata_pdata_t;
 
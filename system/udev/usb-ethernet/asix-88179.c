@@ -286,6 +286,7 @@ static void ax88179_read_complete(iotxn_t* request, void* cookie) {
     mtx_lock(&eth->mutex);
     if ((request->status == NO_ERROR) && eth->ifc) {
         ax88179_recv(eth, request);
+        eth->ifc->recv_flush(eth->cookie);
     }
     requeue_read_request_locked(eth, request);
     mtx_unlock(&eth->mutex);
@@ -179,6 +179,7 @@ static void ax88772b_read_complete(iotxn_t* request, void* cookie) {
     mtx_lock(&eth->mutex);
     if ((request->status == NO_ERROR) && eth->ifc) {
         ax88772b_recv(eth, request);
+        eth->ifc->recv_flush(eth->cookie);
     }
     requeue_read_request_locked(eth, request);
     mtx_unlock(&eth->mutex);
@@ -316,6 +316,7 @@ static void lan9514_read_complete(iotxn_t* request, void* cookie) {
     mtx_lock(&eth->mutex);
     if ((request->status == NO_ERROR) && eth->ifc) {
         lan9514_recv(eth, request);
+        eth->ifc->recv_flush(eth->cookie);
     }
     requeue_read_request_locked(eth, request);
     mtx_unlock(&eth->mutex);
@@ -8,10 +8,16 @@
 #include <hexdump/hexdump.h>
 #include <inttypes.h>
 #include <magenta/compiler.h>
+#include <magenta/device/block.h>
+#include <magenta/device/device.h>
+#include <magenta/syscalls.h>
+#include <magenta/new.h>
 #include <mxtl/auto_lock.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/param.h>
+#include <threads.h>
 
 #include "trace.h"
 #include "utils.h"
@@ -29,6 +35,7 @@
 #define VIRTIO_BLK_F_FLUSH    (1<<9)
 #define VIRTIO_BLK_F_TOPOLOGY (1<<10)
 #define VIRTIO_BLK_F_CONFIG_WCE (1<<11)
+#define VIRTIO_BLK_F_MQ       (1<<12)
 
 #define VIRTIO_BLK_T_IN         0
 #define VIRTIO_BLK_T_OUT        1
@@ -52,12 +59,12 @@ void BlockDevice::virtio_block_iotxn_queue(mx_device_t* dev, iotxn_t* txn) {
     switch (txn->opcode) {
     case IOTXN_OP_READ: {
         LTRACEF("READ offset %#" PRIx64 " length %#" PRIx64 "\n", txn->offset, txn->length);
-        bd->QueueReadWriteTxn(txn);
+        bd->QueueTxn(txn);
         break;
     }
     case IOTXN_OP_WRITE:
         LTRACEF("WRITE offset %#" PRIx64 " length %#" PRIx64 "\n", txn->offset, txn->length);
-        bd->QueueReadWriteTxn(txn);
+        bd->QueueTxn(txn);
         break;
     default:
         iotxn_complete(txn, -1, 0);
@@ -75,6 +82,11 @@ mx_off_t BlockDevice::virtio_block_get_size(mx_device_t* dev) {
     return bd->GetSize();
 }
 
+static void virtio_block_sync_complete(iotxn_t* txn, void* cookie) {
+    mx_handle_t event = *static_cast<mx_handle_t*>(cookie);
+    mx_object_signal(event, 0, MX_EVENT_SIGNALED);
+}
+
 ssize_t BlockDevice::virtio_block_ioctl(mx_device_t* dev, uint32_t op, const void* in_buf, size_t in_len,
                                         void* reply, size_t max) {
     LTRACEF("dev %p, op %u\n", dev, op);
@@ -100,11 +112,97 @@ ssize_t BlockDevice::virtio_block_ioctl(mx_device_t* dev, uint32_t op, const voi
         // rebind to reread the partition table
         return device_rebind(dev);
     }
+    case IOCTL_DEVICE_GET_IOTXN_STATS: {
+        if (max < sizeof(iotxn_pool_stats_t))
+            return ERR_BUFFER_TOO_SMALL;
+        iotxn_pool_stats(static_cast<iotxn_pool_stats_t*>(reply));
+        return sizeof(iotxn_pool_stats_t);
+    }
+    case IOCTL_DEVICE_SYNC: {
+        mx_handle_t event;
+        mx_status_t status = mx_event_create(0, &event);
+        if (status != NO_ERROR)
+            return status;
+        iotxn_t* txn;
+        if ((status = iotxn_alloc(&txn, 0, 0)) != NO_ERROR) {
+            mx_handle_close(event);
+            return status;
+        }
+        txn->opcode = IOTXN_OP_WRITE;
+        txn->offset = 0;
+        txn->length = 0;
+        txn->complete_cb = virtio_block_sync_complete;
+        txn->cookie = &event;
+        bd->QueueTxn(txn);
+        mx_object_wait_one(event, MX_EVENT_SIGNALED, MX_TIME_INFINITE, NULL);
+        status = txn->status;
+        iotxn_release(txn);
+        mx_handle_close(event);
+        return status;
+    }
     default:
         return ERR_NOT_SUPPORTED;
     }
 }
 
+// block_ops_t hooks
+
+void BlockDevice::virtio_block_set_callbacks(mx_device_t* dev, block_callbacks_t* cb) {
+    BlockDevice* bd = static_cast<BlockDevice*>(dev->ctx);
+    bd->callbacks_ = cb;
+}
+
+void BlockDevice::virtio_block_fifo_complete(iotxn_t* txn, void* cookie) {
+    BlockDevice* bd;
+    memcpy(&bd, txn->extra, sizeof(BlockDevice*));
+    bd->callbacks_->complete(cookie, txn->status);
+    iotxn_release(txn);
+}
+
+void BlockDevice::virtio_block_fifo_read(mx_device_t* dev, mx_handle_t vmo, uint64_t length,
+                                         uint64_t vmo_offset, uint64_t dev_offset, void* cookie) {
+    BlockDevice* bd = static_cast<BlockDevice*>(dev->ctx);
+    bd->FifoTxn(IOTXN_OP_READ, vmo, length, vmo_offset, dev_offset, cookie);
+}
+
+void BlockDevice::virtio_block_fifo_write(mx_device_t* dev, mx_handle_t vmo, uint64_t length,
+                                          uint64_t vmo_offset, uint64_t dev_offset, void* cookie) {
+    BlockDevice* bd = static_cast<BlockDevice*>(dev->ctx);
+    bd->FifoTxn(IOTXN_OP_WRITE, vmo, length, vmo_offset, dev_offset, cookie);
+}
+
+void BlockDevice::virtio_block_fifo_sync(mx_device_t* dev, void* cookie) {
+    BlockDevice* bd = static_cast<BlockDevice*>(dev->ctx);
+    bd->FifoTxn(IOTXN_OP_WRITE, MX_HANDLE_INVALID, 0, 0, 0, cookie);
+}
+
+static block_ops_t virtio_block_ops = {};
+
+void BlockDevice::FifoTxn(uint32_t opcode, mx_handle_t vmo, uint64_t length, uint64_t vmo_offset,
+                          uint64_t dev_offset, void* cookie) {
+    iotxn_t* txn;
+    mx_status_t status = iotxn_alloc(&txn, 0, 0);
+    if (status != NO_ERROR) {
+        callbacks_->complete(cookie, status);
+        return;
+    }
+
+    // the vmo belongs to the block server, the iotxn only borrows it
+    txn->vmo_handle = vmo;
+    txn->vmo_offset = vmo_offset;
+    txn->vmo_length = length;
+
+    txn->opcode = opcode;
+    txn->offset = dev_offset;
+    txn->length = length;
+    txn->complete_cb = virtio_block_fifo_complete;
+    txn->cookie = cookie;
+    BlockDevice* bd = this;
+    memcpy(txn->extra, &bd, sizeof(BlockDevice*));
+
+    QueueTxn(txn);
+}
+
 BlockDevice::BlockDevice(mx_driver_t* driver, mx_device_t* bus_device)
     : Device(driver, bus_device) {
     // so that Bind() knows how much io space to allocate
@@ -132,32 +230,34 @@ mx_status_t BlockDevice::Init() {
     // ack and set the driver status bit
     StatusAcknowledgeDriver();
 
-    // XXX check features bits and ack/nak them
-
-    // allocate the main vring
-    auto err = vring_.Init(0, 128); // 128 matches legacy pci
-    if (err < 0) {
-        VIRTIO_ERROR("failed to allocate vring\n");
-        return err;
-    }
-
-    // allocate a queue of block requests
-    size_t size = sizeof(virtio_blk_req) * blk_req_count + sizeof(uint8_t) * blk_req_count;
-
-    mx_status_t r = map_contiguous_memory(size, (uintptr_t*)&blk_req_, &blk_req_pa_);
-    if (r < 0) {
-        VIRTIO_ERROR("cannot alloc blk_req buffers %d\n", r);
-        return r;
+    // without an explicit flush, the device is expected to write through to
+    // stable storage
+    uint32_t features = ReadDeviceFeatures();
+    LTRACEF("device features %#x\n", features);
+    features &= VIRTIO_BLK_F_SEG_MAX | VIRTIO_BLK_F_FLUSH | VIRTIO_BLK_F_MQ |
+                (1u << VIRTIO_RING_F_INDIRECT_DESC) | (1u << VIRTIO_RING_F_EVENT_IDX);
+    flush_ = (features & VIRTIO_BLK_F_FLUSH) != 0;
+    WriteDriverFeatures(features);
+
+    // an indirect table lets a request of many segments take a single ring
+    // slot; otherwise each segment takes one, besides the header and status
+    indirect_ = (features & (1u << VIRTIO_RING_F_INDIRECT_DESC)) != 0;
+    max_segments_ = indirect_ ? max_indirect_segments : ring_size - 2;
+    if ((features & VIRTIO_BLK_F_SEG_MAX) && (config_.seg_max > 0))
+        max_segments_ = (uint16_t)MIN(max_segments_, config_.seg_max);
+
+    if ((features & VIRTIO_BLK_F_MQ) && (config_.num_queues > 1))
+        num_queues_ = MIN(config_.num_queues, max_queues);
+    LTRACEF("%u queues, %u segments per request%s\n", num_queues_, max_segments_,
+            indirect_ ? " (indirect)" : "");
+
+    bool event_idx = (features & (1u << VIRTIO_RING_F_EVENT_IDX)) != 0;
+    for (uint16_t i = 0; i < num_queues_; i++) {
+        mx_status_t r = InitQueue(i, event_idx);
+        if (r < 0)
+            return r;
     }
 
-    LTRACEF("allocated blk request at %p, physical address %#" PRIxPTR "\n", blk_req_, blk_req_pa_);
-
-    // responses are 32 words at the end of the allocated block
-    blk_res_pa_ = blk_req_pa_ + sizeof(virtio_blk_req) * blk_req_count;
-    blk_res_ = (uint8_t*)((uintptr_t)blk_req_ + sizeof(virtio_blk_req) * blk_req_count);
-
-    LTRACEF("allocated blk responses at %p, physical address %#" PRIxPTR "\n", blk_res_, blk_res_pa_);
-
     // start the interrupt thread
     StartIrqThread();
 
@@ -173,7 +273,13 @@ mx_status_t BlockDevice::Init() {
     // point the ctx of our embedded device structure at ourself
     device_.ctx = this;
 
-    device_.protocol_id = MX_PROTOCOL_BLOCK;
+    // the block driver binds on top of us and serves the block fifo
+    virtio_block_ops.set_callbacks = &virtio_block_set_callbacks;
+    virtio_block_ops.read = &virtio_block_fifo_read;
+    virtio_block_ops.write = &virtio_block_fifo_write;
+    virtio_block_ops.sync = &virtio_block_fifo_sync;
+    device_.protocol_id = MX_PROTOCOL_BLOCK_CORE;
+    device_.protocol_ops = &virtio_block_ops;
     auto status = device_add(&device_, bus_device_);
     if (status < 0)
         return status;
@@ -181,13 +287,83 @@ mx_status_t BlockDevice::Init() {
     return NO_ERROR;
 }
 
+mx_status_t BlockDevice::InitQueue(uint16_t index, bool event_idx) {
+    AllocChecker ac;
+    mxtl::unique_ptr<Queue> q(new (&ac) Queue(this));
+    if (!ac.check())
+        return ERR_NO_MEMORY;
+
+    // allocate the vring
+    q->vring.SetEventIdx(event_idx);
+    auto err = q->vring.Init(index, ring_size);
+    if (err < 0) {
+        VIRTIO_ERROR("failed to allocate vring %u\n", index);
+        return err;
+    }
+
+    // allocate a queue of block requests: the indirect tables (if any),
+    // then the request headers, then a status byte per request
+    size_t table_size = indirect_ ? sizeof(vring_desc) * (2 + max_segments_) : 0;
+    size_t indirect_size = table_size * blk_req_count;
+    size_t size = indirect_size + sizeof(virtio_blk_req) * blk_req_count +
+                  sizeof(uint8_t) * blk_req_count;
+
+    uintptr_t va;
+    mx_paddr_t pa;
+    mx_status_t r = map_contiguous_memory(size, &va, &pa);
+    if (r < 0) {
+        VIRTIO_ERROR("cannot alloc blk_req buffers %d\n", r);
+        return r;
+    }
+
+    q->indirect_pa = pa;
+    q->indirect = (vring_desc*)va;
+    q->blk_req_pa = pa + indirect_size;
+    q->blk_req = (virtio_blk_req*)(va + indirect_size);
+    q->blk_res_pa = q->blk_req_pa + sizeof(virtio_blk_req) * blk_req_count;
+    q->blk_res = (uint8_t*)((uintptr_t)q->blk_req + sizeof(virtio_blk_req) * blk_req_count);
+
+    LTRACEF("queue %u: blk requests at %p, physical address %#" PRIxPTR "\n",
+            index, q->blk_req, q->blk_req_pa);
+
+    queues_[index] = mxtl::move(q);
+    return NO_ERROR;
+}
+
+BlockDevice::Queue* BlockDevice::SelectQueue() {
+    if (num_queues_ == 1)
+        return queues_[0].get();
+    uint64_t t = (uint64_t)(uintptr_t)thrd_current();
+    return queues_[((t * 0x9e3779b97f4a7c15ull) >> 32) % num_queues_].get();
+}
+
+uint16_t BlockDevice::CountRuns(const iotxn_t* txn) {
+    // a single entry covers the whole buffer (contiguous vmos are mapped
+    // that way too)
+    uint16_t runs = 1;
+    for (uint64_t p = 1; p < txn->phys_length; p++) {
+        if (txn->phys[p] != txn->phys[p - 1] + PAGE_SIZE)
+            runs++;
+    }
+    return runs;
+}
+
 void BlockDevice::IrqRingUpdate() {
     LTRACE_ENTRY;
 
+    // there is a single interrupt, so every queue is looked at
+    for (uint16_t i = 0; i < num_queues_; i++) {
+        Queue* q = queues_[i].get();
+        mxtl::AutoLock lock(&q->lock);
+        RingUpdateLocked(q);
+    }
+}
+
+void BlockDevice::RingUpdateLocked(Queue* q) {
     // parse our descriptor chain, add back to the free queue
-    auto free_chain = [this](vring_used_elem* used_elem) {
+    auto free_chain = [this, q](vring_used_elem* used_elem) {
         uint32_t i = (uint16_t)used_elem->id;
-        struct vring_desc* desc = vring_.DescFromIndex((uint16_t)i);
+        struct vring_desc* desc = q->vring.DescFromIndex((uint16_t)i);
         auto head_desc = desc; // save the first element
         for (;;) {
             int next;
@@ -203,71 +379,193 @@ void BlockDevice::IrqRingUpdate() {
                 next = -1;
             }
 
-            vring_.FreeDesc((uint16_t)i);
+            q->vring.FreeDesc((uint16_t)i);
 
             if (next < 0)
                 break;
             i = next;
-            desc = vring_.DescFromIndex((uint16_t)i);
+            desc = q->vring.DescFromIndex((uint16_t)i);
         }
 
-        // search our pending txn list to see if this completes it
-        iotxn_t* txn;
-        list_for_every_entry (&iotxn_list, txn, iotxn_t, node) {
-            if (txn->context == head_desc) {
-                LTRACEF("completes txn %p\n", txn);
-                list_delete(&txn->node);
-                iotxn_complete(txn, NO_ERROR, txn->length);
-                break;
-            }
+        // the head descriptor points at the request header, or at the
+        // request's indirect table
+        unsigned int index;
+        if (head_desc->flags & VRING_DESC_F_INDIRECT) {
+            index = (unsigned int)((head_desc->addr - q->indirect_pa) /
+                                   (sizeof(vring_desc) * (2 + max_segments_)));
+        } else {
+            index = (unsigned int)((head_desc->addr - q->blk_req_pa) / sizeof(virtio_blk_req));
         }
+        iotxn_t* txn = q->blk_req_txn[index];
+        LTRACEF("completes txn %p\n", txn);
+        switch (q->blk_res[index]) {
+        case VIRTIO_BLK_S_OK:
+            txn->status = NO_ERROR;
+            break;
+        case VIRTIO_BLK_S_UNSUPP:
+            txn->status = ERR_NOT_SUPPORTED;
+            break;
+        default:
+            txn->status = ERR_IO;
+            break;
+        }
+        q->blk_req_txn[index] = nullptr;
+        q->free_blk_req(index);
+        list_add_tail(&complete_list, &txn->node);
     };
 
     // tell the ring to find free chains and hand it back to our lambda
-    vring_.IrqRingUpdate(free_chain);
+    q->vring.IrqRingUpdate(free_chain);
+
+    // requests and descriptors have been freed up
+    StartPendingLocked(q);
 }
 
 void BlockDevice::IrqConfigChange() {
     LTRACE_ENTRY;
 }
 
-void BlockDevice::QueueReadWriteTxn(iotxn_t* txn) {
+void BlockDevice::IrqComplete() {
+    // iotxns are completed without holding the lock, since completion
+    // callbacks may queue more work
+    list_node done = LIST_INITIAL_VALUE(done);
+    {
+        mxtl::AutoLock lock(&lock_);
+        list_move(&complete_list, &done);
+    }
+
+    iotxn_t* txn;
+    while ((txn = list_remove_head_type(&done, iotxn_t, node)) != nullptr) {
+        iotxn_complete(txn, txn->status, (txn->status == NO_ERROR) ? txn->length : 0);
+    }
+}
+
+void BlockDevice::QueueTxn(iotxn_t* txn) {
     LTRACEF("txn %p\n", txn);
 
-    mxtl::AutoLock lock(&lock_);
+    bool flush = (txn->opcode == IOTXN_OP_WRITE) && (txn->length == 0);
+    if (flush) {
+        if (!flush_) {
+            // nothing is cached, so there is nothing to flush
+            iotxn_complete(txn, NO_ERROR, 0);
+            return;
+        }
+    } else {
+        // offset must be aligned to block size
+        if (txn->offset % config_.blk_size) {
+            TRACEF("offset %#" PRIx64 " is not aligned to sector size %u!\n", txn->offset, config_.blk_size);
+            iotxn_complete(txn, ERR_INVALID_ARGS, 0);
+            return;
+        }
+
+        // constrain to device capacity
+        if (txn->offset >= GetSize()) {
+            iotxn_complete(txn, ERR_INVALID_ARGS, 0);
+            return;
+        }
+        txn->length = MIN(txn->length, GetSize() - txn->offset);
 
+        mx_status_t status = iotxn_physmap(txn);
+        if (status != NO_ERROR) {
+            iotxn_complete(txn, status, 0);
+            return;
+        }
+
+        // the header and status take a descriptor each, the data one per
+        // contiguous run
+        uint16_t runs = CountRuns(txn);
+        if (runs > max_segments_) {
+            TRACEF("txn %p spans too many segments (%u)\n", txn, runs);
+            iotxn_complete(txn, ERR_INVALID_ARGS, 0);
+            return;
+        }
+    }
+
+    Queue* q = SelectQueue();
+    mxtl::AutoLock lock(&q->lock);
+    list_add_tail(&q->pending_list, &txn->node);
+    StartPendingLocked(q);
+}
+
+void BlockDevice::StartPendingLocked(Queue* q) {
+    bool started = false;
+    iotxn_t* txn;
+    while ((txn = list_peek_head_type(&q->pending_list, iotxn_t, node)) != nullptr) {
+        // txns are started in order, so that a flush never passes the
+        // writes queued ahead of it
+        if (!StartTxnLocked(q, txn))
+            break;
+        started = true;
+    }
+
+    /* kick it off, once for the whole batch */
+    if (started)
+        q->vring.Kick();
+}
+
+bool BlockDevice::StartTxnLocked(Queue* q, iotxn_t* txn) {
+    bool flush = (txn->opcode == IOTXN_OP_WRITE) && (txn->length == 0);
     bool write = (txn->opcode == IOTXN_OP_WRITE);
 
-    // offset must be aligned to block size
-    if (txn->offset % config_.blk_size) {
-        TRACEF("offset %#" PRIx64 " is not aligned to sector size %u!\n", txn->offset, config_.blk_size);
-        iotxn_complete(txn, ERR_INVALID_ARGS, 0);
-        return;
+    // work out the physically contiguous runs of the data buffer
+    uint16_t runs = flush ? 0 : CountRuns(txn);
+
+    // allocate a block request and a descriptor chain, or wait for one
+    // to be freed up
+    auto index = q->alloc_blk_req();
+    if (index == blk_req_count)
+        return false;
+    uint16_t i;
+    vring_desc* desc;
+    vring_desc* table = nullptr;
+    if (indirect_) {
+        // the request takes one ring descriptor, pointing at its own table
+        // of 2 + runs descriptors, chained in order
+        i = q->vring.AllocDesc();
+        if (i == 0xffff) {
+            q->free_blk_req(index);
+            return false;
+        }
+        size_t table_count = 2 + max_segments_;
+        desc = q->vring.DescFromIndex(i);
+        desc->addr = q->indirect_pa + index * table_count * sizeof(vring_desc);
+        desc->len = (uint32_t)((2 + runs) * sizeof(vring_desc));
+        desc->flags = VRING_DESC_F_INDIRECT;
+        desc->next = 0;
+
+        table = q->indirect + index * table_count;
+        for (uint16_t n = 0; n < 2 + runs; n++) {
+            table[n].flags = (n + 1 < 2 + runs) ? VRING_DESC_F_NEXT : 0;
+            table[n].next = (uint16_t)(n + 1);
+        }
+        desc = &table[0];
+    } else {
+        desc = q->vring.AllocDescChain((uint16_t)(2 + runs), &i);
+        if (desc == nullptr) {
+            q->free_blk_req(index);
+            return false;
+        }
     }
+    LTRACEF("request index %u, chain desc %p, i %u\n", index, desc, i);
 
-    // constrain to device capacity
-    txn->length = MIN(txn->length, GetSize() - txn->offset);
+    // the next descriptor of the chain, in the ring or in the table
+    auto next_desc = [q, table](vring_desc* d) {
+        return table ? &table[d->next] : q->vring.DescFromIndex(d->next);
+    };
 
-    // allocate and start filling out a block request
-    auto index = alloc_blk_req();
-    LTRACEF("request index %u\n", index);
-    auto req = &blk_req_[index];
-    req->type = write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
+    auto req = &q->blk_req[index];
+    req->type = flush ? VIRTIO_BLK_T_FLUSH : (write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN);
     req->ioprio = 0;
-    req->sector = txn->offset / 512;
+    req->sector = flush ? 0 : txn->offset / 512;
+    q->blk_res[index] = VIRTIO_BLK_S_IOERR;
     LTRACEF("blk_req type %u ioprio %u sector %" PRIu64 "\n",
             req->type, req->ioprio, req->sector);
 
-    /* put together a transfer */
-    uint16_t i;
-    auto desc = vring_.AllocDescChain(3, &i);
-    LTRACEF("after alloc chain desc %p, i %u\n", desc, i);
-
-    /* point the iotxn at this head descriptor */
-    txn->context = desc;
+    /* remember which iotxn this request belongs to */
+    q->blk_req_txn[index] = txn;
 
     /* set up the descriptor pointing to the head */
-    desc->addr = blk_req_pa_ + index * sizeof(virtio_blk_req);
+    desc->addr = q->blk_req_pa + index * sizeof(virtio_blk_req);
     desc->len = sizeof(struct virtio_blk_req);
     desc->flags |= VRING_DESC_F_NEXT;
 
@@ -275,25 +573,42 @@ void BlockDevice::QueueReadWriteTxn(iotxn_t* txn) {
     virtio_dump_desc(desc);
 #endif
 
-    /* set up the descriptor pointing to the buffer */
-    desc = vring_.DescFromIndex(desc->next);
-
-    iotxn_physmap(txn);
+    /* set up the descriptors pointing to the buffer, one per contiguous run */
+    if (!flush) {
+        uint64_t page_offset = txn->vmo_offset - txn->phys_offset;
+        uint64_t remaining = txn->length;
+        uint64_t p = 0;
+        while (remaining > 0) {
+            desc = next_desc(desc);
+            desc->addr = txn->phys[p] + page_offset;
+            uint64_t len = 0;
+            if (txn->phys_length == 1) {
+                len = remaining;
+            } else {
+                len = MIN(remaining, PAGE_SIZE - page_offset);
+                while ((len < remaining) && (txn->phys[p + 1] == txn->phys[p] + PAGE_SIZE)) {
+                    p++;
+                    len += MIN(remaining - len, PAGE_SIZE);
+                }
+                p++;
+            }
+            page_offset = 0;
+            remaining -= len;
+            desc->len = (uint32_t)len;
 
-    desc->addr = (uint64_t)iotxn_phys_contiguous(txn);
-    desc->len = (uint32_t)txn->length;
-
-    if (!write)
-        desc->flags |= VRING_DESC_F_WRITE; /* mark buffer as write-only if its a block read */
-    desc->flags |= VRING_DESC_F_NEXT;
+            if (!write)
+                desc->flags |= VRING_DESC_F_WRITE; /* mark buffer as write-only if its a block read */
+            desc->flags |= VRING_DESC_F_NEXT;
 
 #if LOCAL_TRACE > 0
-    virtio_dump_desc(desc);
+            virtio_dump_desc(desc);
 #endif
+        }
+    }
 
     /* set up the descriptor pointing to the response */
-    desc = vring_.DescFromIndex(desc->next);
-    desc->addr = blk_res_pa_ + index;
+    desc = next_desc(desc);
+    desc->addr = q->blk_res_pa + index;
     desc->len = 1;
     desc->flags = VRING_DESC_F_WRITE;
 
@@ -301,14 +616,11 @@ void BlockDevice::QueueReadWriteTxn(iotxn_t* txn) {
     virtio_dump_desc(desc);
 #endif
 
-    // save the iotxn in a list
-    list_add_tail(&iotxn_list, &txn->node);
+    list_delete(&txn->node);
 
     /* submit the transfer */
-    vring_.SubmitChain(i);
-
-    /* kick it off */
-    vring_.Kick();
+    q->vring.SubmitChain(i);
+    return true;
 }
 
 } // namespace virtio
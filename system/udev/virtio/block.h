@@ -6,7 +6,10 @@
 #include "device.h"
 #include "ring.h"
 
+#include <ddk/protocol/block.h>
 #include <magenta/compiler.h>
+#include <mxtl/mutex.h>
+#include <mxtl/unique_ptr.h>
 #include <stdlib.h>
 
 namespace virtio {
@@ -22,6 +25,7 @@ public:
 
     virtual void IrqRingUpdate();
     virtual void IrqConfigChange();
+    virtual void IrqComplete();
 
     uint64_t GetSize() const { return config_.capacity * config_.blk_size; }
     uint64_t GetBlockSize() const { return config_.blk_size; }
@@ -34,10 +38,90 @@ private:
     static ssize_t virtio_block_ioctl(mx_device_t* dev, uint32_t op, const void* in_buf, size_t in_len,
                                       void* out_buf, size_t out_len);
 
-    void QueueReadWriteTxn(iotxn_t* txn);
+    // block_ops_t hooks, used by the block fifo server
+    static void virtio_block_set_callbacks(mx_device_t* dev, block_callbacks_t* cb);
+    static void virtio_block_fifo_read(mx_device_t* dev, mx_handle_t vmo, uint64_t length,
+                                       uint64_t vmo_offset, uint64_t dev_offset, void* cookie);
+    static void virtio_block_fifo_write(mx_device_t* dev, mx_handle_t vmo, uint64_t length,
+                                        uint64_t vmo_offset, uint64_t dev_offset, void* cookie);
+    static void virtio_block_fifo_sync(mx_device_t* dev, void* cookie);
+    static void virtio_block_fifo_complete(iotxn_t* txn, void* cookie);
+    void FifoTxn(uint32_t opcode, mx_handle_t vmo, uint64_t length, uint64_t vmo_offset,
+                 uint64_t dev_offset, void* cookie);
 
-    // the main virtio ring
-    Ring vring_ = {this};
+    // a queue of block request/responses
+    static const size_t blk_req_count = 32;
+
+    // data segments per request when they are described by an indirect
+    // table (enough for the largest message the block server merges)
+    static const uint16_t max_indirect_segments = 256;
+
+    struct virtio_blk_req {
+        uint32_t type;
+        uint32_t ioprio;
+        uint64_t sector;
+    } __PACKED;
+
+    // A virtqueue, and the requests in flight on it. Each has its own lock,
+    // so that clients on different queues do not contend with one another.
+    struct Queue {
+        Queue(Device* device) : vring(device) {}
+
+        mxtl::Mutex lock;
+        Ring vring;
+
+        // request headers, status bytes and (if negotiated) indirect
+        // descriptor tables, indexed by request
+        mx_paddr_t blk_req_pa = 0;
+        virtio_blk_req* blk_req = nullptr;
+        mx_paddr_t blk_res_pa = 0;
+        uint8_t* blk_res = nullptr;
+        mx_paddr_t indirect_pa = 0;
+        vring_desc* indirect = nullptr;
+
+        uint32_t blk_req_bitmap = 0;
+        // the iotxn each request in flight belongs to
+        iotxn_t* blk_req_txn[blk_req_count] = {};
+
+        // iotxns waiting for a free request or descriptors
+        list_node pending_list = LIST_INITIAL_VALUE(pending_list);
+
+        // returns blk_req_count if every request is in use
+        unsigned int alloc_blk_req() {
+            if (blk_req_bitmap == UINT32_MAX)
+                return blk_req_count;
+            unsigned int i = __builtin_ctz(~blk_req_bitmap);
+            blk_req_bitmap |= (1u << i);
+            return i;
+        }
+
+        void free_blk_req(unsigned int i) {
+            blk_req_bitmap &= ~(1u << i);
+        }
+    };
+
+    mx_status_t InitQueue(uint16_t index, bool event_idx);
+
+    // Txns from one thread always go to the same queue, so that a flush
+    // still follows the writes its client queued ahead of it.
+    Queue* SelectQueue();
+
+    // Queues a read or write. A zero length write flushes the device's write
+    // cache, covering every write which completed before it.
+    void QueueTxn(iotxn_t* txn);
+    // Hands pending txns to the device, for as long as there are free
+    // requests and descriptors.
+    void StartPendingLocked(Queue* q);
+    bool StartTxnLocked(Queue* q, iotxn_t* txn);
+    void RingUpdateLocked(Queue* q);
+
+    // the physically contiguous runs which make up a txn's data buffer
+    static uint16_t CountRuns(const iotxn_t* txn);
+
+    // one virtqueue per request queue the device offers, up to a limit
+    static const uint16_t max_queues = 8;
+    mxtl::unique_ptr<Queue> queues_[max_queues];
+    uint16_t num_queues_ = 1;
 
     // saved block device configuration out of the pci config BAR
     struct virtio_blk_config {
@@ -50,37 +134,32 @@ private:
             uint8_t sectors;
         } geometry;
         uint32_t blk_size;
+        struct virtio_blk_topology {
+            uint8_t physical_block_exp;
+            uint8_t alignment_offset;
+            uint16_t min_io_size;
+            uint32_t opt_io_size;
+        } topology;
+        uint8_t writeback;
+        uint8_t unused0;
+        uint16_t num_queues;
     } config_ __PACKED = {};
 
-    struct virtio_blk_req {
-        uint32_t type;
-        uint32_t ioprio;
-        uint64_t sector;
-    } __PACKED;
-
-    // a queue of block request/responses
-    static const size_t blk_req_count = 32;
-
-    mx_paddr_t blk_req_pa_ = 0;
-    virtio_blk_req* blk_req_ = nullptr;
-
-    mx_paddr_t blk_res_pa_ = 0;
-    uint8_t* blk_res_ = nullptr;
-
-    uint32_t blk_req_bitmap_ = 0;
+    // was VIRTIO_BLK_F_FLUSH negotiated? (if not, the device writes through)
+    bool flush_ = false;
+    // was VIRTIO_RING_F_INDIRECT_DESC negotiated?
+    bool indirect_ = false;
+    // the most data segments a single request may carry
+    uint16_t max_segments_ = 0;
 
-    unsigned int alloc_blk_req() {
-        unsigned int i = 31 - __builtin_clz(blk_req_bitmap_);
-        blk_req_bitmap_ |= (1 << i);
-        return i;
-    }
+    block_callbacks_t* callbacks_ = nullptr;
 
-    void free_blk_req(unsigned int i) {
-        blk_req_bitmap_ &= ~(1 << i);
-    }
+    // the size of each virtio ring
+    static const uint16_t ring_size = 128; // 128 matches legacy pci
 
-    // pending iotxns
-    list_node iotxn_list = LIST_INITIAL_VALUE(iotxn_list);
+    // iotxns which the device has finished with, to be completed outside the
+    // lock; guarded by lock_
+    list_node complete_list = LIST_INITIAL_VALUE(complete_list);
 };
 
 } // namespace virtio
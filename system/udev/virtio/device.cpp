@@ -194,15 +194,18 @@ void Device::IrqWorker() {
         if (irq_status == 0)
             continue;
 
-        // grab the mutex for the duration of the irq handlers
-        mxtl::AutoLock lock(&lock_);
+        {
+            // grab the mutex for the duration of the irq handlers
+            mxtl::AutoLock lock(&lock_);
 
-        if (irq_status & 0x1) { /* used ring update */
-            IrqRingUpdate();
-        }
-        if (irq_status & 0x2) { /* config change */
-            IrqConfigChange();
+            if (irq_status & 0x1) { /* used ring update */
+                IrqRingUpdate();
+            }
+            if (irq_status & 0x2) { /* config change */
+                IrqConfigChange();
+            }
         }
+        IrqComplete();
     }
 }
 
@@ -331,6 +334,36 @@ void Device::StatusAcknowledgeDriver() {
     }
 }
 
+uint32_t Device::ReadDeviceFeatures() {
+    if (trans_) {
+        if (bar0_pio_base_) {
+            return inpd((bar0_pio_base_ + VIRTIO_PCI_DEVICE_FEATURES) & 0xffff);
+        } else {
+            // XXX implement
+            assert(0);
+            return 0;
+        }
+    } else {
+        mmio_regs_.common_config->device_feature_select = 0;
+        return mmio_regs_.common_config->device_feature;
+    }
+}
+
+void Device::WriteDriverFeatures(uint32_t features) {
+    LTRACEF("features %#x\n", features);
+    if (trans_) {
+        if (bar0_pio_base_) {
+            outpd((bar0_pio_base_ + VIRTIO_PCI_DRIVER_FEATURES) & 0xffff, features);
+        } else {
+            // XXX implement
+            assert(0);
+        }
+    } else {
+        mmio_regs_.common_config->driver_feature_select = 0;
+        mmio_regs_.common_config->driver_feature = features;
+    }
+}
+
 void Device::StatusDriverOK() {
     if (trans_) {
         uint8_t val = ReadConfigBar(VIRTIO_PCI_DEVICE_STATUS);
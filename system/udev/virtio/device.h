@@ -33,6 +33,9 @@ public:
     // interrupt cases that devices may override
     virtual void IrqRingUpdate() {}
     virtual void IrqConfigChange() {}
+    // called after the handlers above, once the lock has been dropped, so that
+    // completion callbacks are free to queue more work on the device
+    virtual void IrqComplete() {}
 
     // used by Ring class to manipulate config registers
     void SetRing(uint16_t index, uint16_t count, mx_paddr_t pa_desc, mx_paddr_t pa_avail, mx_paddr_t pa_used);
@@ -48,6 +51,10 @@ protected:
     void StatusAcknowledgeDriver();
     void StatusDriverOK();
 
+    // feature bits 0 - 31, offered by the device and accepted by the driver
+    uint32_t ReadDeviceFeatures();
+    void WriteDriverFeatures(uint32_t features);
+
     static int IrqThreadEntry(void* arg);
     void IrqWorker();
 
@@ -0,0 +1,458 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "net.h"
+
+#include <inet-checksum/checksum.h>
+#include <inttypes.h>
+#include <magenta/compiler.h>
+#include <magenta/syscalls.h>
+#include <magenta/new.h>
+#include <mx/vmar.h>
+#include <mxtl/auto_lock.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include <threads.h>
+
+#include "trace.h"
+#include "utils.h"
+
+#define LOCAL_TRACE 0
+
+// clang-format off
+#define VIRTIO_NET_F_CSUM       (1<<0)
+#define VIRTIO_NET_F_GUEST_CSUM (1<<1)
+#define VIRTIO_NET_F_MAC        (1<<5)
+#define VIRTIO_NET_F_STATUS     (1<<16)
+#define VIRTIO_NET_F_CTRL_VQ    (1<<17)
+#define VIRTIO_NET_F_MQ         (1<<22)
+
+#define VIRTIO_NET_HDR_F_NEEDS_CSUM 1
+#define VIRTIO_NET_HDR_F_DATA_VALID 2
+
+#define VIRTIO_NET_S_LINK_UP    1
+
+#define VIRTIO_NET_CTRL_MQ      4
+#define VIRTIO_NET_CTRL_MQ_VQ_PAIRS_SET 0
+
+#define VIRTIO_NET_OK           0
+// clang-format on
+
+namespace virtio {
+
+namespace {
+
+// Finds the transport header of an IPv4 or IPv6 frame and the checksum
+// field within it, for the TCP, UDP and ICMPv6 protocols.
+bool find_csum(const uint8_t* frame, size_t length, uint16_t* start, uint16_t* offset) {
+    if (length < 14)
+        return false;
+    uint16_t type = (uint16_t)((frame[12] << 8) | frame[13]);
+    size_t l4;
+    uint8_t proto;
+    if (type == 0x86dd) {
+        // IPv6 (extension headers are not walked)
+        if (length < 14 + 40)
+            return false;
+        l4 = 14 + 40;
+        proto = frame[14 + 6];
+    } else if (type == 0x0800) {
+        if (length < 14 + 20)
+            return false;
+        l4 = 14 + (frame[14] & 0xf) * 4;
+        proto = frame[14 + 9];
+    } else {
+        return false;
+    }
+
+    switch (proto) {
+    case 6: // TCP
+        *offset = 16;
+        break;
+    case 17: // UDP
+        *offset = 6;
+        break;
+    case 58: // ICMPv6
+        *offset = 2;
+        break;
+    default:
+        return false;
+    }
+    if (l4 + *offset + 2 > length)
+        return false;
+    *start = (uint16_t)l4;
+    return true;
+}
+
+// Completes a checksum which holds the pseudo-header sum, as the device
+// leaves it in frames it passes with VIRTIO_NET_HDR_F_NEEDS_CSUM.
+void complete_csum(uint8_t* frame, size_t length, uint16_t start, uint16_t offset) {
+    if ((size_t)start + offset + 2 > length)
+        return;
+    // the sum is in network order, as is the frame
+    uint16_t csum = static_cast<uint16_t>(~inet_checksum(frame + start, length - start, 0));
+    // 0 means "no checksum" to UDP, and is the same as 0xffff to the rest
+    if (csum == 0)
+        csum = 0xffff;
+    memcpy(frame + start + offset, &csum, sizeof(csum));
+}
+
+} // namespace
+
+// ethmac_protocol_t hooks
+
+mx_status_t NetDevice::virtio_net_query(mx_device_t* dev, uint32_t options, ethmac_info_t* info) {
+    NetDevice* nd = static_cast<NetDevice*>(dev->ctx);
+    if (options)
+        return ERR_INVALID_ARGS;
+
+    memset(info, 0, sizeof(*info));
+    if (nd->tx_csum_)
+        info->features |= ETHMAC_FEATURE_TX_CSUM;
+    if (nd->rx_csum_)
+        info->features |= ETHMAC_FEATURE_RX_CSUM;
+    info->mtu = 1514;
+    memcpy(info->mac, nd->config_.mac, sizeof(info->mac));
+    return NO_ERROR;
+}
+
+void NetDevice::virtio_net_stop(mx_device_t* dev) {
+    NetDevice* nd = static_cast<NetDevice*>(dev->ctx);
+    mxtl::AutoLock lock(&nd->lock_);
+    nd->ifc_ = nullptr;
+}
+
+mx_status_t NetDevice::virtio_net_start(mx_device_t* dev, ethmac_ifc_t* ifc, void* cookie) {
+    NetDevice* nd = static_cast<NetDevice*>(dev->ctx);
+    mxtl::AutoLock lock(&nd->lock_);
+    if (nd->ifc_ != nullptr)
+        return ERR_BAD_STATE;
+    nd->ifc_ = ifc;
+    nd->cookie_ = cookie;
+    return NO_ERROR;
+}
+
+void NetDevice::virtio_net_send(mx_device_t* dev, uint32_t options, void* data, size_t length) {
+    NetDevice* nd = static_cast<NetDevice*>(dev->ctx);
+    nd->Send(options, data, length);
+}
+
+static ethmac_protocol_t virtio_net_ops = {};
+
+NetDevice::NetDevice(mx_driver_t* driver, mx_device_t* bus_device)
+    : Device(driver, bus_device) {
+    // so that Bind() knows how much io space to allocate
+    bar0_size_ = 0x20;
+}
+
+NetDevice::~NetDevice() {
+    // The device must stop using the rings and buffers before they are
+    // freed along with the queues.
+    if (rx_queues_[0] != nullptr)
+        Reset();
+}
+
+NetDevice::Queue::~Queue() {
+    // the vring frees its own memory
+    if (bufs_va != 0)
+        mx::vmar::root_self().unmap(bufs_va, buf_size * buf_count);
+}
+
+mx_status_t NetDevice::Init() {
+    LTRACE_ENTRY;
+
+    // reset the device
+    Reset();
+
+    // read our configuration
+    CopyDeviceConfig(&config_, sizeof(config_));
+
+    // ack and set the driver status bit
+    StatusAcknowledgeDriver();
+
+    uint32_t features = ReadDeviceFeatures();
+    LTRACEF("device features %#x\n", features);
+    features &= VIRTIO_NET_F_CSUM | VIRTIO_NET_F_GUEST_CSUM | VIRTIO_NET_F_MAC |
+                VIRTIO_NET_F_STATUS | VIRTIO_NET_F_CTRL_VQ | VIRTIO_NET_F_MQ |
+                (1u << VIRTIO_RING_F_EVENT_IDX);
+    // multiple queues are switched on through the control queue
+    if (!(features & VIRTIO_NET_F_CTRL_VQ))
+        features &= ~VIRTIO_NET_F_MQ;
+    WriteDriverFeatures(features);
+
+    if (!(features & VIRTIO_NET_F_MAC))
+        VIRTIO_ERROR("net: device has no mac address\n");
+    tx_csum_ = (features & VIRTIO_NET_F_CSUM) != 0;
+    rx_csum_ = (features & VIRTIO_NET_F_GUEST_CSUM) != 0;
+
+    // receive queue n is virtqueue 2n, its transmit queue 2n + 1, and the
+    // control queue follows every pair the device has
+    uint16_t device_pairs = 1;
+    if ((features & VIRTIO_NET_F_MQ) && (config_.max_virtqueue_pairs > 1))
+        device_pairs = config_.max_virtqueue_pairs;
+    num_pairs_ = MIN(device_pairs, max_pairs);
+    LTRACEF("%u queue pairs (of %u)%s%s\n", num_pairs_, device_pairs,
+            tx_csum_ ? ", tx csum" : "", rx_csum_ ? ", rx csum" : "");
+
+    bool event_idx = (features & (1u << VIRTIO_RING_F_EVENT_IDX)) != 0;
+    mx_status_t r;
+    for (uint16_t n = 0; n < num_pairs_; n++) {
+        if (((r = InitQueue(&rx_queues_[n], (uint16_t)(2 * n), event_idx)) < 0) ||
+            ((r = InitQueue(&tx_queues_[n], (uint16_t)(2 * n + 1), event_idx)) < 0))
+            return r;
+        Queue* q = rx_queues_[n].get();
+        mxtl::AutoLock lock(&q->lock);
+        for (uint16_t i = 0; i < buf_count; i++)
+            PostRxLocked(q, i);
+    }
+    if (features & VIRTIO_NET_F_CTRL_VQ) {
+        if ((r = InitQueue(&ctrl_queue_, (uint16_t)(2 * device_pairs), event_idx)) < 0)
+            return r;
+    }
+
+    // start the interrupt thread
+    StartIrqThread();
+
+    // set DRIVER_OK
+    StatusDriverOK();
+
+    for (uint16_t n = 0; n < num_pairs_; n++) {
+        Queue* q = rx_queues_[n].get();
+        mxtl::AutoLock lock(&q->lock);
+        q->vring.Kick();
+    }
+
+    // the device only uses the first pair until told otherwise
+    if ((num_pairs_ > 1) && ((r = SetQueuePairs(num_pairs_)) < 0)) {
+        VIRTIO_ERROR("net: cannot use %u queue pairs: %d\n", num_pairs_, r);
+        num_pairs_ = 1;
+    }
+
+    // initialize the mx_device and publish us
+    device_init(&device_, driver_, "virtio-net", &device_ops_);
+
+    // point the ctx of our embedded device structure at ourself
+    device_.ctx = this;
+
+    virtio_net_ops.query = &virtio_net_query;
+    virtio_net_ops.stop = &virtio_net_stop;
+    virtio_net_ops.start = &virtio_net_start;
+    virtio_net_ops.send = &virtio_net_send;
+    device_.protocol_id = MX_PROTOCOL_ETHERMAC;
+    device_.protocol_ops = &virtio_net_ops;
+    auto status = device_add(&device_, bus_device_);
+    if (status < 0)
+        return status;
+
+    return NO_ERROR;
+}
+
+mx_status_t NetDevice::InitQueue(mxtl::unique_ptr<Queue>* out, uint16_t index, bool event_idx) {
+    AllocChecker ac;
+    mxtl::unique_ptr<Queue> q(new (&ac) Queue(this));
+    if (!ac.check())
+        return ERR_NO_MEMORY;
+
+    // allocate the vring
+    q->vring.SetEventIdx(event_idx);
+    auto err = q->vring.Init(index, ring_size);
+    if (err < 0) {
+        VIRTIO_ERROR("failed to allocate vring %u\n", index);
+        return err;
+    }
+
+    mx_status_t r = map_contiguous_memory(buf_size * buf_count, &q->bufs_va, &q->bufs_pa);
+    if (r < 0) {
+        VIRTIO_ERROR("cannot alloc net buffers %d\n", r);
+        return r;
+    }
+    LTRACEF("queue %u: buffers at %#" PRIxPTR ", physical address %#" PRIxPTR "\n",
+            index, q->bufs_va, q->bufs_pa);
+
+    *out = mxtl::move(q);
+    return NO_ERROR;
+}
+
+mx_status_t NetDevice::SetQueuePairs(uint16_t pairs) {
+    struct virtio_net_ctrl_mq {
+        uint8_t class_;
+        uint8_t command;
+        uint16_t pairs;
+        uint8_t ack;
+    } __PACKED;
+
+    Queue* q = ctrl_queue_.get();
+    mxtl::AutoLock lock(&q->lock);
+
+    auto cmd = reinterpret_cast<virtio_net_ctrl_mq*>(q->bufs_va);
+    cmd->class_ = VIRTIO_NET_CTRL_MQ;
+    cmd->command = VIRTIO_NET_CTRL_MQ_VQ_PAIRS_SET;
+    cmd->pairs = pairs;
+    cmd->ack = 0xff;
+
+    // the command, its data and the ack each take a descriptor
+    uint16_t head;
+    vring_desc* desc = q->vring.AllocDescChain(3, &head);
+    if (desc == nullptr)
+        return ERR_NO_RESOURCES;
+    desc->addr = q->bufs_pa;
+    desc->len = 2;
+    desc = q->vring.DescFromIndex(desc->next);
+    desc->addr = q->bufs_pa + 2;
+    desc->len = 2;
+    desc = q->vring.DescFromIndex(desc->next);
+    desc->addr = q->bufs_pa + 4;
+    desc->len = 1;
+    desc->flags |= VRING_DESC_F_WRITE;
+    q->vring.SubmitChain(head);
+    q->vring.Kick();
+
+    // the interrupt thread leaves the control queue alone, so it is
+    // polled here
+    bool done = false;
+    for (int tries = 0; !done && (tries < 1000); tries++) {
+        q->vring.IrqRingUpdate([q, &done](vring_used_elem* used_elem) {
+            q->vring.FreeDescChain((uint16_t)used_elem->id);
+            done = true;
+        });
+        if (!done)
+            mx_nanosleep(MX_MSEC(1));
+    }
+    if (!done)
+        return ERR_TIMED_OUT;
+    return (cmd->ack == VIRTIO_NET_OK) ? NO_ERROR : ERR_IO;
+}
+
+bool NetDevice::PostRxLocked(Queue* q, uint16_t i) {
+    uint16_t head;
+    vring_desc* desc = q->vring.AllocDescChain(2, &head);
+    if (desc == nullptr)
+        return false;
+    desc->addr = q->bufs_pa + i * buf_size;
+    desc->len = sizeof(virtio_net_hdr);
+    desc->flags |= VRING_DESC_F_WRITE;
+    desc = q->vring.DescFromIndex(desc->next);
+    desc->addr = q->bufs_pa + i * buf_size + buf_frame_offset;
+    desc->len = max_frame;
+    desc->flags |= VRING_DESC_F_WRITE;
+    q->vring.SubmitChain(head);
+    return true;
+}
+
+void NetDevice::IrqRingUpdate() {
+    LTRACE_ENTRY;
+
+    // there is a single interrupt, so every queue is looked at
+    for (uint16_t n = 0; n < num_pairs_; n++) {
+        Queue* q = rx_queues_[n].get();
+        mxtl::AutoLock lock(&q->lock);
+        RxUpdateLocked(q);
+    }
+    if (ifc_ != nullptr)
+        ifc_->recv_flush(cookie_);
+
+    for (uint16_t n = 0; n < num_pairs_; n++) {
+        Queue* q = tx_queues_[n].get();
+        mxtl::AutoLock lock(&q->lock);
+        TxReclaimLocked(q);
+    }
+}
+
+void NetDevice::RxUpdateLocked(Queue* q) {
+    bool posted = false;
+    auto receive = [this, q, &posted](vring_used_elem* used_elem) {
+        uint16_t head = (uint16_t)used_elem->id;
+        uint16_t i = (uint16_t)((q->vring.DescFromIndex(head)->addr - q->bufs_pa) / buf_size);
+        q->vring.FreeDescChain(head);
+
+        virtio_net_hdr* hdr = q->Header(i);
+        uint8_t* frame = q->Frame(i);
+        if ((used_elem->len > sizeof(virtio_net_hdr)) && (ifc_ != nullptr)) {
+            size_t length = MIN(used_elem->len - sizeof(virtio_net_hdr), max_frame);
+            uint32_t flags = 0;
+            if (hdr->flags & VIRTIO_NET_HDR_F_NEEDS_CSUM) {
+                // from another guest on this host: the data is intact,
+                // but the checksum was never computed
+                complete_csum(frame, length, hdr->csum_start, hdr->csum_offset);
+                flags |= ETHMAC_RX_CSUM_OK;
+            } else if (hdr->flags & VIRTIO_NET_HDR_F_DATA_VALID) {
+                flags |= ETHMAC_RX_CSUM_OK;
+            }
+            ifc_->recv(cookie_, frame, length, flags);
+        }
+        posted |= PostRxLocked(q, i);
+    };
+    q->vring.IrqRingUpdate(receive);
+
+    if (posted)
+        q->vring.Kick();
+}
+
+void NetDevice::TxReclaimLocked(Queue* q) {
+    q->vring.IrqRingUpdate([this, q](vring_used_elem* used_elem) {
+        uint16_t head = (uint16_t)used_elem->id;
+        uint16_t i = (uint16_t)((q->vring.DescFromIndex(head)->addr - q->bufs_pa) / buf_size);
+        q->vring.FreeDescChain(head);
+        q->buf_bitmap &= ~(1ull << i);
+    });
+}
+
+void NetDevice::IrqConfigChange() {
+    LTRACE_ENTRY;
+}
+
+NetDevice::Queue* NetDevice::SelectTxQueue() {
+    if (num_pairs_ == 1)
+        return tx_queues_[0].get();
+    uint64_t t = (uint64_t)(uintptr_t)thrd_current();
+    return tx_queues_[((t * 0x9e3779b97f4a7c15ull) >> 32) % num_pairs_].get();
+}
+
+void NetDevice::Send(uint32_t options, const void* data, size_t length) {
+    if (length > max_frame) {
+        LTRACEF("dropping %zu byte frame\n", length);
+        return;
+    }
+
+    Queue* q = SelectTxQueue();
+    mxtl::AutoLock lock(&q->lock);
+
+    // sent frames are reclaimed here as well as at interrupt time, so
+    // that a busy sender does not have to wait for the interrupt thread
+    TxReclaimLocked(q);
+    static_assert(buf_count == 64, "the tx bitmap is 64 bits");
+    if (q->buf_bitmap == UINT64_MAX) {
+        LTRACEF("tx queue full\n");
+        return;
+    }
+    uint16_t i = (uint16_t)__builtin_ctzll(~q->buf_bitmap);
+    uint16_t head;
+    vring_desc* desc = q->vring.AllocDescChain(2, &head);
+    if (desc == nullptr)
+        return;
+    q->buf_bitmap |= (1ull << i);
+
+    virtio_net_hdr* hdr = q->Header(i);
+    uint8_t* frame = q->Frame(i);
+    memset(hdr, 0, sizeof(*hdr));
+    memcpy(frame, data, length);
+    uint16_t start, offset;
+    if ((options & ETHMAC_TX_CSUM) && tx_csum_ && find_csum(frame, length, &start, &offset)) {
+        hdr->flags = VIRTIO_NET_HDR_F_NEEDS_CSUM;
+        hdr->csum_start = start;
+        hdr->csum_offset = offset;
+    }
+
+    desc->addr = q->bufs_pa + i * buf_size;
+    desc->len = sizeof(virtio_net_hdr);
+    desc = q->vring.DescFromIndex(desc->next);
+    desc->addr = q->bufs_pa + i * buf_size + buf_frame_offset;
+    desc->len = (uint32_t)length;
+    q->vring.SubmitChain(head);
+    q->vring.Kick();
+}
+
+} // namespace virtio
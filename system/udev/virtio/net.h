@@ -0,0 +1,114 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+#pragma once
+
+#include "device.h"
+#include "ring.h"
+
+#include <ddk/protocol/ethernet.h>
+#include <magenta/compiler.h>
+#include <mxtl/mutex.h>
+#include <mxtl/unique_ptr.h>
+#include <stdlib.h>
+
+namespace virtio {
+
+class Ring;
+
+class NetDevice : public Device {
+public:
+    NetDevice(mx_driver_t* driver, mx_device_t* device);
+    virtual ~NetDevice();
+
+    virtual mx_status_t Init();
+
+    virtual void IrqRingUpdate();
+    virtual void IrqConfigChange();
+
+private:
+    // ethmac_protocol_t hooks
+    static mx_status_t virtio_net_query(mx_device_t* dev, uint32_t options, ethmac_info_t* info);
+    static void virtio_net_stop(mx_device_t* dev);
+    static mx_status_t virtio_net_start(mx_device_t* dev, ethmac_ifc_t* ifc, void* cookie);
+    static void virtio_net_send(mx_device_t* dev, uint32_t options, void* data, size_t length);
+
+    struct virtio_net_hdr {
+        uint8_t flags;
+        uint8_t gso_type;
+        uint16_t hdr_len;
+        uint16_t gso_size;
+        uint16_t csum_start;
+        uint16_t csum_offset;
+    } __PACKED;
+
+    // Every packet is a header and a frame, in two descriptors, which
+    // live together in one buffer.
+    static const size_t buf_size = 2048;
+    static const size_t buf_frame_offset = 16;
+    static const size_t max_frame = buf_size - buf_frame_offset;
+
+    // the size of each virtio ring, and so the buffers of each queue
+    static const uint16_t ring_size = 128;
+    static const uint16_t buf_count = ring_size / 2;
+
+    // A virtqueue and its packet buffers.
+    struct Queue {
+        Queue(Device* device) : vring(device) {}
+        ~Queue();
+
+        mxtl::Mutex lock;
+        Ring vring;
+
+        uintptr_t bufs_va = 0;
+        mx_paddr_t bufs_pa = 0;
+        // buffers in flight (tx queues only)
+        uint64_t buf_bitmap = 0;
+
+        virtio_net_hdr* Header(uint16_t i) {
+            return reinterpret_cast<virtio_net_hdr*>(bufs_va + i * buf_size);
+        }
+        uint8_t* Frame(uint16_t i) {
+            return reinterpret_cast<uint8_t*>(bufs_va + i * buf_size + buf_frame_offset);
+        }
+    };
+
+    mx_status_t InitQueue(mxtl::unique_ptr<Queue>* out, uint16_t index, bool event_idx);
+    // Sets how many queue pairs the device spreads traffic over.
+    mx_status_t SetQueuePairs(uint16_t pairs);
+
+    // Gives an rx buffer (back) to the device.
+    bool PostRxLocked(Queue* q, uint16_t i);
+    void RxUpdateLocked(Queue* q);
+    // Frees the buffers of sent frames.
+    void TxReclaimLocked(Queue* q);
+
+    // Frames from one thread always go out of the same queue, so that
+    // they stay in order.
+    Queue* SelectTxQueue();
+    void Send(uint32_t options, const void* data, size_t length);
+
+    // up to this many queue pairs are used, if the device offers them
+    static const uint16_t max_pairs = 4;
+    mxtl::unique_ptr<Queue> rx_queues_[max_pairs];
+    mxtl::unique_ptr<Queue> tx_queues_[max_pairs];
+    uint16_t num_pairs_ = 1;
+    mxtl::unique_ptr<Queue> ctrl_queue_;
+
+    // saved network device configuration out of the pci config BAR
+    struct virtio_net_config {
+        uint8_t mac[6];
+        uint16_t status;
+        uint16_t max_virtqueue_pairs;
+    } config_ __PACKED = {};
+
+    // negotiated VIRTIO_NET_F_CSUM and VIRTIO_NET_F_GUEST_CSUM
+    bool tx_csum_ = false;
+    bool rx_csum_ = false;
+
+    // the ethernet core's callbacks, while started; guarded by lock_
+    ethmac_ifc_t* ifc_ = nullptr;
+    void* cookie_ = nullptr;
+};
+
+} // namespace virtio
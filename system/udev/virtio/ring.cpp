@@ -149,13 +149,24 @@ void Ring::SubmitChain(uint16_t desc_index) {
     struct vring_avail* avail = ring_.avail;
 
     avail->ring[avail->idx & ring_.num_mask] = desc_index;
-    //mb();
-    avail->idx++;
+    // the entry must be visible before the index which publishes it
+    __atomic_store_n(&avail->idx, (uint16_t)(avail->idx + 1), __ATOMIC_RELEASE);
 }
 
 void Ring::Kick() {
     LTRACE_ENTRY;
 
+    if (event_idx_) {
+        uint16_t new_idx = ring_.avail->idx;
+        uint16_t old_idx = kicked_idx_;
+        kicked_idx_ = new_idx;
+
+        // the device publishes the avail index it next wants to be told
+        // about; the new index must be visible before that is read
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (!vring_need_event(vring_avail_event(&ring_), new_idx, old_idx))
+            return;
+    }
     device_->RingKick(index_);
 }
 
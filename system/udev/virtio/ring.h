@@ -20,6 +20,12 @@ public:
 
     mx_status_t Init(uint16_t index, uint16_t count);
 
+    // Call before Init() if VIRTIO_RING_F_EVENT_IDX was negotiated: Kick()
+    // then only notifies the device if it asked to hear about the buffers
+    // made available since the last kick, and the device only interrupts
+    // once for the completions it posts while the driver is catching up.
+    void SetEventIdx(bool enable) { event_idx_ = enable; }
+
     void FreeDesc(uint16_t desc_index);
     void FreeDescChain(uint16_t chain_head);
     uint16_t AllocDesc();
@@ -43,6 +49,10 @@ private:
 
     uint16_t index_ = 0;
 
+    bool event_idx_ = false;
+    // the avail index as of the last notification
+    uint16_t kicked_idx_ = 0;
+
     vring ring_ = {};
 };
 
@@ -52,18 +62,26 @@ inline void Ring::IrqRingUpdate(T free_chain) {
     //TRACEF("used flags 0x%hhx idx 0x%hhx last_used %u\n",
     //        ring_.used->flags, ring_.used->idx, ring_.last_used);
 
-    // find a new free chain of descriptors
-    unsigned int cur_idx = ring_.used->idx;
-    for (unsigned int i = ring_.last_used; i != (cur_idx & ring_.num_mask); i = (i + 1) & ring_.num_mask) {
-        //TRACEF("looking at idx %u\n", i);
-
-        struct vring_used_elem* used_elem = &ring_.used->ring[i];
-        //TRACEF("used chain id %u, len %u\n", used_elem->id, used_elem->len);
-
-        // free the chain
-        free_chain(used_elem);
-
-        ring_.last_used = ((ring_.last_used + 1) & ring_.num_mask) & 0xffff;
+    // find a new free chain of descriptors (last_used runs freely, like the
+    // used index itself)
+    for (;;) {
+        uint16_t cur_idx = __atomic_load_n(&ring_.used->idx, __ATOMIC_ACQUIRE);
+        for (; ring_.last_used != cur_idx; ring_.last_used++) {
+            struct vring_used_elem* used_elem = &ring_.used->ring[ring_.last_used & ring_.num_mask];
+            //TRACEF("used chain id %u, len %u\n", used_elem->id, used_elem->len);
+
+            // free the chain
+            free_chain(used_elem);
+        }
+        if (!event_idx_)
+            break;
+
+        // ask for an interrupt when the next buffer is used, then look again
+        // in case one was used before the device could see the request
+        vring_used_event(&ring_) = ring_.last_used;
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&ring_.used->idx, __ATOMIC_ACQUIRE) == ring_.last_used)
+            break;
     }
 }
 
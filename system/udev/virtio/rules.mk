@@ -12,12 +12,13 @@ MODULE_SRCS := \
     $(LOCAL_DIR)/block.cpp \
     $(LOCAL_DIR)/device.cpp \
     $(LOCAL_DIR)/gpu.cpp \
+    $(LOCAL_DIR)/net.cpp \
     $(LOCAL_DIR)/ring.cpp \
     $(LOCAL_DIR)/utils.cpp \
     $(LOCAL_DIR)/virtio_c.c \
     $(LOCAL_DIR)/virtio_driver.cpp \
 
-MODULE_STATIC_LIBS := system/ulib/ddk system/ulib/hexdump system/ulib/mx system/ulib/mxtl system/ulib/mxcpp
+MODULE_STATIC_LIBS := system/ulib/ddk system/ulib/hexdump system/ulib/inet-checksum system/ulib/mx system/ulib/mxtl system/ulib/mxcpp
 
 MODULE_LIBS := system/ulib/driver system/ulib/magenta system/ulib/c
 
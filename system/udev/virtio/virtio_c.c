@@ -28,6 +28,6 @@ BI_ABORT_IF(NE, BIND_PROTOCOL, MX_PROTOCOL_PCI)
     BI_ABORT_IF(NE, BIND_PCI_VID, 0x1af4),
     BI_MATCH_IF(EQ, BIND_PCI_DID, 0x1001), // Block device (transitional)
     BI_MATCH_IF(EQ, BIND_PCI_DID, 0x1050), // GPU device
-    //BI_MATCH_IF(EQ, BIND_PCI_DID, 0x1000), // Network device (transitional)
+    BI_MATCH_IF(EQ, BIND_PCI_DID, 0x1000), // Network device (transitional)
     BI_ABORT(),
     MAGENTA_DRIVER_END(_driver_virtio)
@@ -49,6 +49,10 @@ public:
     // match *is_set* starting from *bitoff*.
     size_t Scan(size_t bitoff, size_t bitmax, bool is_set) const;
 
+    // Returns the index of the last bit in [*bitoff*, *bitmax*) that doesn't
+    // match *is_set*, or the lesser of bitmax and size() if every bit matches.
+    size_t ReverseScan(size_t bitoff, size_t bitmax, bool is_set) const;
+
     // Find a run of *run_len* *is_set* bits, between bitoff and bitmax.
     // Returns the start of the run in *out*, or bitmax if it is
     // not found in the provided range.
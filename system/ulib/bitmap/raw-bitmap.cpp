@@ -52,17 +52,33 @@ constexpr size_t LastIdx(size_t bitmax) {
 // bits_[idx] is zero.
 #if (SIZE_MAX == UINT_MAX)
 #define CTZ(x) (x == 0 ? kBits : __builtin_ctz(x))
+#define CLZ(x) (x == 0 ? kBits : __builtin_clz(x))
 #elif (SIZE_MAX == ULONG_MAX)
 #define CTZ(x) (x == 0 ? kBits : __builtin_ctzl(x))
+#define CLZ(x) (x == 0 ? kBits : __builtin_clzl(x))
 #elif (SIZE_MAX == ULLONG_MAX)
 #define CTZ(x) (x == 0 ? kBits : __builtin_ctzll(x))
+#define CLZ(x) (x == 0 ? kBits : __builtin_clzll(x))
 #else
 #error "Unsupported size_t length"
 #endif
 size_t CountZeros(size_t idx, size_t value) {
     return idx * kBits + CTZ(value);
 }
+
+// Returns the index of the highest set bit in |value|, which must not be zero.
+size_t LastOne(size_t idx, size_t value) {
+    return idx * kBits + kBits - 1 - CLZ(value);
+}
 #undef CTZ
+#undef CLZ
+
+// Words which consist entirely of bits matching |is_set| are skipped
+// without looking at individual bits: XORing a word with the returned
+// pattern leaves a one in every position that does not match.
+constexpr size_t SkipPattern(bool is_set) {
+    return is_set ? ~static_cast<size_t>(0) : 0;
+}
 
 } // namespace
 
@@ -104,45 +120,83 @@ size_t RawBitmapGeneric<Storage>::Scan(size_t bitoff, size_t bitmax, bool is_set
     if (bitoff >= bitmax) {
         return bitmax;
     }
+    const size_t skip = SkipPattern(is_set);
     size_t first_idx = FirstIdx(bitoff);
     size_t last_idx = LastIdx(bitmax);
     size_t i = first_idx;
-    size_t value = 0;
-    for (i = first_idx; i <= last_idx; ++i) {
-        value = GetMask(i == first_idx, i == last_idx, bitoff, bitmax);
-        if (is_set) {
-            // If is_set=true, invert the mask, OR it with the value, and invert
-            // it again to hopefully get all zeros.
-            value = ~(~value | data_[i]);
-        } else {
-            // If is_set=false, just AND the mask with the value to hopefully
-            // get all zeros.
-            value &= data_[i];
+    size_t value = (data_[i] ^ skip) & GetMask(true, i == last_idx, bitoff, bitmax);
+    if (value == 0 && i < last_idx) {
+        // The words strictly between the first and last need no mask. Test
+        // four of them per branch while we can, then finish one at a time.
+        for (++i; i + 4 <= last_idx; i += 4) {
+            if (((data_[i] ^ skip) | (data_[i + 1] ^ skip) |
+                 (data_[i + 2] ^ skip) | (data_[i + 3] ^ skip)) != 0) {
+                break;
+            }
         }
-        if (value != 0) {
-            break;
+        while (i < last_idx && (data_[i] ^ skip) == 0) {
+            ++i;
         }
+        value = (data_[i] ^ skip) & GetMask(false, i == last_idx, bitoff, bitmax);
     }
     return mxtl::min(bitmax, CountZeros(i, value));
 }
 
+template <typename Storage>
+size_t RawBitmapGeneric<Storage>::ReverseScan(size_t bitoff, size_t bitmax, bool is_set) const {
+    bitmax = mxtl::min(bitmax, size_);
+    if (bitoff >= bitmax) {
+        return bitmax;
+    }
+    const size_t skip = SkipPattern(is_set);
+    size_t first_idx = FirstIdx(bitoff);
+    size_t last_idx = LastIdx(bitmax);
+    size_t i = last_idx;
+    size_t value = (data_[i] ^ skip) & GetMask(i == first_idx, true, bitoff, bitmax);
+    if (value == 0 && i > first_idx) {
+        for (--i; i >= first_idx + 4; i -= 4) {
+            if (((data_[i] ^ skip) | (data_[i - 1] ^ skip) |
+                 (data_[i - 2] ^ skip) | (data_[i - 3] ^ skip)) != 0) {
+                break;
+            }
+        }
+        while (i > first_idx && (data_[i] ^ skip) == 0) {
+            --i;
+        }
+        value = (data_[i] ^ skip) & GetMask(i == first_idx, false, bitoff, bitmax);
+    }
+    return value == 0 ? bitmax : LastOne(i, value);
+}
+
 template <typename Storage>
 mx_status_t RawBitmapGeneric<Storage>::Find(bool is_set, size_t bitoff, size_t bitmax,
                                                 size_t run_len, size_t* out) const {
     if (!out || bitmax <= bitoff) {
         return ERR_INVALID_ARGS;
     }
+    if (run_len == 0) {
+        *out = bitoff;
+        return NO_ERROR;
+    }
+    size_t limit = mxtl::min(bitmax, size_);
     size_t start = bitoff;
-    while (bitoff - start < run_len && bitoff < bitmax) {
-        start = Scan(bitoff, bitmax, !is_set);
-        if (bitmax - start < run_len) {
+    while (true) {
+        start = Scan(start, limit, !is_set);
+        if (limit - start < run_len) {
             *out = bitmax;
             return ERR_NO_RESOURCES;
         }
-        bitoff = Scan(start, start + run_len, is_set);
+        // Check the candidate run from its far end. If the last mismatch is
+        // at 'miss', no run can begin at or before it, so the bits between
+        // 'start' and 'miss' never need to be looked at.
+        size_t end = start + run_len;
+        size_t miss = ReverseScan(start, end, is_set);
+        if (miss == end) {
+            *out = start;
+            return NO_ERROR;
+        }
+        start = miss + 1;
     }
-    *out = start;
-    return NO_ERROR;
 }
 
 template <typename Storage>
@@ -165,10 +219,15 @@ mx_status_t RawBitmapGeneric<Storage>::Set(size_t bitoff, size_t bitmax) {
     }
     size_t first_idx = FirstIdx(bitoff);
     size_t last_idx = LastIdx(bitmax);
-    for (size_t i = first_idx; i <= last_idx; ++i) {
-        data_[i] |=
-                GetMask(i == first_idx, i == last_idx, bitoff, bitmax);
+    if (first_idx == last_idx) {
+        data_[first_idx] |= GetMask(true, true, bitoff, bitmax);
+        return NO_ERROR;
+    }
+    data_[first_idx] |= GetMask(true, false, bitoff, bitmax);
+    for (size_t i = first_idx + 1; i < last_idx; ++i) {
+        data_[i] = ~static_cast<size_t>(0);
     }
+    data_[last_idx] |= GetMask(false, true, bitoff, bitmax);
     return NO_ERROR;
 }
 
@@ -182,10 +241,15 @@ mx_status_t RawBitmapGeneric<Storage>::Clear(size_t bitoff, size_t bitmax) {
     }
     size_t first_idx = FirstIdx(bitoff);
     size_t last_idx = LastIdx(bitmax);
-    for (size_t i = first_idx; i <= last_idx; ++i) {
-        data_[i] &=
-                ~(GetMask(i == first_idx, i == last_idx, bitoff, bitmax));
+    if (first_idx == last_idx) {
+        data_[first_idx] &= ~GetMask(true, true, bitoff, bitmax);
+        return NO_ERROR;
+    }
+    data_[first_idx] &= ~GetMask(true, false, bitoff, bitmax);
+    for (size_t i = first_idx + 1; i < last_idx; ++i) {
+        data_[i] = 0;
     }
+    data_[last_idx] &= ~GetMask(false, true, bitoff, bitmax);
     return NO_ERROR;
 }
 
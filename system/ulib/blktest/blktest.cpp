@@ -18,6 +18,7 @@
 #include <magenta/cpp.h>
 #include <magenta/device/block.h>
 #include <magenta/syscalls.h>
+#include <mxtl/algorithm.h>
 #include <mxtl/array.h>
 #include <mxtl/unique_ptr.h>
 #include <unittest/unittest.h>
@@ -47,6 +48,12 @@ static int get_testdev(uint64_t* blk_size, uint64_t* blk_count) {
     return fd;
 }
 
+static void fill_random(uint8_t* buf, uint64_t size) {
+    for (size_t i = 0; i < size; i++) {
+        buf[i] = static_cast<uint8_t>(rand());
+    }
+}
+
 static bool blkdev_test_simple(void) {
     uint64_t blk_size, blk_count;
     uint8_t buf[PAGE_SIZE];
@@ -106,6 +113,46 @@ bool blkdev_test_bad_requests(void) {
     END_TEST;
 }
 
+// Reads and writes larger than a single remoteio message, which take the
+// vmo path rather than being split into chunks.
+bool blkdev_test_large_io(void) {
+    uint64_t blk_size, blk_count;
+    const size_t kXfer = 256 * 1024;
+
+    BEGIN_TEST;
+    int fd = get_testdev(&blk_size, &blk_count);
+    ASSERT_GE(blk_size * blk_count, kXfer * 2, "Device is too small");
+    AllocChecker ac;
+    mxtl::unique_ptr<uint8_t[]> buf(new (&ac) uint8_t[kXfer]);
+    ASSERT_TRUE(ac.check(), "");
+    mxtl::unique_ptr<uint8_t[]> out(new (&ac) uint8_t[kXfer]);
+    ASSERT_TRUE(ac.check(), "");
+    fill_random(buf.get(), kXfer);
+
+    // write() and read() advance the seek pointer past the whole transfer
+    ASSERT_EQ(lseek(fd, 0, SEEK_SET), 0, "");
+    ASSERT_EQ(write(fd, buf.get(), kXfer), (ssize_t) kXfer, "");
+    ASSERT_EQ(lseek(fd, 0, SEEK_CUR), (off_t) kXfer, "");
+    ASSERT_EQ(lseek(fd, 0, SEEK_SET), 0, "");
+    ASSERT_EQ(read(fd, out.get(), kXfer), (ssize_t) kXfer, "");
+    ASSERT_EQ(lseek(fd, 0, SEEK_CUR), (off_t) kXfer, "");
+    ASSERT_EQ(memcmp(out.get(), buf.get(), kXfer), 0, "");
+
+    // pwrite() and pread() leave it alone
+    memset(out.get(), 0, kXfer);
+    ASSERT_EQ(pwrite(fd, buf.get(), kXfer, kXfer), (ssize_t) kXfer, "");
+    ASSERT_EQ(pread(fd, out.get(), kXfer, kXfer), (ssize_t) kXfer, "");
+    ASSERT_EQ(lseek(fd, 0, SEEK_CUR), (off_t) kXfer, "");
+    ASSERT_EQ(memcmp(out.get(), buf.get(), kXfer), 0, "");
+
+    // A transfer running off the end of the device is cut short
+    off_t dev_size = blk_size * blk_count;
+    ASSERT_EQ(pread(fd, out.get(), kXfer, dev_size - blk_size), (ssize_t) blk_size, "");
+
+    close(fd);
+    END_TEST;
+}
+
 #if 0
 bool blkdev_test_multiple(void) {
     uint8_t buf[PAGE_SIZE];
@@ -151,12 +198,6 @@ bool blkdev_test_fifo_no_op(void) {
     END_TEST;
 }
 
-static void fill_random(uint8_t* buf, uint64_t size) {
-    for (size_t i = 0; i < size; i++) {
-        buf[i] = static_cast<uint8_t>(rand());
-    }
-}
-
 bool blkdev_test_fifo_basic(void) {
     BEGIN_TEST;
     uint64_t blk_size, blk_count;
@@ -453,6 +494,293 @@ bool blkdev_test_fifo_multiple_vmo_multithreaded(void) {
     END_TEST;
 }
 
+// Opens a separate connection to the device for each thread; the block
+// device serves every connection with its own fifo.
+int fifo_client_thread(void* arg) {
+    test_thread_arg_t* fifoarg = (test_thread_arg_t*)arg;
+    const char* blkdev_path = getenv(BLKTEST_BLK_DEV);
+    int fd = open(blkdev_path, O_RDWR);
+    ASSERT_GE(fd, 0, "Could not open block device");
+    mx_handle_t fifo;
+    ssize_t expected = sizeof(fifo);
+    ASSERT_EQ(ioctl_block_get_fifos(fd, &fifo), expected, "Failed to get FIFO");
+    fifo_client_t* client;
+    ASSERT_EQ(block_fifo_create_client(fifo, &client), NO_ERROR, "");
+    txnid_t txnid;
+    expected = sizeof(txnid_t);
+    ASSERT_EQ(ioctl_block_alloc_txn(fd, &txnid), expected, "Failed to allocate txn");
+
+    test_vmo_object_t* obj = fifoarg->obj;
+    size_t kBlockSize = fifoarg->kBlockSize;
+    ASSERT_TRUE(create_vmo_helper(fd, obj, kBlockSize), "");
+    ASSERT_TRUE(write_striped_vmo_helper(client, obj, fifoarg->i, fifoarg->objs, txnid,
+                                         kBlockSize), "");
+    ASSERT_TRUE(read_striped_vmo_helper(client, obj, fifoarg->i, fifoarg->objs, txnid,
+                                        kBlockSize), "");
+    ASSERT_TRUE(close_vmo_helper(client, obj, txnid), "");
+    block_fifo_release_client(client);
+    ASSERT_EQ(ioctl_block_fifo_close(fd), NO_ERROR, "Failed to close fifo");
+    close(fd);
+    return 0;
+}
+
+bool blkdev_test_fifo_multiple_clients(void) {
+    BEGIN_TEST;
+    uint64_t kBlockSize, blk_count;
+    int fd = get_testdev(&kBlockSize, &blk_count);
+
+    size_t num_threads = 4;
+    AllocChecker ac;
+    mxtl::Array<test_vmo_object_t> objs(new (&ac) test_vmo_object_t[num_threads](), num_threads);
+    ASSERT_TRUE(ac.check(), "");
+    mxtl::Array<thrd_t> threads(new (&ac) thrd_t[num_threads](), num_threads);
+    ASSERT_TRUE(ac.check(), "");
+    mxtl::Array<test_thread_arg_t> thread_args(new (&ac) test_thread_arg_t[num_threads](),
+                                               num_threads);
+    ASSERT_TRUE(ac.check(), "");
+
+    for (size_t i = 0; i < num_threads; i++) {
+        thread_args[i].obj = &objs[i];
+        thread_args[i].i = i;
+        thread_args[i].objs = objs.size();
+        thread_args[i].kBlockSize = kBlockSize;
+        ASSERT_EQ(thrd_create(&threads[i], fifo_client_thread, &thread_args[i]),
+                  thrd_success, "");
+    }
+
+    for (size_t i = 0; i < num_threads; i++) {
+        int res;
+        ASSERT_EQ(thrd_join(threads[i], &res), thrd_success, "");
+        ASSERT_EQ(res, 0, "");
+    }
+    close(fd);
+    END_TEST;
+}
+
+typedef struct {
+    size_t depth;        // Requests per txn
+    size_t txns;         // Txns to issue
+    bool sequential;     // Are the requests of a txn adjacent on disk?
+    uint64_t xfer;       // Bytes per request (a multiple of the block size)
+    uint64_t blk_size;
+    uint64_t blk_count;
+    uint64_t* latency;   // Ticks taken by each txn
+    unsigned int seed;
+    mx_status_t status;
+} bench_thread_arg_t;
+
+static mx_status_t bench_reads(bench_thread_arg_t* arg) {
+    const char* blkdev_path = getenv(BLKTEST_BLK_DEV);
+    int fd = open(blkdev_path, O_RDWR);
+    if (fd < 0) {
+        return ERR_IO;
+    }
+    mx_status_t status = ERR_IO;
+    mx_handle_t fifo;
+    fifo_client_t* client = nullptr;
+    txnid_t txnid;
+    mx_handle_t vmo = MX_HANDLE_INVALID;
+    mx_handle_t xfer_vmo;
+    vmoid_t vmoid;
+    // Offsets are picked in units of one request.
+    uint64_t units = arg->blk_count / (arg->xfer / arg->blk_size);
+    uint64_t span = arg->sequential ? arg->depth : 1;
+    uint64_t slots = units / span;
+    block_fifo_request_t requests[MAX_TXN_MESSAGES];
+
+    if (ioctl_block_get_fifos(fd, &fifo) < 0) {
+        goto done;
+    } else if ((status = block_fifo_create_client(fifo, &client)) != NO_ERROR) {
+        goto done;
+    } else if (ioctl_block_alloc_txn(fd, &txnid) < 0) {
+        status = ERR_IO;
+        goto done;
+    } else if ((status = mx_vmo_create(arg->xfer * arg->depth, 0, &vmo)) != NO_ERROR) {
+        goto done;
+    } else if ((status = mx_handle_duplicate(vmo, MX_RIGHT_SAME_RIGHTS, &xfer_vmo)) != NO_ERROR) {
+        goto done;
+    } else if (ioctl_block_attach_vmo(fd, &xfer_vmo, &vmoid) < 0) {
+        status = ERR_IO;
+        goto done;
+    }
+
+    for (size_t t = 0; t < arg->txns; t++) {
+        uint64_t unit = (rand_r(&arg->seed) % slots) * span;
+        for (size_t i = 0; i < arg->depth; i++) {
+            if (!arg->sequential) {
+                unit = rand_r(&arg->seed) % units;
+            }
+            requests[i].txnid      = txnid;
+            requests[i].vmoid      = vmoid;
+            requests[i].opcode     = BLOCKIO_READ;
+            requests[i].length     = static_cast<uint32_t>(arg->xfer);
+            requests[i].vmo_offset = i * arg->xfer;
+            requests[i].dev_offset = (arg->sequential ? unit + i : unit) * arg->xfer;
+        }
+        uint64_t start = mx_ticks_get();
+        if ((status = block_fifo_txn(client, &requests[0], arg->depth)) != NO_ERROR) {
+            goto done;
+        }
+        arg->latency[t] = mx_ticks_get() - start;
+    }
+    status = NO_ERROR;
+
+done:
+    if (client != nullptr) {
+        block_fifo_release_client(client);
+        ioctl_block_fifo_close(fd);
+    }
+    if (vmo != MX_HANDLE_INVALID) {
+        mx_handle_close(vmo);
+    }
+    close(fd);
+    return status;
+}
+
+static int bench_thread(void* arg) {
+    bench_thread_arg_t* a = static_cast<bench_thread_arg_t*>(arg);
+    a->status = bench_reads(a);
+    return 0;
+}
+
+static int compare_ticks(const void* a, const void* b) {
+    uint64_t x = *static_cast<const uint64_t*>(a);
+    uint64_t y = *static_cast<const uint64_t*>(b);
+    return (x < y) ? -1 : (x > y);
+}
+
+// Runs 'num_threads' clients, each on its own connection, issuing txns of
+// 'depth' reads of 'xfer' bytes (or of one block, if zero). Reports IOPS
+// across all clients, and the latency of a txn.
+static bool bench_sweep_helper(size_t num_threads, size_t depth, bool sequential,
+                               uint64_t xfer) {
+    uint64_t blk_size, blk_count;
+    int fd = get_testdev(&blk_size, &blk_count);
+    close(fd);
+    if (xfer == 0) {
+        xfer = blk_size;
+    }
+    ASSERT_EQ(xfer % blk_size, 0, "Transfer size must be a multiple of the block size");
+    ASSERT_GE(blk_size * blk_count, xfer * depth, "Device is too small");
+
+    const size_t kTxns = 1024 / depth;
+    AllocChecker ac;
+    mxtl::unique_ptr<uint64_t[]> latency(new (&ac) uint64_t[num_threads * kTxns]);
+    ASSERT_TRUE(ac.check(), "");
+    mxtl::Array<thrd_t> threads(new (&ac) thrd_t[num_threads](), num_threads);
+    ASSERT_TRUE(ac.check(), "");
+    mxtl::Array<bench_thread_arg_t> args(new (&ac) bench_thread_arg_t[num_threads](),
+                                         num_threads);
+    ASSERT_TRUE(ac.check(), "");
+
+    uint64_t start = mx_ticks_get();
+    for (size_t i = 0; i < num_threads; i++) {
+        args[i].depth = depth;
+        args[i].txns = kTxns;
+        args[i].sequential = sequential;
+        args[i].xfer = xfer;
+        args[i].blk_size = blk_size;
+        args[i].blk_count = blk_count;
+        args[i].latency = &latency[i * kTxns];
+        args[i].seed = static_cast<unsigned int>(i + 1);
+        ASSERT_EQ(thrd_create(&threads[i], bench_thread, &args[i]), thrd_success, "");
+    }
+    for (size_t i = 0; i < num_threads; i++) {
+        ASSERT_EQ(thrd_join(threads[i], NULL), thrd_success, "");
+        ASSERT_EQ(args[i].status, NO_ERROR, "");
+    }
+    uint64_t end = mx_ticks_get();
+
+    uint64_t ticks_per_sec = mx_ticks_per_second();
+    size_t samples = num_threads * kTxns;
+    qsort(latency.get(), samples, sizeof(uint64_t), compare_ticks);
+    uint64_t p50 = latency[samples / 2] * 1000000 / ticks_per_sec;
+    uint64_t p99 = latency[samples * 99 / 100] * 1000000 / ticks_per_sec;
+    uint64_t iops = samples * depth * ticks_per_sec / (end - start);
+    printf("Benchmark %-10s %6lu bytes threads %2zu depth %2zu: "
+           "[%8lu] IOPS [%6lu] MB/s p50 [%6lu] usec p99 [%6lu] usec\n",
+           sequential ? "sequential" : "random", xfer, num_threads, depth, iops,
+           iops * xfer / (1 << 20), p50, p99);
+    return true;
+}
+
+bool blkdev_bench_fifo_sweep(void) {
+    BEGIN_TEST;
+    printf("\n");
+    const size_t kThreads[] = {1, 2, 4, 8};
+    const size_t kDepths[] = {1, 4, MAX_TXN_MESSAGES};
+    for (size_t t = 0; t < countof(kThreads); t++) {
+        for (size_t d = 0; d < countof(kDepths); d++) {
+            ASSERT_TRUE(bench_sweep_helper(kThreads[t], kDepths[d], false, 0), "");
+            ASSERT_TRUE(bench_sweep_helper(kThreads[t], kDepths[d], true, 0), "");
+        }
+    }
+    END_TEST;
+}
+
+// 4KB random reads at a device queue depth of 1 to 32. A txn is not
+// complete until all of its requests are, so the depth seen by the device
+// is the number of clients times the requests in each of their txns.
+bool blkdev_bench_fifo_queue_depth(void) {
+    BEGIN_TEST;
+    printf("\n");
+    const size_t kQueueDepths[] = {1, 2, 4, 8, 16, 32};
+    for (size_t q = 0; q < countof(kQueueDepths); q++) {
+        size_t num_threads = (kQueueDepths[q] + MAX_TXN_MESSAGES - 1) / MAX_TXN_MESSAGES;
+        size_t depth = kQueueDepths[q] / num_threads;
+        ASSERT_TRUE(bench_sweep_helper(num_threads, depth, false, 4096), "");
+    }
+    END_TEST;
+}
+
+// Large reads, which a driver without scatter/gather support (or with
+// little ring space for segments) cannot keep many of in flight.
+bool blkdev_bench_fifo_throughput(void) {
+    BEGIN_TEST;
+    printf("\n");
+    const uint64_t kXfers[] = {64 * 1024, 256 * 1024};
+    const size_t kThreads[] = {1, 4};
+    for (size_t x = 0; x < countof(kXfers); x++) {
+        for (size_t t = 0; t < countof(kThreads); t++) {
+            ASSERT_TRUE(bench_sweep_helper(kThreads[t], 4, false, kXfers[x]), "");
+        }
+    }
+    END_TEST;
+}
+
+// Sequential read() of the same span of the device at sizes from a single
+// remoteio message, which is chunked at 8KB, to those which are passed in
+// a vmo and copied through the devhost in chunks of up to 1MB.
+bool blkdev_bench_read(void) {
+    BEGIN_TEST;
+    printf("\n");
+    uint64_t blk_size, blk_count;
+    int fd = get_testdev(&blk_size, &blk_count);
+    const size_t kXfers[] = {8 * 1024, 64 * 1024, 256 * 1024, 1024 * 1024};
+    const size_t kSpan = mxtl::min<size_t>(blk_size * blk_count, 64 * 1024 * 1024);
+    ASSERT_GE(kSpan, kXfers[countof(kXfers) - 1], "Device is too small");
+    AllocChecker ac;
+    mxtl::unique_ptr<uint8_t[]> buf(new (&ac) uint8_t[kXfers[countof(kXfers) - 1]]);
+    ASSERT_TRUE(ac.check(), "");
+
+    uint64_t ticks_per_sec = mx_ticks_per_second();
+    for (size_t x = 0; x < countof(kXfers); x++) {
+        size_t total = kSpan - (kSpan % kXfers[x]);
+        ASSERT_EQ(lseek(fd, 0, SEEK_SET), 0, "");
+        uint64_t start = mx_ticks_get();
+        for (size_t off = 0; off < total; off += kXfers[x]) {
+            ASSERT_EQ(read(fd, buf.get(), kXfers[x]), (ssize_t) kXfers[x], "");
+        }
+        uint64_t end = mx_ticks_get();
+        uint64_t usec = (end - start) * 1000000 / ticks_per_sec;
+        printf("Benchmark read() %7zu bytes: [%6lu] MB/s [%8lu] usec per read\n",
+               kXfers[x], total * ticks_per_sec / (end - start) / (1 << 20),
+               usec / (total / kXfers[x]));
+    }
+    close(fd);
+    END_TEST;
+}
+
 bool blkdev_test_fifo_unclean_shutdown(void) {
     BEGIN_TEST;
     // Set up the blkdev
@@ -829,9 +1157,51 @@ bool blkdev_test_fifo_bad_client_bad_vmo(void) {
     END_TEST;
 }
 
+bool blkdev_test_fifo_sync(void) {
+    BEGIN_TEST;
+    uint64_t kBlockSize, blk_count;
+    int fd = get_testdev(&kBlockSize, &blk_count);
+
+    mx_handle_t fifo;
+    ssize_t expected = sizeof(fifo);
+    ASSERT_EQ(ioctl_block_get_fifos(fd, &fifo), expected, "Failed to get FIFO");
+    fifo_client_t* client;
+    ASSERT_EQ(block_fifo_create_client(fifo, &client), NO_ERROR, "");
+    txnid_t txnid;
+    expected = sizeof(txnid_t);
+    ASSERT_EQ(ioctl_block_alloc_txn(fd, &txnid), expected, "Failed to allocate txn");
+    test_vmo_object_t obj;
+    ASSERT_TRUE(create_vmo_helper(fd, &obj, kBlockSize), "");
+
+    // Write the vmo twice over, ordered by a sync, then overwrite the start
+    // of it with a FUA write behind a barrier.
+    block_fifo_request_t requests[4];
+    for (size_t i = 0; i < countof(requests); i++) {
+        requests[i].txnid      = txnid;
+        requests[i].vmoid      = obj.vmoid;
+        requests[i].opcode     = BLOCKIO_WRITE;
+        requests[i].length     = static_cast<uint32_t>(obj.vmo_size);
+        requests[i].vmo_offset = 0;
+        requests[i].dev_offset = 0;
+    }
+    requests[1].opcode     = BLOCKIO_SYNC | BLOCKIO_BARRIER_AFTER;
+    requests[2].dev_offset = obj.vmo_size;
+    requests[3].opcode     = BLOCKIO_WRITE | BLOCKIO_FUA | BLOCKIO_BARRIER_BEFORE;
+    requests[3].length     = static_cast<uint32_t>(kBlockSize);
+    ASSERT_EQ(block_fifo_txn(client, &requests[0], countof(requests)), NO_ERROR, "");
+
+    ASSERT_TRUE(read_striped_vmo_helper(client, &obj, 0, 1, txnid, kBlockSize), "");
+    ASSERT_TRUE(close_vmo_helper(client, &obj, txnid), "");
+    block_fifo_release_client(client);
+    ASSERT_EQ(ioctl_block_fifo_close(fd), NO_ERROR, "Failed to close fifo");
+    close(fd);
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(blkdev_tests)
 RUN_TEST(blkdev_test_simple)
 RUN_TEST(blkdev_test_bad_requests)
+RUN_TEST(blkdev_test_large_io)
 #if 0
 RUN_TEST(blkdev_test_multiple)
 #endif
@@ -839,6 +1209,7 @@ RUN_TEST(blkdev_test_fifo_no_op)
 RUN_TEST(blkdev_test_fifo_basic)
 RUN_TEST(blkdev_test_fifo_multiple_vmo)
 RUN_TEST(blkdev_test_fifo_multiple_vmo_multithreaded)
+RUN_TEST(blkdev_test_fifo_multiple_clients)
 // TODO(smklein): Test ops across different vmos
 RUN_TEST(blkdev_test_fifo_unclean_shutdown)
 RUN_TEST(blkdev_test_fifo_large_ops_count)
@@ -847,6 +1218,11 @@ RUN_TEST(blkdev_test_fifo_bad_client_vmoid)
 RUN_TEST(blkdev_test_fifo_bad_client_txnid)
 RUN_TEST(blkdev_test_fifo_bad_client_unaligned_request)
 RUN_TEST(blkdev_test_fifo_bad_client_bad_vmo)
+RUN_TEST(blkdev_test_fifo_sync)
+RUN_TEST_PERFORMANCE(blkdev_bench_fifo_sweep)
+RUN_TEST_PERFORMANCE(blkdev_bench_fifo_queue_depth)
+RUN_TEST_PERFORMANCE(blkdev_bench_fifo_throughput)
+RUN_TEST_PERFORMANCE(blkdev_bench_read)
 END_TEST_CASE(blkdev_tests)
 
 } // namespace tests
@@ -105,7 +105,7 @@ mx_status_t block_fifo_txn(fifo_client_t* client, block_fifo_request_t* requests
     mx_status_t status;
     for (size_t i = 0; i < count; i++) {
         assert(requests[i].txnid == txnid);
-        requests[i].opcode = (requests[i].opcode & BLOCKIO_OP_MASK) |
+        requests[i].opcode = (requests[i].opcode & ~BLOCKIO_TXN_END) |
                              (i == count - 1 ? BLOCKIO_TXN_END : 0);
     }
     if ((status = do_write(client->fifo, &requests[0], count)) != NO_ERROR) {
@@ -31,10 +31,13 @@ void block_fifo_release_client(fifo_client_t* client);
 // --------------------------------------   -----------------
 // txnid                                    All  (must be the same for all requests)
 // vmoid                                    All
-// opcode (BLOCKIO_OP_MASK bits only)       All
+// opcode                                   All
 // length                                   read, write
 // vmo_offset                               read, write
 // dev_offset                               read, write
+//
+// BLOCKIO_TXN_END is set on the last request by this function; any other
+// flags (such as BLOCKIO_BARRIER_BEFORE or BLOCKIO_FUA) are passed through.
 mx_status_t block_fifo_txn(fifo_client_t* client, block_fifo_request_t* requests, size_t count);
 
 __END_CDECLS
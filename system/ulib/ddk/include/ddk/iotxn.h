@@ -8,6 +8,7 @@
 #include <magenta/types.h>
 #include <magenta/listnode.h>
 #include <ddk/driver.h>
+#include <magenta/device/device.h>
 #include <sys/types.h>
 
 __BEGIN_CDECLS;
@@ -179,4 +180,11 @@ mx_status_t iotxn_clone(iotxn_t* txn, iotxn_t** out);
 // free the iotxn -- should be called only by the entity that allocated it
 void iotxn_release(iotxn_t* txn);
 
+// iotxns allocated with IOTXN_ALLOC_POOL (and clones, and iotxns without a
+// buffer) are kept on release, by size class, and handed out again by
+// iotxn_alloc() along with their vmo and physical page list.
+// iotxn_pool_stats() reports how the pool of this driver is doing; drivers
+// return it for IOCTL_DEVICE_GET_IOTXN_STATS.
+void iotxn_pool_stats(iotxn_pool_stats_t* out);
+
 __END_CDECLS;
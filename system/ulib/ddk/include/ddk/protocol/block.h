@@ -21,4 +21,8 @@ typedef struct block_ops {
     // Write from the VMO to the block device
     void (*write)(mx_device_t* dev, mx_handle_t vmo, uint64_t length, uint64_t vmo_offset,
                   uint64_t dev_offset, void* cookie);
+    // Flush any volatile write cache, completing once every write which has
+    // already completed is on stable storage. Optional: devices without a
+    // volatile cache may leave this NULL.
+    void (*sync)(mx_device_t* dev, void* cookie);
 } block_ops_t;
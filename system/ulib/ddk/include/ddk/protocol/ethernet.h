@@ -25,22 +25,44 @@ typedef struct ethernet_protocol {
 // interface (which is selectable independently for transmit and
 // receive)
 //
-// TODO: Implement zero-copy interface in the ethernet common
-// middle layer driver.  Currently ethermac drivers that request
-// these will not be loaded.
+// With FEATURE_RX_QUEUE, the ethernet core queues buffers of at least
+// mtu bytes, which are physically contiguous, and which are usually
+// the client's own (so frames land in client memory).  Buffers are
+// completed in the order they were queued.  stop() discards any still
+// queued, and the ethermac must not touch them afterwards.
+//
+// TODO: Implement FEATURE_TX_QUEUE in the ethernet common middle
+// layer driver.  Currently ethermac drivers that request it will
+// not be loaded.
 //
 // The FEATURE_WLAN flag indicates a device that supports wlan operations.
+//
+// The FEATURE_TX_CSUM flag indicates that send() completes the transport
+// (TCP, UDP or ICMPv6) checksum of a frame passed with ETHMAC_TX_CSUM,
+// whose checksum field holds the sum of the pseudo-header.  The
+// FEATURE_RX_CSUM flag indicates that received frames whose transport
+// checksum was verified are passed with ETHMAC_RX_CSUM_OK.
 
 #define ETHMAC_FEATURE_RX_QUEUE (1u)
 #define ETHMAC_FEATURE_TX_QUEUE (2u)
 #define ETHMAC_FEATURE_WLAN     (4u)
+#define ETHMAC_FEATURE_TX_CSUM  (8u)
+#define ETHMAC_FEATURE_RX_CSUM  (16u)
+
+// options for send()
+#define ETHMAC_TX_CSUM (1u)
+
+// flags for recv() and complete_rx()
+#define ETHMAC_RX_CSUM_OK (1u)
 
 typedef struct ethmac_info {
     uint32_t features;
     uint32_t mtu;
     uint8_t mac[ETH_MAC_SIZE];
     uint8_t reserved0[2];
-    uint32_t reserved1[4];
+    // with FEATURE_RX_QUEUE, how many rx buffers may be queued at once
+    uint32_t rx_queue_depth;
+    uint32_t reserved1[3];
 } ethmac_info_t;
 
 #define ETHMAC_STATUS_ONLINE (1u)
@@ -51,7 +73,13 @@ typedef struct ethmac_ifc_virt {
     // recv() is invoked when FEATURE_RX_QUEUE is not present
     void (*recv)(void* cookie, void* data, size_t length, uint32_t flags);
 
+    // recv_flush() is invoked after each burst of recv() calls (such as
+    // those made for one interrupt), before waiting for more packets.
+    // Received packets may not reach clients until it is called.
+    void (*recv_flush)(void* cookie);
+
     // complete_?x() is invoked when FEATURE_?X_QUEUE is present
+    // recv_flush() follows a burst of complete_rx() calls, as it does recv().
     void (*complete_rx)(void* cookie, uint32_t length, uint32_t flags);
     void (*complete_tx)(void* cookie, uint32_t count);
 } ethmac_ifc_t;
@@ -80,6 +108,8 @@ typedef struct ethmac_protocol {
     void (*send)(mx_device_t* dev, uint32_t options, void* data, size_t length);
 
     // queue_?x() is valid if FEATURE_?X_QUEUE is present, otherwise they are no-op
+    // pa1 is where a buffer continues if it crosses a page boundary, or 0;
+    // rx buffers are always queued with a pa1 of 0.
     void (*queue_tx)(mx_device_t* dev, uint32_t options,
                      uintptr_t pa0, uintptr_t pa1, size_t length);
     void (*queue_rx)(mx_device_t* dev, uint32_t options,
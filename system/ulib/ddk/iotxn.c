@@ -26,53 +26,205 @@
     } while (0)
 #endif
 
+#define ROUNDUP(a, b)   (((a) + ((b)-1)) & ~((b)-1))
+#define ROUNDDOWN(a, b) ((a) & ~((b)-1))
+
 #define IOTXN_PFLAG_CONTIGUOUS (1 << 0)   // the vmo is contiguous
 #define IOTXN_PFLAG_ALLOC      (1 << 1)   // the vmo is allocated by us
 #define IOTXN_PFLAG_PHYSMAP    (1 << 2)   // we performed physmap() on this vmo
 #define IOTXN_PFLAG_MMAP       (1 << 3)   // we performed mmap() on this vmo
 #define IOTXN_PFLAG_FREE       (1 << 4)   // this txn has been released
 
-static list_node_t free_list = LIST_INITIAL_VALUE(free_list);
-static mtx_t free_list_mutex = MTX_INIT;
+// Every iotxn allocated here (as opposed to initialized by iotxn_init()) is
+// wrapped in one of these, which records what the pool needs to hand the
+// txn out again.
+typedef struct iotxn_priv {
+    iotxn_t txn;
+    uint64_t vmo_size;     // size of the vmo we created, 0 if none
+    uint64_t phys_pages;   // entries of 'phys' kept from a physmap at offset 0
+    uint64_t mapped;       // bytes of the vmo kept mapped at 'virt'
+    uint32_t bucket;       // pool bucket, or IOTXN_BUCKET_NONE
+} iotxn_priv_t;
+
+#define txn_to_priv(txn) containerof(txn, iotxn_priv_t, txn)
+
+// Pooled iotxns are kept by size class: one class for txns without a
+// buffer (including clones), then powers of two from 512 bytes to 1MB. Each
+// class is split by whether the vmo is contiguous. Larger txns are freed
+// on release.
+#define IOTXN_CLASS_SHIFT_MIN 9
+#define IOTXN_CLASS_SHIFT_MAX 20
+#define IOTXN_CLASSES         (IOTXN_CLASS_SHIFT_MAX - IOTXN_CLASS_SHIFT_MIN + 2)
+#define IOTXN_BUCKETS         (IOTXN_CLASSES * 2)
+#define IOTXN_BUCKET_NONE     UINT32_MAX
+
+// Released txns go to a small per-thread cache first, so that a thread
+// which allocates and releases txns (such as a driver's completion path)
+// needs neither a lock nor a syscall. Overflow goes to the shared pool.
+// The cache is bounded in bytes as well as in count, as threads may keep
+// it for as long as they live: large txns always go to the shared pool.
+#define IOTXN_CACHE_DEPTH 8
+#define IOTXN_CACHE_BYTES (256u * 1024)
+
+typedef struct iotxn_bucket {
+    mtx_t lock;
+    list_node_t free_list;
+} iotxn_bucket_t;
+
+typedef struct iotxn_cache {
+    uint32_t count[IOTXN_BUCKETS];
+    uint64_t bytes;
+    iotxn_priv_t* txns[IOTXN_BUCKETS][IOTXN_CACHE_DEPTH];
+} iotxn_cache_t;
+
+static iotxn_bucket_t buckets[IOTXN_BUCKETS];
+static tss_t cache_key;
+static once_flag pool_once = ONCE_FLAG_INIT;
+
+static struct {
+    atomic_uint_fast64_t allocs;
+    atomic_uint_fast64_t cache_hits;
+    atomic_uint_fast64_t pool_hits;
+    atomic_uint_fast64_t vmo_creates;
+    atomic_uint_fast64_t releases;
+    atomic_uint_fast64_t frees;
+    atomic_uint_fast64_t pooled;
+    atomic_uint_fast64_t pooled_bytes;
+} pool_stats;
+
+#define STAT_ADD(name, n) atomic_fetch_add_explicit(&pool_stats.name, (n), memory_order_relaxed)
+#define STAT_SUB(name, n) atomic_fetch_sub_explicit(&pool_stats.name, (n), memory_order_relaxed)
 
 // This assert will fail if we attempt to access the buffer of a cloned txn after it has been completed
 #define ASSERT_BUFFER_VALID(priv) MX_DEBUG_ASSERT(!(priv->flags & IOTXN_FLAG_DEAD))
 
-static uint32_t alloc_flags_to_pflags(uint32_t alloc_flags) {
-    if (alloc_flags & IOTXN_ALLOC_CONTIGUOUS) {
-        return IOTXN_PFLAG_CONTIGUOUS;
+static void pool_put_shared(iotxn_priv_t* priv);
+
+// hands a dying thread's cached txns back to the shared pool
+static void cache_destroy(void* arg) {
+    iotxn_cache_t* cache = arg;
+    for (uint32_t b = 0; b < IOTXN_BUCKETS; b++) {
+        for (uint32_t i = 0; i < cache->count[b]; i++) {
+            pool_put_shared(cache->txns[b][i]);
+        }
     }
-    return 0;
+    free(cache);
 }
 
-static bool do_free_phys(uint32_t pflags) {
-    // only free phys if we called physmap
-    return (pflags & IOTXN_PFLAG_PHYSMAP);
+static void pool_init(void) {
+    for (uint32_t b = 0; b < IOTXN_BUCKETS; b++) {
+        mtx_init(&buckets[b].lock, mtx_plain);
+        list_initialize(&buckets[b].free_list);
+    }
+    tss_create(&cache_key, cache_destroy);
+}
+
+// returns the pool bucket for a txn of 'data_size' bytes, or
+// IOTXN_BUCKET_NONE if txns of that size are not pooled
+static uint32_t pool_bucket(uint32_t alloc_flags, uint64_t data_size) {
+    if (data_size == 0) {
+        // without a buffer, there is nothing to be contiguous
+        return 0;
+    }
+    uint32_t shift = (data_size <= (1u << IOTXN_CLASS_SHIFT_MIN)) ? IOTXN_CLASS_SHIFT_MIN :
+                     (uint32_t)(64 - __builtin_clzll(data_size - 1));
+    if (shift > IOTXN_CLASS_SHIFT_MAX) {
+        return IOTXN_BUCKET_NONE;
+    }
+    uint32_t size_class = shift - IOTXN_CLASS_SHIFT_MIN + 1;
+    return size_class * 2 + ((alloc_flags & IOTXN_ALLOC_CONTIGUOUS) ? 1 : 0);
+}
+
+// the size of vmo to create for a new txn in 'bucket'
+static uint64_t pool_vmo_size(uint32_t bucket, uint64_t data_size) {
+    if ((bucket == IOTXN_BUCKET_NONE) || (bucket & 1)) {
+        // physically contiguous memory is too scarce to round up
+        return (bucket == IOTXN_BUCKET_NONE) ? data_size : ROUNDUP(data_size, PAGE_SIZE);
+    }
+    // paged vmos are only committed as they are used
+    return 1ull << ((bucket / 2) - 1 + IOTXN_CLASS_SHIFT_MIN);
 }
 
-static iotxn_t* find_in_free_list(uint32_t pflags, uint64_t data_size) {
-    bool found = false;
-    iotxn_t* txn = NULL;
-    //xprintf("find_in_free_list pflags 0x%x data_size 0x%" PRIx64 "\n", pflags, data_size);
-    mtx_lock(&free_list_mutex);
-    list_for_every_entry (&free_list, txn, iotxn_t, node) {
-        //xprintf("find_in_free_list for_every txn %p\n", txn);
-        if ((txn->pflags & pflags) && (txn->vmo_length == data_size)) {
-            found = true;
-            break;
+static iotxn_cache_t* pool_cache(bool create) {
+    iotxn_cache_t* cache = tss_get(cache_key);
+    if ((cache == NULL) && create) {
+        if ((cache = calloc(1, sizeof(iotxn_cache_t))) == NULL) {
+            return NULL;
+        }
+        if (tss_set(cache_key, cache) != thrd_success) {
+            free(cache);
+            return NULL;
+        }
+    }
+    return cache;
+}
+
+static void pool_put_shared(iotxn_priv_t* priv) {
+    iotxn_bucket_t* bucket = &buckets[priv->bucket];
+    mtx_lock(&bucket->lock);
+    list_add_head(&bucket->free_list, &priv->txn.node);
+    mtx_unlock(&bucket->lock);
+}
+
+static void pool_put(iotxn_priv_t* priv) {
+    STAT_ADD(pooled, 1);
+    STAT_ADD(pooled_bytes, priv->vmo_size);
+    iotxn_cache_t* cache = pool_cache(true);
+    if ((cache != NULL) && (cache->count[priv->bucket] < IOTXN_CACHE_DEPTH) &&
+        (cache->bytes + priv->vmo_size <= IOTXN_CACHE_BYTES)) {
+        cache->txns[priv->bucket][cache->count[priv->bucket]++] = priv;
+        cache->bytes += priv->vmo_size;
+        return;
+    }
+    pool_put_shared(priv);
+}
+
+// takes a pooled txn whose vmo holds at least 'data_size' bytes
+static iotxn_priv_t* pool_get(uint32_t bucket, uint64_t data_size) {
+    iotxn_priv_t* priv = NULL;
+    iotxn_cache_t* cache = pool_cache(false);
+    if (cache != NULL) {
+        for (uint32_t i = cache->count[bucket]; i > 0; i--) {
+            if (cache->txns[bucket][i - 1]->vmo_size >= data_size) {
+                priv = cache->txns[bucket][i - 1];
+                cache->txns[bucket][i - 1] = cache->txns[bucket][--cache->count[bucket]];
+                cache->bytes -= priv->vmo_size;
+                STAT_ADD(cache_hits, 1);
+                break;
+            }
         }
     }
-    if (found) {
-        txn->pflags &= ~IOTXN_PFLAG_FREE;
-        list_delete(&txn->node);
+    if (priv == NULL) {
+        iotxn_bucket_t* b = &buckets[bucket];
+        iotxn_t* txn;
+        mtx_lock(&b->lock);
+        list_for_every_entry (&b->free_list, txn, iotxn_t, node) {
+            if (txn_to_priv(txn)->vmo_size >= data_size) {
+                list_delete(&txn->node);
+                priv = txn_to_priv(txn);
+                break;
+            }
+        }
+        mtx_unlock(&b->lock);
+        if (priv == NULL) {
+            return NULL;
+        }
+        STAT_ADD(pool_hits, 1);
     }
-    mtx_unlock(&free_list_mutex);
-    //xprintf("find_in_free_list found %d txn %p\n", found, txn);
-    return found ? txn : NULL;
+    STAT_SUB(pooled, 1);
+    STAT_SUB(pooled_bytes, priv->vmo_size);
+    priv->txn.pflags &= ~IOTXN_PFLAG_FREE;
+    return priv;
 }
 
-// return the iotxn into the free list
-static void iotxn_release_free_list(iotxn_t* txn) {
+static bool do_free_phys(uint32_t pflags) {
+    // only free phys if we called physmap
+    return (pflags & IOTXN_PFLAG_PHYSMAP);
+}
+
+// return the iotxn into the pool
+static void iotxn_release_pool(iotxn_t* txn) {
+    iotxn_priv_t* priv = txn_to_priv(txn);
     mx_handle_t vmo_handle = txn->vmo_handle;
     uint64_t vmo_offset = txn->vmo_offset;
     uint64_t vmo_length = txn->vmo_length;
@@ -83,17 +235,32 @@ static void iotxn_release_free_list(iotxn_t* txn) {
     uint32_t pflags = txn->pflags;
 
     memset(txn, 0, sizeof(iotxn_t));
+    priv->phys_pages = 0;
+    priv->mapped = 0;
 
     if (pflags & IOTXN_PFLAG_ALLOC) {
-        // if we allocated the vmo, keep it around
+        // if we allocated the vmo, keep it around, along with its physical
+        // pages and mapping where they start at the beginning of the vmo
         txn->vmo_handle = vmo_handle;
-        txn->vmo_offset = vmo_offset;
-        txn->vmo_length = vmo_length;
-        txn->virt = virt;
-        txn->phys = phys;
-        txn->phys_offset = phys_offset;
-        txn->phys_length = phys_length;
-        txn->pflags = pflags;
+        txn->pflags = pflags & (IOTXN_PFLAG_CONTIGUOUS | IOTXN_PFLAG_ALLOC);
+        if (do_free_phys(pflags) && (phys != NULL)) {
+            if (phys_offset == 0) {
+                txn->phys = phys;
+                txn->pflags |= IOTXN_PFLAG_PHYSMAP;
+                priv->phys_pages = phys_length;
+            } else {
+                free(phys);
+            }
+        }
+        if ((pflags & IOTXN_PFLAG_MMAP) && (virt != NULL)) {
+            if (vmo_offset == 0) {
+                txn->virt = virt;
+                txn->pflags |= IOTXN_PFLAG_MMAP;
+                priv->mapped = vmo_length;
+            } else {
+                mx_vmar_unmap(mx_vmar_root_self(), (uintptr_t)virt, vmo_length);
+            }
+        }
     } else {
         if (do_free_phys(pflags)) {
             if (phys != NULL) {
@@ -109,17 +276,16 @@ static void iotxn_release_free_list(iotxn_t* txn) {
     }
 
     txn->pflags |= IOTXN_PFLAG_FREE;
-    txn->release_cb = iotxn_release_free_list;
-
-    mtx_lock(&free_list_mutex);
-    list_add_head(&free_list, &txn->node);
-    mtx_unlock(&free_list_mutex);
+    txn->release_cb = iotxn_release_pool;
+    STAT_ADD(releases, 1);
+    pool_put(priv);
 
-    xprintf("iotxn_release_free_list released txn %p\n", txn);
+    xprintf("iotxn_release_pool released txn %p\n", txn);
 }
 
 // free the iotxn
 static void iotxn_release_free(iotxn_t* txn) {
+    iotxn_priv_t* priv = txn_to_priv(txn);
     if (do_free_phys(txn->pflags)) {
         if (txn->phys != NULL) {
             free(txn->phys);
@@ -133,7 +299,34 @@ static void iotxn_release_free(iotxn_t* txn) {
     if (txn->pflags & IOTXN_PFLAG_ALLOC) {
         mx_handle_close(txn->vmo_handle);
     }
-    free(txn);
+    STAT_ADD(frees, 1);
+    free(priv);
+}
+
+// readies a txn taken from the pool for a buffer of 'data_size' bytes
+static void pool_reuse(iotxn_priv_t* priv, uint64_t data_size) {
+    iotxn_t* txn = &priv->txn;
+    txn->vmo_offset = 0;
+    txn->vmo_length = data_size;
+    if (txn->phys != NULL) {
+        // the pages are already committed and looked up, so physmap() has
+        // nothing left to do
+        uint64_t pages = (txn->pflags & IOTXN_PFLAG_CONTIGUOUS) ? 1 :
+                         ROUNDUP(data_size, PAGE_SIZE) / PAGE_SIZE;
+        if ((data_size > 0) && (pages <= priv->phys_pages)) {
+            txn->phys_offset = 0;
+            txn->phys_length = pages;
+        } else {
+            free(txn->phys);
+            txn->phys = NULL;
+            txn->pflags &= ~IOTXN_PFLAG_PHYSMAP;
+        }
+    }
+    if ((txn->virt != NULL) && (priv->mapped != data_size)) {
+        mx_vmar_unmap(mx_vmar_root_self(), (uintptr_t)txn->virt, priv->mapped);
+        txn->virt = NULL;
+        txn->pflags &= ~IOTXN_PFLAG_MMAP;
+    }
 }
 
 // releases data for a statically allocated iotxn
@@ -183,9 +376,6 @@ ssize_t iotxn_copyto(iotxn_t* txn, const void* data, size_t length, size_t offse
     return (status == NO_ERROR) ? (ssize_t)actual : status;
 }
 
-#define ROUNDUP(a, b)   (((a) + ((b)-1)) & ~((b)-1))
-#define ROUNDDOWN(a, b) ((a) & ~((b)-1))
-
 static mx_status_t iotxn_physmap_contiguous(iotxn_t* txn) {
     txn->phys = malloc(sizeof(mx_paddr_t));
     if (txn->phys == NULL) {
@@ -196,12 +386,12 @@ static mx_status_t iotxn_physmap_contiguous(iotxn_t* txn) {
     // page
     uint64_t page_offset = ROUNDDOWN(txn->vmo_offset, PAGE_SIZE);
     mx_status_t status = mx_vmo_op_range(txn->vmo_handle, MX_VMO_OP_COMMIT, page_offset, txn->vmo_length, NULL, 0);
-    if (status != NO_ERROR) {
-        return status;
+    if (status == NO_ERROR) {
+        status = mx_vmo_op_range(txn->vmo_handle, MX_VMO_OP_LOOKUP, page_offset, PAGE_SIZE, txn->phys, sizeof(mx_paddr_t));
     }
-
-    status = mx_vmo_op_range(txn->vmo_handle, MX_VMO_OP_LOOKUP, page_offset, PAGE_SIZE, txn->phys, sizeof(mx_paddr_t));
     if (status != NO_ERROR) {
+        free(txn->phys);
+        txn->phys = NULL;
         return status;
     }
 
@@ -258,6 +448,10 @@ mx_status_t iotxn_physmap(iotxn_t* txn) {
     } else {
         status = iotxn_physmap_paged(txn);
     }
+    if (status == NO_ERROR) {
+        // the scatter list is ours to free (or keep, for a pooled txn)
+        txn->pflags |= IOTXN_PFLAG_PHYSMAP;
+    }
     return status;
 }
 
@@ -281,20 +475,27 @@ mx_status_t iotxn_clone(iotxn_t* txn, iotxn_t** out) {
     // TODO if out is set, init into out
     // need to check the contiguous flag because they have preallocated space
     // for phys
-    iotxn_t* clone = find_in_free_list(txn->pflags & IOTXN_PFLAG_CONTIGUOUS, 0);
-    if (clone == NULL) {
-        clone = calloc(1, sizeof(iotxn_t));
-        if (clone == NULL) {
+    call_once(&pool_once, pool_init);
+    STAT_ADD(allocs, 1);
+    // clones share the vmo, so they come from the bucket of txns without a
+    // buffer of their own
+    uint32_t bucket = pool_bucket(0, 0);
+    iotxn_priv_t* priv = pool_get(bucket, 0);
+    if (priv == NULL) {
+        priv = calloc(1, sizeof(iotxn_priv_t));
+        if (priv == NULL) {
             return ERR_NO_MEMORY;
         }
+        priv->bucket = bucket;
     }
+    iotxn_t* clone = &priv->txn;
 
     memcpy(clone, txn, sizeof(iotxn_t));
     // the only relevant pflag for a clone is the contiguous bit
     clone->pflags = txn->pflags & IOTXN_PFLAG_CONTIGUOUS;
     clone->complete_cb = NULL;
-    // clones are always freelisted on release
-    clone->release_cb = iotxn_release_free_list;
+    // clones are always pooled on release
+    clone->release_cb = iotxn_release_pool;
 
     *out = clone;
     return NO_ERROR;
@@ -313,39 +514,52 @@ void iotxn_cacheop(iotxn_t* txn, uint32_t op, size_t offset, size_t length) {
 mx_status_t iotxn_alloc(iotxn_t** out, uint32_t alloc_flags, uint64_t data_size) {
     //xprintf("iotxn_alloc: alloc_flags 0x%x data_size 0x%" PRIx64 "\n", alloc_flags, data_size);
 
-    // look in free list first for a iotxn with data_size
-    iotxn_t* txn = find_in_free_list(alloc_flags_to_pflags(alloc_flags), data_size);
-    if (txn != NULL) {
-        //xprintf("iotxn_alloc: found iotxn with size 0x%" PRIx64 " in free list\n", data_size);
+    call_once(&pool_once, pool_init);
+    STAT_ADD(allocs, 1);
+
+    // look in the pool first for a iotxn which holds data_size
+    iotxn_t* txn;
+    uint32_t bucket = pool_bucket(alloc_flags, data_size);
+    iotxn_priv_t* priv = (bucket != IOTXN_BUCKET_NONE) ? pool_get(bucket, data_size) : NULL;
+    if (priv != NULL) {
+        //xprintf("iotxn_alloc: found iotxn with size 0x%" PRIx64 " in pool\n", data_size);
+        pool_reuse(priv, data_size);
+        txn = &priv->txn;
         goto out;
     }
 
     // didn't find one that fits, allocate a new one
-    txn = calloc(1, sizeof(iotxn_t));
-    if (!txn) {
+    priv = calloc(1, sizeof(iotxn_priv_t));
+    if (!priv) {
         return ERR_NO_MEMORY;
     }
+    txn = &priv->txn;
+    // txns without a buffer are cheap to keep, so they are always pooled
+    bool pool = (alloc_flags & IOTXN_ALLOC_POOL) || (data_size == 0);
+    priv->bucket = pool ? bucket : IOTXN_BUCKET_NONE;
+    txn->release_cb = (priv->bucket != IOTXN_BUCKET_NONE) ? iotxn_release_pool : iotxn_release_free;
     if (data_size > 0) {
         mx_status_t status;
+        priv->vmo_size = pool_vmo_size(priv->bucket, data_size);
         if (alloc_flags & IOTXN_ALLOC_CONTIGUOUS) {
-            status = mx_vmo_create_contiguous(get_root_resource(), data_size, 0, &txn->vmo_handle);
+            status = mx_vmo_create_contiguous(get_root_resource(), priv->vmo_size, 0, &txn->vmo_handle);
             txn->pflags |= IOTXN_PFLAG_CONTIGUOUS;
-            // point phys to the extra space
         } else {
-            status = mx_vmo_create(data_size, 0, &txn->vmo_handle);
+            status = mx_vmo_create(priv->vmo_size, 0, &txn->vmo_handle);
         }
         if (status != NO_ERROR) {
             xprintf("iotxn_alloc: error %d in mx_vmo_create, flags 0x%x\n", status, alloc_flags);
-            free(txn);
+            free(priv);
             return status;
         }
+        STAT_ADD(vmo_creates, 1);
         txn->vmo_offset = 0;
         txn->vmo_length = data_size;
         txn->pflags |= IOTXN_PFLAG_ALLOC;
-        if (alloc_flags & IOTXN_ALLOC_POOL) {
-            txn->release_cb = iotxn_release_free_list;
-        } else {
-            txn->release_cb = iotxn_release_free;
+        if (pool && (alloc_flags & IOTXN_ALLOC_CONTIGUOUS)) {
+            // look up the pages now, since contiguous txns are almost always
+            // physmapped, and the pool keeps the result for every later user
+            iotxn_physmap(txn);
         }
     }
 
@@ -361,6 +575,17 @@ void iotxn_queue(mx_device_t* dev, iotxn_t* txn) {
 }
 
 
+void iotxn_pool_stats(iotxn_pool_stats_t* out) {
+    out->allocs = atomic_load_explicit(&pool_stats.allocs, memory_order_relaxed);
+    out->cache_hits = atomic_load_explicit(&pool_stats.cache_hits, memory_order_relaxed);
+    out->pool_hits = atomic_load_explicit(&pool_stats.pool_hits, memory_order_relaxed);
+    out->vmo_creates = atomic_load_explicit(&pool_stats.vmo_creates, memory_order_relaxed);
+    out->releases = atomic_load_explicit(&pool_stats.releases, memory_order_relaxed);
+    out->frees = atomic_load_explicit(&pool_stats.frees, memory_order_relaxed);
+    out->pooled = atomic_load_explicit(&pool_stats.pooled, memory_order_relaxed);
+    out->pooled_bytes = atomic_load_explicit(&pool_stats.pooled_bytes, memory_order_relaxed);
+}
+
 void iotxn_init(iotxn_t* txn, mx_handle_t vmo_handle, uint64_t vmo_offset, uint64_t length) {
     memset(txn, 0, sizeof(*txn));
     txn->vmo_handle = vmo_handle;
@@ -0,0 +1,240 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <string.h>
+#include <threads.h>
+
+#include <magenta/thread_annotations.h>
+#include <mxtl/auto_lock.h>
+#include <mxtl/intrusive_double_list.h>
+
+#include "vfs-internal.h"
+
+// Lookups are cached by parent vnode and name, for names which exist and
+// for names which do not.  A dentry for a name which exists holds a
+// reference on the child, so that the child stays what the name resolves
+// to; the parent is not referenced, but dentries under it are dropped
+// when the parent itself is released.  Vfs::Lookup() only caches names
+// which resolve to directories, so that the cache never keeps closed
+// files, and whatever data they have loaded, in memory.
+//
+// Every change to a name in a directory must be reported through
+// Vfs::InvalidateLookup().  The generic Vfs calls do this themselves;
+// filesystems which add or remove names on their own (like devfs) must do
+// it too.  A lookup which races with an invalidation of the same bucket
+// is not cached.
+
+namespace fs {
+namespace {
+
+constexpr size_t kDentryCacheSize = 1024;
+constexpr size_t kDentryBuckets = 256;
+// Longer names are looked up every time.
+constexpr size_t kDentryNameMax = 63;
+// Releases are batched up to this many at a time, outside the lock.
+constexpr size_t kDentryReleaseBatch = 32;
+
+} // namespace anonymous
+
+struct Dentry {
+    using NodeState = mxtl::DoublyLinkedListNodeState<Dentry*>;
+    struct BucketTraits {
+        static NodeState& node_state(Dentry& de) { return de.bucket_state; }
+    };
+    struct LruTraits {
+        static NodeState& node_state(Dentry& de) { return de.lru_state; }
+    };
+
+    NodeState bucket_state;
+    NodeState lru_state;
+    // nullptr while the dentry is unused
+    Vnode* parent;
+    // holds a reference; nullptr if the name does not exist
+    Vnode* child;
+    uint32_t hash;
+    size_t len;
+    char name[kDentryNameMax];
+};
+
+namespace {
+
+using BucketList = mxtl::DoublyLinkedList<Dentry*, Dentry::BucketTraits>;
+using LruList = mxtl::DoublyLinkedList<Dentry*, Dentry::LruTraits>;
+
+mtx_t dcache_lock = MTX_INIT;
+Dentry dcache_dentries[kDentryCacheSize] TA_GUARDED(dcache_lock);
+BucketList dcache_buckets[kDentryBuckets] TA_GUARDED(dcache_lock);
+// bumped whenever a name in the bucket is invalidated
+uint32_t dcache_bucket_seq[kDentryBuckets] TA_GUARDED(dcache_lock);
+// most recently used at the front, unused dentries at the back
+LruList dcache_lru TA_GUARDED(dcache_lock);
+bool dcache_ready TA_GUARDED(dcache_lock) = false;
+
+bool dcache_cacheable(const char* name, size_t len) {
+    if ((len == 0) || (len > kDentryNameMax)) {
+        return false;
+    }
+    // "." and ".." are resolved by the filesystems themselves
+    if ((name[0] == '.') && ((len == 1) || ((len == 2) && (name[1] == '.')))) {
+        return false;
+    }
+    return true;
+}
+
+uint32_t dcache_hash(Vnode* parent, const char* name, size_t len) {
+    uint32_t hash = 2166136261u;
+    uintptr_t p = reinterpret_cast<uintptr_t>(parent);
+    for (size_t i = 0; i < sizeof(p); i++) {
+        hash = (hash ^ static_cast<uint8_t>(p >> (i * 8))) * 16777619u;
+    }
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ static_cast<uint8_t>(name[i])) * 16777619u;
+    }
+    return hash;
+}
+
+void dcache_init_locked() TA_REQ(dcache_lock) {
+    if (!dcache_ready) {
+        for (size_t i = 0; i < kDentryCacheSize; i++) {
+            dcache_lru.push_back(&dcache_dentries[i]);
+        }
+        dcache_ready = true;
+    }
+}
+
+Dentry* dcache_find_locked(Vnode* parent, const char* name, size_t len,
+                           uint32_t hash) TA_REQ(dcache_lock) {
+    for (auto& de : dcache_buckets[hash % kDentryBuckets]) {
+        if ((de.parent == parent) && (de.hash == hash) && (de.len == len) &&
+            !memcmp(de.name, name, len)) {
+            return &de;
+        }
+    }
+    return nullptr;
+}
+
+} // namespace anonymous
+
+// Unhooks a dentry and moves it to the back of the LRU for reuse.  Returns
+// the child reference it held, for the caller to release once the lock is
+// dropped, since that may release the last reference and purge again.
+Vnode* DentryCache::RemoveLocked(Dentry* de) {
+    Vnode* child = de->child;
+    dcache_buckets[de->hash % kDentryBuckets].erase(*de);
+    dcache_lru.erase(*de);
+    dcache_lru.push_back(de);
+    de->parent->dentry_count_.fetch_sub(1, mxtl::memory_order_relaxed);
+    de->parent = nullptr;
+    de->child = nullptr;
+    return child;
+}
+
+bool DentryCache::Lookup(Vnode* vndir, const char* name, size_t len,
+                         Vnode** out, mx_status_t* status, uint32_t* seq) {
+    if (!dcache_cacheable(name, len)) {
+        return false;
+    }
+    uint32_t hash = dcache_hash(vndir, name, len);
+
+    mxtl::AutoLock lock(&dcache_lock);
+    Dentry* de = dcache_find_locked(vndir, name, len, hash);
+    if (de == nullptr) {
+        *seq = dcache_bucket_seq[hash % kDentryBuckets];
+        return false;
+    }
+    dcache_lru.erase(*de);
+    dcache_lru.push_front(de);
+    if (de->child == nullptr) {
+        *status = ERR_NOT_FOUND;
+    } else {
+        de->child->RefAcquire();
+        *out = de->child;
+        *status = NO_ERROR;
+    }
+    return true;
+}
+
+void DentryCache::Insert(Vnode* vndir, const char* name, size_t len, Vnode* vn, uint32_t seq) {
+    if (!dcache_cacheable(name, len)) {
+        return;
+    }
+    uint32_t hash = dcache_hash(vndir, name, len);
+    Vnode* victim = nullptr;
+    {
+        mxtl::AutoLock lock(&dcache_lock);
+        if ((dcache_bucket_seq[hash % kDentryBuckets] != seq) ||
+            (dcache_find_locked(vndir, name, len, hash) != nullptr)) {
+            // invalidated since the lookup, or cached by another thread
+            return;
+        }
+        dcache_init_locked();
+        Dentry* de = &dcache_lru.back();
+        if (de->parent != nullptr) {
+            victim = RemoveLocked(de);
+        }
+        dcache_lru.erase(*de);
+        dcache_lru.push_front(de);
+        dcache_buckets[hash % kDentryBuckets].push_front(de);
+        vndir->dentry_count_.fetch_add(1, mxtl::memory_order_relaxed);
+        if (vn != nullptr) {
+            vn->RefAcquire();
+        }
+        de->parent = vndir;
+        de->child = vn;
+        de->hash = hash;
+        de->len = len;
+        memcpy(de->name, name, len);
+    }
+    if (victim != nullptr) {
+        victim->RefRelease();
+    }
+}
+
+void DentryCache::Invalidate(Vnode* vndir, const char* name, size_t len) {
+    if (!dcache_cacheable(name, len)) {
+        return;
+    }
+    uint32_t hash = dcache_hash(vndir, name, len);
+    Vnode* child = nullptr;
+    {
+        mxtl::AutoLock lock(&dcache_lock);
+        dcache_bucket_seq[hash % kDentryBuckets]++;
+        Dentry* de = dcache_find_locked(vndir, name, len, hash);
+        if (de != nullptr) {
+            child = RemoveLocked(de);
+        }
+    }
+    if (child != nullptr) {
+        child->RefRelease();
+    }
+}
+
+void DentryCache::Purge(Vnode* vndir) {
+    Vnode* children[kDentryReleaseBatch];
+    size_t count;
+    do {
+        count = 0;
+        {
+            mxtl::AutoLock lock(&dcache_lock);
+            for (size_t i = 0; i < kDentryCacheSize; i++) {
+                Dentry* de = &dcache_dentries[i];
+                if (de->parent != vndir) {
+                    continue;
+                }
+                if (count == kDentryReleaseBatch) {
+                    break;
+                }
+                Vnode* child = RemoveLocked(de);
+                if (child != nullptr) {
+                    children[count++] = child;
+                }
+            }
+        }
+        for (size_t i = 0; i < count; i++) {
+            children[i]->RefRelease();
+        }
+    } while (count == kDentryReleaseBatch);
+}
+
+} // namespace fs
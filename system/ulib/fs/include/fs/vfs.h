@@ -24,11 +24,12 @@
 
 // VFS Helpers (vfs.c)
 #define V_FLAG_DEVICE                 1
-#define V_FLAG_MOUNT_READY            2
 #define V_FLAG_RESERVED_MASK 0x0000FFFF
 
 #ifdef __cplusplus
 
+#include <mxtl/atomic.h>
+
 namespace fs {
 
 #include <mxtl/macros.h>
@@ -38,11 +39,16 @@ namespace fs {
 //
 // The ops are used for dispatch and the refcount
 // is used by the generic RefAcquire and RefRelease.
+// The refcount is atomic, so a vnode may be acquired and released
+// from several dispatcher threads without holding any lock; anything
+// else a filesystem keeps in its vnodes is its own to guard.
 //
 // The lower half of flags (V_FLAG_RESERVED_MASK) is reserved
 // for usage by fs::Vnode, but the upper half of flags may
 // be used by subclasses of Vnode.
 
+class DentryCache;
+
 class Vnode {
 public:
     void RefAcquire();
@@ -60,6 +66,13 @@ public:
     //  - Returns the number of handles acquired.
     virtual mx_status_t GetHandles(uint32_t flags, mx_handle_t* hnds,
                                    uint32_t* type, void* extra, uint32_t* esize) = 0;
+
+    // Returns a vmo holding the contents of vn from off for len bytes, with
+    // rights to suit the MXIO_MMAP_FLAG_* flags, and updates off to where
+    // that content begins within the vmo.
+    virtual mx_status_t Mmap(uint32_t flags, size_t len, size_t* off, mx_handle_t* out) {
+        return ERR_NOT_SUPPORTED;
+    }
 #endif
 
     virtual mx_status_t IoctlWatchDir(const void* in_buf, size_t in_len, void* out_buf, size_t out_len) {
@@ -165,33 +178,44 @@ public:
     virtual ~Vnode() {};
 
     // The vnode is acting as a mount point for a remote filesystem or device.
-    bool IsRemote() const { return remote_ > 0; }
+    bool IsRemote() const;
     // The vnode is a device. Devices may opt to reveal themselves as directories
     // or endpoints, depending on context. For the purposes of our VFS layer,
     // during path traversal, devices are NOT treated as mount points, even though
     // they contain remote handles.
     bool IsDevice() const { return (flags_ & V_FLAG_DEVICE) && IsRemote(); }
     // The vnode is "open elsewhere".
-    bool IsBusy() const { return refcount_ > 1; }
+    bool IsBusy() const { return refcount_.load(mxtl::memory_order_relaxed) > 1; }
 
-    mx_handle_t DetachRemote() {
-        mx_handle_t h = remote_;
-        remote_ = MX_HANDLE_INVALID;
-        flags_ &= ~V_FLAG_MOUNT_READY;
-        return h;
-    }
+    // Removes the remote handle and returns it to the caller, who owns it.
+    mx_handle_t DetachRemote();
 
-    // TODO(smklein): Encapsulate the "remote_" flag more, here and in "GetHandles",
-    // so we can avoid leaking information outside the Vnode / Vfs classes.
+    // Waits for the remote filesystem to be mounted, and returns a duplicate
+    // of its handle, for the caller to use and close; the remote may be
+    // unmounted and its handle closed at any time.
     mx_handle_t WaitForRemote();
 protected:
     DISALLOW_COPY_ASSIGN_AND_MOVE(Vnode);
-    Vnode() : flags_(0), remote_(MX_HANDLE_INVALID), refcount_(1) {};
+    Vnode() : flags_(0), remote_(MX_HANDLE_INVALID), remote_ready_(false), refcount_(1),
+              dentry_count_(0) {};
+
+    // Installs h as the remote handle, unless there is one already.
+    mx_status_t SetRemote(mx_handle_t h);
+    // Returns a duplicate of the remote handle, for the caller to close.
+    mx_handle_t CloneRemote() const;
 
     uint32_t flags_;
-    mx_handle_t remote_;
 private:
-    uint32_t refcount_;
+    // Mounting and unmounting change these while paths are walked, so they
+    // are only touched with the vfs remote_lock held.
+    mx_handle_t remote_;
+    bool remote_ready_;
+
+    friend class DentryCache;
+
+    mxtl::atomic<uint32_t> refcount_;
+    // number of cached lookups in this directory
+    mxtl::atomic<uint32_t> dentry_count_;
 };
 
 struct Vfs {
@@ -202,6 +226,11 @@ struct Vfs {
     // the underlying filesystem functions (lookup, create, open).
     static mx_status_t Open(Vnode* vn, Vnode** out, const char* path, const char** pathout,
                             uint32_t flags, uint32_t mode);
+    // Look up a single name in vndir, through the cache of earlier lookups.
+    static mx_status_t Lookup(Vnode* vndir, Vnode** out, const char* name, size_t len);
+    // Forget whatever lookup of name in vndir was cached.  Filesystems which
+    // add or remove names other than through Vfs must call this.
+    static void InvalidateLookup(Vnode* vndir, const char* name, size_t len);
     static mx_status_t Unlink(Vnode* vn, const char* path, size_t len);
     static mx_status_t Link(Vnode* oldparent, Vnode* newparent,
                             const char* oldname, const char* newname);
@@ -240,7 +269,10 @@ typedef struct vdircookie {
     void* p;
 } vdircookie_t;
 
-// A lock which should be used to protect lookup and walk operations
+// Guards the vnode cookies behind iostate tokens, so that a token
+// cannot be resolved to a vnode while its connection is closing.
+// Filesystems lock their own namespaces; vfs_lock is never held
+// across a call into a Vnode.
 #ifdef __Fuchsia__
 extern mtx_t vfs_lock;
 #endif
@@ -273,4 +305,9 @@ mx_status_t vfs_uninstall_all(mx_time_t timeout);
 // Generic implementation of vfs_handler, which dispatches messages to fs operations.
 mx_status_t vfs_handler_generic(mxrio_msg_t* msg, mx_handle_t rh, void* cookie);
 
+// Counts a change to the names or attributes in this filesystem, so that
+// clients caching them (see IOCTL_DEVMGR_GET_GENERATION) drop what they
+// have. Must be called once the change is visible, not before.
+void vfs_notify_change(void);
+
 __END_CDECLS
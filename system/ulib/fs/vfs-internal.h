@@ -28,4 +28,36 @@
 
 #ifndef __Fuchsia__
 #define O_NOREMOTE 0100000000
+#define O_NOXDEV   0200000000
+#endif
+
+#ifdef __Fuchsia__
+namespace fs {
+
+// Guards the list of mounted remotes, and each vnode's remote handle and
+// whether it is ready.  Nothing else is done while it is held.
+extern mtx_t remote_lock;
+
+struct Dentry;
+
+// The cache of lookups behind Vfs::Lookup, keyed by parent vnode and name.
+class DentryCache {
+public:
+    // Returns true if the lookup is cached, with *out acquired if the
+    // name exists.  Otherwise fills in *seq, to be passed to Insert().
+    static bool Lookup(Vnode* vndir, const char* name, size_t len,
+                       Vnode** out, mx_status_t* status, uint32_t* seq);
+    // Caches the result of a lookup, vn being nullptr if the name does not
+    // exist, unless the name was invalidated since seq was read.  A
+    // reference is held on vn for as long as it is cached.
+    static void Insert(Vnode* vndir, const char* name, size_t len, Vnode* vn, uint32_t seq);
+    static void Invalidate(Vnode* vndir, const char* name, size_t len);
+    // Drops every lookup cached in vndir, which is being released.
+    static void Purge(Vnode* vndir);
+
+private:
+    static Vnode* RemoveLocked(Dentry* de);
+};
+
+} // namespace fs
 #endif
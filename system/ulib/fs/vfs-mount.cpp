@@ -63,7 +63,13 @@ private:
 //
 // This comment serves as a warning: If this variable ends up using
 // non-constexpr ctors, it should no longer be a static global variable.
-static MountNode::ListType remote_list TA_GUARDED(vfs_lock);
+//
+// The list is only touched when mounting and unmounting.  Path walks find
+// mount points through the vnodes themselves, but the same lock guards
+// each vnode's remote handle, so a walk never sees one half mounted or
+// half unmounted; the walk duplicates the handle before letting go.
+mtx_t remote_lock = MTX_INIT;
+static MountNode::ListType remote_list TA_GUARDED(remote_lock);
 
 // Installs a remote filesystem on vn and adds it to the remote_list.
 mx_status_t Vfs::InstallRemote(Vnode* vn, mx_handle_t h) {
@@ -83,8 +89,11 @@ mx_status_t Vfs::InstallRemote(Vnode* vn, mx_handle_t h) {
     }
     // Save this node in the list of mounted vnodes
     mount_point->SetNode(mxtl::move(vn));
-    mxtl::AutoLock lock(&vfs_lock);
-    remote_list.push_front(mxtl::move(mount_point));
+    {
+        mxtl::AutoLock lock(&remote_lock);
+        remote_list.push_front(mxtl::move(mount_point));
+    }
+    vfs_notify_change();
     return NO_ERROR;
 }
 
@@ -93,7 +102,7 @@ mx_status_t Vfs::InstallRemote(Vnode* vn, mx_handle_t h) {
 mx_status_t Vfs::UninstallRemote(Vnode* vn, mx_handle_t* h) {
     mxtl::unique_ptr<MountNode> mount_point;
     {
-        mxtl::AutoLock lock(&vfs_lock);
+        mxtl::AutoLock lock(&remote_lock);
         mount_point = remote_list.erase_if([&vn](const MountNode& node) {
             return node.VnodeMatch(vn);
         });
@@ -102,6 +111,7 @@ mx_status_t Vfs::UninstallRemote(Vnode* vn, mx_handle_t* h) {
         }
     }
     *h = mount_point->ReleaseRemote();
+    vfs_notify_change();
     return NO_ERROR;
 }
 
@@ -113,7 +123,7 @@ mx_status_t vfs_uninstall_all(mx_time_t timeout) {
     mxtl::unique_ptr<fs::MountNode> mount_point;
     for (;;) {
         {
-            mxtl::AutoLock lock(&vfs_lock);
+            mxtl::AutoLock lock(&fs::remote_lock);
             mount_point = fs::remote_list.pop_front();
         }
         if (mount_point) {
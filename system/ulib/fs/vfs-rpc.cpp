@@ -9,6 +9,7 @@
 #include <sys/stat.h>
 #include <threads.h>
 
+#include <magenta/new.h>
 #include <magenta/process.h>
 #include <mxio/debug.h>
 #include <mxio/dispatcher.h>
@@ -16,15 +17,25 @@
 #include <mxio/remoteio.h>
 #include <mxio/vfs.h>
 #include <mxtl/auto_call.h>
+#include <mxtl/algorithm.h>
 #include <mxtl/auto_lock.h>
+#include <mxtl/unique_ptr.h>
 
 #include "vfs-internal.h"
 
 #define MXDEBUG 0
 
+#define CAN_WRITE(ios) ((((ios)->io_flags & O_ACCMODE) == O_RDWR) || \
+                        (((ios)->io_flags & O_ACCMODE) == O_WRONLY))
+#define CAN_READ(ios) ((((ios)->io_flags & O_ACCMODE) == O_RDWR) || \
+                       (((ios)->io_flags & O_ACCMODE) == O_RDONLY))
+
 namespace fs {
 namespace {
 
+// READ_VMO and WRITE_VMO move data through a buffer of this size.
+constexpr size_t kVmoIoChunkSize = 64 * 1024;
+
 void txn_handoff_open(mx_handle_t srv, mx_handle_t rh,
                       const char* path, uint32_t flags, uint32_t mode) {
     mxrio_msg_t msg;
@@ -51,13 +62,7 @@ void vfs_rpc_open(mxrio_msg_t* msg, mx_handle_t rh, fs::Vnode* vn, const char* p
     mxrio_object_t obj;
     memset(&obj, 0, sizeof(obj));
 
-    mx_status_t r;
-
-    {
-        mxtl::AutoLock lock(&vfs_lock);
-        r = Vfs::Open(vn, &vn, path, &path, flags, mode);
-    }
-
+    mx_status_t r = Vfs::Open(vn, &vn, path, &path, flags, mode);
     if (r < 0) {
         xprintf("vfs: open: r=%d\n", r);
         goto done;
@@ -67,6 +72,7 @@ void vfs_rpc_open(mxrio_msg_t* msg, mx_handle_t rh, fs::Vnode* vn, const char* p
         //      eliminate vfs_get_handles() and the other
         //      reply pipe path
         txn_handoff_open(r, rh, path, flags, mode);
+        mx_handle_close(r);
         return;
     }
 
@@ -75,10 +81,16 @@ void vfs_rpc_open(mxrio_msg_t* msg, mx_handle_t rh, fs::Vnode* vn, const char* p
         vn->Close();
         goto done;
     }
-    if (obj.type == 0) {
+    if ((obj.type == 0) && (flags & O_NOXDEV)) {
+        mx_handle_close(obj.handle[0]);
+        vn->RefRelease();
+        r = ERR_UNAVAILABLE;
+        goto done;
+    } else if (obj.type == 0) {
         // device is non-local, handle is the server that
         // can clone it for us, redirect the rpc to there
         txn_handoff_open(obj.handle[0], rh, ".", flags, mode);
+        mx_handle_close(obj.handle[0]);
         vn->RefRelease();
         return;
     }
@@ -97,6 +109,55 @@ done:
     mx_handle_close(rh);
 }
 
+// Moves len bytes between vn at off and the start of vmo, staged through
+// a buffer of our own a chunk at a time.  The client's vmo is only read
+// or written within the bounds of the request; it is never mapped, so it
+// cannot be resized or decommitted under the filesystem.  Returns the
+// bytes moved, or the error if none were.
+ssize_t vfs_vmo_io(Vnode* vn, bool read, mx_handle_t vmo, size_t len, size_t off) {
+    if (len == 0) {
+        return 0;
+    }
+
+    size_t bufsize = mxtl::min(len, kVmoIoChunkSize);
+    AllocChecker ac;
+    mxtl::unique_ptr<uint8_t[]> buf(new (&ac) uint8_t[bufsize]);
+    if (!ac.check()) {
+        return ERR_NO_MEMORY;
+    }
+
+    size_t count = 0;
+    ssize_t r = 0;
+    while (count < len) {
+        size_t xfer = mxtl::min(len - count, bufsize);
+        size_t actual;
+        mx_status_t status;
+        if (read) {
+            if ((r = vn->Read(buf.get(), xfer, off + count)) <= 0) {
+                break;
+            }
+            status = mx_vmo_write(vmo, buf.get(), count, r, &actual);
+            if ((status == NO_ERROR) && (actual != static_cast<size_t>(r))) {
+                status = ERR_IO;
+            }
+        } else {
+            status = mx_vmo_read(vmo, buf.get(), count, xfer, &actual);
+            if ((status == NO_ERROR) && (actual != xfer)) {
+                status = ERR_IO;
+            }
+            if ((status == NO_ERROR) && ((r = vn->Write(buf.get(), xfer, off + count)) <= 0)) {
+                break;
+            }
+        }
+        if (status != NO_ERROR) {
+            r = status;
+            break;
+        }
+        count += r;
+    }
+    return count ? static_cast<ssize_t>(count) : r;
+}
+
 // Consumes rh.
 void mxrio_reply_channel_status(mx_handle_t rh, mx_status_t status) {
     struct {
@@ -226,6 +287,9 @@ mx_status_t vfs_handler_generic(mxrio_msg_t* msg, mx_handle_t rh, void* cookie)
         return ERR_DISPATCHER_INDIRECT;
     }
     case MXRIO_READ: {
+        if (!CAN_READ(ios)) {
+            return ERR_ACCESS_DENIED;
+        }
         ssize_t r = vn->Read(msg->data, arg, ios->io_off);
         if (r >= 0) {
             ios->io_off += r;
@@ -235,6 +299,9 @@ mx_status_t vfs_handler_generic(mxrio_msg_t* msg, mx_handle_t rh, void* cookie)
         return static_cast<mx_status_t>(r);
     }
     case MXRIO_READ_AT: {
+        if (!CAN_READ(ios)) {
+            return ERR_ACCESS_DENIED;
+        }
         ssize_t r = vn->Read(msg->data, arg, msg->arg2.off);
         if (r >= 0) {
             msg->datalen = static_cast<uint32_t>(r);
@@ -242,6 +309,9 @@ mx_status_t vfs_handler_generic(mxrio_msg_t* msg, mx_handle_t rh, void* cookie)
         return static_cast<mx_status_t>(r);
     }
     case MXRIO_WRITE: {
+        if (!CAN_WRITE(ios)) {
+            return ERR_ACCESS_DENIED;
+        }
         if (ios->io_flags & O_APPEND) {
             vnattr_t attr;
             mx_status_t r;
@@ -254,11 +324,51 @@ mx_status_t vfs_handler_generic(mxrio_msg_t* msg, mx_handle_t rh, void* cookie)
         if (r >= 0) {
             ios->io_off += r;
             msg->arg2.off = ios->io_off;
+            vfs_notify_change();
         }
         return static_cast<mx_status_t>(r);
     }
     case MXRIO_WRITE_AT: {
+        if (!CAN_WRITE(ios)) {
+            return ERR_ACCESS_DENIED;
+        }
         ssize_t r = vn->Write(msg->data, len, msg->arg2.off);
+        if (r >= 0) {
+            vfs_notify_change();
+        }
+        return static_cast<mx_status_t>(r);
+    }
+    case MXRIO_READ_VMO:
+    case MXRIO_WRITE_VMO: {
+        bool read = (MXRIO_OP(msg->op) == MXRIO_READ_VMO);
+        mx_handle_t vmo = msg->handle[0];
+        ssize_t r;
+        if (read ? !CAN_READ(ios) : !CAN_WRITE(ios)) {
+            r = ERR_ACCESS_DENIED;
+        } else if ((arg < 0) || ((msg->arg2.off < 0) && (msg->arg2.off != MXRIO_OFF_SEEK))) {
+            r = ERR_INVALID_ARGS;
+        } else {
+            bool seek = (msg->arg2.off == MXRIO_OFF_SEEK);
+            r = NO_ERROR;
+            if (!read && seek && (ios->io_flags & O_APPEND)) {
+                vnattr_t attr;
+                if ((r = vn->Getattr(&attr)) >= 0) {
+                    ios->io_off = attr.size;
+                }
+            }
+            if (r >= 0) {
+                size_t off = seek ? ios->io_off : static_cast<size_t>(msg->arg2.off);
+                r = fs::vfs_vmo_io(vn, read, vmo, arg, off);
+            }
+            if ((r >= 0) && seek) {
+                ios->io_off += r;
+            }
+            if ((r >= 0) && !read) {
+                vfs_notify_change();
+            }
+            msg->arg2.off = seek ? ios->io_off : 0;
+        }
+        mx_handle_close(vmo);
         return static_cast<mx_status_t>(r);
     }
     case MXRIO_SEEK: {
@@ -330,6 +440,9 @@ mx_status_t vfs_handler_generic(mxrio_msg_t* msg, mx_handle_t rh, void* cookie)
     }
     case MXRIO_SETATTR: {
         mx_status_t r = vn->Setattr((vnattr_t*)msg->data);
+        if (r == NO_ERROR) {
+            vfs_notify_change();
+        }
         return r;
     }
     case MXRIO_READDIR: {
@@ -339,11 +452,7 @@ mx_status_t vfs_handler_generic(mxrio_msg_t* msg, mx_handle_t rh, void* cookie)
         if (msg->arg2.off == READDIR_CMD_RESET) {
             memset(&ios->dircookie, 0, sizeof(ios->dircookie));
         }
-        mx_status_t r;
-        {
-            mxtl::AutoLock lock(&vfs_lock);
-            r = vn->Readdir(&ios->dircookie, msg->data, arg);
-        }
+        mx_status_t r = vn->Readdir(&ios->dircookie, msg->data, arg);
         if (r >= 0) {
             msg->datalen = r;
         }
@@ -427,7 +536,11 @@ mx_status_t vfs_handler_generic(mxrio_msg_t* msg, mx_handle_t rh, void* cookie)
         if (msg->arg2.off < 0) {
             return ERR_INVALID_ARGS;
         }
-        return vn->Truncate(msg->arg2.off);
+        mx_status_t r = vn->Truncate(msg->arg2.off);
+        if (r == NO_ERROR) {
+            vfs_notify_change();
+        }
+        return r;
     }
     case MXRIO_RENAME:
     case MXRIO_LINK: {
@@ -451,30 +564,65 @@ mx_status_t vfs_handler_generic(mxrio_msg_t* msg, mx_handle_t rh, void* cookie)
 
         mx_status_t r;
         uint64_t vcookie;
+        Vnode* target_parent;
+        {
+            // Hold a ref on the target so the operation itself runs
+            // unlocked; the token's connection may close meanwhile.
+            mxtl::AutoLock lock(&vfs_lock);
+            if ((r = mx_object_get_cookie(msg->handle[0], mx_process_self(), &vcookie)) < 0) {
+                // TODO(smklein): Return a more specific error code for "token not from this server"
+                return ERR_INVALID_ARGS;
+            }
 
-        mxtl::AutoLock lock(&vfs_lock);
-        if ((r = mx_object_get_cookie(msg->handle[0], mx_process_self(), &vcookie)) < 0) {
-            // TODO(smklein): Return a more specific error code for "token not from this server"
-            return ERR_INVALID_ARGS;
-        }
+            if (vcookie == 0) {
+                // Client closed the channel associated with the token
+                return ERR_INVALID_ARGS;
+            }
 
-        if (vcookie == 0) {
-            // Client closed the channel associated with the token
-            return ERR_INVALID_ARGS;
+            target_parent = reinterpret_cast<Vnode*>(vcookie);
+            target_parent->RefAcquire();
         }
 
-        Vnode* target_parent = reinterpret_cast<Vnode*>(vcookie);
         switch (MXRIO_OP(msg->op)) {
         case MXRIO_RENAME:
-            return fs::Vfs::Rename(vn, target_parent, oldname, newname);
+            r = fs::Vfs::Rename(vn, target_parent, oldname, newname);
+            break;
         case MXRIO_LINK:
-            return fs::Vfs::Link(vn, target_parent, oldname, newname);
+            r = fs::Vfs::Link(vn, target_parent, oldname, newname);
+            break;
+        default:
+            assert(false);
         }
-        assert(false);
+        target_parent->RefRelease();
+        return r;
     }
     case MXRIO_SYNC: {
         return vn->Sync();
     }
+    case MXRIO_MMAP: {
+        uint64_t size;
+        if ((len != sizeof(size)) || (msg->arg2.off < 0)) {
+            return ERR_INVALID_ARGS;
+        }
+        memcpy(&size, msg->data, sizeof(size));
+        if ((size == 0) || (size > static_cast<uint64_t>(INT64_MAX - msg->arg2.off))) {
+            return ERR_INVALID_ARGS;
+        }
+        uint32_t flags = static_cast<uint32_t>(arg);
+        // every mapping reads the file, and a writable one needs a
+        // writable fd, private or not
+        if (((ios->io_flags & O_ACCMODE) == O_WRONLY) ||
+            ((flags & MXIO_MMAP_FLAG_WRITE) && ((ios->io_flags & O_ACCMODE) == O_RDONLY))) {
+            return ERR_ACCESS_DENIED;
+        }
+        size_t off = static_cast<size_t>(msg->arg2.off);
+        mx_status_t r = vn->Mmap(flags, static_cast<size_t>(size), &off, &msg->handle[0]);
+        if (r == NO_ERROR) {
+            msg->hcount = 1;
+            msg->arg2.off = static_cast<int64_t>(off);
+        }
+        return r;
+    }
     case MXRIO_UNLINK:
         return fs::Vfs::Unlink(vn, (const char*)msg->data, len);
     default:
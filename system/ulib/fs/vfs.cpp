@@ -3,7 +3,13 @@
 // found in the LICENSE file.
 
 #ifdef __Fuchsia__
+#include <limits.h>
+#include <magenta/process.h>
 #include <magenta/syscalls.h>
+#include <magenta/thread_annotations.h>
+#include <mxtl/atomic.h>
+#include <mxtl/auto_lock.h>
+#include <threads.h>
 #endif
 
 #include <mxio/dispatcher.h>
@@ -43,27 +49,119 @@ mx_status_t vfs_name_trim(const char* name, size_t len, size_t* len_out, bool* d
     return NO_ERROR;
 }
 
+#ifdef __Fuchsia__
+// The generation count lives at the start of a vmo which clients map
+// read-only. It is only made once some client asks for it; until then
+// there is nothing to count.
+mtx_t generation_lock = MTX_INIT;
+mx_handle_t generation_vmo TA_GUARDED(generation_lock) = MX_HANDLE_INVALID;
+mxtl::atomic<uintptr_t> generation_addr(0);
+
+mx_status_t vfs_get_generation(mx_handle_t* out) {
+    mxtl::AutoLock lock(&generation_lock);
+    mx_status_t r;
+    if (generation_vmo == MX_HANDLE_INVALID) {
+        mx_handle_t vmo;
+        uintptr_t addr;
+        if ((r = mx_vmo_create(PAGE_SIZE, 0, &vmo)) != NO_ERROR) {
+            return r;
+        }
+        if ((r = mx_vmar_map(mx_vmar_root_self(), 0, vmo, 0, PAGE_SIZE,
+                             MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE, &addr)) != NO_ERROR) {
+            mx_handle_close(vmo);
+            return r;
+        }
+        generation_vmo = vmo;
+        generation_addr.store(addr, mxtl::memory_order_release);
+    }
+    return mx_handle_duplicate(generation_vmo, MX_RIGHT_READ | MX_RIGHT_MAP |
+                               MX_RIGHT_DUPLICATE | MX_RIGHT_TRANSFER, out);
+}
+#endif
+
 } // namespace anonymous
 
+bool Vnode::IsRemote() const {
+#ifdef __Fuchsia__
+    mxtl::AutoLock lock(&remote_lock);
+#endif
+    return remote_ > 0;
+}
+
+mx_status_t Vnode::SetRemote(mx_handle_t h) {
+#ifdef __Fuchsia__
+    mxtl::AutoLock lock(&remote_lock);
+    if (remote_ > 0) {
+        return ERR_ALREADY_BOUND;
+    }
+    remote_ = h;
+    remote_ready_ = false;
+    return NO_ERROR;
+#else
+    return ERR_NOT_SUPPORTED;
+#endif
+}
+
+mx_handle_t Vnode::DetachRemote() {
+#ifdef __Fuchsia__
+    mxtl::AutoLock lock(&remote_lock);
+#endif
+    mx_handle_t h = remote_;
+    remote_ = MX_HANDLE_INVALID;
+    remote_ready_ = false;
+    return h;
+}
+
+mx_handle_t Vnode::CloneRemote() const {
+#ifdef __Fuchsia__
+    mxtl::AutoLock lock(&remote_lock);
+    if (remote_ <= 0) {
+        return ERR_UNAVAILABLE;
+    }
+    mx_handle_t h;
+    mx_status_t status = mx_handle_duplicate(remote_, MX_RIGHT_SAME_RIGHTS, &h);
+    return (status != NO_ERROR) ? status : h;
+#else
+    return ERR_NOT_SUPPORTED;
+#endif
+}
+
 // Access the remote handle if it's ready -- otherwise, return an error.
 mx_handle_t Vnode::WaitForRemote() {
 #ifdef __Fuchsia__
-    if (remote_ == 0) {
-        // Trying to get remote on a non-remote vnode
-        return ERR_UNAVAILABLE;
-    } else if (!(flags_ & V_FLAG_MOUNT_READY)) {
+    mx_handle_t remote;
+    mx_handle_t h;
+    bool ready;
+    {
+        mxtl::AutoLock lock(&remote_lock);
+        remote = remote_;
+        if (remote <= 0) {
+            // Trying to get remote on a non-remote vnode
+            return ERR_UNAVAILABLE;
+        }
+        mx_status_t status = mx_handle_duplicate(remote_, MX_RIGHT_SAME_RIGHTS, &h);
+        if (status != NO_ERROR) {
+            return status;
+        }
+        ready = remote_ready_;
+    }
+    if (!ready) {
+        // Wait on our own duplicate, without the lock, so that the remote
+        // may be unmounted meanwhile.
         mx_signals_t observed;
-        mx_status_t status = mx_object_wait_one(remote_,
-                                                MX_USER_SIGNAL_0 | MX_CHANNEL_PEER_CLOSED,
-                                                0,
-                                                &observed);
+        mx_status_t status = mx_object_wait_one(h, MX_USER_SIGNAL_0 | MX_CHANNEL_PEER_CLOSED,
+                                                0, &observed);
         if ((status != NO_ERROR) || (observed & MX_CHANNEL_PEER_CLOSED)) {
             // Not set (or otherwise remote is bad)
+            mx_handle_close(h);
             return ERR_UNAVAILABLE;
         }
-        flags_ |= V_FLAG_MOUNT_READY;
+        mxtl::AutoLock lock(&remote_lock);
+        if (remote_ == remote) {
+            remote_ready_ = true;
+        }
     }
-    return remote_;
+    return h;
 #else
     return ERR_NOT_SUPPORTED;
 #endif
@@ -80,6 +178,13 @@ mx_status_t Vfs::Open(Vnode* vndir, Vnode** out, const char* path,
         // remote filesystem, return handle and path through to caller
         vndir->RefRelease();
         *pathout = path;
+        if (flags & O_NOXDEV) {
+            // the caller wants only answers from this filesystem
+#ifdef __Fuchsia__
+            mx_handle_close(r);
+#endif
+            return ERR_UNAVAILABLE;
+        }
         return r;
     }
 
@@ -111,11 +216,13 @@ mx_status_t Vfs::Open(Vnode* vndir, Vnode** out, const char* path,
             vndir->RefRelease();
             return r;
         } else {
+            Vfs::InvalidateLookup(vndir, path, len);
             vndir->RefRelease();
+            vfs_notify_change();
         }
     } else {
     try_open:
-        r = vndir->Lookup(&vn, path, len);
+        r = Vfs::Lookup(vndir, &vn, path, len);
         vndir->RefRelease();
         if (r < 0) {
             return r;
@@ -130,6 +237,10 @@ mx_status_t Vfs::Open(Vnode* vndir, Vnode** out, const char* path,
         } else if (vn->IsRemote() && !vn->IsDevice()) {
             // Opening a mount point: Traverse across remote.
             // Devices are different, even though they also have remotes.  Ignore them.
+            if (flags & O_NOXDEV) {
+                vn->RefRelease();
+                return ERR_UNAVAILABLE;
+            }
             *pathout = ".";
             r = vn->WaitForRemote();
             vn->RefRelease();
@@ -153,6 +264,8 @@ mx_status_t Vfs::Open(Vnode* vndir, Vnode** out, const char* path,
                     vn->RefRelease();
                     return r;
                 }
+            } else {
+                vfs_notify_change();
             }
         }
     }
@@ -162,13 +275,47 @@ mx_status_t Vfs::Open(Vnode* vndir, Vnode** out, const char* path,
     return NO_ERROR;
 }
 
+mx_status_t Vfs::Lookup(Vnode* vndir, Vnode** out, const char* name, size_t len) {
+#ifdef __Fuchsia__
+    mx_status_t r;
+    uint32_t seq;
+    if (DentryCache::Lookup(vndir, name, len, out, &r, &seq)) {
+        return r;
+    }
+    r = vndir->Lookup(out, name, len);
+    if (r == NO_ERROR) {
+        // A cached name pins what it resolves to, which for a file may be
+        // all of its data, so only directories are remembered.
+        vnattr_t attr;
+        if (((*out)->Getattr(&attr) == NO_ERROR) && S_ISDIR(attr.mode)) {
+            DentryCache::Insert(vndir, name, len, *out, seq);
+        }
+    } else if (r == ERR_NOT_FOUND) {
+        DentryCache::Insert(vndir, name, len, nullptr, seq);
+    }
+    return r;
+#else
+    return vndir->Lookup(out, name, len);
+#endif
+}
+
+void Vfs::InvalidateLookup(Vnode* vndir, const char* name, size_t len) {
+#ifdef __Fuchsia__
+    DentryCache::Invalidate(vndir, name, len);
+#endif
+}
+
 mx_status_t Vfs::Unlink(Vnode* vndir, const char* path, size_t len) {
     bool must_be_dir;
     mx_status_t r;
     if ((r = vfs_name_trim(path, len, &len, &must_be_dir)) != NO_ERROR) {
         return r;
     }
-    return vndir->Unlink(path, len, must_be_dir);
+    if ((r = vndir->Unlink(path, len, must_be_dir)) == NO_ERROR) {
+        Vfs::InvalidateLookup(vndir, path, len);
+        vfs_notify_change();
+    }
+    return r;
 }
 
 mx_status_t Vfs::Link(Vnode* oldparent, Vnode* newparent,
@@ -193,10 +340,13 @@ mx_status_t Vfs::Link(Vnode* oldparent, Vnode* newparent,
 
     // Look up the target vnode
     Vnode* target;
-    if ((r = oldparent->Lookup(&target, oldname, oldlen)) < 0) { // target: +1
+    if ((r = Vfs::Lookup(oldparent, &target, oldname, oldlen)) < 0) { // target: +1
         return r;
     }
-    r = newparent->Link(newname, newlen, target);
+    if ((r = newparent->Link(newname, newlen, target)) == NO_ERROR) {
+        Vfs::InvalidateLookup(newparent, newname, newlen);
+        vfs_notify_change();
+    }
     target->RefRelease(); // target: +0
     return r;
 }
@@ -215,8 +365,13 @@ mx_status_t Vfs::Rename(Vnode* oldparent, Vnode* newparent,
     if ((r = vfs_name_trim(newname, newlen, &newlen, &new_must_be_dir)) != NO_ERROR) {
         return r;
     }
-    return oldparent->Rename(newparent, oldname, oldlen, newname, newlen,
-                             old_must_be_dir, new_must_be_dir);
+    if ((r = oldparent->Rename(newparent, oldname, oldlen, newname, newlen,
+                               old_must_be_dir, new_must_be_dir)) == NO_ERROR) {
+        Vfs::InvalidateLookup(oldparent, oldname, oldlen);
+        Vfs::InvalidateLookup(newparent, newname, newlen);
+        vfs_notify_change();
+    }
+    return r;
 }
 
 ssize_t Vfs::Ioctl(Vnode* vn, uint32_t op, const void* in_buf, size_t in_len,
@@ -251,6 +406,16 @@ ssize_t Vfs::Ioctl(Vnode* vn, uint32_t op, const void* in_buf, size_t in_len,
         mx_handle_t* h = (mx_handle_t*)out_buf;
         return Vfs::UninstallRemote(vn, h);
     }
+    case IOCTL_DEVMGR_GET_GENERATION: {
+        if ((in_len != 0) || (out_len != sizeof(mx_handle_t))) {
+            return ERR_INVALID_ARGS;
+        }
+        mx_status_t status;
+        if ((status = vfs_get_generation((mx_handle_t*)out_buf)) != NO_ERROR) {
+            return status;
+        }
+        return sizeof(mx_handle_t);
+    }
     case IOCTL_DEVMGR_UNMOUNT_FS: {
         vfs_uninstall_all(MX_TIME_INFINITE);
         vn->Ioctl(op, in_buf, in_len, out_buf, out_len);
@@ -269,8 +434,8 @@ mx_status_t Vfs::Close(Vnode* vn) {
 }
 
 void Vnode::RefAcquire() {
-    trace(REFS, "acquire vn=%p ref=%u\n", this, refcount_);
-    refcount_++;
+    trace(REFS, "acquire vn=%p ref=%u\n", this, refcount_.load(mxtl::memory_order_relaxed));
+    refcount_.fetch_add(1, mxtl::memory_order_relaxed);
 }
 
 // TODO(orr): figure out x-system panic
@@ -281,13 +446,21 @@ void Vnode::RefAcquire() {
     } while (0)
 
 void Vnode::RefRelease() {
-    trace(REFS, "release vn=%p ref=%u\n", this, refcount_);
-    if (refcount_ == 0) {
+    trace(REFS, "release vn=%p ref=%u\n", this, refcount_.load(mxtl::memory_order_relaxed));
+    uint32_t old = refcount_.fetch_sub(1, mxtl::memory_order_release);
+    if (old == 0) {
         panic("vn %p: ref underflow\n", this);
     }
-    refcount_--;
-    if (refcount_ == 0) {
+    if (old == 1) {
+        mxtl::atomic_thread_fence(mxtl::memory_order_acquire);
         assert(!IsRemote());
+#ifdef __Fuchsia__
+        // Nothing can be cached in a directory once the last reference to
+        // it is gone, since every lookup is made holding one.
+        if (dentry_count_.load(mxtl::memory_order_relaxed) != 0) {
+            DentryCache::Purge(this);
+        }
+#endif
         trace(VFS, "vfs_release: vn=%p\n", this);
         Release();
     }
@@ -360,7 +533,7 @@ mx_status_t Vfs::Walk(Vnode* vn, Vnode** out, const char* path, const char** pat
             // traverse to the next segment
             size_t len = nextpath - path;
             nextpath++;
-            r = vn->Lookup(&vn, path, len);
+            r = Vfs::Lookup(vn, &vn, path, len);
             assert(r <= 0);
             if (oldvn) {
                 // release the old vnode, even if there was an error
@@ -385,3 +558,12 @@ mx_status_t Vfs::Walk(Vnode* vn, Vnode** out, const char* path, const char** pat
 }
 
 } // namespace fs
+
+void vfs_notify_change(void) {
+#ifdef __Fuchsia__
+    uintptr_t addr = fs::generation_addr.load(mxtl::memory_order_acquire);
+    if (addr != 0) {
+        reinterpret_cast<mxtl::atomic<uint64_t>*>(addr)->fetch_add(1, mxtl::memory_order_release);
+    }
+#endif
+}
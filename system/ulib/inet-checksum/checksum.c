@@ -0,0 +1,289 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <cpuid.h>
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#include <inet-checksum/checksum.h>
+
+// Since the ones-complement sum is the same whatever the word size (and
+// byte order) it is taken in, words of any width may be added into a wider
+// accumulator, and the carries folded back in at the end.
+
+// Buffers shorter than this are not worth setting up the vector units for.
+#define VECTOR_MIN 64
+
+static uint16_t fold(uint64_t sum) {
+    while (sum >> 16) {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    return (uint16_t)sum;
+}
+
+static inline uint64_t add_carry(uint64_t sum, uint64_t x) {
+    sum += x;
+    return sum + (sum < x);
+}
+
+// Portable: 32-bit loads into four 64-bit accumulators, which cannot
+// overflow within a block.
+static uint16_t checksum_generic(const void* data, size_t len, uint16_t sum) {
+    const uint8_t* p = data;
+    uint64_t total = sum;
+    while (len >= 16) {
+        size_t n = (len < (1u << 30)) ? len / 16 : (1u << 26);
+        uint64_t s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+        for (size_t i = 0; i < n; i++, p += 16) {
+            uint32_t w[4];
+            memcpy(w, p, sizeof(w));
+            s0 += w[0];
+            s1 += w[1];
+            s2 += w[2];
+            s3 += w[3];
+        }
+        total = add_carry(total, s0 + s1 + s2 + s3);
+        len -= n * 16;
+    }
+    if (len & 8) {
+        uint64_t w;
+        memcpy(&w, p, sizeof(w));
+        total = add_carry(total, w);
+        p += 8;
+    }
+    if (len & 4) {
+        uint32_t w;
+        memcpy(&w, p, sizeof(w));
+        total = add_carry(total, w);
+        p += 4;
+    }
+    if (len & 2) {
+        uint16_t w;
+        memcpy(&w, p, sizeof(w));
+        total = add_carry(total, w);
+        p += 2;
+    }
+    if (len & 1) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        total = add_carry(total, p[0]);
+#else
+        total = add_carry(total, (uint64_t)p[0] << 8);
+#endif
+    }
+    return fold(total);
+}
+
+#if defined(__x86_64__)
+
+// Each 32-bit lane takes two words an iteration, so it holds out for
+// (well over) this many iterations. Four accumulators keep the adds from
+// waiting on each other.
+#define VECTOR_BLOCK 16384
+
+// The words of each vector are split into the low and high halves of
+// 32-bit lanes (masks and shifts, rather than unpacks, which would all
+// queue for the one shuffle port), and the lanes widened to 64 bits at
+// the end of each block.
+static uint16_t checksum_sse2(const void* data, size_t len, uint16_t sum) {
+    const uint8_t* p = data;
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i mask = _mm_set1_epi32(0xffff);
+    __m128i acc = zero;
+    while (len >= VECTOR_MIN) {
+        size_t n = len / 64;
+        if (n > VECTOR_BLOCK) {
+            n = VECTOR_BLOCK;
+        }
+        __m128i a = zero;
+        __m128i b = zero;
+        __m128i c = zero;
+        __m128i d = zero;
+        for (size_t i = 0; i < n; i++, p += 64) {
+            __m128i v0 = _mm_loadu_si128((const __m128i*)p);
+            __m128i v1 = _mm_loadu_si128((const __m128i*)(p + 16));
+            __m128i v2 = _mm_loadu_si128((const __m128i*)(p + 32));
+            __m128i v3 = _mm_loadu_si128((const __m128i*)(p + 48));
+            a = _mm_add_epi32(a, _mm_and_si128(v0, mask));
+            b = _mm_add_epi32(b, _mm_srli_epi32(v0, 16));
+            c = _mm_add_epi32(c, _mm_and_si128(v1, mask));
+            d = _mm_add_epi32(d, _mm_srli_epi32(v1, 16));
+            a = _mm_add_epi32(a, _mm_and_si128(v2, mask));
+            b = _mm_add_epi32(b, _mm_srli_epi32(v2, 16));
+            c = _mm_add_epi32(c, _mm_and_si128(v3, mask));
+            d = _mm_add_epi32(d, _mm_srli_epi32(v3, 16));
+        }
+        acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(a, zero));
+        acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(a, zero));
+        acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(b, zero));
+        acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(b, zero));
+        acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(c, zero));
+        acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(c, zero));
+        acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(d, zero));
+        acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(d, zero));
+        len -= n * 64;
+    }
+    uint64_t lanes[2];
+    _mm_storeu_si128((__m128i*)lanes, acc);
+    uint64_t total = add_carry(add_carry(sum, lanes[0]), lanes[1]);
+    return checksum_generic(p, len, fold(total));
+}
+
+__attribute__((target("avx2")))
+static uint16_t checksum_avx2(const void* data, size_t len, uint16_t sum) {
+    const uint8_t* p = data;
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i mask = _mm256_set1_epi32(0xffff);
+    __m256i acc = zero;
+    while (len >= 128) {
+        size_t n = len / 128;
+        if (n > VECTOR_BLOCK) {
+            n = VECTOR_BLOCK;
+        }
+        __m256i a = zero;
+        __m256i b = zero;
+        __m256i c = zero;
+        __m256i d = zero;
+        for (size_t i = 0; i < n; i++, p += 128) {
+            __m256i v0 = _mm256_loadu_si256((const __m256i*)p);
+            __m256i v1 = _mm256_loadu_si256((const __m256i*)(p + 32));
+            __m256i v2 = _mm256_loadu_si256((const __m256i*)(p + 64));
+            __m256i v3 = _mm256_loadu_si256((const __m256i*)(p + 96));
+            a = _mm256_add_epi32(a, _mm256_and_si256(v0, mask));
+            b = _mm256_add_epi32(b, _mm256_srli_epi32(v0, 16));
+            c = _mm256_add_epi32(c, _mm256_and_si256(v1, mask));
+            d = _mm256_add_epi32(d, _mm256_srli_epi32(v1, 16));
+            a = _mm256_add_epi32(a, _mm256_and_si256(v2, mask));
+            b = _mm256_add_epi32(b, _mm256_srli_epi32(v2, 16));
+            c = _mm256_add_epi32(c, _mm256_and_si256(v3, mask));
+            d = _mm256_add_epi32(d, _mm256_srli_epi32(v3, 16));
+        }
+        acc = _mm256_add_epi64(acc, _mm256_unpacklo_epi32(a, zero));
+        acc = _mm256_add_epi64(acc, _mm256_unpackhi_epi32(a, zero));
+        acc = _mm256_add_epi64(acc, _mm256_unpacklo_epi32(b, zero));
+        acc = _mm256_add_epi64(acc, _mm256_unpackhi_epi32(b, zero));
+        acc = _mm256_add_epi64(acc, _mm256_unpacklo_epi32(c, zero));
+        acc = _mm256_add_epi64(acc, _mm256_unpackhi_epi32(c, zero));
+        acc = _mm256_add_epi64(acc, _mm256_unpacklo_epi32(d, zero));
+        acc = _mm256_add_epi64(acc, _mm256_unpackhi_epi32(d, zero));
+        len -= n * 128;
+    }
+    uint64_t lanes[4];
+    _mm256_storeu_si256((__m256i*)lanes, acc);
+    uint64_t total = sum;
+    for (int i = 0; i < 4; i++) {
+        total = add_carry(total, lanes[i]);
+    }
+    return checksum_sse2(p, len, fold(total));
+}
+
+static bool cpu_has_avx2(void) {
+    unsigned a, b, c, d;
+    if (__get_cpuid_max(0, NULL) < 7) {
+        return false;
+    }
+    __cpuid(1, a, b, c, d);
+    if (!(c & bit_OSXSAVE) || !(c & bit_AVX)) {
+        return false;
+    }
+    // and the kernel must be saving the upper halves of the registers
+    uint32_t xcr0, xcr0_hi;
+    __asm__ volatile("xgetbv" : "=a"(xcr0), "=d"(xcr0_hi) : "c"(0));
+    if ((xcr0 & 6) != 6) {
+        return false;
+    }
+    __cpuid_count(7, 0, a, b, c, d);
+    return (b & bit_AVX2) != 0;
+}
+
+static const inet_checksum_impl_t impls[] = {
+    { "generic", checksum_generic },
+    { "sse2", checksum_sse2 },
+    { "avx2", checksum_avx2 },
+};
+
+static size_t impl_count(void) {
+    return cpu_has_avx2() ? 3 : 2;
+}
+
+#elif defined(__aarch64__)
+
+// vpadalq_u16() adds pairs of words into each 32-bit lane, which takes
+// four words an iteration.
+#define VECTOR_BLOCK 16384
+
+static uint16_t checksum_neon(const void* data, size_t len, uint16_t sum) {
+    const uint8_t* p = data;
+    uint64x2_t acc = vdupq_n_u64(0);
+    while (len >= VECTOR_MIN) {
+        size_t n = len / 64;
+        if (n > VECTOR_BLOCK) {
+            n = VECTOR_BLOCK;
+        }
+        uint32x4_t a = vdupq_n_u32(0);
+        uint32x4_t b = vdupq_n_u32(0);
+        for (size_t i = 0; i < n; i++, p += 64) {
+            a = vpadalq_u16(a, vreinterpretq_u16_u8(vld1q_u8(p)));
+            b = vpadalq_u16(b, vreinterpretq_u16_u8(vld1q_u8(p + 16)));
+            a = vpadalq_u16(a, vreinterpretq_u16_u8(vld1q_u8(p + 32)));
+            b = vpadalq_u16(b, vreinterpretq_u16_u8(vld1q_u8(p + 48)));
+        }
+        acc = vpadalq_u32(acc, a);
+        acc = vpadalq_u32(acc, b);
+        len -= n * 64;
+    }
+    uint64_t total = add_carry(sum, vgetq_lane_u64(acc, 0));
+    total = add_carry(total, vgetq_lane_u64(acc, 1));
+    return checksum_generic(p, len, fold(total));
+}
+
+static const inet_checksum_impl_t impls[] = {
+    { "generic", checksum_generic },
+    { "neon", checksum_neon },
+};
+
+static size_t impl_count(void) {
+    return 2;
+}
+
+#else
+
+static const inet_checksum_impl_t impls[] = {
+    { "generic", checksum_generic },
+};
+
+static size_t impl_count(void) {
+    return 1;
+}
+
+#endif
+
+size_t inet_checksum_impls(const inet_checksum_impl_t** out) {
+    *out = impls;
+    return impl_count();
+}
+
+// The first call picks the best implementation; racing callers all pick
+// the same one.
+static uint16_t checksum_select(const void* data, size_t len, uint16_t sum);
+static _Atomic(inet_checksum_func_t) checksum_func = checksum_select;
+
+static uint16_t checksum_select(const void* data, size_t len, uint16_t sum) {
+    inet_checksum_func_t func = impls[impl_count() - 1].func;
+    atomic_store_explicit(&checksum_func, func, memory_order_relaxed);
+    return func(data, len, sum);
+}
+
+uint16_t inet_checksum(const void* data, size_t len, uint16_t sum) {
+    if (len < VECTOR_MIN) {
+        return checksum_generic(data, len, sum);
+    }
+    return atomic_load_explicit(&checksum_func, memory_order_relaxed)(data, len, sum);
+}
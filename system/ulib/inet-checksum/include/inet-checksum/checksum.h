@@ -0,0 +1,35 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <magenta/compiler.h>
+
+__BEGIN_CDECLS;
+
+// Adds the ones-complement sum of the 16-bit words at |data| to |sum|, and
+// returns the result folded to 16 bits (the Internet checksum of RFC 1071,
+// before it is complemented).
+//
+// Words are summed as they lie in memory, so |sum| and the result are in
+// network order whatever the host order, and can be stored into a header
+// as they are. An odd final byte is padded with zero, so only the last of
+// several pieces summed in turn may have an odd length. |data| need not
+// be aligned.
+uint16_t inet_checksum(const void* data, size_t len, uint16_t sum);
+
+typedef uint16_t (*inet_checksum_func_t)(const void* data, size_t len, uint16_t sum);
+
+typedef struct {
+    const char* name;
+    inet_checksum_func_t func;
+} inet_checksum_impl_t;
+
+// Returns the implementations which this cpu can run, for tests and
+// benchmarks. The first is portable; inet_checksum() uses the last.
+size_t inet_checksum_impls(const inet_checksum_impl_t** out);
+
+__END_CDECLS;
@@ -31,6 +31,9 @@ mx_status_t eth_complete_tx(eth_client_t* eth, void* ctx,
                             void (*func)(void* ctx, void* cookie));
 
 // Enqueue a packet for reception.
+// Frames are received straight into buffers of at least the device's
+// mtu which do not cross a page boundary (if the driver supports it);
+// other buffers are filled by copying.
 mx_status_t eth_queue_rx(eth_client_t* eth, void* cookie,
                          void* data, size_t len, uint32_t options);
 
@@ -128,9 +128,20 @@ static inline uint32_t _swap32(uint32_t n) {
 char* ip6toa(char* _out, void* ip6addr);
 #define IP6TOAMAX 40
 
+// flags for eth_recv(): the interface has verified the transport checksum
+#define ETH_RECV_CSUM_OK 1
+
+// flags for eth_send(): the interface is to complete the transport
+// checksum, whose field holds only the sum of the pseudo-header
+#define ETH_SEND_CSUM 1
+
 // provided by inet6.c
 void ip6_init(void* macaddr);
-void eth_recv(void* data, size_t len);
+void eth_recv(void* data, size_t len, uint32_t flags);
+
+// Called by an interface driver which can take ETH_SEND_CSUM, to leave
+// transport checksums to it from now on.
+void ip6_set_csum_offload(bool enable);
 
 typedef struct eth_buffer eth_buffer_t;
 
@@ -138,7 +149,7 @@ typedef struct eth_buffer eth_buffer_t;
 int eth_get_buffer(size_t len, void** data, eth_buffer_t** out);
 void eth_put_buffer(eth_buffer_t* ethbuf);
 
-int eth_send(eth_buffer_t* ethbuf, size_t skip, size_t len);
+int eth_send(eth_buffer_t* ethbuf, size_t skip, size_t len, uint32_t flags);
 
 int eth_add_mcast_filter(const mac_addr_t* addr);
 
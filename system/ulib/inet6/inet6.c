@@ -6,6 +6,7 @@
 #include <stdio.h>
 #include <string.h>
 
+#include <inet-checksum/checksum.h>
 #include <inet6/inet6.h>
 
 #if 1
@@ -100,6 +101,13 @@ ip6_addr_t snm_ip6_addr;
 static mac_addr_t rx_mac_addr;
 static ip6_addr_t rx_ip6_addr;
 
+// does the interface compute transport checksums for us?
+static bool csum_offload;
+
+void ip6_set_csum_offload(bool enable) {
+    csum_offload = enable;
+}
+
 void ip6_init(void* macaddr) {
     char tmp[IP6TOAMAX];
     mac_addr_t all;
@@ -142,22 +150,6 @@ static int resolve_ip6(mac_addr_t* _mac, const ip6_addr_t* _ip) {
     return -1;
 }
 
-static uint16_t checksum(const void* _data, size_t len, uint16_t _sum) {
-    uint32_t sum = _sum;
-    const uint16_t* data = _data;
-    while (len > 1) {
-        sum += *data++;
-        len -= 2;
-    }
-    if (len) {
-        sum += (*data & 0xFF);
-    }
-    while (sum > 0xFFFF) {
-        sum = (sum & 0xFFFF) + (sum >> 16);
-    }
-    return sum;
-}
-
 typedef struct {
     uint8_t eth[16];
     ip6_hdr_t ip6;
@@ -175,9 +167,14 @@ static unsigned ip6_checksum(ip6_hdr_t* ip, unsigned type, size_t length) {
     uint16_t sum;
 
     // length and protocol field for pseudo-header
-    sum = checksum(&ip->length, 2, htons(type));
+    sum = inet_checksum(&ip->length, 2, htons(type));
+    if (csum_offload) {
+        // just the pseudo-header: the interface covers the payload
+        // and stores the result
+        return inet_checksum(&ip->src, 32, sum);
+    }
     // src/dst for pseudo-header + payload
-    sum = checksum(&ip->src, 32 + length, sum);
+    sum = inet_checksum(&ip->src, 32 + length, sum);
 
     // 0 is illegal, so 0xffff remains 0xffff
     if (sum != 0xffff) {
@@ -231,7 +228,8 @@ int udp6_send(const void* data, size_t dlen, const ip6_addr_t* daddr, uint16_t d
 
     memcpy(p->data, data, dlen);
     p->udp.checksum = ip6_checksum(&p->ip6, HDR_UDP, length);
-    return eth_send(ethbuf, 2, ETH_HDR_LEN + IP6_HDR_LEN + length);
+    return eth_send(ethbuf, 2, ETH_HDR_LEN + IP6_HDR_LEN + length,
+                    csum_offload ? ETH_SEND_CSUM : 0);
 
 fail:
     eth_put_buffer(ethbuf);
@@ -255,14 +253,15 @@ static int icmp6_send(const void* data, size_t length, const ip6_addr_t* daddr)
     icmp = (void*)p->data;
     memcpy(icmp, data, length);
     icmp->checksum = ip6_checksum(&p->ip6, HDR_ICMP6, length);
-    return eth_send(ethbuf, 2, ETH_HDR_LEN + IP6_HDR_LEN + length);
+    return eth_send(ethbuf, 2, ETH_HDR_LEN + IP6_HDR_LEN + length,
+                    csum_offload ? ETH_SEND_CSUM : 0);
 
 fail:
     eth_put_buffer(ethbuf);
     return -1;
 }
 
-void _udp6_recv(ip6_hdr_t* ip, void* _data, size_t len) {
+void _udp6_recv(ip6_hdr_t* ip, void* _data, size_t len, bool csum_ok) {
     udp_hdr_t* udp = _data;
     uint16_t sum, n;
 
@@ -270,13 +269,15 @@ void _udp6_recv(ip6_hdr_t* ip, void* _data, size_t len) {
         BAD("Bogus Header Len");
     if (udp->checksum == 0)
         BAD("Checksum Invalid");
-    if (udp->checksum == 0xFFFF)
-        udp->checksum = 0;
-
-    sum = checksum(&ip->length, 2, htons(HDR_UDP));
-    sum = checksum(&ip->src, 32 + len, sum);
-    if (sum != 0xFFFF)
-        BAD("Checksum Incorrect");
+    if (!csum_ok) {
+        if (udp->checksum == 0xFFFF)
+            udp->checksum = 0;
+
+        sum = inet_checksum(&ip->length, 2, htons(HDR_UDP));
+        sum = inet_checksum(&ip->src, 32 + len, sum);
+        if (sum != 0xFFFF)
+            BAD("Checksum Incorrect");
+    }
 
     n = ntohs(udp->length);
     if (n < UDP_HDR_LEN)
@@ -290,19 +291,21 @@ void _udp6_recv(ip6_hdr_t* ip, void* _data, size_t len) {
               (void*)&ip->src, ntohs(udp->src_port));
 }
 
-void icmp6_recv(ip6_hdr_t* ip, void* _data, size_t len) {
+void icmp6_recv(ip6_hdr_t* ip, void* _data, size_t len, bool csum_ok) {
     icmp6_hdr_t* icmp = _data;
     uint16_t sum;
 
     if (icmp->checksum == 0)
         BAD("Checksum Invalid");
-    if (icmp->checksum == 0xFFFF)
-        icmp->checksum = 0;
-
-    sum = checksum(&ip->length, 2, htons(HDR_ICMP6));
-    sum = checksum(&ip->src, 32 + len, sum);
-    if (sum != 0xFFFF)
-        BAD("Checksum Incorrect");
+    if (!csum_ok) {
+        if (icmp->checksum == 0xFFFF)
+            icmp->checksum = 0;
+
+        sum = inet_checksum(&ip->length, 2, htons(HDR_ICMP6));
+        sum = inet_checksum(&ip->src, 32 + len, sum);
+        if (sum != 0xFFFF)
+            BAD("Checksum Incorrect");
+    }
 
     if (icmp->type == ICMP6_NDP_N_SOLICIT) {
         ndp_n_hdr_t* ndp = _data;
@@ -341,7 +344,7 @@ void icmp6_recv(ip6_hdr_t* ip, void* _data, size_t len) {
     }
 }
 
-void eth_recv(void* _data, size_t len) {
+void eth_recv(void* _data, size_t len, uint32_t flags) {
     uint8_t* data = _data;
     ip6_hdr_t* ip;
     uint32_t n;
@@ -382,10 +385,10 @@ void eth_recv(void* _data, size_t len) {
 
     switch (ip->next_header) {
     case HDR_ICMP6:
-        icmp6_recv(ip, data, len);
+        icmp6_recv(ip, data, len, flags & ETH_RECV_CSUM_OK);
         break;
     case HDR_UDP:
-        _udp6_recv(ip, data, len);
+        _udp6_recv(ip, data, len, flags & ETH_RECV_CSUM_OK);
         break;
     default:
         // do nothing
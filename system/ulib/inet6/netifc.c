@@ -162,7 +162,7 @@ static void tx_complete(void* ctx, void* cookie) {
     eth_put_buffer_locked(cookie, ETH_BUFFER_TX);
 }
 
-int eth_send(eth_buffer_t* ethbuf, size_t skip, size_t len) {
+int eth_send(eth_buffer_t* ethbuf, size_t skip, size_t len, uint32_t flags) {
     mtx_lock(&eth_lock);
 
     check_ethbuf(ethbuf, ETH_BUFFER_CLIENT);
@@ -185,7 +185,8 @@ int eth_send(eth_buffer_t* ethbuf, size_t skip, size_t len) {
     eth_complete_tx(eth, NULL, tx_complete);
 
     ethbuf->state = ETH_BUFFER_TX;
-    mx_status_t status = eth_queue_tx(eth, ethbuf, ethbuf->data + skip, len, 0);
+    mx_status_t status = eth_queue_tx(eth, ethbuf, ethbuf->data + skip, len,
+                                      (flags & ETH_SEND_CSUM) ? ETH_FIFO_TX_CSUM : 0);
     if (status < 0) {
         printf("eth_fifo_send: queue tx failed: %d\n", status);
         eth_put_buffer_locked(ethbuf, ETH_BUFFER_TX);
@@ -206,7 +207,7 @@ void netifc_send(const void* _data, size_t len) {
     eth_buffer_t* ethbuf;
     if (eth_get_buffer(len, &data, &ethbuf) == 0) {
         memcpy(data, _data, len);
-        eth_send(ethbuf, 0, len);
+        eth_send(ethbuf, 0, len, 0);
     }
 }
 
@@ -269,9 +270,11 @@ static mx_status_t netifc_open_cb(int dirfd, int event, const char* fn, void* co
 
     // we only do this the very first time
     if (iobuf == NULL) {
-        // allocate shareable ethernet buffer data heap
-        size_t iosize = 2 * NET_BUFFERS * NET_BUFFERSZ;
-        if ((status = mx_vmo_create(iosize, 0, &iovmo)) < 0) {
+        // allocate shareable ethernet buffer data heap, preferably one
+        // the device can receive into without a copy
+        uint64_t iosize = 2 * NET_BUFFERS * NET_BUFFERSZ;
+        if ((ioctl_ethernet_alloc_iobuf(netfd, &iosize, &iovmo) < 0) &&
+            ((status = mx_vmo_create(iosize, 0, &iovmo)) < 0)) {
             goto fail_close_fd;
         }
         if ((status = mx_vmar_map(mx_vmar_root_self(), 0, iovmo, 0, iosize,
@@ -304,6 +307,7 @@ static mx_status_t netifc_open_cb(int dirfd, int event, const char* fn, void* co
     }
 
     ip6_init(netmac);
+    ip6_set_csum_offload(info.features & ETH_FEATURE_TX_CSUM);
 
     // enqueue rx buffers
     for (unsigned n = 0; n < NET_BUFFERS; n++) {
@@ -380,7 +384,7 @@ void netifc_close(void) {
 static void rx_complete(void* ctx, void* cookie, size_t len, uint32_t flags) {
     eth_buffer_t* ethbuf = cookie;
     check_ethbuf(ethbuf, ETH_BUFFER_RX);
-    netifc_recv(ethbuf->data, len);
+    netifc_recv(ethbuf->data, len, (flags & ETH_FIFO_RX_CSUM_OK) ? ETH_RECV_CSUM_OK : 0);
     eth_queue_rx(eth, ethbuf, ethbuf->data, NET_BUFFERSZ, 0);
 }
 
@@ -13,6 +13,8 @@ MODULE_SRCS += \
     $(LOCAL_DIR)/netifc.c \
     $(LOCAL_DIR)/eth-client.c \
 
+MODULE_STATIC_LIBS := system/ulib/inet-checksum
+
 MODULE_LIBS += system/ulib/mxio system/ulib/magenta system/ulib/c
 
 include make/module.mk
@@ -49,6 +49,10 @@ public:
         return mx_vmar_protect(get(), address, len, prot);
     }
 
+    mx_status_t op_range(uint32_t op, uintptr_t address, size_t len) const {
+        return mx_vmar_op_range(get(), op, address, len);
+    }
+
     mx_status_t destroy() const {
         return mx_vmar_destroy(get());
     }
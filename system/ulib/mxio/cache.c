@@ -0,0 +1,299 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+
+#include <magenta/device/devmgr.h>
+#include <magenta/process.h>
+#include <magenta/syscalls.h>
+
+#include <mxio/io.h>
+#include <mxio/vfs.h>
+
+#include "private.h"
+#include "unistd.h"
+
+// Each mount the cache is enabled for maps its filesystem's generation
+// count, which the server bumps after every change to a name or to
+// attributes.  An entry is good for as long as the count of its mount is
+// what it was when the lookup behind the entry was sent; a lookup which
+// raced with a change is thrown away, or never trusted afterwards.
+//
+// Entries live in a set-associative table keyed by a hash of the path
+// as given, so "/a/b" and "/a//b" are cached separately.
+
+#define CACHE_MAX_MOUNTS 8
+#define CACHE_SETS 256
+#define CACHE_WAYS 4
+
+typedef struct {
+    // 0 if this slot is free
+    uint32_t id;
+    size_t len;
+    char prefix[MXIO_CACHE_PATH_MAX];
+    _Atomic uint64_t* gen;
+} cache_mount_t;
+
+typedef struct {
+    // 0 if this entry is empty
+    uint32_t mount_id;
+    uint32_t hash;
+    uint64_t gen;
+    mx_status_t status;
+    vnattr_t attr;
+    size_t len;
+    char path[MXIO_CACHE_PATH_MAX];
+} cache_entry_t;
+
+typedef struct {
+    cache_entry_t entry[CACHE_SETS][CACHE_WAYS];
+    uint8_t victim[CACHE_SETS];
+} cache_table_t;
+
+static mtx_t cache_lock = MTX_INIT;
+static cache_mount_t cache_mounts[CACHE_MAX_MOUNTS];
+static cache_table_t* cache_table;
+static uint32_t cache_next_id = 1;
+// read without the lock, so that lookups cost nothing until the cache
+// is enabled somewhere
+static atomic_int cache_nmounts;
+
+static uint32_t cache_hash(const char* path, size_t len) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ (uint8_t)path[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// Finds the innermost mount under which path is cached.
+static cache_mount_t* cache_find_mount_locked(const char* path, size_t len) {
+    cache_mount_t* best = NULL;
+    for (unsigned i = 0; i < CACHE_MAX_MOUNTS; i++) {
+        cache_mount_t* m = &cache_mounts[i];
+        if ((m->id == 0) || (m->len > len) || memcmp(m->prefix, path, m->len)) {
+            continue;
+        }
+        if ((path[m->len] != '/') && (path[m->len] != 0)) {
+            continue;
+        }
+        if ((best == NULL) || (m->len > best->len)) {
+            best = m;
+        }
+    }
+    return best;
+}
+
+static cache_mount_t* cache_mount_by_id_locked(uint32_t id) {
+    for (unsigned i = 0; i < CACHE_MAX_MOUNTS; i++) {
+        if (cache_mounts[i].id == id) {
+            return &cache_mounts[i];
+        }
+    }
+    return NULL;
+}
+
+bool mxio_cache_lookup(const char* path, mxio_cache_ticket_t* ticket,
+                       mx_status_t* status, vnattr_t* attr) {
+    ticket->mount_id = 0;
+    if ((atomic_load(&cache_nmounts) == 0) || (path == NULL) || (path[0] != '/')) {
+        return false;
+    }
+    size_t len = strlen(path);
+    if (len >= MXIO_CACHE_PATH_MAX) {
+        return false;
+    }
+    uint32_t hash = cache_hash(path, len);
+
+    bool found = false;
+    mtx_lock(&cache_lock);
+    cache_mount_t* m = cache_find_mount_locked(path, len);
+    if (m != NULL) {
+        uint64_t gen = atomic_load_explicit(m->gen, memory_order_acquire);
+        cache_entry_t* set = cache_table->entry[hash % CACHE_SETS];
+        for (unsigned i = 0; i < CACHE_WAYS; i++) {
+            cache_entry_t* e = &set[i];
+            if ((e->mount_id == m->id) && (e->hash == hash) && (e->gen == gen) &&
+                (e->len == len) && !memcmp(e->path, path, len)) {
+                *status = e->status;
+                if (e->status == NO_ERROR) {
+                    *attr = e->attr;
+                }
+                found = true;
+                break;
+            }
+        }
+        if (!found) {
+            ticket->mount_id = m->id;
+            ticket->gen = gen;
+        }
+    }
+    mtx_unlock(&cache_lock);
+    return found;
+}
+
+void mxio_cache_insert(const char* path, const mxio_cache_ticket_t* ticket,
+                       mx_status_t status, const vnattr_t* attr) {
+    if ((ticket->mount_id == 0) || ((status != NO_ERROR) && (status != ERR_NOT_FOUND))) {
+        return;
+    }
+    size_t len = strlen(path);
+    uint32_t hash = cache_hash(path, len);
+
+    mtx_lock(&cache_lock);
+    cache_mount_t* m = cache_mount_by_id_locked(ticket->mount_id);
+    if ((m == NULL) || (atomic_load_explicit(m->gen, memory_order_acquire) != ticket->gen)) {
+        // disabled, or something changed while the server was asked
+        mtx_unlock(&cache_lock);
+        return;
+    }
+
+    unsigned set_index = hash % CACHE_SETS;
+    cache_entry_t* set = cache_table->entry[set_index];
+    cache_entry_t* e = NULL;
+    for (unsigned i = 0; i < CACHE_WAYS; i++) {
+        if ((set[i].mount_id == 0) ||
+            ((set[i].hash == hash) && (set[i].len == len) && !memcmp(set[i].path, path, len))) {
+            e = &set[i];
+            break;
+        }
+    }
+    if (e == NULL) {
+        e = &set[cache_table->victim[set_index]];
+        cache_table->victim[set_index] = (cache_table->victim[set_index] + 1) % CACHE_WAYS;
+    }
+    e->mount_id = m->id;
+    e->hash = hash;
+    e->gen = ticket->gen;
+    e->status = status;
+    if (status == NO_ERROR) {
+        e->attr = *attr;
+    }
+    e->len = len;
+    memcpy(e->path, path, len);
+    mtx_unlock(&cache_lock);
+}
+
+// Strips trailing slashes, so that "/" becomes "" and covers every
+// absolute path.
+static mx_status_t cache_prefix(const char* path, size_t* out) {
+    if ((path == NULL) || (path[0] != '/')) {
+        return ERR_INVALID_ARGS;
+    }
+    size_t len = strlen(path);
+    while ((len > 0) && (path[len - 1] == '/')) {
+        len--;
+    }
+    if (len >= MXIO_CACHE_PATH_MAX) {
+        return ERR_INVALID_ARGS;
+    }
+    *out = len;
+    return NO_ERROR;
+}
+
+mx_status_t mxio_cache_enable(const char* path) {
+    size_t len;
+    mx_status_t r;
+    if ((r = cache_prefix(path, &len)) < 0) {
+        return r;
+    }
+
+    mxio_t* io;
+    if ((r = __mxio_open(&io, path, O_RDONLY | O_DIRECTORY, 0)) < 0) {
+        return r;
+    }
+    mx_handle_t vmo;
+    r = io->ops->ioctl(io, IOCTL_DEVMGR_GET_GENERATION, NULL, 0, &vmo, sizeof(vmo));
+    mxio_close(io);
+    mxio_release(io);
+    if (r < 0) {
+        return r;
+    } else if (r != sizeof(vmo)) {
+        return ERR_IO;
+    }
+
+    uintptr_t addr;
+    r = mx_vmar_map(mx_vmar_root_self(), 0, vmo, 0, PAGE_SIZE, MX_VM_FLAG_PERM_READ, &addr);
+    mx_handle_close(vmo);
+    if (r < 0) {
+        return r;
+    }
+
+    mtx_lock(&cache_lock);
+    cache_mount_t* slot = NULL;
+    for (unsigned i = 0; i < CACHE_MAX_MOUNTS; i++) {
+        cache_mount_t* m = &cache_mounts[i];
+        if (m->id == 0) {
+            if (slot == NULL) {
+                slot = m;
+            }
+        } else if ((m->len == len) && !memcmp(m->prefix, path, len)) {
+            r = ERR_ALREADY_EXISTS;
+            goto fail;
+        }
+    }
+    if (slot == NULL) {
+        r = ERR_NO_RESOURCES;
+        goto fail;
+    }
+    if ((cache_table == NULL) && ((cache_table = calloc(1, sizeof(*cache_table))) == NULL)) {
+        r = ERR_NO_MEMORY;
+        goto fail;
+    }
+    slot->id = cache_next_id++;
+    slot->len = len;
+    memcpy(slot->prefix, path, len);
+    slot->gen = (_Atomic uint64_t*)addr;
+    atomic_fetch_add(&cache_nmounts, 1);
+    mtx_unlock(&cache_lock);
+    return NO_ERROR;
+
+fail:
+    mtx_unlock(&cache_lock);
+    mx_vmar_unmap(mx_vmar_root_self(), addr, PAGE_SIZE);
+    return r;
+}
+
+mx_status_t mxio_cache_disable(const char* path) {
+    size_t len;
+    mx_status_t r;
+    if ((r = cache_prefix(path, &len)) < 0) {
+        return r;
+    }
+
+    mtx_lock(&cache_lock);
+    cache_mount_t* m = NULL;
+    for (unsigned i = 0; i < CACHE_MAX_MOUNTS; i++) {
+        if ((cache_mounts[i].id != 0) && (cache_mounts[i].len == len) &&
+            !memcmp(cache_mounts[i].prefix, path, len)) {
+            m = &cache_mounts[i];
+            break;
+        }
+    }
+    if (m == NULL) {
+        mtx_unlock(&cache_lock);
+        return ERR_NOT_FOUND;
+    }
+    for (unsigned i = 0; i < CACHE_SETS; i++) {
+        for (unsigned j = 0; j < CACHE_WAYS; j++) {
+            if (cache_table->entry[i][j].mount_id == m->id) {
+                cache_table->entry[i][j].mount_id = 0;
+            }
+        }
+    }
+    uintptr_t addr = (uintptr_t)m->gen;
+    m->id = 0;
+    m->gen = NULL;
+    atomic_fetch_sub(&cache_nmounts, 1);
+    mtx_unlock(&cache_lock);
+
+    mx_vmar_unmap(mx_vmar_root_self(), addr, PAGE_SIZE);
+    return NO_ERROR;
+}
@@ -2,6 +2,7 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <stdatomic.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -13,10 +14,6 @@
 #include <mxio/dispatcher.h>
 #include <magenta/listnode.h>
 
-// Eventually we want to use the repeating version of mx_object_wait_async,
-// but it is not ready for prime time yet.  This feature flag enables testing.
-#define USE_WAIT_ONCE 1
-
 #define VERBOSE_DEBUG 0
 
 #if VERBOSE_DEBUG
@@ -25,25 +22,42 @@
 #define xprintf(...) do {} while (0)
 #endif
 
+// Handlers are waited on with repeating waits, which queue a packet each
+// time the channel *becomes* readable (or closed), so a handler must drain
+// its channel before the next packet can be counted on.
+//
+// Packets are keyed by a handler id rather than its address: a packet may
+// still be queued when its handler is torn down, and the id is simply not
+// found afterwards, where an address might have been reused.
+//
+// Any number of threads may pull packets from the port, but only one runs
+// a given handler at a time.  A thread that gets a packet for a busy
+// handler leaves the signals in |pending| for the running thread to pick
+// up before it lets go.
+
 typedef struct {
     list_node_t node;
+    uint64_t id;
     mx_handle_t h;
-    uint32_t flags;
+    // signals seen but not yet handled, and whether a thread is running
+    // the handler; both guarded by the dispatcher lock
+    mx_signals_t pending;
+    bool busy;
     mxio_dispatcher_cb_t cb;
     void* func;
     void* cookie;
 } handler_t;
 
-#if !USE_WAIT_ONCE
-#define FLAG_DISCONNECTED 1
-#endif
+#define HANDLER_BUCKETS 64
 
 struct mxio_dispatcher {
     mtx_t lock;
-    list_node_t list;
+    list_node_t handlers[HANDLER_BUCKETS];
+    uint64_t next_id;
     mx_handle_t ioport;
     mxio_dispatcher_cb_t default_cb;
-    thrd_t t;
+    bool started;
+    atomic_uint threads;
 };
 
 static void mxio_dispatcher_destroy(mxio_dispatcher_t* md) {
@@ -51,50 +65,68 @@ static void mxio_dispatcher_destroy(mxio_dispatcher_t* md) {
     free(md);
 }
 
-static void destroy_handler(mxio_dispatcher_t* md, handler_t* handler, bool need_close_cb) {
-    if (need_close_cb) {
-        handler->cb(0, handler->func, handler->cookie);
+static list_node_t* handler_bucket(mxio_dispatcher_t* md, uint64_t id) {
+    return &md->handlers[id % HANDLER_BUCKETS];
+}
+
+static handler_t* handler_lookup_locked(mxio_dispatcher_t* md, uint64_t id) {
+    handler_t* handler;
+    list_for_every_entry (handler_bucket(md, id), handler, handler_t, node) {
+        if (handler->id == id) {
+            return handler;
+        }
     }
+    return NULL;
+}
 
-    mx_handle_close(handler->h);
-    handler->h = MX_HANDLE_INVALID;
+// Called by the thread running the handler, so no other thread will pick
+// it up again once it is out of the table.
+static void disconnect_handler(mxio_dispatcher_t* md, handler_t* handler, bool need_close_cb) {
+    xprintf("dispatcher: disconnect: %p / %x\n", handler, handler->h);
 
     mtx_lock(&md->lock);
     list_delete(&handler->node);
     mtx_unlock(&md->lock);
-    free(handler);
-}
 
-// synthetic signal bit for synthetic packet
-// used during teardown.
-#define SIGNAL_NEEDS_CLOSE_CB 1u
+    if (need_close_cb) {
+        handler->cb(0, handler->func, handler->cookie);
+    }
 
-static void disconnect_handler(mxio_dispatcher_t* md, handler_t* handler, bool need_close_cb) {
-    xprintf("dispatcher: disconnect: %p / %x\n", handler, handler->h);
+    // closing the handle cancels the wait; any packet still in the port
+    // finds no handler
+    mx_handle_close(handler->h);
+    free(handler);
+}
 
-#if USE_WAIT_ONCE
-    destroy_handler(md, handler, need_close_cb);
-#else
-    // Cancel the async wait operations.
-    mx_status_t r = mx_port_cancel(md->ioport, handler->h, (uint64_t)(uintptr_t)handler);
-    if (r) {
-        printf("dispatcher: CANCEL FAILED %d\n", r);
-    }
+// Runs the handler until nothing is left pending.  Returns false if the
+// handler was torn down.
+static bool run_handler(mxio_dispatcher_t* md, handler_t* handler) {
+    mx_status_t r;
+    for (;;) {
+        mtx_lock(&md->lock);
+        mx_signals_t observed = handler->pending;
+        handler->pending = 0;
+        if (observed == 0) {
+            handler->busy = false;
+            mtx_unlock(&md->lock);
+            return true;
+        }
+        mtx_unlock(&md->lock);
 
-    // send a synthetic message so we know when it's safe to destroy
-    // TODO: once cancel guarantees no packets will arrive after,
-    // we can just destroy the object here instead of doing this...
-    mx_port_packet_t packet;
-    packet.key = (uint64_t)(uintptr_t)handler;
-    packet.signal.observed = need_close_cb ? SIGNAL_NEEDS_CLOSE_CB : 0;
-    r = mx_port_queue(md->ioport, &packet, 0);
-    if (r) {
-        printf("dispatcher: PORT QUEUE FAILED %d\n", r);
+        if (observed & MX_CHANNEL_READABLE) {
+            while ((r = handler->cb(handler->h, handler->func, handler->cookie)) == 0) {
+            }
+            if (r != ERR_DISPATCHER_NO_WORK) {
+                disconnect_handler(md, handler, r < 0);
+                return false;
+            }
+        }
+        if (observed & MX_CHANNEL_PEER_CLOSED) {
+            // synthesize a close
+            disconnect_handler(md, handler, true);
+            return false;
+        }
     }
-
-    // flag so we know to ignore further events
-    handler->flags |= FLAG_DISCONNECTED;
-#endif
 }
 
 static int mxio_dispatcher_thread(void* _md) {
@@ -108,46 +140,29 @@ static int mxio_dispatcher_thread(void* _md) {
             printf("dispatcher: ioport wait failed %d\n", r);
             break;
         }
-        handler_t* handler = (void*)(uintptr_t)packet.key;
-#if !USE_WAIT_ONCE
-        if (handler->flags & FLAG_DISCONNECTED) {
-            // handler is awaiting gc
-            // ignore events for it until we get the synthetic "destroy" event
-            if (packet.type == MX_PKT_TYPE_USER) {
-                destroy_handler(md, handler, packet.signal.observed & SIGNAL_NEEDS_CLOSE_CB);
-                printf("dispatcher: destroy %p\n", handler);
-            } else {
-                printf("dispatcher: spurious packet for %p\n", handler);
-            }
+
+        mtx_lock(&md->lock);
+        handler_t* handler = handler_lookup_locked(md, packet.key);
+        if (handler == NULL) {
+            // torn down after this packet was queued
+            mtx_unlock(&md->lock);
             continue;
         }
-#endif
-        if (packet.signal.observed & MX_CHANNEL_READABLE) {
-            if ((r = handler->cb(handler->h, handler->func, handler->cookie)) != 0) {
-                if (r == ERR_DISPATCHER_NO_WORK) {
-                    printf("mxio: dispatcher found no work to do!\n");
-                } else {
-                    disconnect_handler(md, handler, r < 0);
-                    continue;
-                }
-            }
-#if USE_WAIT_ONCE
-            if ((r = mx_object_wait_async(handler->h, md->ioport, (uint64_t)(uintptr_t)handler,
-                                          MX_CHANNEL_READABLE | MX_CHANNEL_PEER_CLOSED,
-                                          MX_WAIT_ASYNC_ONCE)) < 0) {
-                printf("dispatcher: could not re-arm: %p\n", handler);
-            }
-#endif
+        handler->pending |= packet.signal.observed;
+        if (handler->busy) {
+            mtx_unlock(&md->lock);
             continue;
         }
-        if (packet.signal.observed & MX_CHANNEL_PEER_CLOSED) {
-            // synthesize a close
-            disconnect_handler(md, handler, true);
-        }
+        handler->busy = true;
+        mtx_unlock(&md->lock);
+
+        run_handler(md, handler);
     }
 
     xprintf("dispatcher: FATAL ERROR, EXITING\n");
-    mxio_dispatcher_destroy(md);
+    if (atomic_fetch_sub(&md->threads, 1) == 1) {
+        mxio_dispatcher_destroy(md);
+    }
     return NO_ERROR;
 }
 
@@ -157,7 +172,9 @@ mx_status_t mxio_dispatcher_create(mxio_dispatcher_t** out, mxio_dispatcher_cb_t
         return ERR_NO_MEMORY;
     }
     xprintf("mxio_dispatcher_create: %p\n", md);
-    list_initialize(&md->list);
+    for (size_t i = 0; i < HANDLER_BUCKETS; i++) {
+        list_initialize(&md->handlers[i]);
+    }
     mtx_init(&md->lock, mtx_plain);
     mx_status_t status;
     if ((status = mx_port_create(MX_PORT_OPT_V2, &md->ioport)) < 0) {
@@ -165,29 +182,78 @@ mx_status_t mxio_dispatcher_create(mxio_dispatcher_t** out, mxio_dispatcher_cb_t
         return status;
     }
     md->default_cb = cb;
+    md->next_id = 1;
     *out = md;
     return NO_ERROR;
 }
 
-mx_status_t mxio_dispatcher_start(mxio_dispatcher_t* md, const char* name) {
-    mx_status_t r;
-    mtx_lock(&md->lock);
-    if (md->t == NULL) {
-        if (thrd_create_with_name(&md->t, mxio_dispatcher_thread, md, name) != thrd_success) {
-            mxio_dispatcher_destroy(md);
-            r = ERR_NO_RESOURCES;
+// Returns how many of the |count| threads could be started.
+static uint32_t start_threads(mxio_dispatcher_t* md, const char* name, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        char tname[MX_MAX_NAME_LEN];
+        if (count > 1) {
+            snprintf(tname, sizeof(tname), "%s-%u", name, i);
         } else {
-            thrd_detach(md->t);
-            r = NO_ERROR;
+            snprintf(tname, sizeof(tname), "%s", name);
         }
-    } else {
+        thrd_t t;
+        if (thrd_create_with_name(&t, mxio_dispatcher_thread, md, tname) != thrd_success) {
+            return i;
+        }
+        thrd_detach(t);
+    }
+    return count;
+}
+
+static mx_status_t mark_started(mxio_dispatcher_t* md, uint32_t threads) {
+    mx_status_t r = NO_ERROR;
+    mtx_lock(&md->lock);
+    if (md->started) {
         r = ERR_BAD_STATE;
+    } else {
+        md->started = true;
+        atomic_store(&md->threads, threads);
     }
     mtx_unlock(&md->lock);
     return r;
 }
 
+mx_status_t mxio_dispatcher_start(mxio_dispatcher_t* md, const char* name) {
+    return mxio_dispatcher_start_etc(md, name, 1);
+}
+
+mx_status_t mxio_dispatcher_start_etc(mxio_dispatcher_t* md, const char* name,
+                                      uint32_t threads) {
+    mx_status_t r;
+    if (threads == 0) {
+        return ERR_INVALID_ARGS;
+    }
+    if ((r = mark_started(md, threads)) < 0) {
+        return r;
+    }
+    uint32_t n = start_threads(md, name, threads);
+    if (n == 0) {
+        mxio_dispatcher_destroy(md);
+        return ERR_NO_RESOURCES;
+    }
+    // make do with the threads that did start
+    atomic_fetch_sub(&md->threads, threads - n);
+    return NO_ERROR;
+}
+
 void mxio_dispatcher_run(mxio_dispatcher_t* md) {
+    mxio_dispatcher_run_etc(md, 1);
+}
+
+void mxio_dispatcher_run_etc(mxio_dispatcher_t* md, uint32_t threads) {
+    if (threads == 0) {
+        threads = 1;
+    }
+    if (mark_started(md, threads) < 0) {
+        return;
+    }
+    uint32_t n = start_threads(md, "mxio-dispatcher", threads - 1);
+    atomic_fetch_sub(&md->threads, threads - 1 - n);
     mxio_dispatcher_thread(md);
 }
 
@@ -205,26 +271,20 @@ mx_status_t mxio_dispatcher_add_etc(mxio_dispatcher_t* md, mx_handle_t h,
         return ERR_NO_MEMORY;
     }
     handler->h = h;
-    handler->flags = 0;
+    handler->pending = 0;
+    handler->busy = false;
     handler->cb = cb;
     handler->func = func;
     handler->cookie = cookie;
 
     mtx_lock(&md->lock);
-    list_add_tail(&md->list, &handler->node);
-#if USE_WAIT_ONCE
-    if ((r = mx_object_wait_async(h, md->ioport, (uint64_t)(uintptr_t)handler,
-                                  MX_CHANNEL_READABLE | MX_CHANNEL_PEER_CLOSED,
-                                  MX_WAIT_ASYNC_ONCE)) < 0) {
-        list_delete(&handler->node);
-    }
-#else
-    if ((r = mx_object_wait_async(h, md->ioport, (uint64_t)(uintptr_t)handler,
+    handler->id = md->next_id++;
+    list_add_tail(handler_bucket(md, handler->id), &handler->node);
+    if ((r = mx_object_wait_async(h, md->ioport, handler->id,
                                   MX_CHANNEL_READABLE | MX_CHANNEL_PEER_CLOSED,
                                   MX_WAIT_ASYNC_REPEATING)) < 0) {
         list_delete(&handler->node);
     }
-#endif
     mtx_unlock(&md->lock);
 
     if (r < 0) {
@@ -99,6 +99,8 @@ static mxio_ops_t mxio_epoll_ops = {
     .wait_begin = mxio_default_wait_begin,
     .wait_end = mxio_default_wait_end,
     .posix_ioctl = mxio_default_posix_ioctl,
+    .get_vmo = mxio_default_get_vmo,
+    .mmap = mxio_default_mmap,
 };
 
 mxio_t* mxio_epoll_create(mx_handle_t h) {
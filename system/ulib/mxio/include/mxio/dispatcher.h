@@ -24,14 +24,30 @@ typedef mx_status_t (*mxio_dispatcher_cb_t)(mx_handle_t h, void* func, void* coo
 // A non-zero return will cause the handle to be closed.  If the non-zero
 // return is *negative*, the handler will be called one last time, as if
 // the channel had been closed remotely (zero handle).
+//
+// The handler is called again as long as it returns zero, and must return
+// ERR_DISPATCHER_NO_WORK once the channel is empty: it is only woken again
+// when the channel next becomes readable.
+//
+// A dispatcher may be run by several threads.  Each channel's handler is
+// only ever running on one of them at a time, but handlers for different
+// channels run concurrently, so any state they share needs a lock.
 mx_status_t mxio_dispatcher_create(mxio_dispatcher_t** out, mxio_dispatcher_cb_t cb);
 
 // create a thread for a dispatcher and start it running
 mx_status_t mxio_dispatcher_start(mxio_dispatcher_t* md, const char* name);
 
+// create |threads| threads for a dispatcher and start them running
+mx_status_t mxio_dispatcher_start_etc(mxio_dispatcher_t* md, const char* name,
+                                      uint32_t threads);
+
 // run the dispatcher loop on the current thread, never to return
 void mxio_dispatcher_run(mxio_dispatcher_t* md);
 
+// run the dispatcher loop on the current thread and |threads| - 1 more,
+// never to return
+void mxio_dispatcher_run_etc(mxio_dispatcher_t* md, uint32_t threads);
+
 // add a channel to the dispatcher, using the default callback
 mx_status_t mxio_dispatcher_add(mxio_dispatcher_t* md, mx_handle_t h,
                                 void* func, void* cookie);
@@ -55,4 +55,14 @@ mx_status_t mxio_pipe_half(mx_handle_t* handle, uint32_t* type);
 // the contents of the file, at offset off, of length len.
 mx_status_t mxio_get_vmo(int fd, mx_handle_t* vmo, size_t* off, size_t* len);
 
+// Cache what stat(), access() and open()s which find nothing learn about
+// absolute paths under path, which should be where a filesystem is
+// mounted, until anything in that filesystem changes.  Lookups which
+// cross into another filesystem mounted further down, or into a device,
+// are not cached, since its changes are not seen.
+mx_status_t mxio_cache_enable(const char* path);
+
+// Stop caching paths under path, forgetting what was cached for them.
+mx_status_t mxio_cache_disable(const char* path);
+
 __END_CDECLS
@@ -49,7 +49,10 @@ __BEGIN_CDECLS
 #define MXRIO_SETATTR      0x00000018
 #define MXRIO_SYNC         0x00000019
 #define MXRIO_LINK        (0x0000001a | MXRIO_ONE_HANDLE)
-#define MXRIO_NUM_OPS      27
+#define MXRIO_READ_VMO    (0x0000001b | MXRIO_ONE_HANDLE)
+#define MXRIO_WRITE_VMO   (0x0000001c | MXRIO_ONE_HANDLE)
+#define MXRIO_MMAP         0x0000001d
+#define MXRIO_NUM_OPS      30
 
 #define MXRIO_OP(n)        ((n) & 0x3FF) // opcode
 #define MXRIO_HC(n)        (((n) >> 8) & 3) // handle count
@@ -62,7 +65,8 @@ __BEGIN_CDECLS
     "read_at", "write_at", "truncate", "rename", \
     "connect", "bind", "listen", "getsockname", \
     "getpeername", "getsockopt", "setsockopt", "getaddrinfo", \
-    "setattr", "sync", "link" }
+    "setattr", "sync", "link", "read_vmo", \
+    "write_vmo", "mmap" }
 
 const char* mxio_opname(uint32_t op);
 
@@ -133,6 +137,8 @@ struct mxrio_msg {
 
 static_assert(MXIO_CHUNK_SIZE >= PATH_MAX, "MXIO_CHUNK_SIZE must be large enough to contain paths");
 
+#define MXRIO_OFF_SEEK    (-1)
+
 #define READDIR_CMD_NONE  0
 #define READDIR_CMD_RESET 1
 
@@ -167,6 +173,20 @@ static_assert(MXIO_CHUNK_SIZE >= PATH_MAX, "MXIO_CHUNK_SIZE must be large enough
 // SETATTR     0          0        <vnattr>          0           -               -
 // SYNC        0          0        0                 0           -               -
 // LINK        0          0        <name1>0<name2>0  0           -               -
+// READ_VMO    maxread    offset   -                 newoffset   -               -
+// WRITE_VMO   len        offset   -                 newoffset   -               -
+// MMAP        flags      offset   <uint64:len>      vmooffset   -               vmohandle
+//
+// READ_VMO and WRITE_VMO carry a vmo handle, which the server consumes, and
+// move the data through the start of that vmo rather than through data[],
+// so they are not limited to MXIO_CHUNK_SIZE. An offset of MXRIO_OFF_SEEK
+// reads or writes at the seek pointer and advances it, like READ and WRITE.
+// Servers which do not support them reply ERR_NOT_SUPPORTED.
+//
+// MMAP asks for a vmo holding the file's contents, with rights to suit the
+// MXIO_MMAP_FLAG_* flags. The bytes at the requested offset are found at
+// vmooffset within it. Without MXIO_MMAP_FLAG_PRIVATE, stores through a
+// writable mapping reach the file when it is next synced.
 //
 // proposed:
 //
@@ -174,7 +194,6 @@ static_assert(MXIO_CHUNK_SIZE >= PATH_MAX, "MXIO_CHUNK_SIZE must be large enough
 // MKDIR       0          0        <name>            0           -               -
 // SYMLINK     namelen    0        <name><path>      0           -               -
 // READLINK    maxreply   0        -                 0           <path>          -
-// MMAP        flags      offset   <uint64:len>      offset      -               vmohandle
 // FLUSH       0          0        -                 0           -               -
 //
 // on response arg32 is always mx_status, and may be positive for read/write calls
@@ -65,6 +65,12 @@ typedef struct vnattr {
 #define VTYPE_TO_DTYPE(mode) (((mode)&V_TYPE_MASK) >> 12)
 #define DTYPE_TO_VTYPE(type) (((type)&15) << 12)
 
+// flags for MXRIO_MMAP
+#define MXIO_MMAP_FLAG_READ    0x00000001
+#define MXIO_MMAP_FLAG_WRITE   0x00000002
+#define MXIO_MMAP_FLAG_EXEC    0x00000004
+#define MXIO_MMAP_FLAG_PRIVATE 0x00010000
+
 typedef struct vdirent {
     uint32_t size;
     uint32_t type;
@@ -152,6 +152,9 @@ static mx_status_t handle_loader_rpc(mx_handle_t h, mxio_loader_service_function
     uint32_t sz = sizeof(data);
     mx_status_t r;
     if ((r = mx_channel_read(h, 0, msg, sz, &sz, NULL, 0, NULL)) < 0) {
+        if (r == ERR_SHOULD_WAIT) {
+            return ERR_DISPATCHER_NO_WORK;
+        }
         // This is the normal error for the other end going away,
         // which happens when the process dies.
         if (r != ERR_PEER_CLOSED)
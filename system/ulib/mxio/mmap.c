@@ -0,0 +1,204 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <errno.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <threads.h>
+
+#include <magenta/process.h>
+#include <magenta/syscalls.h>
+#include <mxio/remoteio.h>
+#include <mxio/vfs.h>
+
+#include "private.h"
+#include "unistd.h"
+
+// Shared writable mappings of files, which are written back by msync()
+// and munmap(). Each holds a reference to the file it maps.
+typedef struct mxio_mapping mxio_mapping_t;
+struct mxio_mapping {
+    mxio_mapping_t* next;
+    uintptr_t start;
+    size_t len;
+    mxio_t* io;
+};
+
+static mtx_t mapping_lock = MTX_INIT;
+static mxio_mapping_t* mapping_list;
+
+#define MX_VM_FLAG_PERMS \
+    (MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE | MX_VM_FLAG_PERM_EXECUTE)
+
+// Maps a fresh vmo holding a copy of len bytes of vmo from vmo_off.
+static mx_status_t map_copy(mx_handle_t vmo, size_t vmo_off, size_t offset, size_t len,
+                            uint32_t mx_flags, uintptr_t* out) {
+    mx_status_t r;
+    uint64_t size;
+    if ((r = mx_vmo_get_size(vmo, &size)) < 0) {
+        return r;
+    }
+    mx_handle_t copy;
+    if ((r = mx_vmo_create(len, 0, &copy)) < 0) {
+        return r;
+    }
+    uint32_t fill_flags = (mx_flags & ~MX_VM_FLAG_PERMS) |
+                          MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE;
+    uintptr_t ptr;
+    r = mx_vmar_map(mx_vmar_root_self(), offset, copy, 0, len, fill_flags, &ptr);
+    mx_handle_close(copy);
+    if (r < 0) {
+        return r;
+    }
+
+    // anything past the end of the file stays zero
+    if (vmo_off < size) {
+        size_t actual;
+        size_t xfer = (size - vmo_off < len) ? size - vmo_off : len;
+        if ((r = mx_vmo_read(vmo, (void*)ptr, vmo_off, xfer, &actual)) < 0) {
+            goto fail;
+        }
+    }
+    if ((mx_flags & MX_VM_FLAG_PERMS) != (fill_flags & MX_VM_FLAG_PERMS)) {
+        r = mx_vmar_protect(mx_vmar_root_self(), ptr, len, mx_flags & MX_VM_FLAG_PERMS);
+        if (r < 0) {
+            goto fail;
+        }
+    }
+    *out = ptr;
+    return NO_ERROR;
+
+fail:
+    mx_vmar_unmap(mx_vmar_root_self(), ptr, len);
+    return r;
+}
+
+// hook into libc mmap() for anything but anonymous memory
+mx_status_t _mmap_file(size_t offset, size_t len, uint32_t mx_flags, int flags,
+                       int fd, off_t fd_off, uintptr_t* out) {
+    if (fd_off < 0) {
+        return ERR_INVALID_ARGS;
+    }
+    mxio_t* io;
+    if ((io = fd_to_io(fd)) == NULL) {
+        return ERR_BAD_HANDLE;
+    }
+
+    // Without copy-on-write clones of vmos, a private writable mapping
+    // gets a copy of the file, which need only be readable to make.
+    bool writable = (mx_flags & MX_VM_FLAG_PERM_WRITE) != 0;
+    bool copy = writable && (flags & MAP_PRIVATE);
+    bool shared = writable && (flags & MAP_SHARED);
+
+    uint32_t vflags = MXIO_MMAP_FLAG_READ;
+    if (!copy) {
+        vflags |= writable ? MXIO_MMAP_FLAG_WRITE : 0;
+        vflags |= (mx_flags & MX_VM_FLAG_PERM_EXECUTE) ? MXIO_MMAP_FLAG_EXEC : 0;
+    }
+    vflags |= (flags & MAP_PRIVATE) ? MXIO_MMAP_FLAG_PRIVATE : 0;
+
+    mxio_mapping_t* mapping = NULL;
+    if (shared && ((mapping = malloc(sizeof(*mapping))) == NULL)) {
+        mxio_release(io);
+        return ERR_NO_MEMORY;
+    }
+
+    mx_handle_t vmo;
+    size_t vmo_off = fd_off;
+    mx_status_t r;
+    if ((r = io->ops->mmap(io, vflags, len, &vmo_off, &vmo)) < 0) {
+        goto fail;
+    }
+    if (vmo_off & (PAGE_SIZE - 1)) {
+        // The file does not start on a page boundary within the vmo (as
+        // in bootfs), so can only be mapped by copying it.
+        if (shared) {
+            r = ERR_NOT_SUPPORTED;
+        } else {
+            r = map_copy(vmo, vmo_off, offset, len, mx_flags, out);
+        }
+    } else if (copy) {
+        r = map_copy(vmo, vmo_off, offset, len, mx_flags, out);
+    } else {
+        r = mx_vmar_map(mx_vmar_root_self(), offset, vmo, vmo_off, len, mx_flags, out);
+    }
+    mx_handle_close(vmo);
+    if (r < 0) {
+        goto fail;
+    }
+
+    if (shared) {
+        // the mapping keeps our reference to io
+        mapping->start = *out;
+        mapping->len = len;
+        mapping->io = io;
+        mtx_lock(&mapping_lock);
+        mapping->next = mapping_list;
+        mapping_list = mapping;
+        mtx_unlock(&mapping_lock);
+    } else {
+        mxio_release(io);
+    }
+    return NO_ERROR;
+
+fail:
+    free(mapping);
+    mxio_release(io);
+    return r;
+}
+
+static bool overlaps(mxio_mapping_t* m, uintptr_t start, size_t len) {
+    return (m->start < start + len) && (start < m->start + m->len);
+}
+
+// hook into libc msync()
+mx_status_t _msync_file(void* start, size_t len, int flags) {
+    // MS_ASYNC only schedules the write, which munmap() will do anyway.
+    if (!(flags & MS_SYNC)) {
+        return NO_ERROR;
+    }
+    mx_status_t status = NO_ERROR;
+    mtx_lock(&mapping_lock);
+    for (mxio_mapping_t* m = mapping_list; m != NULL; m = m->next) {
+        if (overlaps(m, (uintptr_t)start, len)) {
+            mx_status_t r = m->io->ops->misc(m->io, MXRIO_SYNC, 0, 0, 0, 0);
+            if (r < 0) {
+                status = r;
+            }
+        }
+    }
+    mtx_unlock(&mapping_lock);
+    return status;
+}
+
+// hook into libc munmap()
+void _munmap_file(void* start, size_t len) {
+    uintptr_t ustart = (uintptr_t)start;
+    mxio_mapping_t* done = NULL;
+    mtx_lock(&mapping_lock);
+    // mappings only partly unmapped stay on the list until the rest goes
+    for (mxio_mapping_t** prev = &mapping_list; *prev != NULL;) {
+        mxio_mapping_t* m = *prev;
+        if ((m->start >= ustart) && (m->start + m->len <= ustart + len)) {
+            *prev = m->next;
+            m->next = done;
+            done = m;
+        } else {
+            prev = &m->next;
+        }
+    }
+    mtx_unlock(&mapping_lock);
+
+    // What was stored through the mapping is written back as it goes,
+    // as it would be from a page cache.
+    while (done != NULL) {
+        mxio_mapping_t* m = done;
+        done = m->next;
+        m->io->ops->misc(m->io, MXRIO_SYNC, 0, 0, 0, 0);
+        mxio_release(m->io);
+        free(m);
+    }
+}
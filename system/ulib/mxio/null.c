@@ -80,6 +80,10 @@ mx_status_t mxio_default_get_vmo(mxio_t* io, mx_handle_t* out, size_t* off, size
     return ERR_NOT_SUPPORTED;
 }
 
+mx_status_t mxio_default_mmap(mxio_t* io, uint32_t flags, size_t len, size_t* off, mx_handle_t* out) {
+    return ERR_NOT_SUPPORTED;
+}
+
 static mxio_ops_t mx_null_ops = {
     .read = mxio_default_read,
     .write = mxio_default_write,
@@ -96,6 +100,7 @@ static mxio_ops_t mx_null_ops = {
     .unwrap = mxio_default_unwrap,
     .posix_ioctl = mxio_default_posix_ioctl,
     .get_vmo = mxio_default_get_vmo,
+    .mmap = mxio_default_mmap,
 };
 
 mxio_t* mxio_null_create(void) {
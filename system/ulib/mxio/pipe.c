@@ -189,8 +189,46 @@ static mxio_ops_t mx_pipe_ops = {
     .unwrap = mx_pipe_unwrap,
     .posix_ioctl = mx_pipe_posix_ioctl,
     .get_vmo = mxio_default_get_vmo,
+    .mmap = mxio_default_mmap,
 };
 
+// Either end of a pipe may be the one asked, and a pipe does not know
+// which way its data flows, so both of the socket's buffers are looked
+// at: the one this end reads from, and the peer's, which its writes fill.
+// Once the peer is gone only the first matters.
+mx_status_t mxio_pipe_get_buffer_size(mxio_t* io, size_t* out) {
+    mx_pipe_t* p = (void*)io;
+    size_t peer_size;
+    mx_status_t r;
+    if ((r = mx_object_get_property(p->h, MX_PROP_SOCKET_BUFFER_SIZE,
+                                    out, sizeof(*out))) < 0) {
+        return r;
+    }
+    r = mx_object_get_property(p->h, MX_PROP_SOCKET_PEER_BUFFER_SIZE,
+                               &peer_size, sizeof(peer_size));
+    if (r == ERR_PEER_CLOSED) {
+        return NO_ERROR;
+    } else if (r < 0) {
+        return r;
+    }
+    if (peer_size > *out) {
+        *out = peer_size;
+    }
+    return NO_ERROR;
+}
+
+mx_status_t mxio_pipe_set_buffer_size(mxio_t* io, size_t size) {
+    mx_pipe_t* p = (void*)io;
+    mx_status_t r;
+    if ((r = mx_object_set_property(p->h, MX_PROP_SOCKET_BUFFER_SIZE,
+                                    &size, sizeof(size))) < 0) {
+        return r;
+    }
+    r = mx_object_set_property(p->h, MX_PROP_SOCKET_PEER_BUFFER_SIZE,
+                               &size, sizeof(size));
+    return (r == ERR_PEER_CLOSED) ? NO_ERROR : r;
+}
+
 mxio_t* mxio_pipe_create(mx_handle_t h) {
     mx_pipe_t* p = calloc(1, sizeof(*p));
     if (p == NULL)
@@ -207,7 +245,7 @@ int mxio_pipe_pair(mxio_t** _a, mxio_t** _b) {
     mx_handle_t h0, h1;
     mxio_t *a, *b;
     mx_status_t r;
-    if ((r = mx_socket_create(0, &h0, &h1)) < 0) {
+    if ((r = mx_socket_create(MX_SOCKET_CREATE_RESIZABLE, &h0, &h1)) < 0) {
         return r;
     }
     if ((a = mxio_pipe_create(h0)) == NULL) {
@@ -227,7 +265,7 @@ int mxio_pipe_pair(mxio_t** _a, mxio_t** _b) {
 
 mx_status_t mxio_pipe_pair_raw(mx_handle_t* handles, uint32_t* types) {
     mx_status_t r;
-    if ((r = mx_socket_create(0, handles, handles + 1)) < 0) {
+    if ((r = mx_socket_create(MX_SOCKET_CREATE_RESIZABLE, handles, handles + 1)) < 0) {
         return r;
     }
     types[0] = MX_HND_TYPE_MXIO_PIPE;
@@ -240,7 +278,7 @@ mx_status_t mxio_pipe_half(mx_handle_t* handle, uint32_t* type) {
     mx_status_t r;
     mxio_t* io;
     int fd;
-    if ((r = mx_socket_create(0, &h0, &h1)) < 0) {
+    if ((r = mx_socket_create(MX_SOCKET_CREATE_RESIZABLE, &h0, &h1)) < 0) {
         return r;
     }
     if ((io = mxio_pipe_create(h0)) == NULL) {
@@ -43,6 +43,7 @@ typedef struct mxio_ops {
     ssize_t (*ioctl)(mxio_t* io, uint32_t op, const void* in_buf, size_t in_len, void* out_buf, size_t out_len);
     ssize_t (*posix_ioctl)(mxio_t* io, int req, va_list va);
     mx_status_t (*get_vmo)(mxio_t* io, mx_handle_t* out, size_t* off, size_t* len);
+    mx_status_t (*mmap)(mxio_t* io, uint32_t flags, size_t len, size_t* off, mx_handle_t* out);
 } mxio_ops_t;
 
 // mxio_t flags
@@ -120,6 +121,11 @@ mxio_t* mxio_pipe_create(mx_handle_t h);
 
 mx_status_t mxio_pipe_posix_ioctl(mxio_t* io, int req, va_list va);
 
+// the size of a pipe's (MXIO_FLAG_PIPE) buffers, which bounds how much
+// may be written to either end before it blocks
+mx_status_t mxio_pipe_get_buffer_size(mxio_t* io, size_t* out);
+mx_status_t mxio_pipe_set_buffer_size(mxio_t* io, size_t size);
+
 // wraps a vmo, offset, length with an mxio_t providing a readonly file
 mxio_t* mxio_vmofile_create(mx_handle_t h, mx_off_t off, mx_off_t len);
 
@@ -150,6 +156,7 @@ mxio_t* mxio_waitable_create(mx_handle_t h, mx_signals_t signals_in, mx_signals_
 
 void mxio_socket_set_stream_ops(mxio_t* io);
 void mxio_socket_set_dgram_ops(mxio_t* io);
+bool mxio_is_socket_dgram(mxio_t* io);
 
 mx_status_t mxio_socket_posix_ioctl(mxio_t* io, int req, va_list va);
 mx_status_t mxio_socket_shutdown(mxio_t* io, int how);
@@ -172,6 +179,7 @@ void mxio_default_wait_end(mxio_t* io, mx_signals_t signals, uint32_t* _events);
 mx_status_t mxio_default_unwrap(mxio_t* io, mx_handle_t* handles, uint32_t* types);
 ssize_t mxio_default_posix_ioctl(mxio_t* io, int req, va_list va);
 mx_status_t mxio_default_get_vmo(mxio_t* io, mx_handle_t* out, size_t* off, size_t* len);
+mx_status_t mxio_default_mmap(mxio_t* io, uint32_t flags, size_t len, size_t* off, mx_handle_t* out);
 
 void __mxio_startup_handles_init(uint32_t num, mx_handle_t handles[],
                                  uint32_t handle_info[])
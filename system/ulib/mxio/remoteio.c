@@ -25,6 +25,7 @@
 #include <mxio/remoteio.h>
 #include <mxio/socket.h>
 #include <mxio/util.h>
+#include <mxio/vfs.h>
 
 #include "private.h"
 
@@ -40,6 +41,50 @@ static_assert((POLLOUT << POLL_SHIFT) == DEVICE_SIGNAL_WRITABLE, "");
 static_assert((POLLERR << POLL_SHIFT) == DEVICE_SIGNAL_ERROR, "");
 static_assert((POLLHUP << POLL_SHIFT) == DEVICE_SIGNAL_HANGUP, "");
 
+// Small sequential read()s of a file are served from READ_AT requests
+// issued ahead of them, up to MXRIO_READAHEAD_DEPTH chunks at a time,
+// once MXRIO_READAHEAD_TRIGGER full reads in a row have been seen.
+//
+// Data read ahead is only as fresh as the moment it was requested.  The
+// stream ends on any write, seek or truncate through the same mxio, but
+// nothing tells it of writes through other connections to the file, so
+// it is only used where the reader cannot be writing the file itself:
+// files opened read-only, or objects nothing has yet been written
+// through.  Like any client cache, it is not coherent with other writers.
+#define MXRIO_READAHEAD_DEPTH 4
+#define MXRIO_READAHEAD_TRIGGER 2
+
+// Whether a remote object may be read ahead: it must be a regular
+// file, as the reads of anything else may block or have side effects,
+// and not one written through this mxio.
+#define RA_UNKNOWN 0
+#define RA_FILE    1
+#define RA_NEVER   2
+
+typedef struct mxrio_prefetch {
+    mx_txid_t txid;
+    bool done;
+    mx_status_t status;
+    int64_t off;
+    uint32_t len;
+    uint32_t consumed;
+    uint8_t data[MXIO_CHUNK_SIZE];
+} mxrio_prefetch_t;
+
+typedef struct mxrio_readahead {
+    // outstanding and completed prefetches, in file order from head
+    mxrio_prefetch_t slot[MXRIO_READAHEAD_DEPTH];
+    unsigned head;
+    unsigned count;
+    // where the reader is, where the next prefetch starts, and where the
+    // server's seek pointer was left, which READ_AT does not move
+    int64_t pos;
+    int64_t next;
+    int64_t server_off;
+    // a prefetch came back short; issue no more
+    bool eof;
+} mxrio_readahead_t;
+
 typedef struct mxrio mxrio_t;
 struct mxrio {
     // base mxio io object
@@ -53,6 +98,18 @@ struct mxrio {
 
     // transaction id used for synchronous remoteio calls
     _Atomic mx_txid_t txid;
+
+    // set once the server has refused READ_VMO or WRITE_VMO
+    atomic_bool no_vmo_io;
+
+    // RA_UNKNOWN, RA_FILE or RA_NEVER
+    atomic_int ra_kind;
+    // Once the object is known to be a file, held across anything which
+    // uses or moves the seek pointer, so that the readahead stream (if
+    // any) is consistent with it.
+    mtx_t ra_lock;
+    unsigned ra_seq;
+    mxrio_readahead_t* ra;
 };
 
 static pthread_key_t rchannel_key;
@@ -334,6 +391,87 @@ static ssize_t mxrio_ioctl(mxio_t* io, uint32_t op, const void* in_buf,
     return r;
 }
 
+// Reads and writes larger than a message's payload move their data through
+// a vmo instead, up to this many bytes per round trip.
+#define MXRIO_VMO_XFER_MAX (16u * 1024 * 1024)
+
+// one READ_VMO or WRITE_VMO round trip through a vmo made for the purpose
+static mx_status_t vmo_txn(mxrio_t* rio, uint32_t op, uint8_t* data, size_t len, int64_t offset) {
+    mx_handle_t vmo;
+    mx_status_t r;
+    size_t actual;
+    if ((r = mx_vmo_create(len, 0, &vmo)) < 0) {
+        return r;
+    }
+    if (op == MXRIO_WRITE_VMO) {
+        if ((r = mx_vmo_write(vmo, data, 0, len, &actual)) < 0) {
+            goto done;
+        } else if (actual != len) {
+            r = ERR_IO;
+            goto done;
+        }
+    }
+
+    mxrio_msg_t msg;
+    memset(&msg, 0, MXRIO_HDR_SZ);
+    msg.op = op;
+    msg.arg = len;
+    msg.arg2.off = offset;
+    msg.hcount = 1;
+    if ((r = mx_handle_duplicate(vmo, MX_RIGHT_SAME_RIGHTS, &msg.handle[0])) < 0) {
+        goto done;
+    }
+    if ((r = mxrio_txn(rio, &msg)) < 0) {
+        goto done;
+    }
+    discard_handles(msg.handle, msg.hcount);
+
+    if ((size_t)r > len) {
+        r = ERR_IO;
+    } else if ((op == MXRIO_READ_VMO) && (r > 0)) {
+        mx_status_t status;
+        if ((status = mx_vmo_read(vmo, data, 0, r, &actual)) < 0) {
+            r = status;
+        } else if (actual != (size_t)r) {
+            r = ERR_IO;
+        }
+    }
+done:
+    mx_handle_close(vmo);
+    return r;
+}
+
+// Returns ERR_NOT_SUPPORTED, having done nothing, if the server
+// cannot do vmo io; the caller falls back to chunked messages.
+static ssize_t vmo_io_common(uint32_t op, mxrio_t* rio, uint8_t* data, size_t len, off_t offset) {
+    ssize_t count = 0;
+    mx_status_t r = 0;
+    size_t xfer;
+
+    if (atomic_load(&rio->no_vmo_io)) {
+        return ERR_NOT_SUPPORTED;
+    }
+    while (len > 0) {
+        xfer = (len > MXRIO_VMO_XFER_MAX) ? MXRIO_VMO_XFER_MAX : len;
+        if ((r = vmo_txn(rio, op, data, xfer, offset)) < 0) {
+            if ((r == ERR_NOT_SUPPORTED) && (count == 0)) {
+                atomic_store(&rio->no_vmo_io, true);
+            }
+            break;
+        }
+        count += r;
+        data += r;
+        len -= r;
+        if (offset != MXRIO_OFF_SEEK)
+            offset += r;
+        // stop at short read or write
+        if ((size_t)r < xfer) {
+            break;
+        }
+    }
+    return count ? count : r;
+}
+
 static ssize_t write_common(uint32_t op, mxio_t* io, const void* _data, size_t len, off_t offset) {
     mxrio_t* rio = (mxrio_t*)io;
     const uint8_t* data = _data;
@@ -342,6 +480,15 @@ static ssize_t write_common(uint32_t op, mxio_t* io, const void* _data, size_t l
     mxrio_msg_t msg;
     ssize_t xfer;
 
+    if (len > MXIO_CHUNK_SIZE) {
+        count = vmo_io_common(MXRIO_WRITE_VMO, rio, (uint8_t*)data, len,
+                              (op == MXRIO_WRITE_AT) ? offset : MXRIO_OFF_SEEK);
+        if (count != ERR_NOT_SUPPORTED) {
+            return count;
+        }
+        count = 0;
+    }
+
     while (len > 0) {
         xfer = (len > MXIO_CHUNK_SIZE) ? MXIO_CHUNK_SIZE : len;
 
@@ -374,15 +521,10 @@ static ssize_t write_common(uint32_t op, mxio_t* io, const void* _data, size_t l
     return count ? count : r;
 }
 
-static ssize_t mxrio_write(mxio_t* io, const void* _data, size_t len) {
-    return write_common(MXRIO_WRITE, io, _data, len, 0);
-}
-
-static ssize_t mxrio_write_at(mxio_t* io, const void* _data, size_t len, mx_off_t offset) {
-    return write_common(MXRIO_WRITE_AT, io, _data, len, offset);
-}
-
-static ssize_t read_common(uint32_t op, mxio_t* io, void* _data, size_t len, off_t offset) {
+// For MXRIO_READ of at most MXIO_CHUNK_SIZE, the seek pointer after the
+// read is returned through newoff.
+static ssize_t read_common(uint32_t op, mxio_t* io, void* _data, size_t len, off_t offset,
+                           int64_t* newoff) {
     mxrio_t* rio = (mxrio_t*)io;
     uint8_t* data = _data;
     ssize_t count = 0;
@@ -390,6 +532,15 @@ static ssize_t read_common(uint32_t op, mxio_t* io, void* _data, size_t len, off
     mxrio_msg_t msg;
     ssize_t xfer;
 
+    if (len > MXIO_CHUNK_SIZE) {
+        count = vmo_io_common(MXRIO_READ_VMO, rio, data, len,
+                              (op == MXRIO_READ_AT) ? offset : MXRIO_OFF_SEEK);
+        if (count != ERR_NOT_SUPPORTED) {
+            return count;
+        }
+        count = 0;
+    }
+
     while (len > 0) {
         xfer = (len > MXIO_CHUNK_SIZE) ? MXIO_CHUNK_SIZE : len;
 
@@ -414,6 +565,8 @@ static ssize_t read_common(uint32_t op, mxio_t* io, void* _data, size_t len, off
         len -= r;
         if (op == MXRIO_READ_AT)
             offset += r;
+        else if (newoff != NULL)
+            *newoff = msg.arg2.off;
 
         // stop at short read
         if (r < xfer) {
@@ -423,16 +576,302 @@ static ssize_t read_common(uint32_t op, mxio_t* io, void* _data, size_t len, off
     return count ? count : r;
 }
 
+// Sends a READ_AT for the next chunk of the stream, without waiting.
+static mx_status_t ra_issue(mxrio_t* rio, mxrio_readahead_t* ra) {
+    mxrio_prefetch_t* p = &ra->slot[(ra->head + ra->count) % MXRIO_READAHEAD_DEPTH];
+    mxrio_msg_t msg;
+    memset(&msg, 0, MXRIO_HDR_SZ);
+    msg.txid = atomic_fetch_add(&rio->txid, 1);
+    msg.op = MXRIO_READ_AT;
+    msg.arg = MXIO_CHUNK_SIZE;
+    msg.arg2.off = ra->next;
+
+    mx_status_t r;
+    if ((r = mx_channel_write(rio->h, 0, &msg, MXRIO_HDR_SZ, NULL, 0)) < 0) {
+        return r;
+    }
+    p->txid = msg.txid;
+    p->done = false;
+    p->off = ra->next;
+    p->consumed = 0;
+    ra->next += MXIO_CHUNK_SIZE;
+    ra->count++;
+    return NO_ERROR;
+}
+
+// Waits for one prefetch reply and files it with its request. Replies
+// to mx_channel_call()s on the same channel go straight to their callers,
+// so anything read here is the reply to some prefetch, in whatever order
+// the server chose to answer, or one left behind by an earlier call that
+// gave up waiting; those are dropped.
+static mx_status_t ra_collect(mxrio_t* rio, mxrio_readahead_t* ra) {
+    mxrio_msg_t msg;
+    uint32_t dsize;
+    mx_status_t r;
+    for (;;) {
+        msg.hcount = MXIO_MAX_HANDLES;
+        r = mx_channel_read(rio->h, 0, &msg, sizeof(msg), &dsize,
+                            msg.handle, msg.hcount, &msg.hcount);
+        if (r == ERR_SHOULD_WAIT) {
+            mx_signals_t pending;
+            if ((r = mx_object_wait_one(rio->h, MX_CHANNEL_READABLE | MX_CHANNEL_PEER_CLOSED,
+                                        MX_TIME_INFINITE, &pending)) < 0) {
+                return r;
+            }
+            if (!(pending & MX_CHANNEL_READABLE)) {
+                return ERR_PEER_CLOSED;
+            }
+            continue;
+        }
+        if (r < 0) {
+            return r;
+        }
+        discard_handles(msg.handle, msg.hcount);
+        if (dsize < MXRIO_HDR_SZ) {
+            continue;
+        }
+
+        for (unsigned i = 0; i < ra->count; i++) {
+            mxrio_prefetch_t* p = &ra->slot[(ra->head + i) % MXRIO_READAHEAD_DEPTH];
+            if (p->done || (p->txid != msg.txid)) {
+                continue;
+            }
+            p->done = true;
+            p->status = msg.arg;
+            if (!is_message_reply_valid(&msg, dsize) || (MXRIO_OP(msg.op) != MXRIO_STATUS) ||
+                (msg.arg > (int32_t)msg.datalen) || (msg.arg > MXIO_CHUNK_SIZE)) {
+                p->status = ERR_IO;
+            }
+            p->len = (p->status > 0) ? (uint32_t)p->status : 0;
+            memcpy(p->data, msg.data, p->len);
+            return NO_ERROR;
+        }
+    }
+}
+
+// Drops any replies already waiting on the channel, which can only be
+// ones nobody is waiting for, so that a stream starts with it empty.
+static void ra_drain(mxrio_t* rio) {
+    mxrio_msg_t msg;
+    uint32_t dsize;
+    for (;;) {
+        msg.hcount = MXIO_MAX_HANDLES;
+        if (mx_channel_read(rio->h, 0, &msg, sizeof(msg), &dsize,
+                            msg.handle, msg.hcount, &msg.hcount) < 0) {
+            return;
+        }
+        discard_handles(msg.handle, msg.hcount);
+    }
+}
+
+// Serves a read from the stream, topping the prefetches back up as they
+// are used. Returns less than len only at the end of the file, or on an
+// error.
+static ssize_t ra_read(mxrio_t* rio, mxrio_readahead_t* ra, uint8_t* data, size_t len) {
+    size_t count = 0;
+    mx_status_t r = NO_ERROR;
+    while ((count < len) && (ra->count > 0)) {
+        mxrio_prefetch_t* p = &ra->slot[ra->head];
+        while (!p->done) {
+            if ((r = ra_collect(rio, ra)) < 0) {
+                return count ? (ssize_t)count : r;
+            }
+        }
+        if (p->status < 0) {
+            return count ? (ssize_t)count : p->status;
+        }
+
+        size_t xfer = p->len - p->consumed;
+        if (xfer > len - count) {
+            xfer = len - count;
+        }
+        memcpy(data + count, p->data + p->consumed, xfer);
+        p->consumed += xfer;
+        count += xfer;
+        ra->pos += xfer;
+
+        if (p->consumed == p->len) {
+            ra->head = (ra->head + 1) % MXRIO_READAHEAD_DEPTH;
+            ra->count--;
+            if (p->len < MXIO_CHUNK_SIZE) {
+                ra->eof = true;
+                break;
+            }
+            if (!ra->eof && (ra_issue(rio, ra) < 0)) {
+                ra->eof = true;
+            }
+        }
+    }
+    return count;
+}
+
+// Starts a stream at off, where the server's seek pointer is.
+static void ra_start(mxrio_t* rio, int64_t off) {
+    mxrio_readahead_t* ra = calloc(1, sizeof(*ra));
+    if (ra == NULL) {
+        return;
+    }
+    ra->pos = ra->next = ra->server_off = off;
+    ra_drain(rio);
+    while ((ra->count < MXRIO_READAHEAD_DEPTH) && (ra_issue(rio, ra) == NO_ERROR)) {
+    }
+    if (ra->count == 0) {
+        free(ra);
+        return;
+    }
+    rio->ra = ra;
+}
+
+// Ends the stream, if there is one: waits out its prefetches and leaves
+// the server's seek pointer where the reader got to.
+static mx_status_t ra_stop(mxrio_t* rio) {
+    mxrio_readahead_t* ra = rio->ra;
+    rio->ra_seq = 0;
+    if (ra == NULL) {
+        return NO_ERROR;
+    }
+    rio->ra = NULL;
+
+    mx_status_t r = NO_ERROR;
+    for (unsigned i = 0; i < ra->count; i++) {
+        mxrio_prefetch_t* p = &ra->slot[(ra->head + i) % MXRIO_READAHEAD_DEPTH];
+        while (!p->done) {
+            if ((r = ra_collect(rio, ra)) < 0) {
+                break;
+            }
+        }
+        if (r < 0) {
+            break;
+        }
+    }
+    if ((r == NO_ERROR) && (ra->pos != ra->server_off)) {
+        mxrio_msg_t msg;
+        memset(&msg, 0, MXRIO_HDR_SZ);
+        msg.op = MXRIO_SEEK;
+        msg.arg = SEEK_SET;
+        msg.arg2.off = ra->pos;
+        if ((r = mxrio_txn(rio, &msg)) >= 0) {
+            discard_handles(msg.handle, msg.hcount);
+            r = NO_ERROR;
+        }
+    }
+    free(ra);
+    return r;
+}
+
+// Called after a read() of an object not yet known to be a file. Once
+// reads look sequential, find out what the object is, and if it is a
+// file, where its seek pointer is.
+static void ra_note_read(mxrio_t* rio, ssize_t r, size_t len) {
+    mtx_lock(&rio->ra_lock);
+    if ((r != (ssize_t)len) || (len > MXIO_CHUNK_SIZE)) {
+        rio->ra_seq = 0;
+    } else if ((++rio->ra_seq >= MXRIO_READAHEAD_TRIGGER) &&
+               (atomic_load(&rio->ra_kind) == RA_UNKNOWN)) {
+        vnattr_t attr;
+        mxrio_msg_t msg;
+        memset(&msg, 0, MXRIO_HDR_SZ);
+        msg.op = MXRIO_STAT;
+        msg.arg = sizeof(attr);
+        if ((mxrio_txn(rio, &msg) < 0) || (msg.datalen < sizeof(attr))) {
+            atomic_store(&rio->ra_kind, RA_NEVER);
+            goto done;
+        }
+        memcpy(&attr, msg.data, sizeof(attr));
+        if ((attr.mode & V_TYPE_MASK) != V_TYPE_FILE) {
+            atomic_store(&rio->ra_kind, RA_NEVER);
+            goto done;
+        }
+        memset(&msg, 0, MXRIO_HDR_SZ);
+        msg.op = MXRIO_SEEK;
+        msg.arg = SEEK_CUR;
+        if (mxrio_txn(rio, &msg) < 0) {
+            goto done;
+        }
+        // unless a write has ruled it out meanwhile
+        int kind = RA_UNKNOWN;
+        if (atomic_compare_exchange_strong(&rio->ra_kind, &kind, RA_FILE)) {
+            ra_start(rio, msg.arg2.off);
+        }
+    }
+done:
+    mtx_unlock(&rio->ra_lock);
+}
+
 static ssize_t mxrio_read(mxio_t* io, void* _data, size_t len) {
-    return read_common(MXRIO_READ, io, _data, len, 0);
+    mxrio_t* rio = (mxrio_t*)io;
+    ssize_t r;
+    int64_t off = 0;
+    int kind = atomic_load(&rio->ra_kind);
+    if (kind == RA_NEVER) {
+        return read_common(MXRIO_READ, io, _data, len, 0, NULL);
+    } else if (kind == RA_UNKNOWN) {
+        // Reads of devices and the like may block indefinitely, so
+        // are not made holding the lock.
+        r = read_common(MXRIO_READ, io, _data, len, 0, NULL);
+        ra_note_read(rio, r, len);
+        return r;
+    }
+
+    mtx_lock(&rio->ra_lock);
+    if ((rio->ra != NULL) && (len <= MXIO_CHUNK_SIZE)) {
+        if ((r = ra_read(rio, rio->ra, _data, len)) < (ssize_t)len) {
+            // end of file, for now: pick up anything appended later
+            // from the server
+            mx_status_t status = ra_stop(rio);
+            if ((r == 0) && (status < 0)) {
+                r = status;
+            }
+        }
+    } else if ((r = ra_stop(rio)) == NO_ERROR) {
+        r = read_common(MXRIO_READ, io, _data, len, 0, &off);
+        if ((r == (ssize_t)len) && (len <= MXIO_CHUNK_SIZE) &&
+            (atomic_load(&rio->ra_kind) == RA_FILE)) {
+            if (++rio->ra_seq >= MXRIO_READAHEAD_TRIGGER) {
+                ra_start(rio, off);
+            }
+        } else {
+            rio->ra_seq = 0;
+        }
+    }
+    mtx_unlock(&rio->ra_lock);
+    return r;
 }
 
 static ssize_t mxrio_read_at(mxio_t* io, void* _data, size_t len, mx_off_t offset) {
-    return read_common(MXRIO_READ_AT, io, _data, len, offset);
+    return read_common(MXRIO_READ_AT, io, _data, len, offset, NULL);
 }
 
-static off_t mxrio_seek(mxio_t* io, off_t offset, int whence) {
+// Anything written could already have been read ahead, so writes end
+// the stream (and for MXRIO_WRITE, put the seek pointer back in place).
+// Once written through, an object is not read ahead again.
+static ssize_t ra_write_common(uint32_t op, mxio_t* io, const void* _data, size_t len,
+                               off_t offset) {
     mxrio_t* rio = (mxrio_t*)io;
+    int kind = RA_UNKNOWN;
+    if (atomic_compare_exchange_strong(&rio->ra_kind, &kind, RA_NEVER) || (kind == RA_NEVER)) {
+        // ra_note_read will not start a stream now
+        return write_common(op, io, _data, len, offset);
+    }
+    mtx_lock(&rio->ra_lock);
+    atomic_store(&rio->ra_kind, RA_NEVER);
+    ssize_t r = ra_stop(rio);
+    if (r == NO_ERROR) {
+        r = write_common(op, io, _data, len, offset);
+    }
+    mtx_unlock(&rio->ra_lock);
+    return r;
+}
+
+static ssize_t mxrio_write(mxio_t* io, const void* _data, size_t len) {
+    return ra_write_common(MXRIO_WRITE, io, _data, len, 0);
+}
+
+static ssize_t mxrio_write_at(mxio_t* io, const void* _data, size_t len, mx_off_t offset) {
+    return ra_write_common(MXRIO_WRITE_AT, io, _data, len, offset);
+}
+
+static off_t seek_common(mxrio_t* rio, off_t offset, int whence) {
     mxrio_msg_t msg;
     mx_status_t r;
 
@@ -449,11 +888,38 @@ static off_t mxrio_seek(mxio_t* io, off_t offset, int whence) {
     return msg.arg2.off;
 }
 
+// A seek of an object not yet known to be a file is also made holding
+// the lock, so that a stream is never started from where the seek
+// pointer was before it; seeks do not block, unlike reads.
+static off_t mxrio_seek(mxio_t* io, off_t offset, int whence) {
+    mxrio_t* rio = (mxrio_t*)io;
+    if (atomic_load(&rio->ra_kind) == RA_NEVER) {
+        return seek_common(rio, offset, whence);
+    }
+
+    off_t r;
+    mtx_lock(&rio->ra_lock);
+    if ((rio->ra != NULL) && (whence == SEEK_CUR) && (offset == 0)) {
+        // asking where the reader is need not end the stream
+        r = rio->ra->pos;
+    } else if ((r = ra_stop(rio)) == NO_ERROR) {
+        r = seek_common(rio, offset, whence);
+    }
+    mtx_unlock(&rio->ra_lock);
+    return r;
+}
+
 static mx_status_t mxrio_close(mxio_t* io) {
     mxrio_t* rio = (mxrio_t*)io;
     mxrio_msg_t msg;
     mx_status_t r;
 
+    // any prefetches still outstanding are dropped with the channel
+    mtx_lock(&rio->ra_lock);
+    free(rio->ra);
+    rio->ra = NULL;
+    mtx_unlock(&rio->ra_lock);
+
     memset(&msg, 0, MXRIO_HDR_SZ);
     msg.op = MXRIO_CLOSE;
 
@@ -544,7 +1010,17 @@ static mx_status_t mxrio_misc(mxio_t* io, uint32_t op, int64_t off,
         msg.hcount = 1;
     }
 
-    if ((r = mxrio_txn(rio, &msg)) < 0) {
+    if ((op == MXRIO_TRUNCATE) && (atomic_load(&rio->ra_kind) == RA_FILE)) {
+        // data read ahead may be cut off
+        mtx_lock(&rio->ra_lock);
+        if ((r = ra_stop(rio)) == NO_ERROR) {
+            r = mxrio_txn(rio, &msg);
+        }
+        mtx_unlock(&rio->ra_lock);
+    } else {
+        r = mxrio_txn(rio, &msg);
+    }
+    if (r < 0) {
         return r;
     }
 
@@ -648,6 +1124,8 @@ static mx_status_t mxrio_getobject(mxrio_t* rio, uint32_t op, const char* name,
     return mxrio_reply_channel_call(rio, &msg, info);
 }
 
+static mxio_ops_t mx_remote_ops;
+
 static mx_status_t mxrio_open(mxio_t* io, const char* path, int32_t flags, uint32_t mode, mxio_t** out) {
     mxrio_t* rio = (void*)io;
     mxrio_object_t info;
@@ -655,7 +1133,15 @@ static mx_status_t mxrio_open(mxio_t* io, const char* path, int32_t flags, uint3
     if (r < 0) {
         return r;
     }
-    return mxio_from_handles(info.type, info.handle, info.hcount, info.extra, info.esize, out);
+    if ((r = mxio_from_handles(info.type, info.handle, info.hcount, info.extra, info.esize,
+                               out)) < 0) {
+        return r;
+    }
+    if (((*out)->ops == &mx_remote_ops) && ((flags & O_ACCMODE) != O_RDONLY)) {
+        // only files opened read-only are read ahead
+        atomic_store(&((mxrio_t*)*out)->ra_kind, RA_NEVER);
+    }
+    return NO_ERROR;
 }
 
 static mx_status_t mxrio_clone(mxio_t* io, mx_handle_t* handles, uint32_t* types) {
@@ -681,6 +1167,12 @@ mx_status_t __mxrio_clone(mx_handle_t h, mx_handle_t* handles, uint32_t* types)
 static mx_status_t mxrio_unwrap(mxio_t* io, mx_handle_t* handles, uint32_t* types) {
     mxrio_t* rio = (void*)io;
     mx_status_t r;
+    // whoever gets the handles expects the seek pointer where we left it
+    if (atomic_load(&rio->ra_kind) == RA_FILE) {
+        mtx_lock(&rio->ra_lock);
+        ra_stop(rio);
+        mtx_unlock(&rio->ra_lock);
+    }
     handles[0] = rio->h;
     types[0] = MX_HND_TYPE_MXIO_REMOTE;
     if (rio->h2 != 0) {
@@ -694,6 +1186,34 @@ static mx_status_t mxrio_unwrap(mxio_t* io, mx_handle_t* handles, uint32_t* type
     return r;
 }
 
+static mx_status_t mxrio_mmap(mxio_t* io, uint32_t flags, size_t len, size_t* off, mx_handle_t* out) {
+    mxrio_t* rio = (void*)io;
+    if ((len > INT64_MAX) || (*off > INT64_MAX)) {
+        return ERR_INVALID_ARGS;
+    }
+    uint64_t size = len;
+
+    mxrio_msg_t msg;
+    memset(&msg, 0, MXRIO_HDR_SZ);
+    msg.op = MXRIO_MMAP;
+    msg.datalen = sizeof(size);
+    msg.arg = flags;
+    msg.arg2.off = *off;
+    memcpy(msg.data, &size, sizeof(size));
+
+    mx_status_t r;
+    if ((r = mxrio_txn(rio, &msg)) < 0) {
+        return r;
+    }
+    if ((msg.hcount != 1) || (msg.arg2.off < 0)) {
+        discard_handles(msg.handle, msg.hcount);
+        return ERR_IO;
+    }
+    *off = msg.arg2.off;
+    *out = msg.handle[0];
+    return NO_ERROR;
+}
+
 static void mxrio_wait_begin(mxio_t* io, uint32_t events, mx_handle_t* handle, mx_signals_t* _signals) {
     mxrio_t* rio = (void*)io;
     *handle = rio->h2;
@@ -723,6 +1243,7 @@ static mxio_ops_t mx_remote_ops = {
     .unwrap = mxrio_unwrap,
     .posix_ioctl = mxio_default_posix_ioctl,
     .get_vmo = mxio_default_get_vmo,
+    .mmap = mxrio_mmap,
 };
 
 mxio_t* mxio_remote_create(mx_handle_t h, mx_handle_t e) {
@@ -734,6 +1255,10 @@ mxio_t* mxio_remote_create(mx_handle_t h, mx_handle_t e) {
     atomic_init(&rio->io.refcount, 1);
     rio->h = h;
     rio->h2 = e;
+    mtx_init(&rio->ra_lock, mtx_plain);
+    // Objects which signal through an event are devices and the like,
+    // never plain files.
+    atomic_init(&rio->ra_kind, (e != 0) ? RA_NEVER : RA_UNKNOWN);
     return &rio->io;
 }
 
@@ -1171,6 +1696,7 @@ static mxio_ops_t mxio_socket_stream_ops = {
     .unwrap = mxio_default_unwrap,
     .posix_ioctl = mxsio_posix_ioctl_stream,
     .get_vmo = mxio_default_get_vmo,
+    .mmap = mxio_default_mmap,
 };
 
 static mxio_ops_t mxio_socket_dgram_ops = {
@@ -1189,6 +1715,7 @@ static mxio_ops_t mxio_socket_dgram_ops = {
     .unwrap = mxio_default_unwrap,
     .posix_ioctl = mxio_default_posix_ioctl, // not supported
     .get_vmo = mxio_default_get_vmo,
+    .mmap = mxio_default_mmap,
 };
 
 mxio_t* mxio_socket_create(mx_handle_t h, mx_handle_t s) {
@@ -1201,6 +1728,7 @@ mxio_t* mxio_socket_create(mx_handle_t h, mx_handle_t s) {
     rio->io.flags |= MXIO_FLAG_SOCKET;
     rio->h = h;
     rio->h2 = s;
+    atomic_init(&rio->ra_kind, RA_NEVER);
     return &rio->io;
 }
 
@@ -1214,6 +1742,10 @@ void mxio_socket_set_dgram_ops(mxio_t* io) {
     rio->io.ops = &mxio_socket_dgram_ops;
 }
 
+bool mxio_is_socket_dgram(mxio_t* io) {
+    return io->ops == &mxio_socket_dgram_ops;
+}
+
 mx_status_t mxio_socket_shutdown(mxio_t* io, int how) {
     mxrio_t* rio = (mxrio_t*)io;
     if (how == SHUT_RD || how == SHUT_RDWR) {
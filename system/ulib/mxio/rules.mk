@@ -11,9 +11,11 @@ MODULE_TYPE := userlib
 MODULE_SRCS += \
     $(LOCAL_DIR)/bootfs.c \
     $(LOCAL_DIR)/bsdsocket.c \
+    $(LOCAL_DIR)/cache.c \
     $(LOCAL_DIR)/dispatcher.c \
     $(LOCAL_DIR)/epoll.c \
     $(LOCAL_DIR)/logger.c \
+    $(LOCAL_DIR)/mmap.c \
     $(LOCAL_DIR)/null.c \
     $(LOCAL_DIR)/pipe.c \
     $(LOCAL_DIR)/vmofile.c \
@@ -539,27 +539,74 @@ mx_status_t mxio_wait_fd(int fd, uint32_t events, uint32_t* _pending, mx_time_t
     return r;
 }
 
-int mxio_stat(mxio_t* io, struct stat* s) {
-    vnattr_t attr;
-    int r = io->ops->misc(io, MXRIO_STAT, 0, sizeof(attr), &attr, 0);
+static mx_status_t mxio_getattr(mxio_t* io, vnattr_t* attr) {
+    int r = io->ops->misc(io, MXRIO_STAT, 0, sizeof(*attr), attr, 0);
     if (r < 0) {
         return ERR_BAD_HANDLE;
     }
-    if (r < (int)sizeof(attr)) {
+    if (r < (int)sizeof(*attr)) {
         return ERR_IO;
     }
+    return NO_ERROR;
+}
+
+static void stat_from_attr(struct stat* s, const vnattr_t* attr) {
     memset(s, 0, sizeof(struct stat));
-    s->st_mode = attr.mode;
-    s->st_ino = attr.inode;
-    s->st_size = attr.size;
-    s->st_nlink = attr.nlink;
-    s->st_ctim.tv_sec = attr.create_time / MX_SEC(1);
-    s->st_ctim.tv_nsec = attr.create_time % MX_SEC(1);
-    s->st_mtim.tv_sec = attr.modify_time / MX_SEC(1);
-    s->st_mtim.tv_nsec = attr.modify_time % MX_SEC(1);
+    s->st_mode = attr->mode;
+    s->st_ino = attr->inode;
+    s->st_size = attr->size;
+    s->st_nlink = attr->nlink;
+    s->st_ctim.tv_sec = attr->create_time / MX_SEC(1);
+    s->st_ctim.tv_nsec = attr->create_time % MX_SEC(1);
+    s->st_mtim.tv_sec = attr->modify_time / MX_SEC(1);
+    s->st_mtim.tv_nsec = attr->modify_time % MX_SEC(1);
+}
+
+int mxio_stat(mxio_t* io, struct stat* s) {
+    vnattr_t attr;
+    mx_status_t r = mxio_getattr(io, &attr);
+    if (r < 0) {
+        return r;
+    }
+    stat_from_attr(s, &attr);
     return 0;
 }
 
+// Opens path for a lookup the cache may keep, which only the filesystem
+// whose generation the ticket is for may answer: one which crosses into
+// another filesystem mounted below is tried again, and not cached.
+static mx_status_t cache_open_at(mxio_t** io, int dirfd, const char* path, int flags,
+                                 uint32_t mode, mxio_cache_ticket_t* ticket) {
+    if (ticket->mount_id == 0) {
+        return __mxio_open_at(io, dirfd, path, flags, mode);
+    }
+    mx_status_t r = __mxio_open_at(io, dirfd, path, flags | O_NOXDEV, mode);
+    if (r == ERR_UNAVAILABLE) {
+        ticket->mount_id = 0;
+        r = __mxio_open_at(io, dirfd, path, flags, mode);
+    }
+    return r;
+}
+
+// Gets the attributes of what is at path, from the lookup cache if the
+// path is cached.
+static mx_status_t getattr_at(int dirfd, const char* path, vnattr_t* attr) {
+    mxio_cache_ticket_t ticket;
+    mx_status_t r;
+    if (mxio_cache_lookup(path, &ticket, &r, attr)) {
+        return r;
+    }
+
+    mxio_t* io;
+    if ((r = cache_open_at(&io, dirfd, path, 0, 0, &ticket)) >= 0) {
+        r = mxio_getattr(io, attr);
+        mxio_close(io);
+        mxio_release(io);
+    }
+    mxio_cache_insert(path, &ticket, r, attr);
+    return r;
+}
+
 
 mx_status_t mxio_setattr(mxio_t* io, vnattr_t* vn){
     mx_status_t r = io->ops->misc(io, MXRIO_SETATTR, 0, 0, vn, sizeof(*vn));
@@ -602,6 +649,9 @@ int mxio_status_to_errno(mx_status_t status) {
 // centric posix-y io operations.
 
 ssize_t readv(int fd, const struct iovec* iov, int num) {
+    if ((num < 0) || (num > IOV_MAX)) {
+        return ERRNO(EINVAL);
+    }
     ssize_t count = 0;
     ssize_t r;
     while (num > 0) {
@@ -621,22 +671,82 @@ ssize_t readv(int fd, const struct iovec* iov, int num) {
     return count;
 }
 
+// Adds what one write of writev() managed to *count, or sets it to the
+// error if nothing has been written yet.  Returns false if writev() must
+// stop here.
+static bool writev_piece(int fd, const void* data, size_t len, ssize_t* count) {
+    ssize_t r = write(fd, data, len);
+    if (r < 0) {
+        if (*count == 0) {
+            *count = r;
+        }
+        return false;
+    }
+    *count += r;
+    return (size_t)r == len;
+}
+
+// Pieces smaller than a chunk are gathered up and written together, so
+// that a stdio buffer flushed along with the data behind it reaches the
+// server as one message rather than one per piece.  A datagram socket
+// sends all the pieces as a single datagram instead, of whatever size.
 ssize_t writev(int fd, const struct iovec* iov, int num) {
+    if ((num < 0) || (num > IOV_MAX)) {
+        return ERRNO(EINVAL);
+    }
+    mxio_t* io = fd_to_io(fd);
+    if (io == NULL) {
+        return ERRNO(EBADF);
+    }
+    bool dgram = mxio_is_socket_dgram(io);
+    mxio_release(io);
+    if (dgram) {
+        struct msghdr msg = {
+            .msg_iov = (struct iovec*)iov,
+            .msg_iovlen = num,
+        };
+        return sendmsg(fd, &msg, 0);
+    }
+
+    uint8_t buf[MXIO_CHUNK_SIZE];
+    size_t buflen = 0;
     ssize_t count = 0;
-    ssize_t r;
-    while (num > 0) {
-        if (iov->iov_len != 0) {
-            r = write(fd, iov->iov_base, iov->iov_len);
-            if (r < 0) {
-                return count ? count : r;
+    const uint8_t* data = NULL;
+    size_t len = 0;
+    for (;;) {
+        if (len == 0) {
+            if (num == 0) {
+                break;
             }
-            if ((size_t)r < iov->iov_len) {
-                return count + r;
+            data = iov->iov_base;
+            len = iov->iov_len;
+            iov++;
+            num--;
+        } else if ((buflen == 0) && (len >= sizeof(buf))) {
+            // large pieces go out as they are
+            if (!writev_piece(fd, data, len, &count)) {
+                return count;
+            }
+            len = 0;
+        } else {
+            size_t n = sizeof(buf) - buflen;
+            if (n > len) {
+                n = len;
+            }
+            memcpy(buf + buflen, data, n);
+            buflen += n;
+            data += n;
+            len -= n;
+            if (buflen == sizeof(buf)) {
+                if (!writev_piece(fd, buf, buflen, &count)) {
+                    return count;
+                }
+                buflen = 0;
             }
-            count += r;
         }
-        iov++;
-        num--;
+    }
+    if (buflen > 0) {
+        writev_piece(fd, buf, buflen, &count);
     }
     return count;
 }
@@ -906,6 +1016,34 @@ int fcntl(int fd, int cmd, ...) {
         mxio_release(io);
         return 0;
     }
+    case F_GETPIPE_SZ:
+    case F_SETPIPE_SZ: {
+        mxio_t* io = fd_to_io(fd);
+        if (io == NULL) {
+            return ERRNO(EBADF);
+        }
+        if (!(io->flags & MXIO_FLAG_PIPE)) {
+            mxio_release(io);
+            return ERRNO(EBADF);
+        }
+        mx_status_t r = NO_ERROR;
+        if (cmd == F_SETPIPE_SZ) {
+            GET_INT_ARG(requested);
+            r = (requested < 0) ? ERR_INVALID_ARGS : mxio_pipe_set_buffer_size(io, requested);
+        }
+        size_t size;
+        if (r == NO_ERROR) {
+            r = mxio_pipe_get_buffer_size(io, &size);
+        }
+        mxio_release(io);
+        if (r == ERR_BAD_STATE) {
+            // data already in the buffer is in the way
+            return ERRNO(EBUSY);
+        } else if (r < 0) {
+            return ERROR(r);
+        }
+        return (size > INT_MAX) ? INT_MAX : (int)size;
+    }
     case F_GETOWN:
     case F_SETOWN:
         // TODO(kulakowski) Socket support.
@@ -1067,7 +1205,19 @@ static int vopenat(int dirfd, const char* path, int flags, va_list args) {
         }
         mode = va_arg(args, uint32_t) & 0777;
     }
-    if ((r = __mxio_open_at(&io, dirfd, path, flags, mode)) < 0) {
+
+    // Only a lookup which found nothing is any use to an open().
+    mxio_cache_ticket_t ticket;
+    vnattr_t attr;
+    bool cacheable = !(flags & O_CREAT);
+    if (cacheable && mxio_cache_lookup(path, &ticket, &r, &attr) && (r == ERR_NOT_FOUND)) {
+        return ERROR(r);
+    }
+    if ((r = (cacheable ? cache_open_at(&io, dirfd, path, flags, mode, &ticket)
+                        : __mxio_open_at(&io, dirfd, path, flags, mode))) < 0) {
+        if (cacheable && (r == ERR_NOT_FOUND)) {
+            mxio_cache_insert(path, &ticket, r, NULL);
+        }
         return ERROR(r);
     }
     if (flags & O_NONBLOCK) {
@@ -1143,16 +1293,14 @@ int fstat(int fd, struct stat* s) {
 }
 
 int fstatat(int dirfd, const char* fn, struct stat* s, int flags) {
-    mxio_t* io;
+    vnattr_t attr;
     mx_status_t r;
 
-    if ((r = __mxio_open_at(&io, dirfd, fn, 0, 0)) < 0) {
+    if ((r = getattr_at(dirfd, fn, &attr)) < 0) {
         return ERROR(r);
     }
-    r = mxio_stat(io, s);
-    mxio_close(io);
-    mxio_release(io);
-    return STATUS(r);
+    stat_from_attr(s, &attr);
+    return 0;
 }
 
 int stat(const char* fn, struct stat* s) {
@@ -1259,16 +1407,8 @@ int faccessat(int dirfd, const char* filename, int amode, int flag) {
 
     // Since we are not tracking permissions yet, just check that the
     // file exists a la fstatat.
-    mxio_t* io;
-    mx_status_t status;
-    if ((status = __mxio_open_at(&io, dirfd, filename, 0, 0)) < 0) {
-        return ERROR(status);
-    }
-    struct stat s;
-    status = mxio_stat(io, &s);
-    mxio_close(io);
-    mxio_release(io);
-    return STATUS(status);
+    vnattr_t attr;
+    return STATUS(getattr_at(dirfd, filename, &attr));
 }
 
 char* getcwd(char* buf, size_t size) {
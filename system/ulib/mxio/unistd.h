@@ -5,6 +5,7 @@
 #pragma once
 
 #include <mxio/io.h>
+#include <mxio/vfs.h>
 #include <limits.h>
 #include <stdbool.h>
 #include <sys/types.h>
@@ -41,6 +42,26 @@ mx_status_t __mxio_open(mxio_t** io, const char* path, int flags, uint32_t mode)
 
 int mxio_status_to_errno(mx_status_t status);
 
+// Cache of lookups of absolute paths (cache.c), for the mounts it has
+// been enabled for by mxio_cache_enable().  Longer paths are not cached.
+#define MXIO_CACHE_PATH_MAX 128
+
+typedef struct {
+    uint32_t mount_id;
+    uint64_t gen;
+} mxio_cache_ticket_t;
+
+// Returns true if the outcome of looking up path is cached, with its
+// status and, if that is NO_ERROR, its attributes.  Otherwise fills in
+// ticket, which is to be handed to mxio_cache_insert() along with what
+// the server has to say.
+bool mxio_cache_lookup(const char* path, mxio_cache_ticket_t* ticket,
+                       mx_status_t* status, vnattr_t* attr);
+
+// Only NO_ERROR (with attr) and ERR_NOT_FOUND are cached.
+void mxio_cache_insert(const char* path, const mxio_cache_ticket_t* ticket,
+                       mx_status_t status, const vnattr_t* attr);
+
 // set errno to the closest match for error and return -1
 static inline int ERROR(mx_status_t error) {
     errno = mxio_status_to_errno(error);
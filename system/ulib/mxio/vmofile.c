@@ -147,6 +147,22 @@ mx_status_t vmofile_get_vmo(mxio_t* io, mx_handle_t* out, size_t* off, size_t* l
     return mx_handle_duplicate(vf->vmo, MX_RIGHT_SAME_RIGHTS, out);
 }
 
+static mx_status_t vmofile_mmap(mxio_t* io, uint32_t flags, size_t len, size_t* off, mx_handle_t* out) {
+    vmofile_t* vf = (vmofile_t*)io;
+
+    // the file is read-only; only private copies of it may be written
+    if ((flags & MXIO_MMAP_FLAG_WRITE) && !(flags & MXIO_MMAP_FLAG_PRIVATE)) {
+        return ERR_ACCESS_DENIED;
+    }
+    if (*off > (vf->end - vf->off)) {
+        return ERR_INVALID_ARGS;
+    }
+    *off += vf->off;
+    mx_rights_t rights = MX_RIGHT_TRANSFER | MX_RIGHT_DUPLICATE | MX_RIGHT_READ | MX_RIGHT_MAP;
+    rights |= (flags & MXIO_MMAP_FLAG_EXEC) ? MX_RIGHT_EXECUTE : 0;
+    return mx_handle_duplicate(vf->vmo, rights, out);
+}
+
 static mxio_ops_t vmofile_ops = {
     .read = vmofile_read,
     .read_at = vmofile_read_at,
@@ -165,6 +181,7 @@ static mxio_ops_t vmofile_ops = {
     .unwrap = mxio_default_unwrap,
     .posix_ioctl = mxio_default_posix_ioctl,
     .get_vmo = vmofile_get_vmo,
+    .mmap = vmofile_mmap,
 };
 
 mxio_t* mxio_vmofile_create(mx_handle_t h, mx_off_t off, mx_off_t len) {
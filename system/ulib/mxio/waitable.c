@@ -79,6 +79,8 @@ static mxio_ops_t mxio_waitable_ops = {
     .wait_begin = mxwio_wait_begin,
     .wait_end = mxwio_wait_end,
     .posix_ioctl = mxio_default_posix_ioctl,
+    .get_vmo = mxio_default_get_vmo,
+    .mmap = mxio_default_mmap,
 };
 
 mxio_t* mxio_waitable_create(mx_handle_t h, mx_signals_t signals_in,
@@ -0,0 +1,113 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <bitmap/raw-bitmap.h>
+#include <bitmap/storage.h>
+
+#include <magenta/syscalls.h>
+#include <mxtl/algorithm.h>
+#include <unittest/unittest.h>
+
+namespace bitmap {
+namespace tests {
+namespace {
+
+// One gigabit, roughly the block bitmap of a 4TB minfs partition.
+constexpr size_t kBenchBits = 1lu << 30;
+// The tail of the bitmap which is left free, so that long runs exist only
+// at the very end.
+constexpr size_t kBenchFreeTail = 1lu << 20;
+constexpr size_t kBenchAllocs = 100000;
+
+// A small deterministic generator, so that every run sees the same bitmap.
+uint32_t NextRandom(uint64_t* state) {
+    *state = *state * 6364136223846793005lu + 1442695040888963407lu;
+    return static_cast<uint32_t>(*state >> 33);
+}
+
+// Lays out the bitmap the way an aged filesystem looks: allocated extents
+// of up to 256 bits, separated by free gaps which are all shorter than 48
+// bits, followed by a free tail.
+bool Fragment(RawBitmapGeneric<VmoStorage>* bitmap) {
+    BEGIN_HELPER;
+    uint64_t state = 1;
+    size_t bit = 0;
+    while (bit < kBenchBits - kBenchFreeTail) {
+        size_t run = 1 + NextRandom(&state) % 256;
+        size_t end = mxtl::min(bit + run, kBenchBits - kBenchFreeTail);
+        ASSERT_EQ(bitmap->Set(bit, end), NO_ERROR, "");
+        bit = end + NextRandom(&state) % 48;
+    }
+    END_HELPER;
+}
+
+} // namespace
+
+static bool BenchmarkFind(void) {
+    BEGIN_TEST;
+    printf("\nBenchmarking RawBitmap on %zu bits\n", kBenchBits);
+
+    RawBitmapGeneric<VmoStorage> bitmap;
+    ASSERT_EQ(bitmap.Reset(kBenchBits), NO_ERROR, "");
+    uint64_t ticks_per_msec = mx_ticks_per_second() / 1000;
+    uint64_t start = mx_ticks_get();
+    ASSERT_TRUE(Fragment(&bitmap), "");
+    uint64_t end = mx_ticks_get();
+    printf("Benchmark fragment:       [%10lu] msec\n", (end - start) / ticks_per_msec);
+
+    // Walk the whole bitmap, a free gap at a time.
+    size_t gaps = 0;
+    start = mx_ticks_get();
+    for (size_t bit = 0; bit < kBenchBits; gaps++) {
+        bit = bitmap.Scan(bitmap.Scan(bit, kBenchBits, true), kBenchBits, false);
+    }
+    end = mx_ticks_get();
+    printf("Benchmark scan gaps:      [%10lu] msec (%zu gaps)\n",
+           (end - start) / ticks_per_msec, gaps);
+
+    // Runs longer than any gap are only found in the free tail.
+    size_t bitoff;
+    start = mx_ticks_get();
+    ASSERT_EQ(bitmap.Find(false, 0, kBenchBits, 64, &bitoff), NO_ERROR, "");
+    end = mx_ticks_get();
+    ASSERT_EQ(bitoff, kBenchBits - kBenchFreeTail, "");
+    printf("Benchmark find 64:        [%10lu] msec\n", (end - start) / ticks_per_msec);
+
+    start = mx_ticks_get();
+    ASSERT_EQ(bitmap.Find(false, 0, kBenchBits, 4096, &bitoff), NO_ERROR, "");
+    end = mx_ticks_get();
+    ASSERT_EQ(bitoff, kBenchBits - kBenchFreeTail, "");
+    printf("Benchmark find 4096:      [%10lu] msec\n", (end - start) / ticks_per_msec);
+
+    // No allocated extent is this long, so every candidate is rejected.
+    start = mx_ticks_get();
+    ASSERT_EQ(bitmap.Find(true, 0, kBenchBits, 4096, &bitoff), ERR_NO_RESOURCES, "");
+    end = mx_ticks_get();
+    printf("Benchmark find set 4096:  [%10lu] msec\n", (end - start) / ticks_per_msec);
+
+    // Allocate single bits first-fit from a moving hint, as minfs does.
+    size_t hint = 0;
+    start = mx_ticks_get();
+    for (size_t i = 0; i < kBenchAllocs; i++) {
+        if (bitmap.Find(false, hint, kBenchBits, 1, &bitoff) != NO_ERROR) {
+            ASSERT_EQ(bitmap.Find(false, 0, hint, 1, &bitoff), NO_ERROR, "");
+        }
+        ASSERT_EQ(bitmap.SetOne(bitoff), NO_ERROR, "");
+        hint = bitoff + 1;
+    }
+    end = mx_ticks_get();
+    printf("Benchmark alloc %zu:   [%10lu] msec\n", kBenchAllocs, (end - start) / ticks_per_msec);
+
+    END_TEST;
+}
+
+BEGIN_TEST_CASE(raw_bitmap_bench)
+RUN_TEST_PERFORMANCE(BenchmarkFind)
+END_TEST_CASE(raw_bitmap_bench);
+
+} // namespace tests
+} // namespace bitmap
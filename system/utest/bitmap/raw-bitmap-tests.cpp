@@ -245,6 +245,74 @@ static bool FindSimple(void) {
     END_TEST;
 }
 
+template <typename RawBitmap>
+static bool ScanManyWords(void) {
+    BEGIN_TEST;
+
+    RawBitmap bitmap;
+    EXPECT_EQ(bitmap.Reset(4096), NO_ERROR, "");
+
+    // Runs spanning many whole words, with unaligned ends.
+    EXPECT_EQ(bitmap.Set(3, 4000), NO_ERROR, "set range");
+    EXPECT_EQ(bitmap.Scan(3, 4096, true), 4000U, "scan set bits");
+    EXPECT_EQ(bitmap.Scan(0, 4096, false), 3U, "scan cleared bits");
+    EXPECT_EQ(bitmap.Scan(4000, 4096, false), 4096U, "scan cleared tail");
+    EXPECT_EQ(bitmap.Scan(10, 3990, true), 3990U, "scan set subrange");
+
+    // A single mismatch in each position of a word is found.
+    for (size_t bit = 1000; bit < 1000 + 64; bit++) {
+        EXPECT_EQ(bitmap.ClearOne(bit), NO_ERROR, "clear one bit");
+        EXPECT_EQ(bitmap.Scan(3, 4096, true), bit, "scan to cleared bit");
+        EXPECT_EQ(bitmap.ReverseScan(3, 4000, true), bit, "reverse scan to cleared bit");
+        EXPECT_EQ(bitmap.SetOne(bit), NO_ERROR, "set one bit");
+    }
+
+    EXPECT_EQ(bitmap.ReverseScan(3, 4000, true), 4000U, "reverse scan set bits");
+    EXPECT_EQ(bitmap.ReverseScan(0, 4096, true), 4095U, "reverse scan to last bit");
+    EXPECT_EQ(bitmap.ReverseScan(0, 4000, true), 2U, "reverse scan to first bits");
+    EXPECT_EQ(bitmap.ReverseScan(0, 4096, false), 3999U, "reverse scan cleared bits");
+    EXPECT_EQ(bitmap.ReverseScan(4000, 4096, false), 4096U, "reverse scan cleared tail");
+    EXPECT_EQ(bitmap.ReverseScan(4000, 5000, false), 4096U, "reverse scan past end");
+    EXPECT_EQ(bitmap.ReverseScan(100, 100, false), 100U, "reverse scan empty range");
+
+    END_TEST;
+}
+
+template <typename RawBitmap>
+static bool FindFragmented(void) {
+    BEGIN_TEST;
+
+    RawBitmap bitmap;
+    EXPECT_EQ(bitmap.Reset(4096), NO_ERROR, "");
+
+    // Free runs of increasing length, separated by single set bits.
+    size_t bit = 0;
+    for (size_t len = 1; bit + len < 4096; len++) {
+        bit += len;
+        EXPECT_EQ(bitmap.SetOne(bit), NO_ERROR, "set separator");
+        bit++;
+    }
+
+    size_t bitoff_start;
+    for (size_t len = 1; len < 80; len++) {
+        // The run of length 'len' starts just after the separator which
+        // follows the run of length 'len - 1'.
+        size_t expected = (len - 1) * len / 2 + (len - 1);
+        EXPECT_EQ(bitmap.Find(false, 0, 4096, len, &bitoff_start), NO_ERROR, "find run");
+        EXPECT_EQ(bitoff_start, expected, "check returned arg");
+    }
+
+    EXPECT_EQ(bitmap.Find(true, 0, 4096, 2, &bitoff_start), ERR_NO_RESOURCES, "find set run");
+    EXPECT_EQ(bitoff_start, 4096U, "check returned arg");
+    EXPECT_EQ(bitmap.Find(false, 0, 4096, 0, &bitoff_start), NO_ERROR, "find empty run");
+    EXPECT_EQ(bitoff_start, 0U, "check returned arg");
+    EXPECT_EQ(bitmap.Find(false, 4000, 8192, 200, &bitoff_start), ERR_NO_RESOURCES,
+              "find past end");
+    EXPECT_EQ(bitoff_start, 8192U, "check returned arg");
+
+    END_TEST;
+}
+
 template <typename RawBitmap>
 static bool ClearAll(void) {
     BEGIN_TEST;
@@ -344,6 +412,8 @@ static bool SetOutOfOrder(void) {
     RUN_TEMPLATIZED_TEST(GetReturnArg, specialization)      \
     RUN_TEMPLATIZED_TEST(SetRange, specialization)          \
     RUN_TEMPLATIZED_TEST(FindSimple, specialization)        \
+    RUN_TEMPLATIZED_TEST(ScanManyWords, specialization)     \
+    RUN_TEMPLATIZED_TEST(FindFragmented, specialization)    \
     RUN_TEMPLATIZED_TEST(ClearSubrange, specialization)     \
     RUN_TEMPLATIZED_TEST(BoundaryArguments, specialization) \
     RUN_TEMPLATIZED_TEST(ClearAll, specialization)          \
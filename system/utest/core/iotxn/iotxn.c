@@ -4,12 +4,14 @@
 
 #include <ddk/iotxn.h>
 
+#include <magenta/syscalls.h>
 #include <unittest/unittest.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <limits.h>
+#include <threads.h>
 
 static bool test_physmap_simple(void) {
     BEGIN_TEST;
@@ -89,12 +91,156 @@ static bool test_physmap_unaligned_offset2(void) {
     END_TEST;
 }
 
+static bool test_pool_reuse(void) {
+    BEGIN_TEST;
+    iotxn_t* txn;
+    ASSERT_EQ(iotxn_alloc(&txn, IOTXN_ALLOC_POOL, PAGE_SIZE * 2), NO_ERROR, "");
+    ASSERT_EQ(iotxn_physmap(txn), NO_ERROR, "");
+    mx_handle_t vmo = txn->vmo_handle;
+    mx_paddr_t* phys = txn->phys;
+    iotxn_release(txn);
+
+    // a smaller txn of the same size class gets the same vmo back, with the
+    // physical pages it needs already looked up
+    iotxn_pool_stats_t before, after;
+    iotxn_pool_stats(&before);
+    ASSERT_EQ(iotxn_alloc(&txn, IOTXN_ALLOC_POOL, PAGE_SIZE + 1), NO_ERROR, "");
+    iotxn_pool_stats(&after);
+    ASSERT_EQ(after.cache_hits, before.cache_hits + 1, "expected a thread cache hit");
+    ASSERT_EQ(after.vmo_creates, before.vmo_creates, "expected no new vmo");
+    ASSERT_EQ(txn->vmo_handle, vmo, "expected the pooled vmo");
+    ASSERT_EQ(txn->vmo_offset, 0u, "");
+    ASSERT_EQ(txn->vmo_length, (uint64_t)PAGE_SIZE + 1, "");
+    ASSERT_EQ(txn->phys, phys, "expected the pooled scatter list");
+    ASSERT_EQ(txn->phys_length, 2u, "unexpected phys_length");
+    ASSERT_EQ(iotxn_physmap(txn), NO_ERROR, "");
+    ASSERT_EQ(txn->phys, phys, "");
+
+    // the caller may move the buffer around; the next user still gets it
+    // from the start of the vmo
+    txn->vmo_offset = PAGE_SIZE;
+    txn->vmo_length = PAGE_SIZE;
+    iotxn_release(txn);
+    ASSERT_EQ(iotxn_alloc(&txn, IOTXN_ALLOC_POOL, PAGE_SIZE * 2), NO_ERROR, "");
+    ASSERT_EQ(txn->vmo_offset, 0u, "");
+    ASSERT_EQ(txn->vmo_length, (uint64_t)PAGE_SIZE * 2, "");
+    ASSERT_EQ(iotxn_physmap(txn), NO_ERROR, "");
+    ASSERT_EQ(txn->phys_offset, 0u, "");
+    ASSERT_EQ(txn->phys_length, 2u, "");
+    iotxn_release(txn);
+    END_TEST;
+}
+
+static bool test_pool_unpooled(void) {
+    BEGIN_TEST;
+    iotxn_pool_stats_t before, after;
+    iotxn_pool_stats(&before);
+
+    // without IOTXN_ALLOC_POOL the txn is freed on release
+    iotxn_t* txn;
+    ASSERT_EQ(iotxn_alloc(&txn, 0, PAGE_SIZE), NO_ERROR, "");
+    iotxn_release(txn);
+    iotxn_pool_stats(&after);
+    ASSERT_EQ(after.frees, before.frees + 1, "");
+    ASSERT_EQ(after.pooled, before.pooled, "");
+
+    // clones and txns without a buffer are always pooled
+    ASSERT_EQ(iotxn_alloc(&txn, 0, PAGE_SIZE), NO_ERROR, "");
+    iotxn_t* clone;
+    ASSERT_EQ(iotxn_clone(txn, &clone), NO_ERROR, "");
+    iotxn_release(clone);
+    iotxn_release(txn);
+    iotxn_pool_stats(&after);
+    ASSERT_EQ(after.releases, before.releases + 1, "");
+    ASSERT_EQ(iotxn_alloc(&txn, 0, 0), NO_ERROR, "");
+    ASSERT_EQ(txn, clone, "expected the pooled clone");
+    ASSERT_EQ(txn->vmo_handle, MX_HANDLE_INVALID, "");
+    ASSERT_NULL(txn->phys, "");
+    iotxn_release(txn);
+    END_TEST;
+}
+
+typedef struct {
+    uint32_t alloc_flags;
+    uint64_t data_size;
+    size_t cycles;
+    mx_status_t status;
+} bench_args_t;
+
+static void bench_complete(iotxn_t* txn, void* cookie) {
+    (*(size_t*)cookie)++;
+}
+
+// the life of a txn in a driver: allocate, physmap, queue (here, complete
+// straight away) and release
+static int bench_thread(void* arg) {
+    bench_args_t* args = arg;
+    size_t completed = 0;
+    for (size_t i = 0; i < args->cycles; i++) {
+        iotxn_t* txn;
+        if ((args->status = iotxn_alloc(&txn, args->alloc_flags, args->data_size)) != NO_ERROR) {
+            return 0;
+        }
+        if ((args->status = iotxn_physmap(txn)) != NO_ERROR) {
+            return 0;
+        }
+        txn->complete_cb = bench_complete;
+        txn->cookie = &completed;
+        iotxn_complete(txn, NO_ERROR, txn->length);
+        iotxn_release(txn);
+    }
+    args->status = (completed == args->cycles) ? NO_ERROR : ERR_INTERNAL;
+    return 0;
+}
+
+static bool bench_helper(const char* name, uint32_t alloc_flags, uint64_t data_size,
+                         size_t num_threads, size_t cycles) {
+    bench_args_t args[8];
+    thrd_t threads[8];
+    ASSERT_LE(num_threads, countof(threads), "");
+
+    uint64_t start = mx_ticks_get();
+    for (size_t i = 0; i < num_threads; i++) {
+        args[i].alloc_flags = alloc_flags;
+        args[i].data_size = data_size;
+        args[i].cycles = cycles;
+        ASSERT_EQ(thrd_create(&threads[i], bench_thread, &args[i]), thrd_success, "");
+    }
+    for (size_t i = 0; i < num_threads; i++) {
+        ASSERT_EQ(thrd_join(threads[i], NULL), thrd_success, "");
+        ASSERT_EQ(args[i].status, NO_ERROR, "");
+    }
+    uint64_t ticks = mx_ticks_get() - start;
+    printf("Benchmark %-8s %7lu bytes threads %zu: [%10lu] cycles/sec\n", name, data_size,
+           num_threads, num_threads * cycles * mx_ticks_per_second() / ticks);
+    return true;
+}
+
+static bool bench_alloc_cycle(void) {
+    BEGIN_TEST;
+    printf("\n");
+    const uint64_t kSizes[] = {0, 512, PAGE_SIZE * 4};
+    const size_t kThreads[] = {1, 4};
+    for (size_t s = 0; s < countof(kSizes); s++) {
+        if (kSizes[s] > 0) {
+            ASSERT_TRUE(bench_helper("unpooled", 0, kSizes[s], 1, 10000), "");
+        }
+        for (size_t t = 0; t < countof(kThreads); t++) {
+            ASSERT_TRUE(bench_helper("pooled", IOTXN_ALLOC_POOL, kSizes[s], kThreads[t], 100000), "");
+        }
+    }
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(iotxn_tests)
 RUN_TEST(test_physmap_simple)
 RUN_TEST(test_physmap_clone)
 RUN_TEST(test_physmap_aligned_offset)
 RUN_TEST(test_physmap_unaligned_offset)
 RUN_TEST(test_physmap_unaligned_offset2)
+RUN_TEST(test_pool_reuse)
+RUN_TEST(test_pool_unpooled)
+RUN_TEST_PERFORMANCE(bench_alloc_cycle)
 END_TEST_CASE(iotxn_tests)
 
 #ifndef BUILD_COMBINED_TESTS
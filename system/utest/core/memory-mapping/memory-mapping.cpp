@@ -3,6 +3,8 @@
 // found in the LICENSE file.
 
 #include <errno.h>
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #include <magenta/process.h>
@@ -11,8 +13,19 @@
 #include <unittest/unittest.h>
 #include <sys/mman.h>
 
+// jemalloc's control interface, which libc exports but no header declares.
+extern "C" int mallctl(const char* name, void* oldp, size_t* oldlenp,
+                       void* newp, size_t newlen) __attribute__((weak));
+
 namespace {
 
+size_t committed_bytes() {
+    mx_info_task_stats_t info;
+    mx_status_t status = mx_object_get_info(mx_process_self(), MX_INFO_TASK_STATS,
+                                            &info, sizeof(info), NULL, NULL);
+    return status == NO_ERROR ? info.mem_committed_bytes : 0;
+}
+
 #if defined(__x86_64__)
 
 // This is based on code from kernel/ which isn't usable by code in system/.
@@ -197,6 +210,152 @@ bool mprotect_test() {
     END_TEST;
 }
 
+bool madvise_dontneed_test() {
+    BEGIN_TEST;
+
+    const size_t len = 64 * getpagesize();
+    uint8_t* addr = (uint8_t*)mmap(NULL, len, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANON, -1, 0);
+    ASSERT_NEQ(MAP_FAILED, addr, "mmap failed to map");
+
+    size_t before = committed_bytes();
+    memset(addr, 0x5a, len);
+    size_t touched = committed_bytes();
+    EXPECT_GE(touched - before, len, "touching the mapping should commit it");
+
+    EXPECT_EQ(0, madvise(addr, len, MADV_DONTNEED), "madvise(MADV_DONTNEED) failed");
+    size_t released = committed_bytes();
+    EXPECT_GE(touched - released, len, "MADV_DONTNEED should release the pages");
+
+    // Private anonymous memory reads back as zeros afterwards.
+    for (size_t i = 0; i < len; i += getpagesize()) {
+        EXPECT_EQ(0u, addr[i], "released memory should read as zero");
+    }
+    addr[0] = 1;
+    EXPECT_EQ(1u, addr[0], "could not write to released memory");
+
+    EXPECT_EQ(0, munmap(addr, len), "munmap failed");
+
+    END_TEST;
+}
+
+bool madvise_shared_test() {
+    BEGIN_TEST;
+
+    // A VMO we still hold a handle to is shared: its pages are not the
+    // mapping's to throw away.
+    const size_t len = 4 * getpagesize();
+    mx_handle_t vmo;
+    ASSERT_EQ(NO_ERROR, mx_vmo_create(len, 0, &vmo), "vm_object_create");
+    uintptr_t mapped;
+    ASSERT_EQ(NO_ERROR, mx_vmar_map(mx_vmar_root_self(), 0, vmo, 0, len,
+                                    MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE, &mapped),
+              "vm_map");
+    uint8_t* addr = (uint8_t*)mapped;
+    memset(addr, 0x5a, len);
+
+    EXPECT_EQ(ERR_BAD_STATE, mx_vmar_op_range(mx_vmar_root_self(), MX_VMAR_OP_DECOMMIT,
+                                              mapped, len),
+              "decommit should fail on a shared VMO");
+    EXPECT_EQ(0, madvise(addr, len, MADV_DONTNEED), "MADV_DONTNEED should be ignored");
+    int status = madvise(addr, len, MADV_FREE);
+    auto test_errno = errno;
+    EXPECT_EQ(-1, status, "MADV_FREE should fail on a shared mapping");
+    EXPECT_EQ(EINVAL, test_errno, "madvise errno should be EINVAL for a shared mapping");
+    for (size_t i = 0; i < len; i += getpagesize()) {
+        EXPECT_EQ(0x5au, addr[i], "shared memory should be kept");
+    }
+
+    EXPECT_EQ(NO_ERROR, mx_vmar_unmap(mx_vmar_root_self(), mapped, len), "vm_unmap");
+    EXPECT_EQ(NO_ERROR, mx_handle_close(vmo), "handle_close");
+
+    END_TEST;
+}
+
+bool madvise_willneed_test() {
+    BEGIN_TEST;
+
+    const size_t len = 64 * getpagesize();
+    uint8_t* addr = (uint8_t*)mmap(NULL, len, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANON, -1, 0);
+    ASSERT_NEQ(MAP_FAILED, addr, "mmap failed to map");
+
+    size_t before = committed_bytes();
+    EXPECT_EQ(0, madvise(addr, len, MADV_WILLNEED), "madvise(MADV_WILLNEED) failed");
+    EXPECT_GE(committed_bytes() - before, len, "MADV_WILLNEED should commit the pages");
+
+    // Hints are accepted and do not change the contents.
+    addr[0] = 7;
+    EXPECT_EQ(0, madvise(addr, len, MADV_SEQUENTIAL), "madvise(MADV_SEQUENTIAL) failed");
+    EXPECT_EQ(0, madvise(addr, len, MADV_RANDOM), "madvise(MADV_RANDOM) failed");
+    EXPECT_EQ(0, madvise(addr, len, MADV_NORMAL), "madvise(MADV_NORMAL) failed");
+    EXPECT_EQ(7u, addr[0], "hints should not change memory");
+
+    EXPECT_EQ(0, munmap(addr, len), "munmap failed");
+
+    END_TEST;
+}
+
+bool madvise_errors_test() {
+    BEGIN_TEST;
+
+    size_t page_size = getpagesize();
+    uint8_t* addr = (uint8_t*)mmap(NULL, page_size, PROT_READ, MAP_PRIVATE|MAP_ANON, -1, 0);
+    ASSERT_NEQ(MAP_FAILED, addr, "mmap failed to map");
+
+    int status = madvise(addr, page_size, MADV_DONTNEED);
+    auto test_errno = errno;
+    EXPECT_EQ(-1, status, "MADV_DONTNEED should fail on a read-only mapping");
+    EXPECT_EQ(EINVAL, test_errno, "madvise errno should be EINVAL for a read-only mapping");
+
+    status = madvise(addr + 1, page_size, MADV_WILLNEED);
+    test_errno = errno;
+    EXPECT_EQ(-1, status, "madvise should fail for an unaligned address");
+    EXPECT_EQ(EINVAL, test_errno, "madvise errno should be EINVAL for an unaligned address");
+
+    EXPECT_EQ(0, munmap(addr, page_size), "munmap failed");
+
+    status = madvise(addr, page_size, MADV_WILLNEED);
+    test_errno = errno;
+    EXPECT_EQ(-1, status, "madvise should fail on unmapped memory");
+    EXPECT_EQ(ENOMEM, test_errno, "madvise errno should be ENOMEM on unmapped memory");
+
+    END_TEST;
+}
+
+// malloc should hand freed memory back once it is purged, rather than
+// keeping it committed.
+bool malloc_purge_test() {
+    BEGIN_TEST;
+
+    if (mallctl == NULL) {
+        unittest_printf("mallctl not available, skipping\n");
+        END_TEST;
+    }
+
+    const size_t count = 64;
+    const size_t size = 256 * 1024;
+    void* blocks[count];
+
+    size_t before = committed_bytes();
+    for (size_t i = 0; i < count; i++) {
+        blocks[i] = malloc(size);
+        ASSERT_NONNULL(blocks[i], "malloc failed");
+        memset(blocks[i], 0xa5, size);
+    }
+    size_t touched = committed_bytes();
+    EXPECT_GE(touched - before, count * size, "touching the blocks should commit them");
+
+    for (size_t i = 0; i < count; i++) {
+        free(blocks[i]);
+    }
+    EXPECT_EQ(0, mallctl("arena.4096.purge", NULL, NULL, NULL, 0), "purge failed");
+
+    // Allow for allocator metadata, but most of it should be gone.
+    size_t purged = committed_bytes();
+    EXPECT_GE(touched - purged, count * size / 2, "purging should release freed memory");
+
+    END_TEST;
+}
+
 }
 
 BEGIN_TEST_CASE(memory_mapping_tests)
@@ -206,6 +365,11 @@ RUN_TEST(mmap_offset_test);
 RUN_TEST(mmap_prot_test);
 RUN_TEST(mmap_flags_test);
 RUN_TEST(mprotect_test);
+RUN_TEST(madvise_dontneed_test);
+RUN_TEST(madvise_shared_test);
+RUN_TEST(madvise_willneed_test);
+RUN_TEST(madvise_errors_test);
+RUN_TEST(malloc_purge_test);
 END_TEST_CASE(memory_mapping_tests)
 
 #ifndef BUILD_COMBINED_TESTS
@@ -311,11 +311,14 @@ static bool socket_short_write(void) {
     mx_status_t status;
 
     mx_handle_t h0, h1;
-    status = mx_socket_create(0, &h0, &h1);
+    status = mx_socket_create(MX_SOCKET_CREATE_RESIZABLE, &h0, &h1);
     ASSERT_EQ(status, NO_ERROR, "");
 
-    // TODO(qsr): Request socket buffer and use (socket_buffer + 1).
-    const size_t buffer_size = 256 * 1024 + 1;
+    size_t socket_buffer;
+    status = mx_object_get_property(h1, MX_PROP_SOCKET_BUFFER_SIZE,
+                                    &socket_buffer, sizeof(socket_buffer));
+    ASSERT_EQ(status, NO_ERROR, "");
+    const size_t buffer_size = socket_buffer + 1;
     char* buffer = malloc(buffer_size);
     size_t written = 0;
     status = mx_socket_write(h0, 0u, buffer, buffer_size, &written);
@@ -328,6 +331,87 @@ static bool socket_short_write(void) {
     END_TEST;
 }
 
+static bool socket_buffer_size(void) {
+    BEGIN_TEST;
+
+    mx_status_t status;
+    size_t size;
+    size_t count;
+
+    // Only resizable sockets let their buffers be looked at.
+    mx_handle_t h0, h1;
+    status = mx_socket_create(0, &h0, &h1);
+    ASSERT_EQ(status, NO_ERROR, "");
+    status = mx_object_get_property(h1, MX_PROP_SOCKET_BUFFER_SIZE, &size, sizeof(size));
+    ASSERT_EQ(status, ERR_ACCESS_DENIED, "");
+    mx_handle_close(h0);
+    mx_handle_close(h1);
+
+    status = mx_socket_create(MX_SOCKET_CREATE_RESIZABLE, &h0, &h1);
+    ASSERT_EQ(status, NO_ERROR, "");
+
+    // Rounded up to a power of two.
+    size = 1024 * 1024 - 1;
+    status = mx_object_set_property(h1, MX_PROP_SOCKET_BUFFER_SIZE, &size, sizeof(size));
+    ASSERT_EQ(status, NO_ERROR, "");
+    status = mx_object_get_property(h1, MX_PROP_SOCKET_BUFFER_SIZE, &size, sizeof(size));
+    ASSERT_EQ(status, NO_ERROR, "");
+    ASSERT_EQ(size, 1024u * 1024u, "");
+
+    // The writing end sees the same buffer as its peer's.
+    status = mx_object_get_property(h0, MX_PROP_SOCKET_PEER_BUFFER_SIZE, &size, sizeof(size));
+    ASSERT_EQ(status, NO_ERROR, "");
+    ASSERT_EQ(size, 1024u * 1024u, "");
+
+    size = 0;
+    status = mx_object_set_property(h1, MX_PROP_SOCKET_BUFFER_SIZE, &size, sizeof(size));
+    ASSERT_EQ(status, ERR_OUT_OF_RANGE, "");
+
+    // Nearly all of the new buffer can be filled by the other end.
+    char* buffer = malloc(1024 * 1024);
+    ASSERT_NONNULL(buffer, "");
+    status = mx_socket_write(h0, 0u, buffer, 1024 * 1024, &count);
+    ASSERT_EQ(status, NO_ERROR, "");
+    ASSERT_EQ(count, 1024u * 1024u - 1u, "");
+    EXPECT_EQ(get_satisfied_signals(h0) & MX_SOCKET_WRITABLE, 0u, "");
+
+    // Not while there is data in it, from either end.
+    size = 64 * 1024;
+    status = mx_object_set_property(h1, MX_PROP_SOCKET_BUFFER_SIZE, &size, sizeof(size));
+    ASSERT_EQ(status, ERR_BAD_STATE, "");
+    status = mx_object_set_property(h0, MX_PROP_SOCKET_PEER_BUFFER_SIZE, &size, sizeof(size));
+    ASSERT_EQ(status, ERR_BAD_STATE, "");
+
+    status = mx_socket_read(h1, 0u, buffer, 1024 * 1024, &count);
+    ASSERT_EQ(status, NO_ERROR, "");
+    ASSERT_EQ(count, 1024u * 1024u - 1u, "");
+
+    // Resized from the writing end, it is the buffer its writes fill.
+    status = mx_object_set_property(h0, MX_PROP_SOCKET_PEER_BUFFER_SIZE, &size, sizeof(size));
+    ASSERT_EQ(status, NO_ERROR, "");
+    status = mx_object_get_property(h1, MX_PROP_SOCKET_BUFFER_SIZE, &size, sizeof(size));
+    ASSERT_EQ(status, NO_ERROR, "");
+    ASSERT_EQ(size, 64u * 1024u, "");
+    status = mx_socket_write(h0, 0u, buffer, 1024 * 1024, &count);
+    ASSERT_EQ(status, NO_ERROR, "");
+    ASSERT_EQ(count, 64u * 1024u - 1u, "");
+
+    // The other direction is unchanged.
+    status = mx_object_get_property(h0, MX_PROP_SOCKET_BUFFER_SIZE, &size, sizeof(size));
+    ASSERT_EQ(status, NO_ERROR, "");
+    ASSERT_NEQ(size, 64u * 1024u, "");
+
+    // Nor can the peer's buffer be had once the peer is gone.
+    mx_handle_close(h1);
+    status = mx_object_get_property(h0, MX_PROP_SOCKET_PEER_BUFFER_SIZE, &size, sizeof(size));
+    ASSERT_EQ(status, ERR_PEER_CLOSED, "");
+
+    free(buffer);
+    mx_handle_close(h0);
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(socket_tests)
 RUN_TEST(socket_basic)
 RUN_TEST(socket_signals)
@@ -335,6 +419,7 @@ RUN_TEST(socket_half_close)
 RUN_TEST(socket_bytes_outstanding)
 RUN_TEST(socket_bytes_outstanding_half_close)
 RUN_TEST(socket_short_write)
+RUN_TEST(socket_buffer_size)
 END_TEST_CASE(socket_tests)
 
 #ifndef BUILD_COMBINED_TESTS
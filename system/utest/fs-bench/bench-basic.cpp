@@ -90,6 +90,222 @@ bool benchmark_write_read(void) {
     END_TEST;
 }
 
+constexpr size_t kLargeIoTotal = (32 << 20);
+constexpr size_t kLargeIoSizes[] = { 1 << 16, 1 << 18, 1 << 20, 1 << 22 };
+
+// Measures sequential reads and writes much larger than a single RemoteIO
+// message, which go to the server in bulk rather than in 8 KB pieces.
+static bool large_io(const char* dir) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/largefile", dir);
+    printf("\nBenchmarking large reads and writes in %s\n", dir);
+
+    AllocChecker ac;
+    mxtl::unique_ptr<uint8_t[]> data(new (&ac) uint8_t[kLargeIoSizes[3]]);
+    ASSERT_EQ(ac.check(), true, "");
+    memset(data.get(), kMagicByte, kLargeIoSizes[3]);
+
+    uint64_t ticks_per_msec = mx_ticks_per_second() / 1000;
+    for (size_t size : kLargeIoSizes) {
+        int fd = open(path, O_CREAT | O_RDWR | O_TRUNC, 0644);
+        ASSERT_GT(fd, 0, "Cannot create file");
+
+        uint64_t start = mx_ticks_get();
+        for (size_t done = 0; done < kLargeIoTotal; done += size) {
+            ASSERT_EQ(write(fd, data.get(), size), static_cast<ssize_t>(size), "");
+        }
+        uint64_t write_msec = (mx_ticks_get() - start) / ticks_per_msec;
+
+        ASSERT_EQ(lseek(fd, 0, SEEK_SET), 0, "");
+        start = mx_ticks_get();
+        for (size_t done = 0; done < kLargeIoTotal; done += size) {
+            ASSERT_EQ(read(fd, data.get(), size), static_cast<ssize_t>(size), "");
+            ASSERT_EQ(data[size - 1], kMagicByte, "");
+        }
+        uint64_t read_msec = (mx_ticks_get() - start) / ticks_per_msec;
+
+        printf("Benchmark %5zu KB: write [%8lu] msec, read [%8lu] msec (%zu MB each)\n",
+               size >> 10, write_msec, read_msec, kLargeIoTotal >> 20);
+        ASSERT_EQ(close(fd), 0, "");
+        ASSERT_EQ(unlink(path), 0, "");
+    }
+    return true;
+}
+
+bool benchmark_large_io_memfs(void) {
+    BEGIN_TEST;
+    ASSERT_TRUE(large_io("/tmp"), "");
+    END_TEST;
+}
+
+bool benchmark_large_io(void) {
+    BEGIN_TEST;
+    ASSERT_TRUE(large_io(MOUNT_POINT), "");
+    END_TEST;
+}
+
+constexpr size_t kBlockSize = 8192;
+constexpr size_t kNumBlocks = 2048;
+constexpr size_t kNumRandomOps = 4096;
+
+// Measures reads and writes of single blocks at random offsets within a
+// previously populated file, where no two consecutive accesses are
+// likely to be adjacent on disk.
+bool benchmark_random_io(void) {
+    BEGIN_TEST;
+    printf("\nBenchmarking Random Write + Read\n");
+    int fd = open(MOUNT_POINT "/randomfile", O_CREAT | O_RDWR, 0644);
+    ASSERT_GT(fd, 0, "Cannot create file (FS benchmarks assume mounted FS exists at '/benchmark')");
+
+    AllocChecker ac;
+    mxtl::unique_ptr<uint8_t[]> data(new (&ac) uint8_t[kBlockSize]);
+    ASSERT_EQ(ac.check(), true, "");
+    memset(data.get(), kMagicByte, kBlockSize);
+
+    for (size_t i = 0; i < kNumBlocks; i++) {
+        ASSERT_EQ(write(fd, data.get(), kBlockSize), kBlockSize, "");
+    }
+
+    uint64_t start, end;
+    uint64_t ticks_per_msec = mx_ticks_per_second() / 1000;
+    unsigned int seed = 0x4d696e46;
+
+    start = mx_ticks_get();
+    for (size_t i = 0; i < kNumRandomOps; i++) {
+        off_t off = static_cast<off_t>((rand_r(&seed) % kNumBlocks) * kBlockSize);
+        ASSERT_EQ(pwrite(fd, data.get(), kBlockSize, off), kBlockSize, "");
+    }
+    end = mx_ticks_get();
+    printf("Benchmark random write: [%10lu] msec\n", (end - start) / ticks_per_msec);
+
+    start = mx_ticks_get();
+    for (size_t i = 0; i < kNumRandomOps; i++) {
+        off_t off = static_cast<off_t>((rand_r(&seed) % kNumBlocks) * kBlockSize);
+        ASSERT_EQ(pread(fd, data.get(), kBlockSize, off), kBlockSize, "");
+        ASSERT_EQ(data[0], kMagicByte, "");
+    }
+    end = mx_ticks_get();
+    printf("Benchmark random read:  [%10lu] msec\n", (end - start) / ticks_per_msec);
+
+    ASSERT_EQ(close(fd), 0, "");
+    ASSERT_EQ(unlink(MOUNT_POINT "/randomfile"), 0, "");
+
+    END_TEST;
+}
+
+// Bounded by the number of inodes in a freshly created minfs (32k), as well as
+// the size of a minfs directory (1MB, or roughly 65k short names).
+constexpr size_t kNumDirents = 25000;
+
+bool dirent_op(size_t i, int (*op)(const char* path)) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), MOUNT_POINT "/dir/%05zu", i);
+    ASSERT_EQ(op(path), 0, "Dirent operation failed");
+    return true;
+}
+
+int create_op(const char* path) {
+    int fd = open(path, O_CREAT | O_EXCL | O_RDWR, 0644);
+    return (fd < 0) ? fd : close(fd);
+}
+
+int stat_op(const char* path) {
+    struct stat buf;
+    return stat(path, &buf);
+}
+
+// Measures creating, looking up and unlinking many files in a single
+// directory, which is linear in the size of the directory unless
+// directories are indexed.
+bool benchmark_large_directory(void) {
+    BEGIN_TEST;
+    printf("\nBenchmarking Large directory\n");
+    ASSERT_EQ(mkdir(MOUNT_POINT "/dir", 0666), 0, "Could not make directory");
+
+    uint64_t start, end;
+    uint64_t ticks_per_msec = mx_ticks_per_second() / 1000;
+
+    start = mx_ticks_get();
+    for (size_t i = 0; i < kNumDirents; i++) {
+        ASSERT_TRUE(dirent_op(i, create_op), "");
+    }
+    end = mx_ticks_get();
+    printf("Benchmark create: [%10lu] msec\n", (end - start) / ticks_per_msec);
+
+    unsigned int seed = 0x4d696e46;
+    start = mx_ticks_get();
+    for (size_t i = 0; i < kNumDirents; i++) {
+        ASSERT_TRUE(dirent_op(rand_r(&seed) % kNumDirents, stat_op), "");
+    }
+    end = mx_ticks_get();
+    printf("Benchmark stat:   [%10lu] msec\n", (end - start) / ticks_per_msec);
+
+    start = mx_ticks_get();
+    for (size_t i = 0; i < kNumDirents; i++) {
+        ASSERT_TRUE(dirent_op(i, unlink), "");
+    }
+    end = mx_ticks_get();
+    printf("Benchmark unlink: [%10lu] msec\n", (end - start) / ticks_per_msec);
+
+    ASSERT_EQ(unlink(MOUNT_POINT "/dir"), 0, "");
+    END_TEST;
+}
+
+constexpr size_t kStormDirs = 32;
+constexpr size_t kStormFiles = 64;
+constexpr size_t kStormFileSize = 4096;
+
+// Unpacks a source-tree-like archive: many small files, each of which is
+// created, written and closed, spread over a number of directories. This is
+// dominated by metadata updates (bitmaps, inodes and dirents) rather than by
+// the data itself.
+bool benchmark_create_storm(void) {
+    BEGIN_TEST;
+    printf("\nBenchmarking Create storm\n");
+    char data[kStormFileSize];
+    memset(data, kMagicByte, sizeof(data));
+    char path[PATH_MAX];
+
+    uint64_t start, end;
+    uint64_t ticks_per_msec = mx_ticks_per_second() / 1000;
+
+    start = mx_ticks_get();
+    for (size_t i = 0; i < kStormDirs; i++) {
+        snprintf(path, sizeof(path), MOUNT_POINT "/src%02zu", i);
+        ASSERT_EQ(mkdir(path, 0666), 0, "Could not make directory");
+        for (size_t j = 0; j < kStormFiles; j++) {
+            snprintf(path, sizeof(path), MOUNT_POINT "/src%02zu/file%02zu.c", i, j);
+            int fd = open(path, O_CREAT | O_EXCL | O_WRONLY, 0644);
+            ASSERT_GT(fd, 0, "Could not create file");
+            ASSERT_EQ(write(fd, data, sizeof(data)), (ssize_t)sizeof(data), "");
+            ASSERT_EQ(close(fd), 0, "");
+        }
+    }
+    end = mx_ticks_get();
+    printf("Benchmark create: [%10lu] msec\n", (end - start) / ticks_per_msec);
+
+    start = mx_ticks_get();
+    int fd = open(MOUNT_POINT, O_RDONLY | O_DIRECTORY);
+    ASSERT_GT(fd, 0, "");
+    ASSERT_EQ(fsync(fd), 0, "");
+    ASSERT_EQ(close(fd), 0, "");
+    end = mx_ticks_get();
+    printf("Benchmark sync:   [%10lu] msec\n", (end - start) / ticks_per_msec);
+
+    start = mx_ticks_get();
+    for (size_t i = 0; i < kStormDirs; i++) {
+        for (size_t j = 0; j < kStormFiles; j++) {
+            snprintf(path, sizeof(path), MOUNT_POINT "/src%02zu/file%02zu.c", i, j);
+            ASSERT_EQ(unlink(path), 0, "");
+        }
+        snprintf(path, sizeof(path), MOUNT_POINT "/src%02zu", i);
+        ASSERT_EQ(unlink(path), 0, "");
+    }
+    end = mx_ticks_get();
+    printf("Benchmark unlink: [%10lu] msec\n", (end - start) / ticks_per_msec);
+    END_TEST;
+}
+
 #define START_STRING "/aaa"
 
 size_t constexpr cStrlen(const char* str) {
@@ -183,5 +399,10 @@ bool benchmark_path_walk(void) {
 
 BEGIN_TEST_CASE(basic_benchmarks)
 RUN_TEST_PERFORMANCE(benchmark_write_read)
+RUN_TEST_PERFORMANCE(benchmark_large_io_memfs)
+RUN_TEST_PERFORMANCE(benchmark_large_io)
+RUN_TEST_PERFORMANCE(benchmark_random_io)
 RUN_TEST_PERFORMANCE(benchmark_path_walk)
+RUN_TEST_PERFORMANCE(benchmark_large_directory)
+RUN_TEST_PERFORMANCE(benchmark_create_storm)
 END_TEST_CASE(basic_benchmarks)
@@ -0,0 +1,80 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <magenta/syscalls.h>
+#include <mxio/io.h>
+#include <unittest/unittest.h>
+
+constexpr int kCachePaths = 256;
+constexpr int kCacheMissingPaths = 64;
+constexpr int kCacheStats = 1000000;
+
+// Stats the same few hundred paths, most there and some not, over and
+// over, the way build tools do.
+static bool stat_paths(const char* dir, const char* label) {
+    char path[PATH_MAX];
+    struct stat st;
+    uint64_t ticks_per_msec = mx_ticks_per_second() / 1000;
+    uint64_t start = mx_ticks_get();
+    for (int i = 0; i < kCacheStats; i++) {
+        int n = i % (kCachePaths + kCacheMissingPaths);
+        if (n < kCachePaths) {
+            snprintf(path, sizeof(path), "%s/file-%d", dir, n);
+            ASSERT_EQ(stat(path, &st), 0, "");
+        } else {
+            snprintf(path, sizeof(path), "%s/missing-%d", dir, n);
+            ASSERT_EQ(stat(path, &st), -1, "");
+        }
+    }
+    uint64_t msec = (mx_ticks_get() - start) / ticks_per_msec;
+    uint64_t ops = kCacheStats;
+    printf("Benchmark %-8s: [%10lu] msec, [%10lu] stats/sec\n", label, msec,
+           msec ? ops * 1000 / msec : 0);
+    return true;
+}
+
+static bool stat_throughput(const char* mount) {
+    printf("\nBenchmarking %d stats of %d paths in %s\n", kCacheStats,
+           kCachePaths + kCacheMissingPaths, mount);
+
+    char dir[PATH_MAX];
+    char path[PATH_MAX];
+    snprintf(dir, sizeof(dir), "%s/stat-cache", mount);
+    ASSERT_EQ(mkdir(dir, 0755), 0, "");
+    for (int i = 0; i < kCachePaths; i++) {
+        snprintf(path, sizeof(path), "%s/file-%d", dir, i);
+        int fd = open(path, O_CREAT | O_RDWR, 0644);
+        ASSERT_GT(fd, 0, "Cannot create file");
+        ASSERT_EQ(close(fd), 0, "");
+    }
+
+    ASSERT_TRUE(stat_paths(dir, "uncached"), "");
+    ASSERT_EQ(mxio_cache_enable(mount), NO_ERROR, "");
+    ASSERT_TRUE(stat_paths(dir, "cached"), "");
+    ASSERT_EQ(mxio_cache_disable(mount), NO_ERROR, "");
+
+    for (int i = 0; i < kCachePaths; i++) {
+        snprintf(path, sizeof(path), "%s/file-%d", dir, i);
+        ASSERT_EQ(unlink(path), 0, "");
+    }
+    ASSERT_EQ(rmdir(dir), 0, "");
+    return true;
+}
+
+bool benchmark_stat_cache_memfs(void) {
+    BEGIN_TEST;
+    ASSERT_TRUE(stat_throughput("/tmp"), "");
+    END_TEST;
+}
+
+BEGIN_TEST_CASE(stat_cache_benchmarks)
+RUN_TEST_PERFORMANCE(benchmark_stat_cache_memfs)
+END_TEST_CASE(stat_cache_benchmarks)
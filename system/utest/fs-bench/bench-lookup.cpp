@@ -0,0 +1,102 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <magenta/syscalls.h>
+#include <unittest/unittest.h>
+
+#define MOUNT_POINT "/benchmark"
+
+constexpr int kLookupDepth = 10;
+constexpr int kLookupOps = 100000;
+
+// Builds "<mount>/deep-0/deep-1/.../deep-9", making each directory on the
+// way if |make| is set, or removing them deepest first otherwise.
+static bool deep_path(const char* mount, bool make, char* path, size_t len) {
+    int n = snprintf(path, len, "%s", mount);
+    for (int i = 0; i < kLookupDepth; i++) {
+        n += snprintf(path + n, len - n, "/deep-%d", i);
+        if (make) {
+            ASSERT_EQ(mkdir(path, 0755), 0, "Could not make directory");
+        }
+    }
+    if (!make) {
+        size_t mount_len = strlen(mount);
+        while (strlen(path) > mount_len) {
+            ASSERT_EQ(rmdir(path), 0, "Could not remove directory");
+            *strrchr(path, '/') = 0;
+        }
+    }
+    return true;
+}
+
+// Every stat and open of a deep path walks all of its components on the
+// server, so this is mostly the cost of the lookups along the way.
+static bool lookup_deep_path(const char* mount) {
+    printf("\nBenchmarking lookups of a %d deep path in %s\n", kLookupDepth, mount);
+
+    char path[PATH_MAX];
+    char file[PATH_MAX];
+    char missing[PATH_MAX];
+    ASSERT_TRUE(deep_path(mount, true, path, sizeof(path)), "");
+    snprintf(file, sizeof(file), "%s/file", path);
+    snprintf(missing, sizeof(missing), "%s/missing", path);
+    int fd = open(file, O_CREAT | O_RDWR, 0644);
+    ASSERT_GT(fd, 0, "Cannot create file");
+    ASSERT_EQ(close(fd), 0, "");
+
+    uint64_t ticks_per_msec = mx_ticks_per_second() / 1000;
+    struct stat st;
+    uint64_t start = mx_ticks_get();
+    for (int i = 0; i < kLookupOps; i++) {
+        ASSERT_EQ(stat(file, &st), 0, "");
+    }
+    uint64_t end = mx_ticks_get();
+    printf("Benchmark stat:         [%10lu] msec\n", (end - start) / ticks_per_msec);
+
+    start = mx_ticks_get();
+    for (int i = 0; i < kLookupOps; i++) {
+        ASSERT_EQ(stat(missing, &st), -1, "");
+    }
+    end = mx_ticks_get();
+    printf("Benchmark stat missing: [%10lu] msec\n", (end - start) / ticks_per_msec);
+
+    start = mx_ticks_get();
+    for (int i = 0; i < kLookupOps; i++) {
+        fd = open(file, O_RDONLY);
+        ASSERT_GT(fd, 0, "");
+        ASSERT_EQ(close(fd), 0, "");
+    }
+    end = mx_ticks_get();
+    printf("Benchmark open + close: [%10lu] msec\n", (end - start) / ticks_per_msec);
+
+    ASSERT_EQ(unlink(file), 0, "");
+    ASSERT_EQ(stat(file, &st), -1, "Stale lookup after unlink");
+    ASSERT_TRUE(deep_path(mount, false, path, sizeof(path)), "");
+    return true;
+}
+
+bool benchmark_lookup_memfs(void) {
+    BEGIN_TEST;
+    ASSERT_TRUE(lookup_deep_path("/tmp"), "");
+    END_TEST;
+}
+
+bool benchmark_lookup_minfs(void) {
+    BEGIN_TEST;
+    ASSERT_TRUE(lookup_deep_path(MOUNT_POINT), "");
+    END_TEST;
+}
+
+BEGIN_TEST_CASE(lookup_benchmarks)
+RUN_TEST_PERFORMANCE(benchmark_lookup_memfs)
+RUN_TEST_PERFORMANCE(benchmark_lookup_minfs)
+END_TEST_CASE(lookup_benchmarks)
@@ -0,0 +1,109 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <magenta/new.h>
+#include <magenta/syscalls.h>
+#include <mxtl/unique_ptr.h>
+#include <unittest/unittest.h>
+
+#define MOUNT_POINT "/benchmark"
+
+constexpr size_t kMmapFileSize = 500 * (1 << 20);
+constexpr size_t kMmapChunkSize = (1 << 20);
+
+// Adds up the words of a buffer, so that neither way of getting at the
+// file is let off looking at its contents.
+static uint64_t checksum(const uint8_t* data, size_t len) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        sum += word;
+    }
+    return sum;
+}
+
+// Compares reading a large file through read() into a buffer with
+// mapping it and reading it in place.
+static bool mmap_vs_read(const char* dir) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/mmapfile", dir);
+    printf("\nBenchmarking read vs mmap of %zu MB in %s\n", kMmapFileSize >> 20, dir);
+
+    int fd = open(path, O_CREAT | O_RDWR, 0644);
+    ASSERT_GT(fd, 0, "Cannot create file");
+
+    AllocChecker ac;
+    mxtl::unique_ptr<uint8_t[]> data(new (&ac) uint8_t[kMmapChunkSize]);
+    ASSERT_EQ(ac.check(), true, "");
+    for (size_t i = 0; i < kMmapChunkSize; i++) {
+        data[i] = static_cast<uint8_t>(i * 7);
+    }
+    for (size_t off = 0; off < kMmapFileSize; off += kMmapChunkSize) {
+        ASSERT_EQ(write(fd, data.get(), kMmapChunkSize), (ssize_t)kMmapChunkSize, "");
+    }
+    ASSERT_EQ(fsync(fd), 0, "");
+
+    uint64_t start, end;
+    uint64_t ticks_per_msec = mx_ticks_per_second() / 1000;
+
+    ASSERT_EQ(lseek(fd, 0, SEEK_SET), 0, "");
+    uint64_t read_sum = 0;
+    start = mx_ticks_get();
+    for (size_t off = 0; off < kMmapFileSize; off += kMmapChunkSize) {
+        ASSERT_EQ(read(fd, data.get(), kMmapChunkSize), (ssize_t)kMmapChunkSize, "");
+        read_sum += checksum(data.get(), kMmapChunkSize);
+    }
+    end = mx_ticks_get();
+    printf("Benchmark read: [%10lu] msec\n", (end - start) / ticks_per_msec);
+
+    start = mx_ticks_get();
+    void* addr = mmap(NULL, kMmapFileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    ASSERT_NEQ(addr, MAP_FAILED, "Cannot map file");
+    uint64_t mmap_sum = checksum(static_cast<const uint8_t*>(addr), kMmapFileSize);
+    ASSERT_EQ(munmap(addr, kMmapFileSize), 0, "");
+    end = mx_ticks_get();
+    printf("Benchmark mmap: [%10lu] msec\n", (end - start) / ticks_per_msec);
+    ASSERT_EQ(mmap_sum, read_sum, "Mapped contents differ from read contents");
+
+    // Stores through a shared mapping reach the file once synced.
+    addr = mmap(NULL, PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ASSERT_NEQ(addr, MAP_FAILED, "Cannot map file for writing");
+    memset(addr, 0xee, PAGE_SIZE);
+    ASSERT_EQ(msync(addr, PAGE_SIZE, MS_SYNC), 0, "");
+    ASSERT_EQ(munmap(addr, PAGE_SIZE), 0, "");
+    ASSERT_EQ(pread(fd, data.get(), PAGE_SIZE, 0), (ssize_t)PAGE_SIZE, "");
+    for (size_t i = 0; i < PAGE_SIZE; i++) {
+        ASSERT_EQ(data[i], 0xee, "Store through mapping was lost");
+    }
+
+    ASSERT_EQ(close(fd), 0, "");
+    ASSERT_EQ(unlink(path), 0, "");
+    return true;
+}
+
+bool benchmark_mmap_memfs(void) {
+    BEGIN_TEST;
+    ASSERT_TRUE(mmap_vs_read("/tmp"), "");
+    END_TEST;
+}
+
+bool benchmark_mmap(void) {
+    BEGIN_TEST;
+    ASSERT_TRUE(mmap_vs_read(MOUNT_POINT), "");
+    END_TEST;
+}
+
+BEGIN_TEST_CASE(mmap_benchmarks)
+RUN_TEST_PERFORMANCE(benchmark_mmap_memfs)
+RUN_TEST_PERFORMANCE(benchmark_mmap)
+END_TEST_CASE(mmap_benchmarks)
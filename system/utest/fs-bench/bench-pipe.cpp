@@ -0,0 +1,143 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <threads.h>
+#include <unistd.h>
+
+#include <magenta/new.h>
+#include <magenta/syscalls.h>
+#include <mxtl/unique_ptr.h>
+#include <unittest/unittest.h>
+
+#define PIPE_FILE "/tmp/pipe-bench"
+
+constexpr size_t kPipeLineLen = 80;
+constexpr size_t kPipeLines = 400000;
+constexpr size_t kPipeFileSize = kPipeLines * kPipeLineLen;
+constexpr size_t kPipeIoSize = 64 * 1024;
+// lines written to the file at a time, to make it quickly
+constexpr size_t kPipeBlockLines = 800;
+
+struct PipeCat {
+    int fd;
+    bool ok;
+};
+
+// "cat PIPE_FILE": copies the file into the pipe, then closes it.
+static int pipe_cat_thread(void* arg) {
+    PipeCat* cat = static_cast<PipeCat*>(arg);
+    cat->ok = false;
+    int in = open(PIPE_FILE, O_RDONLY);
+    if (in >= 0) {
+        AllocChecker ac;
+        mxtl::unique_ptr<char[]> buf(new (&ac) char[kPipeIoSize]);
+        ssize_t r = -1;
+        while (ac.check() && (r = read(in, buf.get(), kPipeIoSize)) > 0) {
+            for (ssize_t off = 0; off < r;) {
+                ssize_t w = write(cat->fd, buf.get() + off, r - off);
+                if (w <= 0) {
+                    r = -1;
+                    break;
+                }
+                off += w;
+            }
+            if (r < 0) {
+                break;
+            }
+        }
+        cat->ok = (r == 0);
+        close(in);
+    }
+    close(cat->fd);
+    return 0;
+}
+
+// "| wc": counts the lines and bytes coming out of the pipe.
+static bool pipe_wc(int fd, size_t* lines, size_t* bytes) {
+    AllocChecker ac;
+    mxtl::unique_ptr<char[]> buf(new (&ac) char[kPipeIoSize]);
+    ASSERT_TRUE(ac.check(), "");
+    *lines = 0;
+    *bytes = 0;
+    ssize_t r;
+    while ((r = read(fd, buf.get(), kPipeIoSize)) > 0) {
+        for (ssize_t i = 0; i < r; i++) {
+            *lines += (buf[i] == '\n');
+        }
+        *bytes += r;
+    }
+    ASSERT_EQ(r, 0, "");
+    return true;
+}
+
+static bool pipe_throughput(int pipe_size) {
+    int fds[2];
+    ASSERT_EQ(pipe(fds), 0, "");
+    int size = fcntl(fds[0], F_GETPIPE_SZ);
+    ASSERT_GT(size, 0, "");
+    if (pipe_size != 0) {
+        // enlarged by the writer, the way a producer would, and seen by
+        // the reader too
+        size = fcntl(fds[1], F_SETPIPE_SZ, pipe_size);
+        ASSERT_GE(size, pipe_size, "");
+        ASSERT_EQ(fcntl(fds[0], F_GETPIPE_SZ), size, "");
+    }
+
+    PipeCat cat = {fds[1], false};
+    uint64_t ticks_per_msec = mx_ticks_per_second() / 1000;
+    uint64_t start = mx_ticks_get();
+    thrd_t t;
+    ASSERT_EQ(thrd_create(&t, pipe_cat_thread, &cat), thrd_success, "");
+    size_t lines;
+    size_t bytes;
+    ASSERT_TRUE(pipe_wc(fds[0], &lines, &bytes), "");
+    ASSERT_EQ(thrd_join(t, NULL), thrd_success, "");
+    uint64_t msec = (mx_ticks_get() - start) / ticks_per_msec;
+    ASSERT_EQ(close(fds[0]), 0, "");
+
+    ASSERT_TRUE(cat.ok, "cat failed");
+    ASSERT_EQ(bytes, kPipeFileSize, "");
+    ASSERT_EQ(lines, kPipeLines, "");
+    printf("Benchmark pipe buffer %8d: [%10lu] msec, [%10lu] KB/s\n", size, msec,
+           msec ? (kPipeFileSize / 1024) * 1000 / msec : 0);
+    return true;
+}
+
+// The equivalent of "cat bigfile | wc", with the pipe's buffer left
+// alone and then enlarged.
+bool benchmark_pipe_cat_wc(void) {
+    BEGIN_TEST;
+    printf("\nBenchmarking cat | wc of a %zu KB file\n", kPipeFileSize / 1024);
+
+    constexpr size_t block_size = kPipeBlockLines * kPipeLineLen;
+    AllocChecker ac;
+    mxtl::unique_ptr<char[]> block(new (&ac) char[block_size]);
+    ASSERT_TRUE(ac.check(), "");
+    memset(block.get(), 'x', block_size);
+    for (size_t i = 1; i <= kPipeBlockLines; i++) {
+        block[i * kPipeLineLen - 1] = '\n';
+    }
+
+    int fd = open(PIPE_FILE, O_CREAT | O_RDWR, 0644);
+    ASSERT_GT(fd, 0, "Cannot create file");
+    for (size_t i = 0; i < kPipeLines; i += kPipeBlockLines) {
+        ASSERT_EQ(write(fd, block.get(), block_size), static_cast<ssize_t>(block_size), "");
+    }
+    ASSERT_EQ(close(fd), 0, "");
+
+    const int sizes[] = {0, 1 << 20, 4 << 20};
+    for (int size : sizes) {
+        ASSERT_TRUE(pipe_throughput(size), "");
+    }
+    ASSERT_EQ(unlink(PIPE_FILE), 0, "");
+    END_TEST;
+}
+
+BEGIN_TEST_CASE(pipe_benchmarks)
+RUN_TEST_PERFORMANCE(benchmark_pipe_cat_wc)
+END_TEST_CASE(pipe_benchmarks)
@@ -0,0 +1,223 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <threads.h>
+#include <unistd.h>
+
+#include <magenta/new.h>
+#include <magenta/syscalls.h>
+#include <mxio/io.h>
+#include <mxio/remoteio.h>
+#include <mxio/util.h>
+#include <mxio/vfs.h>
+#include <mxtl/unique_ptr.h>
+#include <unittest/unittest.h>
+
+constexpr size_t kRaFileSize = 2 * (1 << 20);
+constexpr size_t kRaReadSize = 4096;
+constexpr size_t kRaMaxQueued = 16;
+
+static uint8_t ra_pattern(int64_t off) {
+    return static_cast<uint8_t>(off % 251);
+}
+
+// A file server which answers each request only after |latency| has gone
+// by, like one at the other end of a slow link.  It keeps reading requests
+// in the meantime, so that any which are pipelined overlap their waits.
+struct LatencyServer {
+    mx_handle_t h;
+    mx_time_t latency;
+    int64_t off;
+
+    struct Reply {
+        mx_time_t due;
+        mxrio_msg_t msg;
+    };
+    Reply queue[kRaMaxQueued];
+    size_t head;
+    size_t count;
+};
+
+static void latency_fill(mxrio_msg_t* msg, int64_t off, uint32_t len) {
+    if (off >= static_cast<int64_t>(kRaFileSize)) {
+        len = 0;
+    } else if (len > kRaFileSize - off) {
+        len = static_cast<uint32_t>(kRaFileSize - off);
+    }
+    for (uint32_t i = 0; i < len; i++) {
+        msg->data[i] = ra_pattern(off + i);
+    }
+    msg->datalen = len;
+    msg->arg = len;
+}
+
+// Fills in the reply to |msg| in place.  Returns false once the client
+// has closed the file.
+static bool latency_handle(LatencyServer* srv, mxrio_msg_t* msg) {
+    bool open = true;
+    uint32_t len = (msg->arg > MXIO_CHUNK_SIZE) ? MXIO_CHUNK_SIZE : msg->arg;
+    switch (MXRIO_OP(msg->op)) {
+    case MXRIO_READ:
+        latency_fill(msg, srv->off, len);
+        srv->off += msg->datalen;
+        msg->arg2.off = srv->off;
+        break;
+    case MXRIO_READ_AT:
+        latency_fill(msg, msg->arg2.off, len);
+        break;
+    case MXRIO_SEEK: {
+        int64_t base = (msg->arg == SEEK_SET) ? 0 :
+                       (msg->arg == SEEK_CUR) ? srv->off : kRaFileSize;
+        srv->off = base + msg->arg2.off;
+        msg->arg2.off = srv->off;
+        msg->datalen = 0;
+        msg->arg = NO_ERROR;
+        break;
+    }
+    case MXRIO_STAT: {
+        vnattr_t attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.mode = V_TYPE_FILE | 0644;
+        attr.size = kRaFileSize;
+        memcpy(msg->data, &attr, sizeof(attr));
+        msg->datalen = sizeof(attr);
+        msg->arg = sizeof(attr);
+        break;
+    }
+    case MXRIO_CLOSE:
+        open = false;
+        msg->datalen = 0;
+        msg->arg = NO_ERROR;
+        break;
+    default:
+        msg->datalen = 0;
+        msg->arg = ERR_NOT_SUPPORTED;
+    }
+    msg->op = MXRIO_STATUS;
+    msg->hcount = 0;
+    return open;
+}
+
+static int latency_server_thread(void* arg) {
+    LatencyServer* srv = static_cast<LatencyServer*>(arg);
+    bool open = true;
+    while (open || srv->count > 0) {
+        mx_time_t now = mx_time_get(MX_CLOCK_MONOTONIC);
+        while (srv->count > 0 && srv->queue[srv->head].due <= now) {
+            mxrio_msg_t* msg = &srv->queue[srv->head].msg;
+            mx_channel_write(srv->h, 0, msg, MXRIO_HDR_SZ + msg->datalen, NULL, 0);
+            srv->head = (srv->head + 1) % kRaMaxQueued;
+            srv->count--;
+        }
+
+        mx_time_t timeout = MX_TIME_INFINITE;
+        if (srv->count > 0) {
+            timeout = srv->queue[srv->head].due - now;
+        }
+        if (!open || srv->count == kRaMaxQueued) {
+            if (srv->count > 0) {
+                mx_nanosleep(timeout);
+            }
+            continue;
+        }
+
+        mx_signals_t pending;
+        mx_status_t r = mx_object_wait_one(srv->h, MX_CHANNEL_READABLE | MX_CHANNEL_PEER_CLOSED,
+                                           timeout, &pending);
+        if (r == ERR_TIMED_OUT) {
+            continue;
+        } else if (r < 0 || !(pending & MX_CHANNEL_READABLE)) {
+            break;
+        }
+
+        LatencyServer::Reply* reply = &srv->queue[(srv->head + srv->count) % kRaMaxQueued];
+        uint32_t dsize;
+        uint32_t hcount;
+        if (mx_channel_read(srv->h, 0, &reply->msg, sizeof(reply->msg), &dsize,
+                            NULL, 0, &hcount) < 0) {
+            break;
+        }
+        open = latency_handle(srv, &reply->msg);
+        reply->due = mx_time_get(MX_CLOCK_MONOTONIC) + srv->latency;
+        srv->count++;
+    }
+    mx_handle_close(srv->h);
+    return 0;
+}
+
+// Reads the whole file at |fd| in small pieces, either with read(), which
+// may be served from readahead, or with pread(), which never is.
+static bool ra_read_file(int fd, bool sequential, uint8_t* buf, uint64_t* msec) {
+    uint64_t ticks_per_msec = mx_ticks_per_second() / 1000;
+    uint64_t start = mx_ticks_get();
+    for (size_t off = 0; off < kRaFileSize; off += kRaReadSize) {
+        ssize_t r = sequential ? read(fd, buf + off, kRaReadSize) :
+                                 pread(fd, buf + off, kRaReadSize, off);
+        ASSERT_EQ(r, static_cast<ssize_t>(kRaReadSize), "Short read");
+    }
+    *msec = (mx_ticks_get() - start) / ticks_per_msec;
+    uint8_t tail;
+    ASSERT_EQ(sequential ? read(fd, &tail, 1) : pread(fd, &tail, 1, kRaFileSize), 0,
+              "Expected end of file");
+
+    for (size_t i = 0; i < kRaFileSize; i++) {
+        ASSERT_EQ(buf[i], ra_pattern(i), "Data mismatch");
+    }
+    return true;
+}
+
+static bool ra_throughput(mx_time_t latency, bool sequential, uint8_t* buf) {
+    LatencyServer* srv;
+    AllocChecker ac;
+    mxtl::unique_ptr<LatencyServer> srv_owner(srv = new (&ac) LatencyServer());
+    ASSERT_TRUE(ac.check(), "");
+    srv->latency = latency;
+
+    mx_handle_t h;
+    ASSERT_EQ(mx_channel_create(0, &h, &srv->h), NO_ERROR, "");
+    thrd_t t;
+    ASSERT_EQ(thrd_create(&t, latency_server_thread, srv), thrd_success, "");
+
+    mxio_t* io = mxio_remote_create(h, 0);
+    ASSERT_NONNULL(io, "");
+    int fd = mxio_bind_to_fd(io, -1, 0);
+    ASSERT_GE(fd, 0, "");
+
+    memset(buf, 0, kRaFileSize);
+    uint64_t msec;
+    ASSERT_TRUE(ra_read_file(fd, sequential, buf, &msec), "");
+    ASSERT_EQ(close(fd), 0, "");
+    ASSERT_EQ(thrd_join(t, NULL), thrd_success, "");
+
+    printf("Benchmark %-5s latency %6lu us: [%10lu] msec, [%10lu] KB/s\n",
+           sequential ? "read" : "pread", latency / 1000, msec,
+           msec ? (kRaFileSize / 1024) * 1000 / msec : 0);
+    return true;
+}
+
+// Sequential read() of a file through a server which takes a while to
+// answer, compared with pread() of the same file, which is always one
+// request at a time.
+bool benchmark_readahead(void) {
+    BEGIN_TEST;
+    printf("\nBenchmarking sequential reads with server latency\n");
+
+    AllocChecker ac;
+    mxtl::unique_ptr<uint8_t[]> buf(new (&ac) uint8_t[kRaFileSize]);
+    ASSERT_TRUE(ac.check(), "");
+
+    const mx_time_t latencies[] = {0, MX_USEC(100), MX_MSEC(1)};
+    for (mx_time_t latency : latencies) {
+        ASSERT_TRUE(ra_throughput(latency, false, buf.get()), "");
+        ASSERT_TRUE(ra_throughput(latency, true, buf.get()), "");
+    }
+    END_TEST;
+}
+
+BEGIN_TEST_CASE(readahead_benchmarks)
+RUN_TEST_PERFORMANCE(benchmark_readahead)
+END_TEST_CASE(readahead_benchmarks)
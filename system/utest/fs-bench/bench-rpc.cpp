@@ -0,0 +1,91 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <threads.h>
+#include <unistd.h>
+
+#include <magenta/syscalls.h>
+#include <unittest/unittest.h>
+
+constexpr int kRpcIterations = 2000;
+constexpr int kRpcMaxClients = 16;
+
+struct RpcClient {
+    int fd;
+    bool ok;
+};
+
+// Each iteration is two round trips to the server: a stat and a small read.
+static int rpc_client_thread(void* arg) {
+    RpcClient* client = static_cast<RpcClient*>(arg);
+    char buf[64];
+    struct stat st;
+    client->ok = true;
+    for (int i = 0; i < kRpcIterations; i++) {
+        if (fstat(client->fd, &st) != 0 ||
+            pread(client->fd, buf, sizeof(buf), 0) != static_cast<ssize_t>(sizeof(buf))) {
+            client->ok = false;
+            break;
+        }
+    }
+    return 0;
+}
+
+// Measures how many requests a server gets through with more and more
+// clients, each on its own connection, talking to it at once.
+static bool rpc_throughput(const char* dir) {
+    printf("\nBenchmarking RPC throughput with concurrent clients in %s\n", dir);
+
+    RpcClient clients[kRpcMaxClients];
+    char path[PATH_MAX];
+    char data[64];
+    memset(data, 'r', sizeof(data));
+    for (int i = 0; i < kRpcMaxClients; i++) {
+        snprintf(path, sizeof(path), "%s/rpcfile-%d", dir, i);
+        clients[i].fd = open(path, O_CREAT | O_RDWR, 0644);
+        ASSERT_GT(clients[i].fd, 0, "Cannot create file");
+        ASSERT_EQ(write(clients[i].fd, data, sizeof(data)), (ssize_t)sizeof(data), "");
+    }
+
+    uint64_t ticks_per_msec = mx_ticks_per_second() / 1000;
+    for (int count = 1; count <= kRpcMaxClients; count *= 2) {
+        thrd_t threads[kRpcMaxClients];
+        uint64_t start = mx_ticks_get();
+        for (int i = 0; i < count; i++) {
+            ASSERT_EQ(thrd_create(&threads[i], rpc_client_thread, &clients[i]),
+                      thrd_success, "");
+        }
+        for (int i = 0; i < count; i++) {
+            ASSERT_EQ(thrd_join(threads[i], NULL), thrd_success, "");
+            ASSERT_TRUE(clients[i].ok, "Client request failed");
+        }
+        uint64_t msec = (mx_ticks_get() - start) / ticks_per_msec;
+        uint64_t ops = 2ull * kRpcIterations * count;
+        printf("Benchmark %2d clients: [%10lu] msec, [%10lu] ops/sec\n", count, msec,
+               msec ? ops * 1000 / msec : 0);
+    }
+
+    for (int i = 0; i < kRpcMaxClients; i++) {
+        ASSERT_EQ(close(clients[i].fd), 0, "");
+        snprintf(path, sizeof(path), "%s/rpcfile-%d", dir, i);
+        ASSERT_EQ(unlink(path), 0, "");
+    }
+    return true;
+}
+
+bool benchmark_rpc_memfs(void) {
+    BEGIN_TEST;
+    ASSERT_TRUE(rpc_throughput("/tmp"), "");
+    END_TEST;
+}
+
+BEGIN_TEST_CASE(rpc_benchmarks)
+RUN_TEST_PERFORMANCE(benchmark_rpc_memfs)
+END_TEST_CASE(rpc_benchmarks)
@@ -0,0 +1,57 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <magenta/syscalls.h>
+#include <unittest/unittest.h>
+
+#define STDIO_PATH "/tmp/stdio-bench"
+
+constexpr int kStdioLines = 200000;
+
+// Writes a log's worth of short formatted lines, and checks they all
+// made it to the file, either line buffered, which is one write per
+// line, or buffered the way stdio chooses for a file.
+static bool printf_lines(bool line_buffered, const char* label) {
+    FILE* f = fopen(STDIO_PATH, "w");
+    ASSERT_NONNULL(f, "");
+    if (line_buffered) {
+        ASSERT_EQ(setvbuf(f, NULL, _IOLBF, 0), 0, "");
+    }
+
+    uint64_t ticks_per_msec = mx_ticks_per_second() / 1000;
+    uint64_t start = mx_ticks_get();
+    uint64_t total = 0;
+    for (int i = 0; i < kStdioLines; i++) {
+        int r = fprintf(f, "line %8d: %s %#x\n", i, label, i * 7);
+        ASSERT_GT(r, 0, "");
+        total += r;
+    }
+    ASSERT_EQ(fclose(f), 0, "");
+    uint64_t msec = (mx_ticks_get() - start) / ticks_per_msec;
+    printf("Benchmark %-8s: [%10lu] msec, [%10lu] KB/s\n", label, msec,
+           msec ? (total / 1024) * 1000 / msec : 0);
+
+    struct stat st;
+    ASSERT_EQ(stat(STDIO_PATH, &st), 0, "");
+    ASSERT_EQ(st.st_size, static_cast<off_t>(total), "Lost output");
+    ASSERT_EQ(unlink(STDIO_PATH), 0, "");
+    return true;
+}
+
+bool benchmark_stdio_printf(void) {
+    BEGIN_TEST;
+    printf("\nBenchmarking %d fprintf calls to a file on memfs\n", kStdioLines);
+    ASSERT_TRUE(printf_lines(true, "line"), "");
+    ASSERT_TRUE(printf_lines(false, "full"), "");
+    END_TEST;
+}
+
+BEGIN_TEST_CASE(stdio_benchmarks)
+RUN_TEST_PERFORMANCE(benchmark_stdio_printf)
+END_TEST_CASE(stdio_benchmarks)
@@ -13,6 +13,13 @@ MODULE_NAME := fs-bench-test
 MODULE_SRCS := \
     $(LOCAL_DIR)/main.cpp \
     $(LOCAL_DIR)/bench-basic.cpp \
+    $(LOCAL_DIR)/bench-cache.cpp \
+    $(LOCAL_DIR)/bench-lookup.cpp \
+    $(LOCAL_DIR)/bench-mmap.cpp \
+    $(LOCAL_DIR)/bench-pipe.cpp \
+    $(LOCAL_DIR)/bench-readahead.cpp \
+    $(LOCAL_DIR)/bench-rpc.cpp \
+    $(LOCAL_DIR)/bench-stdio.cpp \
 
 MODULE_LIBS := \
     system/ulib/c \
@@ -18,14 +18,18 @@ MODULE_SRCS := \
     $(LOCAL_DIR)/test-attr.c \
     $(LOCAL_DIR)/test-append.c \
     $(LOCAL_DIR)/test-basic.c \
+    $(LOCAL_DIR)/test-cache.c \
     $(LOCAL_DIR)/test-directory.c \
     $(LOCAL_DIR)/test-link.c \
     $(LOCAL_DIR)/test-maxfile.c \
+    $(LOCAL_DIR)/test-mmap.c \
     $(LOCAL_DIR)/test-overflow.c \
+    $(LOCAL_DIR)/test-parallel.c \
     $(LOCAL_DIR)/test-persist.c \
     $(LOCAL_DIR)/test-rw-workers.c \
     $(LOCAL_DIR)/test-rename.c \
     $(LOCAL_DIR)/test-random-op.c \
+    $(LOCAL_DIR)/test-readahead.c \
     $(LOCAL_DIR)/test-sync.c \
     $(LOCAL_DIR)/test-truncate.c \
     $(LOCAL_DIR)/test-unlink.c \
@@ -6,6 +6,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
@@ -49,6 +50,39 @@ bool test_basic(void) {
     END_TEST;
 }
 
+// Large enough to go through a vmo rather than messages.
+#define ACCESS_BUF_SIZE (64 * 1024)
+
+bool test_access_mode(void) {
+    BEGIN_TEST;
+
+    static char buf[ACCESS_BUF_SIZE];
+    memset(buf, 'a', sizeof(buf));
+    int fd = open("::access", O_CREAT | O_RDWR, 0644);
+    ASSERT_GT(fd, 0, "");
+    ASSERT_EQ(write(fd, buf, sizeof(buf)), (ssize_t)sizeof(buf), "");
+    ASSERT_EQ(close(fd), 0, "");
+
+    fd = open("::access", O_WRONLY, 0644);
+    ASSERT_GT(fd, 0, "");
+    ASSERT_EQ(read(fd, buf, 16), -1, "Read from a write-only file");
+    ASSERT_EQ(read(fd, buf, sizeof(buf)), -1, "Read from a write-only file");
+    ASSERT_EQ(pread(fd, buf, sizeof(buf), 0), -1, "Read from a write-only file");
+    ASSERT_EQ(close(fd), 0, "");
+
+    fd = open("::access", O_RDONLY, 0644);
+    ASSERT_GT(fd, 0, "");
+    ASSERT_EQ(write(fd, buf, 16), -1, "Wrote to a read-only file");
+    ASSERT_EQ(write(fd, buf, sizeof(buf)), -1, "Wrote to a read-only file");
+    ASSERT_EQ(pwrite(fd, buf, sizeof(buf), 0), -1, "Wrote to a read-only file");
+    ASSERT_EQ(read(fd, buf, sizeof(buf)), (ssize_t)sizeof(buf), "");
+    ASSERT_EQ(close(fd), 0, "");
+
+    ASSERT_EQ(unlink("::access"), 0, "");
+    END_TEST;
+}
+
 RUN_FOR_ALL_FILESYSTEMS(basic_tests,
     RUN_TEST_MEDIUM(test_basic)
+    RUN_TEST_MEDIUM(test_access_mode)
 )
@@ -0,0 +1,99 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+
+#include <mxio/io.h>
+
+#include "filesystems.h"
+
+// Whatever the cache has seen of a path, changes made since must show.
+bool test_cache_sees_changes(void) {
+    BEGIN_TEST;
+
+    ASSERT_EQ(mxio_cache_enable(test_root_path), NO_ERROR, "");
+    ASSERT_EQ(mxio_cache_enable(test_root_path), ERR_ALREADY_EXISTS, "");
+
+    struct stat st;
+    for (int i = 0; i < 2; i++) {
+        ASSERT_EQ(stat("::cached", &st), -1, "");
+        ASSERT_EQ(errno, ENOENT, "");
+        ASSERT_EQ(open("::cached", O_RDWR), -1, "");
+        ASSERT_EQ(errno, ENOENT, "");
+    }
+
+    int fd = open("::cached", O_CREAT | O_RDWR, 0644);
+    ASSERT_GT(fd, 0, "Created file hidden by cached lookup");
+    ASSERT_EQ(stat("::cached", &st), 0, "");
+    ASSERT_EQ(st.st_size, 0, "");
+    ASSERT_EQ(stat("::cached", &st), 0, "");
+
+    char data[] = "generation";
+    ASSERT_EQ(write(fd, data, sizeof(data)), (ssize_t)sizeof(data), "");
+    ASSERT_EQ(stat("::cached", &st), 0, "");
+    ASSERT_EQ(st.st_size, (off_t)sizeof(data), "Stale size after write");
+    ASSERT_EQ(ftruncate(fd, 1), 0, "");
+    ASSERT_EQ(stat("::cached", &st), 0, "");
+    ASSERT_EQ(st.st_size, 1, "Stale size after truncate");
+    ASSERT_EQ(close(fd), 0, "");
+
+    ASSERT_EQ(rename("::cached", "::renamed"), 0, "");
+    ASSERT_EQ(stat("::cached", &st), -1, "Stale name after rename");
+    ASSERT_EQ(stat("::renamed", &st), 0, "");
+    ASSERT_EQ(st.st_size, 1, "");
+
+    ASSERT_EQ(unlink("::renamed"), 0, "");
+    ASSERT_EQ(stat("::renamed", &st), -1, "Stale name after unlink");
+    ASSERT_EQ(errno, ENOENT, "");
+
+    ASSERT_EQ(mxio_cache_disable(test_root_path), NO_ERROR, "");
+    ASSERT_EQ(mxio_cache_disable(test_root_path), ERR_NOT_FOUND, "");
+
+    END_TEST;
+}
+
+// The test filesystem may be mounted below /tmp, in which case changes
+// to it are not counted by /tmp's filesystem, and must still show.
+bool test_cache_below_mount(void) {
+    BEGIN_TEST;
+
+    ASSERT_EQ(mxio_cache_enable("/tmp"), NO_ERROR, "");
+
+    struct stat st;
+    for (int i = 0; i < 2; i++) {
+        ASSERT_EQ(stat("::below", &st), -1, "");
+        ASSERT_EQ(errno, ENOENT, "");
+        ASSERT_EQ(open("::below", O_RDWR), -1, "");
+        ASSERT_EQ(errno, ENOENT, "");
+    }
+
+    int fd = open("::below", O_CREAT | O_RDWR, 0644);
+    ASSERT_GT(fd, 0, "Created file hidden by cached lookup");
+    ASSERT_EQ(stat("::below", &st), 0, "");
+    ASSERT_EQ(st.st_size, 0, "");
+
+    char data[] = "mounted";
+    ASSERT_EQ(write(fd, data, sizeof(data)), (ssize_t)sizeof(data), "");
+    ASSERT_EQ(stat("::below", &st), 0, "");
+    ASSERT_EQ(st.st_size, (off_t)sizeof(data), "Stale size after write");
+    ASSERT_EQ(close(fd), 0, "");
+
+    ASSERT_EQ(unlink("::below"), 0, "");
+    ASSERT_EQ(stat("::below", &st), -1, "Stale name after unlink");
+    ASSERT_EQ(errno, ENOENT, "");
+
+    ASSERT_EQ(mxio_cache_disable("/tmp"), NO_ERROR, "");
+
+    END_TEST;
+}
+
+RUN_FOR_ALL_FILESYSTEMS(cache_tests,
+    RUN_TEST_MEDIUM(test_cache_sees_changes)
+    RUN_TEST_MEDIUM(test_cache_below_mount)
+)
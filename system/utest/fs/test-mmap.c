@@ -0,0 +1,107 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "filesystems.h"
+#include "misc.h"
+
+#define MMAP_SIZE 8192
+
+static bool make_file(const char* path, uint8_t* data) {
+    for (size_t i = 0; i < MMAP_SIZE; i++) {
+        data[i] = (uint8_t)(i * 3 + 5);
+    }
+    int fd = open(path, O_RDWR | O_CREAT | O_EXCL, 0644);
+    ASSERT_GT(fd, 0, "");
+    ASSERT_EQ(write(fd, data, MMAP_SIZE), MMAP_SIZE, "");
+    ASSERT_EQ(close(fd), 0, "");
+    return true;
+}
+
+bool test_mmap_shared(void) {
+    BEGIN_TEST;
+
+    uint8_t data[MMAP_SIZE];
+    ASSERT_TRUE(make_file("::mmap", data), "");
+
+    int fd = open("::mmap", O_RDWR, 0644);
+    ASSERT_GT(fd, 0, "");
+    uint8_t* addr = mmap(NULL, MMAP_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ASSERT_NEQ(addr, MAP_FAILED, "");
+    ASSERT_EQ(memcmp(addr, data, MMAP_SIZE), 0, "");
+
+    // stores through the mapping reach the file
+    memset(addr, 'x', 16);
+    memset(data, 'x', 16);
+    ASSERT_EQ(msync(addr, MMAP_SIZE, MS_SYNC), 0, "");
+    ASSERT_EQ(munmap(addr, MMAP_SIZE), 0, "");
+    ASSERT_TRUE(check_file_contents(fd, data, MMAP_SIZE), "");
+    ASSERT_EQ(close(fd), 0, "");
+
+    ASSERT_EQ(unlink("::mmap"), 0, "");
+    END_TEST;
+}
+
+bool test_mmap_private(void) {
+    BEGIN_TEST;
+
+    uint8_t data[MMAP_SIZE];
+    ASSERT_TRUE(make_file("::mmap", data), "");
+
+    // a private mapping may be written even through a read-only fd, but
+    // the file is left alone
+    int fd = open("::mmap", O_RDONLY, 0644);
+    ASSERT_GT(fd, 0, "");
+    uint8_t* addr = mmap(NULL, MMAP_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    ASSERT_NEQ(addr, MAP_FAILED, "");
+    memset(addr, 'x', MMAP_SIZE);
+    ASSERT_EQ(munmap(addr, MMAP_SIZE), 0, "");
+    ASSERT_TRUE(check_file_contents(fd, data, MMAP_SIZE), "");
+    ASSERT_EQ(close(fd), 0, "");
+
+    ASSERT_EQ(unlink("::mmap"), 0, "");
+    END_TEST;
+}
+
+bool test_mmap_access(void) {
+    BEGIN_TEST;
+
+    uint8_t data[MMAP_SIZE];
+    ASSERT_TRUE(make_file("::mmap", data), "");
+
+    // a shared writable mapping needs a writable fd
+    int fd = open("::mmap", O_RDONLY, 0644);
+    ASSERT_GT(fd, 0, "");
+    void* addr = mmap(NULL, MMAP_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ASSERT_EQ(addr, MAP_FAILED, "");
+    ASSERT_EQ(errno, EACCES, "");
+    ASSERT_EQ(close(fd), 0, "");
+
+    // and any mapping needs a readable one
+    fd = open("::mmap", O_WRONLY, 0644);
+    ASSERT_GT(fd, 0, "");
+    addr = mmap(NULL, MMAP_SIZE, PROT_READ, MAP_SHARED, fd, 0);
+    ASSERT_EQ(addr, MAP_FAILED, "");
+    ASSERT_EQ(errno, EACCES, "");
+    addr = mmap(NULL, MMAP_SIZE, PROT_READ, MAP_PRIVATE, fd, 0);
+    ASSERT_EQ(addr, MAP_FAILED, "");
+    ASSERT_EQ(errno, EACCES, "");
+    ASSERT_EQ(close(fd), 0, "");
+
+    ASSERT_EQ(unlink("::mmap"), 0, "");
+    END_TEST;
+}
+
+RUN_FOR_ALL_FILESYSTEMS(mmap_tests,
+    RUN_TEST_MEDIUM(test_mmap_shared)
+    RUN_TEST_MEDIUM(test_mmap_private)
+    RUN_TEST_MEDIUM(test_mmap_access)
+)
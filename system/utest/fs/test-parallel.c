@@ -0,0 +1,134 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <threads.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+
+#include <magenta/syscalls.h>
+
+#include "filesystems.h"
+
+#define NUM_FILES 16
+#define MAX_THREADS 8
+#define ITERATIONS 200
+#define FILE_SIZE 512
+
+typedef struct worker {
+    int id;
+    bool ok;
+} worker_t;
+
+static void fill_pattern(uint8_t* buf, int file) {
+    for (size_t i = 0; i < FILE_SIZE; i++) {
+        buf[i] = (uint8_t)(file * 31 + i);
+    }
+}
+
+// Each iteration walks to one of the shared files, opens, stats, reads
+// and checks it, and also creates and removes a file of its own in the
+// same directory, so lookups race with changes to the namespace.
+static int parallel_worker(void* arg) {
+    worker_t* w = arg;
+    uint8_t expected[FILE_SIZE];
+    uint8_t buf[FILE_SIZE];
+    char path[PATH_MAX];
+    char own[PATH_MAX];
+    struct stat st;
+
+    snprintf(own, sizeof(own), "::parallel/dir/worker-%d", w->id);
+    w->ok = false;
+    for (int i = 0; i < ITERATIONS; i++) {
+        int file = (w->id + i) % NUM_FILES;
+        snprintf(path, sizeof(path), "::parallel/dir/file-%d", file);
+        fill_pattern(expected, file);
+
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) {
+            fprintf(stderr, "worker %d: open %s failed\n", w->id, path);
+            return -1;
+        }
+        if (fstat(fd, &st) != 0 || st.st_size != FILE_SIZE) {
+            fprintf(stderr, "worker %d: fstat %s failed\n", w->id, path);
+            close(fd);
+            return -1;
+        }
+        if (read(fd, buf, sizeof(buf)) != FILE_SIZE ||
+            memcmp(buf, expected, sizeof(buf)) != 0) {
+            fprintf(stderr, "worker %d: read %s failed\n", w->id, path);
+            close(fd);
+            return -1;
+        }
+        if (close(fd) != 0 || stat("::parallel/dir", &st) != 0) {
+            return -1;
+        }
+
+        if ((fd = open(own, O_CREAT | O_EXCL | O_RDWR, 0644)) < 0) {
+            fprintf(stderr, "worker %d: create %s failed\n", w->id, own);
+            return -1;
+        }
+        if (close(fd) != 0 || unlink(own) != 0) {
+            return -1;
+        }
+    }
+    w->ok = true;
+    return 0;
+}
+
+bool test_parallel_open_stat_read(void) {
+    BEGIN_TEST;
+
+    ASSERT_EQ(mkdir("::parallel", 0755), 0, "");
+    ASSERT_EQ(mkdir("::parallel/dir", 0755), 0, "");
+    uint8_t data[FILE_SIZE];
+    char path[PATH_MAX];
+    for (int i = 0; i < NUM_FILES; i++) {
+        snprintf(path, sizeof(path), "::parallel/dir/file-%d", i);
+        int fd = open(path, O_CREAT | O_RDWR, 0644);
+        ASSERT_GT(fd, 0, "");
+        fill_pattern(data, i);
+        ASSERT_EQ(write(fd, data, sizeof(data)), FILE_SIZE, "");
+        ASSERT_EQ(close(fd), 0, "");
+    }
+
+    uint64_t ticks_per_msec = mx_ticks_per_second() / 1000;
+    for (int count = 1; count <= MAX_THREADS; count *= 2) {
+        worker_t workers[MAX_THREADS];
+        thrd_t threads[MAX_THREADS];
+        uint64_t start = mx_ticks_get();
+        for (int i = 0; i < count; i++) {
+            workers[i].id = i;
+            ASSERT_EQ(thrd_create(&threads[i], parallel_worker, &workers[i]), thrd_success, "");
+        }
+        for (int i = 0; i < count; i++) {
+            ASSERT_EQ(thrd_join(threads[i], NULL), thrd_success, "");
+            ASSERT_TRUE(workers[i].ok, "Worker failed");
+        }
+        uint64_t msec = (mx_ticks_get() - start) / ticks_per_msec;
+        // open, fstat, read, close, stat, create, close, unlink
+        uint64_t ops = 8ull * ITERATIONS * count;
+        unittest_printf("%s: %d threads: [%lu] msec, [%lu] ops/sec\n", test_info->name,
+                        count, msec, msec ? ops * 1000 / msec : 0);
+    }
+
+    for (int i = 0; i < NUM_FILES; i++) {
+        snprintf(path, sizeof(path), "::parallel/dir/file-%d", i);
+        ASSERT_EQ(unlink(path), 0, "");
+    }
+    ASSERT_EQ(rmdir("::parallel/dir"), 0, "");
+    ASSERT_EQ(rmdir("::parallel"), 0, "");
+
+    END_TEST;
+}
+
+RUN_FOR_ALL_FILESYSTEMS(parallel_tests,
+    RUN_TEST_MEDIUM(test_parallel_open_stat_read)
+)
@@ -49,6 +49,54 @@ bool test_persist_simple(void) {
     END_TEST;
 }
 
+bool test_persist_reused_dir_block(void) {
+    if (!test_info->can_be_mounted) {
+        fprintf(stderr, "Filesystem cannot be mounted; cannot test persistence\n");
+        return true;
+    }
+
+    BEGIN_TEST;
+
+    // Give the directory blocks of its own, written (but not necessarily
+    // written home) before they are freed.
+    ASSERT_EQ(mkdir("::dir", 0755), 0, "");
+    char name[PATH_MAX];
+    for (int i = 0; i < 64; i++) {
+        snprintf(name, sizeof(name), "::dir/entry-with-a-long-name-%d", i);
+        int fd = open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+        ASSERT_GT(fd, 0, "");
+        ASSERT_EQ(close(fd), 0, "");
+    }
+    for (int i = 0; i < 64; i++) {
+        snprintf(name, sizeof(name), "::dir/entry-with-a-long-name-%d", i);
+        ASSERT_EQ(unlink(name), 0, "");
+    }
+    ASSERT_EQ(rmdir("::dir"), 0, "");
+
+    // The freed blocks are reallocated as file data, and must not be
+    // overwritten by old copies of the directory when they are written
+    // back on unmount.
+    static uint8_t data[65536];
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = (uint8_t)(i * 7 + 1);
+    }
+    int fd = open("::file", O_RDWR | O_CREAT | O_EXCL, 0644);
+    ASSERT_GT(fd, 0, "");
+    ASSERT_EQ(write(fd, data, sizeof(data)), (ssize_t)sizeof(data), "");
+    ASSERT_EQ(close(fd), 0, "");
+
+    ASSERT_TRUE(check_remount(), "Could not remount filesystem");
+
+    fd = open("::file", O_RDONLY, 0644);
+    ASSERT_GT(fd, 0, "");
+    ASSERT_TRUE(check_file_contents(fd, data, sizeof(data)), "");
+    ASSERT_EQ(close(fd), 0, "");
+    ASSERT_EQ(unlink("::file"), 0, "");
+
+    END_TEST;
+}
+
 RUN_FOR_ALL_FILESYSTEMS(persistence_tests,
     RUN_TEST_MEDIUM(test_persist_simple)
+    RUN_TEST_MEDIUM(test_persist_reused_dir_block)
 )
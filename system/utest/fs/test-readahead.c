@@ -0,0 +1,106 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "filesystems.h"
+#include "misc.h"
+
+// Small sequential reads of a file are served from reads issued ahead of
+// them; these make sure that seeking and writing in the middle of such a
+// stream see the file as it is.
+
+#define RA_IO_SIZE 4096
+#define RA_FILE_SIZE (64 * RA_IO_SIZE)
+
+static uint8_t ra_data[RA_FILE_SIZE];
+
+static bool ra_create(const char* path) {
+    for (size_t i = 0; i < sizeof(ra_data); i++) {
+        ra_data[i] = (uint8_t)rand();
+    }
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    ASSERT_GT(fd, 0, "");
+    ASSERT_STREAM_ALL(write, fd, ra_data, sizeof(ra_data));
+    ASSERT_EQ(close(fd), 0, "");
+    return true;
+}
+
+// Reads count blocks in order from the seek pointer, which is at off.
+static bool ra_read_blocks(int fd, off_t off, size_t count) {
+    uint8_t buf[RA_IO_SIZE];
+    for (size_t i = 0; i < count; i++) {
+        ASSERT_STREAM_ALL(read, fd, buf, sizeof(buf));
+        ASSERT_EQ(memcmp(buf, ra_data + off, sizeof(buf)), 0, "");
+        off += sizeof(buf);
+    }
+    return true;
+}
+
+bool test_readahead_seek(void) {
+    BEGIN_TEST;
+
+    ASSERT_TRUE(ra_create("::readahead"), "");
+    int fd = open("::readahead", O_RDONLY, 0644);
+    ASSERT_GT(fd, 0, "");
+
+    ASSERT_TRUE(ra_read_blocks(fd, 0, 8), "");
+    ASSERT_EQ(lseek(fd, 0, SEEK_CUR), 8 * RA_IO_SIZE, "");
+
+    // backwards, forwards past what was read ahead, and to an odd offset
+    ASSERT_EQ(lseek(fd, RA_IO_SIZE, SEEK_SET), RA_IO_SIZE, "");
+    ASSERT_TRUE(ra_read_blocks(fd, RA_IO_SIZE, 8), "");
+    ASSERT_EQ(lseek(fd, 16 * RA_IO_SIZE, SEEK_CUR), 25 * RA_IO_SIZE, "");
+    ASSERT_TRUE(ra_read_blocks(fd, 25 * RA_IO_SIZE, 8), "");
+    ASSERT_EQ(lseek(fd, 100, SEEK_SET), 100, "");
+    ASSERT_TRUE(ra_read_blocks(fd, 100, 8), "");
+
+    // up to and past the end of the file
+    off_t off = RA_FILE_SIZE - 6 * RA_IO_SIZE;
+    ASSERT_EQ(lseek(fd, off, SEEK_SET), off, "");
+    ASSERT_TRUE(ra_read_blocks(fd, off, 6), "");
+    uint8_t buf[RA_IO_SIZE];
+    ASSERT_EQ(read(fd, buf, sizeof(buf)), 0, "");
+    ASSERT_EQ(lseek(fd, 0, SEEK_CUR), RA_FILE_SIZE, "");
+
+    ASSERT_EQ(close(fd), 0, "");
+    ASSERT_EQ(unlink("::readahead"), 0, "");
+    END_TEST;
+}
+
+bool test_readahead_write(void) {
+    BEGIN_TEST;
+
+    ASSERT_TRUE(ra_create("::readahead"), "");
+    int fd = open("::readahead", O_RDWR, 0644);
+    ASSERT_GT(fd, 0, "");
+
+    // the write lands where the reader got to, not past what was
+    // read ahead of it
+    ASSERT_TRUE(ra_read_blocks(fd, 0, 8), "");
+    uint8_t buf[RA_IO_SIZE];
+    memset(buf, 0xab, sizeof(buf));
+    ASSERT_STREAM_ALL(write, fd, buf, sizeof(buf));
+    memcpy(ra_data + 8 * RA_IO_SIZE, buf, sizeof(buf));
+    ASSERT_EQ(lseek(fd, 0, SEEK_CUR), 9 * RA_IO_SIZE, "");
+
+    // and is seen by later reads
+    ASSERT_TRUE(ra_read_blocks(fd, 9 * RA_IO_SIZE, 8), "");
+    ASSERT_EQ(lseek(fd, 0, SEEK_SET), 0, "");
+    ASSERT_TRUE(ra_read_blocks(fd, 0, 32), "");
+
+    ASSERT_EQ(close(fd), 0, "");
+    ASSERT_EQ(unlink("::readahead"), 0, "");
+    END_TEST;
+}
+
+RUN_FOR_ALL_FILESYSTEMS(readahead_tests,
+    RUN_TEST_MEDIUM(test_readahead_seek)
+    RUN_TEST_MEDIUM(test_readahead_write)
+)
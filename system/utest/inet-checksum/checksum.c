@@ -0,0 +1,152 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <inet-checksum/checksum.h>
+#include <magenta/syscalls.h>
+#include <unittest/unittest.h>
+
+// A word at a time, as inet6 used to sum.
+static uint16_t reference_checksum(const void* data, size_t len, uint16_t _sum) {
+    const uint8_t* p = data;
+    uint32_t sum = _sum;
+    for (; len > 1; p += 2, len -= 2) {
+        uint16_t w;
+        memcpy(&w, p, sizeof(w));
+        sum += w;
+        while (sum > 0xffff) {
+            sum = (sum & 0xffff) + (sum >> 16);
+        }
+    }
+    if (len) {
+        uint16_t w = 0;
+        memcpy(&w, p, 1);
+        sum += w;
+    }
+    while (sum > 0xffff) {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    return (uint16_t)sum;
+}
+
+// A small deterministic generator, so that every run sees the same data.
+static uint32_t next_random(uint64_t* state) {
+    *state = *state * 6364136223846793005lu + 1442695040888963407lu;
+    return (uint32_t)(*state >> 33);
+}
+
+#define FUZZ_BUF_SIZE 8192
+#define FUZZ_ITERATIONS 20000
+
+static bool checksum_fuzz_test(void) {
+    BEGIN_TEST;
+    const inet_checksum_impl_t* impls;
+    size_t count = inet_checksum_impls(&impls);
+    ASSERT_GT(count, 0u, "no implementations");
+
+    static uint8_t buf[FUZZ_BUF_SIZE + 16];
+    uint64_t state = 1;
+    for (int i = 0; i < FUZZ_ITERATIONS; i++) {
+        // every alignment, every length up to a jumbo frame and beyond,
+        // and data which carries as much as it can, or not at all
+        size_t off = next_random(&state) % 16;
+        size_t len = next_random(&state) % ((i % 16) ? 256 : FUZZ_BUF_SIZE);
+        uint32_t fill = next_random(&state) % 4;
+        for (size_t n = 0; n < len; n++) {
+            buf[off + n] = (fill == 0) ? 0xff : (fill == 1) ? 0 : (uint8_t)next_random(&state);
+        }
+        uint16_t sum = (uint16_t)next_random(&state);
+        uint16_t expected = reference_checksum(buf + off, len, sum);
+
+        for (size_t n = 0; n < count; n++) {
+            uint16_t actual = impls[n].func(buf + off, len, sum);
+            if (actual != expected) {
+                unittest_printf("%s: len %zu off %zu sum %#x: %#x != %#x\n", impls[n].name,
+                                len, off, sum, actual, expected);
+            }
+            ASSERT_EQ(actual, expected, "checksum mismatch");
+        }
+        ASSERT_EQ(inet_checksum(buf + off, len, sum), expected, "checksum mismatch");
+    }
+    END_TEST;
+}
+
+// Past the point where the vector lanes are widened, with every word at
+// its largest.
+static bool checksum_large_test(void) {
+    BEGIN_TEST;
+    const inet_checksum_impl_t* impls;
+    size_t count = inet_checksum_impls(&impls);
+
+    size_t len = 8u << 20;
+    uint8_t* buf = malloc(len + 1);
+    ASSERT_NONNULL(buf, "");
+    memset(buf, 0xff, len + 1);
+    for (size_t n = 0; n < count; n++) {
+        EXPECT_EQ(impls[n].func(buf, len, 0), 0xffff, impls[n].name);
+        EXPECT_EQ(impls[n].func(buf + 1, len - 1, 0xffff),
+                  reference_checksum(buf + 1, len - 1, 0xffff), impls[n].name);
+    }
+    memset(buf, 0, len + 1);
+    buf[len - 1] = 1;
+    for (size_t n = 0; n < count; n++) {
+        EXPECT_EQ(impls[n].func(buf, len, 0), reference_checksum(buf, len, 0), impls[n].name);
+    }
+    free(buf);
+    END_TEST;
+}
+
+static bool checksum_benchmark(void) {
+    BEGIN_TEST;
+    const inet_checksum_impl_t* impls;
+    size_t count = inet_checksum_impls(&impls);
+
+    const size_t sizes[] = { 64, 1500, 65536, 4u << 20 };
+    const size_t total = 256u << 20;
+    uint8_t* buf = malloc(sizes[3]);
+    ASSERT_NONNULL(buf, "");
+    uint64_t state = 1;
+    for (size_t n = 0; n < sizes[3]; n++) {
+        buf[n] = (uint8_t)next_random(&state);
+    }
+
+    printf("\n");
+    uint64_t ticks_per_sec = mx_ticks_per_second();
+    for (size_t s = 0; s < countof(sizes); s++) {
+        size_t reps = total / sizes[s];
+        uint64_t start = mx_ticks_get();
+        volatile uint16_t sum = 0;
+        for (size_t r = 0; r < reps; r++) {
+            sum = reference_checksum(buf, sizes[s], sum);
+        }
+        uint64_t ticks = mx_ticks_get() - start;
+        printf("Benchmark %-9s %8zu bytes: %6.2f GB/s\n", "reference", sizes[s],
+               (double)total * ticks_per_sec / ticks / 1e9);
+        for (size_t n = 0; n < count; n++) {
+            start = mx_ticks_get();
+            for (size_t r = 0; r < reps; r++) {
+                sum = impls[n].func(buf, sizes[s], sum);
+            }
+            ticks = mx_ticks_get() - start;
+            printf("Benchmark %-9s %8zu bytes: %6.2f GB/s\n", impls[n].name, sizes[s],
+                   (double)total * ticks_per_sec / ticks / 1e9);
+        }
+    }
+    free(buf);
+    END_TEST;
+}
+
+BEGIN_TEST_CASE(inet_checksum_tests)
+RUN_TEST(checksum_fuzz_test)
+RUN_TEST(checksum_large_test)
+RUN_TEST_PERFORMANCE(checksum_benchmark)
+END_TEST_CASE(inet_checksum_tests)
+
+int main(int argc, char** argv) {
+    return unittest_run_all_tests(argc, argv) ? 0 : -1;
+}
@@ -3,9 +3,11 @@
 // found in the LICENSE file.
 
 #include <assert.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/epoll.h>
 #include <sys/ioctl.h>
@@ -128,10 +130,48 @@ bool pipe_test(void) {
     END_TEST;
 }
 
+bool pipe_size_test(void) {
+    BEGIN_TEST;
+
+    int fds[2];
+    ASSERT_EQ(pipe(fds), 0, "pipe() failed");
+
+    // Set from the read end, the buffer the writer fills is enlarged.
+    int size = fcntl(fds[0], F_SETPIPE_SZ, 512 * 1024);
+    ASSERT_GE(size, 512 * 1024, "fcntl(F_SETPIPE_SZ) failed");
+    EXPECT_EQ(fcntl(fds[1], F_GETPIPE_SZ), size, "ends disagree on the size");
+
+    // And the same from the write end.
+    size = fcntl(fds[1], F_SETPIPE_SZ, 1024 * 1024);
+    ASSERT_GE(size, 1024 * 1024, "fcntl(F_SETPIPE_SZ) failed");
+    EXPECT_EQ(fcntl(fds[0], F_GETPIPE_SZ), size, "ends disagree on the size");
+
+    // Nearly all of it can be written without blocking.
+    int flags = fcntl(fds[1], F_GETFL);
+    ASSERT_GE(flags, 0, "fcntl(F_GETFL) failed");
+    ASSERT_EQ(fcntl(fds[1], F_SETFL, flags | O_NONBLOCK), 0, "fcntl(F_SETFL) failed");
+    char* buffer = calloc(1, size);
+    ASSERT_NONNULL(buffer, "");
+    EXPECT_EQ(write(fds[1], buffer, size), size - 1, "write() fell short");
+
+    // Not resizable from either end while there is data in it.
+    EXPECT_EQ(fcntl(fds[1], F_SETPIPE_SZ, 64 * 1024), -1, "");
+    EXPECT_EQ(errno, EBUSY, "");
+    EXPECT_EQ(fcntl(fds[0], F_SETPIPE_SZ, 64 * 1024), -1, "");
+    EXPECT_EQ(errno, EBUSY, "");
+
+    free(buffer);
+    close(fds[0]);
+    close(fds[1]);
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(mxio_handle_fd_test)
 RUN_TEST(epoll_test);
 RUN_TEST(close_test);
 RUN_TEST(pipe_test);
+RUN_TEST(pipe_size_test);
 END_TEST_CASE(mxio_handle_fd_test)
 
 int main(int argc, char** argv) {
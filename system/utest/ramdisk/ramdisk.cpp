@@ -899,6 +899,219 @@ bool ramdisk_test_fifo_bad_client_bad_vmo(void) {
     END_TEST;
 }
 
+// Writes 'kWrites' different blocks to the same device block, ordered only
+// by 'flag', and checks that the last one sent is the one which sticks.
+bool fifo_ordered_overwrite_helper(const char* name, uint16_t flag) {
+    const size_t kBlockSize = PAGE_SIZE;
+    const size_t kWrites = 16;
+    int fd = get_ramdisk(name, kBlockSize, 64);
+
+    mx_handle_t fifo;
+    ssize_t expected = sizeof(fifo);
+    ASSERT_EQ(ioctl_block_get_fifos(fd, &fifo), expected, "Failed to get FIFO");
+    fifo_client_t* client;
+    ASSERT_EQ(block_fifo_create_client(fifo, &client), NO_ERROR, "");
+    txnid_t txnid;
+    expected = sizeof(txnid_t);
+    ASSERT_EQ(ioctl_block_alloc_txn(fd, &txnid), expected, "Failed to allocate txn");
+
+    // One block for each write, and one more to read back into
+    uint64_t vmo_size = kBlockSize * (kWrites + 1);
+    mx_handle_t vmo;
+    ASSERT_EQ(mx_vmo_create(vmo_size, 0, &vmo), NO_ERROR, "Failed to create VMO");
+    AllocChecker ac;
+    mxtl::unique_ptr<uint8_t[]> buf(new (&ac) uint8_t[vmo_size]);
+    ASSERT_TRUE(ac.check(), "");
+    fill_random(buf.get(), vmo_size);
+    size_t actual;
+    ASSERT_EQ(mx_vmo_write(vmo, buf.get(), 0, vmo_size, &actual), NO_ERROR, "");
+    vmoid_t vmoid;
+    expected = sizeof(vmoid_t);
+    mx_handle_t xfer_vmo;
+    ASSERT_EQ(mx_handle_duplicate(vmo, MX_RIGHT_SAME_RIGHTS, &xfer_vmo), NO_ERROR, "");
+    ASSERT_EQ(ioctl_block_attach_vmo(fd, &xfer_vmo, &vmoid), expected, "Failed to attach vmo");
+
+    block_fifo_request_t requests[kWrites + 1];
+    for (size_t i = 0; i < kWrites; i++) {
+        requests[i].txnid      = txnid;
+        requests[i].vmoid      = vmoid;
+        requests[i].opcode     = static_cast<uint16_t>(BLOCKIO_WRITE | flag);
+        requests[i].length     = static_cast<uint32_t>(kBlockSize);
+        requests[i].vmo_offset = i * kBlockSize;
+        requests[i].dev_offset = 0;
+    }
+    // The read is ordered behind every write, in the same txn
+    requests[kWrites].txnid      = txnid;
+    requests[kWrites].vmoid      = vmoid;
+    requests[kWrites].opcode     = BLOCKIO_READ | BLOCKIO_BARRIER_BEFORE;
+    requests[kWrites].length     = static_cast<uint32_t>(kBlockSize);
+    requests[kWrites].vmo_offset = kWrites * kBlockSize;
+    requests[kWrites].dev_offset = 0;
+    ASSERT_EQ(block_fifo_txn(client, &requests[0], countof(requests)), NO_ERROR, "");
+
+    mxtl::unique_ptr<uint8_t[]> out(new (&ac) uint8_t[kBlockSize]);
+    ASSERT_TRUE(ac.check(), "");
+    ASSERT_EQ(mx_vmo_read(vmo, out.get(), kWrites * kBlockSize, kBlockSize, &actual),
+              NO_ERROR, "");
+    ASSERT_EQ(memcmp(buf.get() + (kWrites - 1) * kBlockSize, out.get(), kBlockSize), 0,
+              "Later write was overtaken by an earlier one");
+
+    ASSERT_EQ(mx_handle_close(vmo), NO_ERROR, "");
+    block_fifo_release_client(client);
+    ASSERT_GE(ioctl_ramdisk_unlink(fd), 0, "Could not unlink ramdisk device");
+    ASSERT_EQ(close(fd), 0, "");
+    return true;
+}
+
+bool ramdisk_test_fifo_barrier_before(void) {
+    BEGIN_TEST;
+    ASSERT_TRUE(fifo_ordered_overwrite_helper("ramdisk-test-fifo-barrier-before",
+                                              BLOCKIO_BARRIER_BEFORE), "");
+    END_TEST;
+}
+
+bool ramdisk_test_fifo_barrier_after(void) {
+    BEGIN_TEST;
+    ASSERT_TRUE(fifo_ordered_overwrite_helper("ramdisk-test-fifo-barrier-after",
+                                              BLOCKIO_BARRIER_AFTER), "");
+    END_TEST;
+}
+
+bool ramdisk_test_fifo_sync(void) {
+    BEGIN_TEST;
+    const size_t kBlockSize = PAGE_SIZE;
+    int fd = get_ramdisk("ramdisk-test-fifo-sync", kBlockSize, 64);
+
+    mx_handle_t fifo;
+    ssize_t expected = sizeof(fifo);
+    ASSERT_EQ(ioctl_block_get_fifos(fd, &fifo), expected, "Failed to get FIFO");
+    fifo_client_t* client;
+    ASSERT_EQ(block_fifo_create_client(fifo, &client), NO_ERROR, "");
+    txnid_t txnid;
+    expected = sizeof(txnid_t);
+    ASSERT_EQ(ioctl_block_alloc_txn(fd, &txnid), expected, "Failed to allocate txn");
+    test_vmo_object_t obj;
+    ASSERT_TRUE(create_vmo_helper(fd, &obj, kBlockSize), "");
+
+    // A sync needs no vmo
+    block_fifo_request_t request;
+    request.txnid      = txnid;
+    request.vmoid      = static_cast<vmoid_t>(obj.vmoid + 5);
+    request.opcode     = BLOCKIO_SYNC;
+    request.length     = 0;
+    request.vmo_offset = 0;
+    request.dev_offset = 0;
+    ASSERT_EQ(block_fifo_txn(client, &request, 1), NO_ERROR, "");
+
+    // The journal pattern: write, sync, then FUA writes behind it
+    block_fifo_request_t requests[3];
+    requests[0].txnid      = txnid;
+    requests[0].vmoid      = obj.vmoid;
+    requests[0].opcode     = BLOCKIO_WRITE;
+    requests[0].length     = static_cast<uint32_t>(kBlockSize);
+    requests[0].vmo_offset = 0;
+    requests[0].dev_offset = 0;
+    requests[1].txnid      = txnid;
+    requests[1].vmoid      = obj.vmoid;
+    requests[1].opcode     = BLOCKIO_SYNC | BLOCKIO_BARRIER_AFTER;
+    requests[1].length     = 0;
+    requests[1].vmo_offset = 0;
+    requests[1].dev_offset = 0;
+    requests[2].txnid      = txnid;
+    requests[2].vmoid      = obj.vmoid;
+    requests[2].opcode     = BLOCKIO_WRITE | BLOCKIO_FUA;
+    requests[2].length     = static_cast<uint32_t>(obj.vmo_size);
+    requests[2].vmo_offset = 0;
+    requests[2].dev_offset = kBlockSize;
+    ASSERT_EQ(block_fifo_txn(client, &requests[0], countof(requests)), NO_ERROR, "");
+
+    // Clear the vmo, and read both writes back
+    AllocChecker ac;
+    mxtl::unique_ptr<uint8_t[]> out(new (&ac) uint8_t[obj.vmo_size]());
+    ASSERT_TRUE(ac.check(), "");
+    size_t actual;
+    ASSERT_EQ(mx_vmo_write(obj.vmo, out.get(), 0, obj.vmo_size, &actual), NO_ERROR, "");
+    requests[0].opcode = BLOCKIO_READ;
+    ASSERT_EQ(block_fifo_txn(client, &requests[0], 1), NO_ERROR, "");
+    ASSERT_EQ(mx_vmo_read(obj.vmo, out.get(), 0, kBlockSize, &actual), NO_ERROR, "");
+    ASSERT_EQ(memcmp(obj.buf.get(), out.get(), kBlockSize), 0, "Read data not equal to written data");
+    requests[2].opcode = BLOCKIO_READ;
+    ASSERT_EQ(block_fifo_txn(client, &requests[2], 1), NO_ERROR, "");
+    ASSERT_EQ(mx_vmo_read(obj.vmo, out.get(), 0, obj.vmo_size, &actual), NO_ERROR, "");
+    ASSERT_EQ(memcmp(obj.buf.get(), out.get(), obj.vmo_size), 0, "Read data not equal to written data");
+
+    ASSERT_TRUE(close_vmo_helper(client, &obj, txnid), "");
+    block_fifo_release_client(client);
+    ASSERT_GE(ioctl_ramdisk_unlink(fd), 0, "Could not unlink ramdisk device");
+    ASSERT_EQ(close(fd), 0, "");
+    END_TEST;
+}
+
+// Writes 'total' bytes sequentially, a block per request and MAX_TXN_MESSAGES
+// requests per txn. 'flags' is added to every request; if 'sync' is set, the
+// last request of each txn is a BLOCKIO_SYNC instead.
+bool fifo_write_bench_helper(const char* name, uint16_t flags, bool sync) {
+    const size_t kBlockSize = PAGE_SIZE;
+    const size_t kBlockCount = 4096;
+    int fd = get_ramdisk(name, kBlockSize, kBlockCount);
+
+    mx_handle_t fifo;
+    ssize_t expected = sizeof(fifo);
+    ASSERT_EQ(ioctl_block_get_fifos(fd, &fifo), expected, "Failed to get FIFO");
+    fifo_client_t* client;
+    ASSERT_EQ(block_fifo_create_client(fifo, &client), NO_ERROR, "");
+    txnid_t txnid;
+    expected = sizeof(txnid_t);
+    ASSERT_EQ(ioctl_block_alloc_txn(fd, &txnid), expected, "Failed to allocate txn");
+
+    uint64_t vmo_size = kBlockSize * MAX_TXN_MESSAGES;
+    mx_handle_t vmo;
+    ASSERT_EQ(mx_vmo_create(vmo_size, 0, &vmo), NO_ERROR, "Failed to create VMO");
+    vmoid_t vmoid;
+    expected = sizeof(vmoid_t);
+    mx_handle_t xfer_vmo;
+    ASSERT_EQ(mx_handle_duplicate(vmo, MX_RIGHT_SAME_RIGHTS, &xfer_vmo), NO_ERROR, "");
+    ASSERT_EQ(ioctl_block_attach_vmo(fd, &xfer_vmo, &vmoid), expected, "Failed to attach vmo");
+
+    block_fifo_request_t requests[MAX_TXN_MESSAGES];
+    uint64_t ticks_per_msec = mx_ticks_per_second() / 1000;
+    uint64_t start = mx_ticks_get();
+    for (size_t pass = 0; pass < 16; pass++) {
+        for (size_t blk = 0; blk < kBlockCount; blk += MAX_TXN_MESSAGES) {
+            for (size_t i = 0; i < MAX_TXN_MESSAGES; i++) {
+                requests[i].txnid      = txnid;
+                requests[i].vmoid      = vmoid;
+                requests[i].opcode     = static_cast<uint16_t>(BLOCKIO_WRITE | flags);
+                requests[i].length     = static_cast<uint32_t>(kBlockSize);
+                requests[i].vmo_offset = i * kBlockSize;
+                requests[i].dev_offset = (blk + i) * kBlockSize;
+            }
+            if (sync) {
+                requests[MAX_TXN_MESSAGES - 1].opcode = BLOCKIO_SYNC;
+            }
+            ASSERT_EQ(block_fifo_txn(client, &requests[0], countof(requests)), NO_ERROR, "");
+        }
+    }
+    uint64_t end = mx_ticks_get();
+    printf("Benchmark %-32s [%10lu] msec\n", name, (end - start) / ticks_per_msec);
+
+    ASSERT_EQ(mx_handle_close(vmo), NO_ERROR, "");
+    block_fifo_release_client(client);
+    ASSERT_GE(ioctl_ramdisk_unlink(fd), 0, "Could not unlink ramdisk device");
+    ASSERT_EQ(close(fd), 0, "");
+    return true;
+}
+
+bool ramdisk_bench_fifo_ordering(void) {
+    BEGIN_TEST;
+    printf("\n");
+    ASSERT_TRUE(fifo_write_bench_helper("ramdisk-bench-unordered", 0, false), "");
+    ASSERT_TRUE(fifo_write_bench_helper("ramdisk-bench-barrier", BLOCKIO_BARRIER_BEFORE, false), "");
+    ASSERT_TRUE(fifo_write_bench_helper("ramdisk-bench-sync", 0, true), "");
+    ASSERT_TRUE(fifo_write_bench_helper("ramdisk-bench-fua", BLOCKIO_FUA, false), "");
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(ramdisk_tests)
 RUN_TEST(ramdisk_test_simple)
 RUN_TEST(ramdisk_test_filesystem)
@@ -916,6 +1129,10 @@ RUN_TEST(ramdisk_test_fifo_bad_client_vmoid)
 RUN_TEST(ramdisk_test_fifo_bad_client_txnid)
 RUN_TEST(ramdisk_test_fifo_bad_client_unaligned_request)
 RUN_TEST(ramdisk_test_fifo_bad_client_bad_vmo)
+RUN_TEST(ramdisk_test_fifo_barrier_before)
+RUN_TEST(ramdisk_test_fifo_barrier_after)
+RUN_TEST(ramdisk_test_fifo_sync)
+RUN_TEST_PERFORMANCE(ramdisk_bench_fifo_ordering)
 END_TEST_CASE(ramdisk_tests)
 
 } // namespace tests
@@ -259,7 +259,7 @@
 /* #undef JEMALLOC_PROC_SYS_VM_OVERCOMMIT_MEMORY */
 
 /* Defined if madvise(2) is available. */
-/* #undef JEMALLOC_HAVE_MADVISE */
+#define JEMALLOC_HAVE_MADVISE 
 
 /*
  * Methods for purging unused pages differ between operating systems.
@@ -271,7 +271,7 @@
  *                                 address region is later touched.
  */
 /* #undef JEMALLOC_PURGE_MADVISE_FREE */
-/* #undef JEMALLOC_PURGE_MADVISE_DONTNEED */
+#define JEMALLOC_PURGE_MADVISE_DONTNEED 
 
 /*
  * Defined if transparent huge pages are supported via the MADV_[NO]HUGEPAGE
@@ -37,6 +37,12 @@ static void start_c11(void* arg) {
     pthread_exit((void*)(intptr_t)start(self->start_arg));
 }
 
+static void init_file_lock(FILE* f) {
+    // A FILE already held with flockfile keeps its owner.
+    if (atomic_load(&f->lock) < 0)
+        atomic_store(&f->lock, 0);
+}
+
 static void deallocate_region(const struct iovec* region) {
     _mx_vmar_unmap(_mx_vmar_root_self(),
                    (uintptr_t)region->iov_base, region->iov_len);
@@ -51,6 +57,18 @@ int pthread_create(pthread_t* restrict res, const pthread_attr_t* restrict attrp
 
     __acquire_ptc();
 
+    if (!libc.threaded) {
+        // stdio has not been locking anything so far.  Nor can any FILE be
+        // in use by another thread yet, so it is safe to start now.
+        for (FILE* f = *__ofl_lock(); f; f = f->next)
+            init_file_lock(f);
+        init_file_lock(stdin);
+        init_file_lock(stdout);
+        init_file_lock(stderr);
+        libc.threaded = 1;
+        __ofl_unlock();
+    }
+
     pthread_t new = __allocate_thread(&attr);
     if (new == NULL) {
         __release_ptc();
@@ -23,6 +23,9 @@ struct tls_module {
 
 struct __libc {
     atomic_int thread_count;
+    // Set once a second thread is created, and never cleared.  Until then,
+    // stdio does not lock its FILEs.
+    int threaded;
     struct tls_module* tls_head;
     size_t tls_size, tls_align, tls_cnt;
     size_t stack_size;
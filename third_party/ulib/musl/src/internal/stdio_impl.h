@@ -6,6 +6,11 @@
 
 #define UNGET 8
 
+/* Buffer size for FILEs which are not terminals.  Each flush is one
+ * write to the fd, so this is the size of the largest single RemoteIO
+ * message (MXIO_CHUNK_SIZE) rather than BUFSIZ. */
+#define BUFSIZ_NOTTY 8192
+
 #define FFINALLOCK(f) ((f)->lock >= 0 ? __lockfile((f)) : 0)
 #define FLOCK(f) int __need_unlock = ((f)->lock >= 0 ? __lockfile((f)) : 0)
 #define FUNLOCK(f)     \
@@ -1,9 +1,55 @@
 #include "libc.h"
+#include <errno.h>
+#include <magenta/process.h>
+#include <magenta/syscalls.h>
+#include <magenta/types.h>
 #include <sys/mman.h>
 
 int __madvise(void* addr, size_t len, int advice) {
-    // TODO(kulakowski) Implement more mmap
-    return 0;
+    uint32_t op;
+    switch (advice) {
+    case MADV_NORMAL:
+        op = MX_VMAR_OP_HINT_NORMAL;
+        break;
+    case MADV_RANDOM:
+        op = MX_VMAR_OP_HINT_RANDOM;
+        break;
+    case MADV_SEQUENTIAL:
+        op = MX_VMAR_OP_HINT_SEQUENTIAL;
+        break;
+    case MADV_WILLNEED:
+        op = MX_VMAR_OP_COMMIT;
+        break;
+    case MADV_DONTNEED:
+    case MADV_FREE:
+        op = MX_VMAR_OP_DECOMMIT;
+        break;
+    default:
+        // The rest are only advice, and there is nothing to act on.
+        return 0;
+    }
+
+    mx_status_t status = _mx_vmar_op_range(_mx_vmar_root_self(), op, (uintptr_t)addr, len);
+    if (status == NO_ERROR)
+        return 0;
+    // The pages of a shared mapping are not ours to discard.  As on
+    // Linux, dropping them is then just advice to ignore, but freeing
+    // them is refused (as EINVAL, below).
+    if (status == ERR_BAD_STATE && advice == MADV_DONTNEED)
+        return 0;
+
+    switch (status) {
+    case ERR_NOT_FOUND:
+        errno = ENOMEM;
+        break;
+    case ERR_NO_MEMORY:
+        errno = EAGAIN;
+        break;
+    default:
+        errno = EINVAL;
+        break;
+    }
+    return -1;
 }
 
 weak_alias(__madvise, madvise);
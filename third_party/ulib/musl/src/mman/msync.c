@@ -1,7 +1,30 @@
 #include <errno.h>
+#include <limits.h>
+#include <magenta/types.h>
+#include <stdint.h>
 #include <sys/mman.h>
 
+#include "libc.h"
+
+// Writes back the files behind any shared mappings in the range. Provided
+// by mxio, which keeps track of them.
+mx_status_t _msync_file(void* start, size_t len, int flags) __attribute__((weak));
+
 int msync(void* start, size_t len, int flags) {
-    errno = ENOSYS;
-    return -1;
+    if (((uintptr_t)start & (PAGE_SIZE - 1)) ||
+        (flags & ~(MS_ASYNC | MS_INVALIDATE | MS_SYNC)) ||
+        ((flags & MS_ASYNC) && (flags & MS_SYNC))) {
+        errno = EINVAL;
+        return -1;
+    }
+    // anonymous memory has nothing behind it to write back
+    if (_msync_file == NULL) {
+        return 0;
+    }
+    mx_status_t status = _msync_file(start, len, flags);
+    if (status < 0) {
+        errno = EIO;
+        return -1;
+    }
+    return 0;
 }
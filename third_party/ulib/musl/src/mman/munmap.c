@@ -4,6 +4,10 @@
 #include <magenta/syscalls.h>
 #include <sys/mman.h>
 
+// Forgets any shared file mappings in the range. Provided by mxio, which
+// keeps track of them for msync.
+void _munmap_file(void* start, size_t len) __attribute__((weak));
+
 int __munmap(void* start, size_t len) {
     uintptr_t ptr = (uintptr_t)start;
     mx_status_t status = _mx_vmar_unmap(_mx_vmar_root_self(), ptr, len);
@@ -11,6 +15,9 @@ int __munmap(void* start, size_t len) {
         errno = EINVAL;
         return -1;
     }
+    if (_munmap_file != NULL) {
+        _munmap_file(start, len);
+    }
     return 0;
 }
 
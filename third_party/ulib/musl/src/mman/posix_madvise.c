@@ -2,9 +2,15 @@
 #include <errno.h>
 #include <sys/mman.h>
 
+int __madvise(void*, size_t, int);
+
 int posix_madvise(void* addr, size_t len, int advice) {
-    if (advice == MADV_DONTNEED)
+    // POSIX_MADV_DONTNEED may not discard the contents, as MADV_DONTNEED
+    // does, so there is nothing for it to do.
+    if (advice == POSIX_MADV_DONTNEED)
         return 0;
-    errno = ENOSYS;
-    return -1;
+    int old_errno = errno;
+    int ret = __madvise(addr, len, advice) ? errno : 0;
+    errno = old_errno;
+    return ret;
 }
@@ -8,6 +8,8 @@
 
 FILE* __fdopen(int fd, const char* mode) {
     FILE* f;
+    size_t buf_size;
+    int tty;
 
     /* Check for valid initial mode character */
     if (!strchr("rwa", *mode)) {
@@ -15,8 +17,13 @@ FILE* __fdopen(int fd, const char* mode) {
         return 0;
     }
 
+    /* Terminals keep a small buffer; anything else gets a large one,
+     * since each flush or refill is a round trip to the server */
+    tty = isatty(fd);
+    buf_size = tty ? BUFSIZ : BUFSIZ_NOTTY;
+
     /* Allocate FILE+buffer or fail */
-    if (!(f = malloc(sizeof *f + UNGET + BUFSIZ)))
+    if (!(f = malloc(sizeof *f + UNGET + buf_size)))
         return 0;
 
     /* Zero-fill only the struct, not the buffer */
@@ -40,11 +47,11 @@ FILE* __fdopen(int fd, const char* mode) {
 
     f->fd = fd;
     f->buf = (unsigned char*)f + sizeof *f + UNGET;
-    f->buf_size = BUFSIZ;
+    f->buf_size = buf_size;
 
     /* Activate line buffered mode for terminals */
     f->lbf = EOF;
-    if (!(f->flags & F_NOWR) && isatty(fd))
+    if (!(f->flags & F_NOWR) && tty)
         f->lbf = '\n';
 
     /* Initialize op ptrs. No problem if some are unneeded. */
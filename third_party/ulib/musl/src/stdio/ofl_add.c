@@ -2,6 +2,11 @@
 
 FILE* __ofl_add(FILE* f) {
     FILE** head = __ofl_lock();
+    /* While there is only one thread, FILEs need no locking.  This is
+     * decided under the ofl lock so that pthread_create cannot miss the
+     * FILE when it turns locking on. */
+    if (!libc.threaded)
+        f->lock = -1;
     f->next = *head;
     if (*head)
         (*head)->prev = f;